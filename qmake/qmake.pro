@@ -31,6 +31,7 @@ dll = $$[ACFUTILS_DLL]
 noerrors = $$[NOERRORS]
 minimal=$$system("test -f ../.minimal-deps; echo $?")
 noxplm=$$[ACFUTILS_NOXPLM]
+poppler=$$[ACFUTILS_POPPLER]
 
 INCLUDEPATH += ../src ../SDK/CHeaders/XPLM
 INCLUDEPATH += ../SDK/CHeaders/Widgets
@@ -207,6 +208,7 @@ HEADERS += \
     ../src/acfutils/list.h \
     ../src/acfutils/list_impl.h \
     ../src/acfutils/log.h \
+    ../src/acfutils/lru.h \
     ../src/acfutils/math_core.h \
     ../src/acfutils/math.h \
     ../src/acfutils/mslibs.h \
@@ -235,6 +237,7 @@ SOURCES += \
     ../src/base64.c \
     ../src/cmd.c \
     ../src/compress_7z.c \
+    ../src/compress_stream.c \
     ../src/compress_zip.c \
     ../src/compress_zlib.c \
     ../src/conf.c \
@@ -252,6 +255,7 @@ SOURCES += \
     ../src/intl.c \
     ../src/list.c \
     ../src/log.c \
+    ../src/lru.c \
     ../src/math.c \
     ../src/osrand.c \
     ../src/perf.c \
@@ -300,6 +304,14 @@ exists("../cairo/cairo-$$PLAT_LONG/lib/libcairo.a") : exists("$$GLEWMX_LIB") {
 	    ../src/widget.c
 }
 
+# In-process PDF rendering for chartdb. Needs poppler-glib from the
+# system, so it's off by default.
+contains(minimal, 1) : contains(poppler, 1) {
+	DEFINES += LACF_WITH_POPPLER
+	QMAKE_CFLAGS += $$system("pkg-config --cflags poppler-glib")
+	SOURCES += ../src/chartdb_poppler.c
+}
+
 exists("../lzma/qmake/$$PLAT_LONG/liblzma.a") {
 	HEADERS += ../src/acfutils/dsf.h
 	SOURCES += ../src/dsf.c
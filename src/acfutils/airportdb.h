@@ -151,6 +151,17 @@ typedef struct {
 	char		*cachedir;
 	int		xp_airac_cycle;
 	double		load_limit;
+	/*
+	 * Number of threads used by adb_recreate_cache. 0 means one
+	 * per CPU, 1 forces a single-threaded rebuild. See
+	 * adb_set_rebuild_threads.
+	 */
+	unsigned	rebuild_threads;
+	/*
+	 * Also keep a memory-mappable binary copy of every cache tile,
+	 * which loads much faster than the text tiles. Enabled by default.
+	 */
+	bool_t		binary_cache;
 
 	mutex_t		lock;
 
@@ -159,6 +170,22 @@ typedef struct {
 	avl_tree_t	arpt_index;
 	htbl2_t		icao_index;
 	htbl2_t		iata_index;
+	/*
+	 * Spatial index over arpt_index, used by adb_airport_index_nearest
+	 * and adb_airport_index_radius. Rebuilt by adb_recreate_cache.
+	 */
+	struct arpt_kdtree *arpt_kdtree;
+	/*
+	 * Background tile loader, see adb_set_async_load. NULL if tiles
+	 * are loaded synchronously.
+	 */
+	struct adb_loader *loader;
+	/*
+	 * Approximate memory limit for loaded tiles in bytes, applied by
+	 * adb_unload_distant_airport_tiles. 0 means tiles are unloaded
+	 * purely by distance.
+	 */
+	size_t		tile_mem_budget;
 } airportdb_t;
 
 typedef struct airport airport_t;
@@ -238,6 +265,18 @@ struct runway {
 	avl_node_t	node;
 };
 
+/**
+ * Runway areas which can be tested against by adb_airport_rwys_at().
+ */
+typedef enum {
+	ADB_RWY_AREA_RWY,	/**< Matches runway::rwy_bbox. */
+	ADB_RWY_AREA_TORA,	/**< Matches runway::tora_bbox. */
+	ADB_RWY_AREA_ASDA,	/**< Matches runway::asda_bbox. */
+	ADB_RWY_AREA_PROX,	/**< Matches runway::prox_bbox. */
+	ADB_RWY_AREA_APCH,	/**< Matches runway_end::apch_bbox. */
+	ADB_NUM_RWY_AREAS
+} adb_rwy_area_t;
+
 typedef enum {
 	FREQ_TYPE_REC,	/**< Pre-recorded message ATIS, AWOS or ASOS */
 	FREQ_TYPE_CTAF,	/**< Common Traffic Advisory Frequency */
@@ -298,6 +337,12 @@ struct airport {
 	fpp_t		fpp;		/**< Orthographic fpp_t centered on refpt. */
 	bool_t		in_navdb;	/**< Used by recreate_apt_dat_cache. */
 	bool_t		have_iaps;	/**< Used by recreate_apt_dat_cache. */
+	/** Internal: allocation arena of the airport's records, or NULL. */
+	struct adb_arena	*arena;
+	/** Internal: runway geometry built by load_airport, or NULL. */
+	struct adb_rwy_geom	*rwy_geom;
+	/** Internal: geo tile the airport is linked into, or NULL. */
+	struct adb_tile		*tile;
 
 	avl_node_t	apt_dat_node;	/**< Used by apt_dat tree. */
 	list_node_t	cur_arpts_node;	/**< Used by cur_arpts list. */
@@ -346,9 +391,15 @@ API_EXPORT void airportdb_unlock(airportdb_t *db);
 #define recreate_cache(__db)	adb_recreate_cache((__db), 0)
 API_EXPORT bool_t adb_recreate_cache(airportdb_t *db, int app_version);
 
+API_EXPORT void adb_set_rebuild_threads(airportdb_t *db, unsigned n);
+API_EXPORT void adb_set_async_load(airportdb_t *db, bool_t flag);
+API_EXPORT void adb_set_tile_mem_budget(airportdb_t *db, size_t bytes);
+
 #define	find_nearest_airports		adb_find_nearest_airports
 API_EXPORT list_t *adb_find_nearest_airports(airportdb_t *db,
     geo_pos2_t my_pos);
+API_EXPORT list_t *adb_find_nearest_airports2(airportdb_t *db,
+    geo_pos2_t my_pos, unsigned *n_pending);
 
 #define	free_nearest_airport_list	adb_free_nearest_airport_list
 API_EXPORT void adb_free_nearest_airport_list(list_t *l);
@@ -359,6 +410,10 @@ API_EXPORT void adb_set_airport_load_limit(airportdb_t *db, double limit);
 #define	load_nearest_airport_tiles	adb_load_nearest_airport_tiles
 API_EXPORT void adb_load_nearest_airport_tiles(airportdb_t *db,
     geo_pos2_t my_pos);
+API_EXPORT void adb_load_nearest_airport_tiles2(airportdb_t *db,
+    geo_pos2_t my_pos, double trk, double lookahead);
+API_EXPORT size_t adb_pending_airport_tiles(airportdb_t *db,
+    geo_pos2_t *tiles, size_t max_tiles);
 
 /*
  * Query functions to look for airports
@@ -390,6 +445,17 @@ API_EXPORT size_t adb_airport_lookup_by_iata(airportdb_t *db, const char *iata,
 #define	airport_index_walk	adb_airport_index_walk
 API_EXPORT size_t adb_airport_index_walk(const airportdb_t *db,
     void (*found_cb)(const arpt_index_t *idx, void *userinfo), void *userinfo);
+
+#define	airport_index_nearest	adb_airport_index_nearest
+API_EXPORT size_t adb_airport_index_nearest(const airportdb_t *db,
+    geo_pos2_t pos, double max_dist, const arpt_index_t **results,
+    double *dists, size_t max_results);
+
+#define	airport_index_radius	adb_airport_index_radius
+API_EXPORT size_t adb_airport_index_radius(const airportdb_t *db,
+    geo_pos2_t pos, double radius,
+    void (*found_cb)(const arpt_index_t *idx, void *userinfo), void *userinfo);
+
 /*
  * Querying information about a particular airport.
  */
@@ -397,6 +463,10 @@ API_EXPORT size_t adb_airport_index_walk(const airportdb_t *db,
 API_EXPORT bool_t adb_airport_find_runway(airport_t *arpt, const char *rwy_id,
     runway_t **rwy_p, unsigned *end_p);
 
+#define	airport_rwys_at	adb_airport_rwys_at
+API_EXPORT size_t adb_airport_rwys_at(const airport_t *arpt, vect2_t pos_v,
+    adb_rwy_area_t area, runway_t **rwys, unsigned *ends, size_t max_results);
+
 #define	matching_airport_in_tile_with_TATL \
 	adb_matching_airport_in_tile_with_TATL
 API_EXPORT airport_t *adb_matching_airport_in_tile_with_TATL(airportdb_t *db,
@@ -185,6 +185,11 @@ typedef struct {
  *	PDF charts. PDF charts are supplied by the Aeronav and Autorouter
  *	chart providers. If you specify `NULL` here, PDF chart support will
  *	not be available.
+ *
+ *	If libacfutils was built with poppler-glib (`build-win-lin -P`),
+ *	PDF charts are instead rendered in-process, without either utility.
+ *	They're then only used as a fallback for documents which fail to
+ *	render in-process, so both paths may be `NULL`.
  * @param airac The AIRAC cycle for which to initialize the provider. This
  *	information is used by the Aeronav provider, as charts are tied to
  *	a specific AIRAC cycle. Navigraph and Autorouter do not use this.
@@ -239,6 +244,16 @@ API_EXPORT bool_t chartdb_test_connection2(const char *provider_name,
  * @param bytes The new maximum sizeof the disk cache in bytes.
  */
 API_EXPORT void chartdb_set_load_limit(chartdb_t *cdb, uint64_t bytes);
+/**
+ * Sets the maximum number of threads used for rendering PDF charts, as
+ * well as for decoding PNG charts. Downloads from the chart provider are
+ * always done by a single thread, separately from METAR and TAF
+ * downloads, so a slow download never holds up either of them. By
+ * default, up to 2 threads are used for each of rendering and decoding.
+ * @param n The new maximum number of threads. Pass 0 to use one thread
+ *	per CPU.
+ */
+API_EXPORT void chartdb_set_loader_threads(chartdb_t *cdb, unsigned n);
 /**
  * Instructs the chart database to immediately purge its disk cache.
  * You should generally not need to ever do this, as cache management
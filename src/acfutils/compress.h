@@ -23,6 +23,10 @@
 #ifndef	_ACF_UTILS_COMPRESS_H_
 #define	_ACF_UTILS_COMPRESS_H_
 
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "taskq.h"
 #include "types.h"
 
 #ifdef	__cplusplus
@@ -33,11 +37,75 @@ API_EXPORT bool_t zlib_test(const void *in_buf, size_t len);
 API_EXPORT void *zlib_compress(void *in_buf, size_t len, size_t *out_len);
 API_EXPORT void *zlib_decompress(void *in_buf, size_t len, size_t *out_len_p);
 
+API_EXPORT void *zlib_compress_chunked(const void *in_buf, size_t len,
+    int level, size_t chunk_sz, bool_t gzip, taskq_t *tq, size_t *out_len);
+API_EXPORT ssize_t zlib_chunked_size(const void *in_buf, size_t len);
+API_EXPORT ssize_t zlib_chunked_read(const void *in_buf, size_t len,
+    size_t off, void *out, size_t cap);
+API_EXPORT void *zlib_decompress_chunked(const void *in_buf, size_t len,
+    taskq_t *tq, size_t *out_len);
+
 API_EXPORT bool_t test_7z(const void *in_buf, size_t len);
 API_EXPORT void *decompress_7z(const char *filename, size_t *out_len);
 
+typedef struct decompress_7z_stream_s decompress_7z_stream_t;
+API_EXPORT decompress_7z_stream_t *decompress_7z_stream_open(
+    const char *filename, size_t *out_len);
+API_EXPORT ssize_t decompress_7z_stream_fill(decompress_7z_stream_t *st,
+    void *out_buf, size_t upto);
+API_EXPORT ssize_t decompress_7z_stream_read(decompress_7z_stream_t *st,
+    void *buf, size_t cap);
+API_EXPORT void decompress_7z_stream_close(decompress_7z_stream_t *st);
+
 API_EXPORT void *decompress_zip(void *in_buf, size_t len, size_t *out_len);
 
+/**
+ * Formats understood by the decompress_stream_*() functions.
+ */
+typedef enum {
+	/** Detect the format from the first few bytes of the data */
+	DECOMPRESS_FMT_AUTO,
+	/** Uncompressed data, passed through as-is */
+	DECOMPRESS_FMT_NONE,
+	/** zlib-compressed data, see zlib_compress() */
+	DECOMPRESS_FMT_ZLIB,
+	/** A gzip (.gz) file */
+	DECOMPRESS_FMT_GZIP,
+	/** The first file in a 7-zip archive */
+	DECOMPRESS_FMT_7Z,
+	/** The first file in a zip archive */
+	DECOMPRESS_FMT_ZIP
+} decompress_fmt_t;
+
+typedef struct decompress_stream_s decompress_stream_t;
+/**
+ * Callback receiving decompressed data from a push stream.
+ * @see decompress_stream_push_init()
+ */
+typedef bool_t (*decompress_stream_cb_t)(const void *buf, size_t len,
+    void *userinfo);
+
+API_EXPORT decompress_stream_t *decompress_stream_open(const char *filename,
+    decompress_fmt_t fmt);
+API_EXPORT decompress_stream_t *decompress_stream_open_mem(const void *buf,
+    size_t len, decompress_fmt_t fmt);
+API_EXPORT ssize_t decompress_stream_read(decompress_stream_t *st,
+    void *buf, size_t cap);
+API_EXPORT ssize_t decompress_stream_getline(decompress_stream_t *st,
+    char **linep, size_t *linecap);
+API_EXPORT uint64_t decompress_stream_size(const decompress_stream_t *st);
+API_EXPORT decompress_fmt_t decompress_stream_fmt(
+    const decompress_stream_t *st);
+API_EXPORT bool_t decompress_stream_error(const decompress_stream_t *st);
+
+API_EXPORT decompress_stream_t *decompress_stream_push_init(
+    decompress_fmt_t fmt, decompress_stream_cb_t cb, void *userinfo);
+API_EXPORT bool_t decompress_stream_push(decompress_stream_t *st,
+    const void *buf, size_t len);
+API_EXPORT bool_t decompress_stream_push_end(decompress_stream_t *st);
+
+API_EXPORT void decompress_stream_close(decompress_stream_t *st);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -58,6 +58,8 @@ extern "C" {
 #endif
 
 typedef struct conf conf_t;
+/* From compress.h, which conf.h doesn't need to pull in. */
+struct decompress_stream_s;
 
 API_EXPORT conf_t *conf_create_empty(void);
 API_EXPORT conf_t *conf_create_copy(const conf_t *conf2);
@@ -67,6 +69,8 @@ API_EXPORT conf_t *conf_read_file(const char *filename, int *errline);
 API_EXPORT conf_t *conf_read(FILE *fp, int *errline);
 API_EXPORT conf_t *conf_read2(void *fp, int *errline, bool_t compressed);
 API_EXPORT conf_t *conf_read_buf(const void *buf, size_t cap, int *errline);
+API_EXPORT conf_t *conf_read_stream(struct decompress_stream_s *st,
+    int *errline);
 
 API_EXPORT bool_t conf_write_file(const conf_t *conf, const char *filename);
 API_EXPORT bool_t conf_write_file2(const conf_t *conf, const char *filename,
@@ -53,6 +53,8 @@ crc64_state_init(uint64_t *crc)
 API_EXPORT void crc64_state_init_impl(uint64_t *crc);
 API_EXPORT uint64_t crc64_append(uint64_t crc, const void *input, size_t sz);
 API_EXPORT uint64_t crc64(const void *input, size_t sz);
+API_EXPORT uint64_t crc64_combine(uint64_t crc1, uint64_t crc2,
+    uint64_t len2);
 
 API_EXPORT void crc64_srand(uint64_t seed);
 API_EXPORT uint64_t crc64_rand(void);
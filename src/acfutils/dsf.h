@@ -37,6 +37,7 @@
 
 #include "avl.h"
 #include "list.h"
+#include "taskq.h"
 
 #ifdef	__cplusplus
 extern "C" {
@@ -91,6 +92,41 @@ typedef enum {
 	DSF_ENC_RLE = 1 << 1
 } dsf_data_plane_enc_t;
 
+/*
+ * Flags for dsf_init2() and dsf_parse2().
+ */
+typedef enum {
+	/*
+	 * Decode the planes of POOL and PO32 atoms straight into a single
+	 * point-major array in dsf_planar_atom_t.interleaved, instead of
+	 * one array per plane in dsf_planar_atom_t.data. This is much
+	 * cheaper than transposing the per-plane arrays afterwards.
+	 * However, DIFF-encoded planes are always decoded with scalar code
+	 * in this mode, so parsing itself gains nothing from the SIMD
+	 * decoders and is slower than the default per-plane parse.
+	 */
+	DSF_PARSE_INTERLEAVE =	1 << 0,
+	/*
+	 * Don't use the SIMD plane decoders, only the portable scalar ones.
+	 * The decoded output is identical either way, so this is only
+	 * useful for testing and benchmarking.
+	 */
+	DSF_PARSE_SCALAR =	1 << 1,
+	/*
+	 * Parse the DSF on demand. dsf_init2() memory-maps raw DSF files
+	 * rather than reading them in, and 7z-compressed files are only
+	 * decompressed as far as the last top-level atom looked up so far.
+	 * POOL and PO32 atoms are only decoded the first time they are
+	 * returned from dsf_lookup() or dsf_iter(). If decoding fails, the
+	 * error is logged and the atom is treated as if it didn't exist.
+	 * The `md5sum' field of the dsf_t is only filled in once the whole
+	 * file is available. A lazy DSF may be queried from multiple
+	 * threads at once, but its atom lists must only be accessed using
+	 * dsf_lookup() and dsf_iter().
+	 */
+	DSF_PARSE_LAZY =	1 << 2
+} dsf_parse_flags_t;
+
 typedef struct {
 	const char		*name;
 	const char		*value;
@@ -134,6 +170,23 @@ typedef struct {
 		float		**data_fp32;
 		double		**data_fp64;
 	};
+	/*
+	 * Only populated if the DSF was parsed with DSF_PARSE_INTERLEAVE,
+	 * in which case `data' is NULL instead. Holds `data_count' points
+	 * of `plane_count' values each, so plane `p' of point `i' lives at
+	 * index `i * plane_count + p'.
+	 */
+	union {
+		void		*interleaved;
+		int16_t		*interleaved_sint16;
+		uint16_t	*interleaved_uint16;
+		int32_t		*interleaved_sint32;
+		uint32_t	*interleaved_uint32;
+		int64_t		*interleaved_sint64;
+		uint64_t	*interleaved_uint64;
+		float		*interleaved_fp32;
+		double		*interleaved_fp64;
+	};
 } dsf_planar_atom_t;
 
 typedef struct {
@@ -151,6 +204,10 @@ typedef struct {
 	};
 
 	list_node_t		atom_list;
+
+	/* Internal state of DSF_PARSE_LAZY, don't touch */
+	struct dsf_lazy_s	*lazy;
+	unsigned		lazy_state;
 } dsf_atom_t;
 
 typedef struct {
@@ -159,6 +216,12 @@ typedef struct {
 	uint8_t			*data;
 	uint64_t		size;
 	uint8_t			md5sum[16];
+
+	/* Internal state of DSF_PARSE_LAZY, don't touch */
+	struct dsf_lazy_s	*lazy;
+	/* Internal state of the DSF cache, don't touch */
+	void			*cache_map;
+	size_t			cache_map_sz;
 } dsf_t;
 
 typedef struct {
@@ -262,10 +325,25 @@ typedef struct {
 typedef void (*dsf_cmd_cb_t)(dsf_cmd_t cmd, const void *cmd_args,
     const dsf_cmd_parser_t *parser);
 
+/*
+ * The CMDS atom of a DSF, split into segments which can be parsed
+ * independently of each other. See dsf_split_cmds().
+ */
+typedef struct dsf_cmd_segs_s dsf_cmd_segs_t;
+
 API_EXPORT dsf_t *dsf_init(const char *filename);
+API_EXPORT dsf_t *dsf_init2(const char *filename, unsigned flags);
+API_EXPORT dsf_t *dsf_init3(const char *filename, unsigned flags,
+    taskq_t *tq);
 API_EXPORT dsf_t *dsf_parse(uint8_t *buf, size_t bufsz,
     char reason[DSF_REASON_SZ]);
+API_EXPORT dsf_t *dsf_parse2(uint8_t *buf, size_t bufsz, unsigned flags,
+    char reason[DSF_REASON_SZ]);
+API_EXPORT dsf_t *dsf_parse3(uint8_t *buf, size_t bufsz, unsigned flags,
+    taskq_t *tq, char reason[DSF_REASON_SZ]);
 API_EXPORT void dsf_fini(dsf_t *dsf);
+API_EXPORT bool_t dsf_cache_init(const char *cachedir, uint64_t budget);
+API_EXPORT void dsf_cache_fini(void);
 API_EXPORT char *dsf_dump(const dsf_t *dsf);
 
 API_EXPORT const dsf_atom_t *dsf_lookup(const dsf_t *dsf, ...);
@@ -277,6 +355,17 @@ API_EXPORT bool_t dsf_parse_cmds(const dsf_t *dsf,
     dsf_cmd_cb_t user_cbs[NUM_DSF_CMDS],
     void *userinfo, char reason[DSF_REASON_SZ]);
 
+API_EXPORT dsf_cmd_segs_t *dsf_split_cmds(const dsf_t *dsf,
+    size_t max_segs, char reason[DSF_REASON_SZ]);
+API_EXPORT size_t dsf_cmd_segs_num(const dsf_cmd_segs_t *segs);
+API_EXPORT void dsf_cmd_segs_free(dsf_cmd_segs_t *segs);
+API_EXPORT bool_t dsf_parse_cmds_seg(const dsf_cmd_segs_t *segs,
+    size_t seg, dsf_cmd_cb_t user_cbs[NUM_DSF_CMDS], void *userinfo,
+    char reason[DSF_REASON_SZ]);
+API_EXPORT bool_t dsf_parse_cmds_parallel(const dsf_cmd_segs_t *segs,
+    taskq_t *tq, dsf_cmd_cb_t user_cbs[NUM_DSF_CMDS], void **userinfo,
+    char reason[DSF_REASON_SZ]);
+
 API_EXPORT const char *dsf_cmd2str(dsf_cmd_t cmd);
 
 #ifdef	__cplusplus
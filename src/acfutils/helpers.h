@@ -470,6 +470,8 @@ API_EXPORT char *file2str_ext(long *len_p, const char *comp, ...) SENTINEL_ATTR;
 API_EXPORT char *file2str_name(long *len_p, const char *filename);
 API_EXPORT void *file2buf(const char *filename, size_t *bufsz);
 API_EXPORT ssize_t filesz(const char *filename);
+API_EXPORT void *file2mmap(const char *filename, size_t *bufsz);
+API_EXPORT void file_unmap(void *buf, size_t bufsz);
 
 /*
  * strlcpy is a BSD function not available on Windows, so we roll a simple
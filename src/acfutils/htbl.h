@@ -25,9 +25,10 @@
 /**
  * \file
  * This module implements a simple general-purpose hash table.
- * @note The hash table functionality is dependent on the CRC64 subsystem,
- *	so be sure to call crc64_init() before initializing the first hash
- *	table.
+ * @note By default, the hash table functionality is dependent on the
+ *	CRC64 subsystem, so be sure to call crc64_init() before initializing
+ *	the first hash table. Tables created with \ref HTBL_HASH_FAST
+ *	(see htbl_create_opts()) don't have this requirement.
  * @see htbl_t
  */
 
@@ -46,6 +47,102 @@
 extern "C" {
 #endif
 
+/**
+ * Storage layout selector for htbl_create_opts() and htbl2_create_opts().
+ */
+typedef enum {
+	/**
+	 * The classic layout used by htbl_create(). Each entry is a
+	 * separately allocated item, chained into a per-bucket list. The
+	 * bucket array never grows, so the table must be sized up front.
+	 */
+	HTBL_LAYOUT_CHAINED,
+	/**
+	 * Open-addressing layout. Keys and values are stored inline in
+	 * a single contiguous slot array, which is probed in groups of
+	 * control bytes using SSE2 or NEON (with a portable fallback).
+	 * The table grows automatically and migrates entries to the new
+	 * slot array incrementally, a few slots per modifying operation,
+	 * so no single insert ever pays for a full rehash. The `tbl_sz`
+	 * passed at creation time is only the initial capacity.
+	 * Multi-value tables don't support this layout and transparently
+	 * fall back to \ref HTBL_LAYOUT_CHAINED.
+	 * @note Entries may be removed from within an htbl_foreach()
+	 *	callback, but new keys must not be added if doing so would
+	 *	require the table to grow (this trips an assertion).
+	 */
+	HTBL_LAYOUT_OPEN_ADDR,
+	/**
+	 * Concurrent read-mostly layout. htbl_lookup() may be called from
+	 * any number of threads at the same time without any locking on
+	 * the caller's side and never blocks. Modifying calls
+	 * (htbl_set(), htbl_remove(), htbl_empty()) as well as
+	 * htbl_foreach() are serialized internally using a mutex, and
+	 * storage of removed entries is reclaimed only after all lookups
+	 * which might still be examining them have finished. The table
+	 * grows automatically, so `tbl_sz` is only the initial size.
+	 * Multi-value tables are not supported in this layout.
+	 * @note The hash table itself doesn't manage the lifetime of your
+	 *	values. If you free a value after removing it from the table,
+	 *	make sure that no other thread can still be using a pointer
+	 *	it obtained from an earlier htbl_lookup().
+	 * @note htbl_set() and htbl_remove() may be called from within an
+	 *	htbl_foreach() callback on the same thread.
+	 * @note htbl_create_opts() and htbl_destroy() are not thread-safe.
+	 */
+	HTBL_LAYOUT_CONCURRENT
+} htbl_layout_t;
+
+/**
+ * Hash function selector for htbl_create_opts() and htbl2_create_opts().
+ */
+typedef enum {
+	/**
+	 * Table-driven CRC64 (see crc64()). This is what htbl_create()
+	 * uses and requires crc64_init() to have been called first.
+	 */
+	HTBL_HASH_CRC64,
+	/**
+	 * A fast multiply-mix 64-bit hash in the style of wyhash, with
+	 * dedicated code paths for 4-, 8- and 16-byte keys. See
+	 * htbl_hash_fast(). Needs no global initialization.
+	 */
+	HTBL_HASH_FAST,
+	/**
+	 * A user-supplied hash function, set in the `hash_func` and
+	 * `hash_userinfo` fields of \ref htbl_opts_t.
+	 */
+	HTBL_HASH_CUSTOM
+} htbl_hash_t;
+
+/**
+ * User-supplied hash function for \ref HTBL_HASH_CUSTOM. Must return the
+ * same value for keys whose `key_sz` bytes are identical. The low 7 bits
+ * and the bits above them should both be well distributed, as the
+ * open-addressing layout uses them separately.
+ */
+typedef uint64_t (*htbl_hash_func_t)(const void *key, size_t key_sz,
+    void *userinfo);
+
+/**
+ * Extended hash table creation options. Pass to htbl_create_opts() or
+ * htbl2_create_opts(). Zero-initializing this structure gives you the
+ * same behavior as htbl_create().
+ */
+typedef struct {
+	htbl_layout_t		layout;
+	htbl_hash_t		hash;
+	/** Only used with \ref HTBL_HASH_CUSTOM */
+	htbl_hash_func_t	hash_func;
+	/** Passed to `hash_func` in the last argument */
+	void			*hash_userinfo;
+} htbl_opts_t;
+
+/* Opaque open-addressing table state, see HTBL_LAYOUT_OPEN_ADDR */
+typedef struct htbl_oa_s htbl_oa_t;
+/* Opaque concurrent table state, see HTBL_LAYOUT_CONCURRENT */
+typedef struct htbl_conc_s htbl_conc_t;
+
 /**
  * Hash table structure. This is the object you want to allocate and
  * subsequently initialize using htbl_create(). Use htbl_destroy() to
@@ -65,6 +162,11 @@ typedef struct {
 	list_t		*buckets;
 	size_t		num_values;
 	bool_t		multi_value;
+	htbl_oa_t	*oa;
+	htbl_conc_t	*conc;
+	htbl_hash_t	hash;
+	htbl_hash_func_t hash_func;
+	void		*hash_userinfo;
 } htbl_t;
 
 typedef struct {
@@ -87,6 +189,12 @@ API_EXPORT void htbl2_create(htbl2_t REQ_PTR(htbl), size_t tbl_sz,
     size_t key_sz, size_t value_sz, bool multi_value);
 void htbl2_destroy(htbl2_t REQ_PTR(htbl));
 
+API_EXPORT void htbl_create_opts(htbl_t REQ_PTR(htbl), size_t tbl_sz,
+    size_t key_sz, bool_t multi_value, const htbl_opts_t *opts);
+API_EXPORT void htbl2_create_opts(htbl2_t REQ_PTR(htbl), size_t tbl_sz,
+    size_t key_sz, size_t value_sz, bool multi_value,
+    const htbl_opts_t *opts);
+
 API_EXPORT void htbl_empty(htbl_t REQ_PTR(htbl),
     void (*func)(void *value, void *userinfo), void *userinfo);
 API_EXPORT void htbl2_empty(htbl2_t REQ_PTR(htbl), size_t value_sz,
@@ -135,6 +243,8 @@ API_EXPORT void htbl2_foreach(const htbl2_t REQ_PTR(htbl),
 
 API_EXPORT char *htbl_dump(const htbl_t *htbl, bool_t printable_keys);
 
+API_EXPORT uint64_t htbl_hash_fast(const void *key, size_t key_sz);
+
 /**
  * Utility function that can be passed in the second argument of
  * htbl_empty() if your values only require a standard C `free()` call
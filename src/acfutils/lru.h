@@ -0,0 +1,112 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license in the file COPYING
+ * or http://www.opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file COPYING.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+/**
+ * \file
+ * A byte-budgeted least-recently-used cache. Like list_t, the cache is
+ * intrusive: objects embed an lru_node_t and the cache never allocates
+ * or frees them itself. Instead, each object is inserted with a size in
+ * bytes, the cache keeps a running total of those sizes and lru_trim()
+ * evicts the least recently used objects through a callback until the
+ * total fits the budget again. All operations are O(1), except for
+ * lru_trim() and lru_purge(), which are O(1) per evicted object.
+ *
+ * Objects which are in use can be pinned. A pinned object still counts
+ * towards the total size, but is never evicted.
+ *
+ * The cache does no locking of its own, so the caller must serialize
+ * all access to it.
+ * @see lru_create()
+ */
+
+#ifndef	_ACFUTILS_LRU_H_
+#define	_ACFUTILS_LRU_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "list.h"
+#include "types.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/**
+ * You must embed a member of this type in any object which is to be
+ * held in an lru_t. The node must be zero-initialized before its first
+ * use. Its contents are private to the cache.
+ */
+typedef struct {
+	list_node_t	node;
+	uint64_t	size;
+	unsigned	pins;
+	bool_t		cached;
+} lru_node_t;
+
+/**
+ * Eviction callback. Called from lru_trim() and lru_purge() after
+ * `obj' has been removed from the cache, to release whatever the cached
+ * size accounted for. The callback must not call back into the cache.
+ */
+typedef void (*lru_evict_cb_t)(void *obj, void *userinfo);
+
+/**
+ * The cache itself. Initialize it with lru_create() and deinitialize it
+ * with lru_destroy(). The fields are private to the cache.
+ */
+typedef struct {
+	list_t		lru;		/* unpinned objects, MRU first */
+	size_t		offset;
+	size_t		count;
+	uint64_t	size;
+	uint64_t	budget;
+	lru_evict_cb_t	evict_cb;
+	void		*userinfo;
+} lru_t;
+
+API_EXPORT void lru_create(lru_t *lru, size_t size, size_t offset,
+    uint64_t budget, lru_evict_cb_t evict_cb, void *userinfo);
+API_EXPORT void lru_destroy(lru_t *lru);
+
+API_EXPORT void lru_insert(lru_t *lru, void *obj, uint64_t size);
+API_EXPORT void lru_remove(lru_t *lru, void *obj);
+API_EXPORT bool_t lru_contains(const lru_t *lru, const void *obj);
+API_EXPORT void lru_touch(lru_t *lru, void *obj);
+API_EXPORT void lru_pin(lru_t *lru, void *obj);
+API_EXPORT void lru_unpin(lru_t *lru, void *obj);
+
+API_EXPORT void lru_set_budget(lru_t *lru, uint64_t budget);
+API_EXPORT uint64_t lru_get_budget(const lru_t *lru);
+API_EXPORT uint64_t lru_size(const lru_t *lru);
+API_EXPORT size_t lru_count(const lru_t *lru);
+
+API_EXPORT size_t lru_trim(lru_t *lru);
+API_EXPORT void lru_purge(lru_t *lru);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _ACFUTILS_LRU_H_ */
@@ -58,10 +58,17 @@ API_EXPORT odb_t *odb_init(const char *xpdir, const char *cainfo);
 API_EXPORT void odb_fini(odb_t *odb);
 
 API_EXPORT void odb_set_unload_delay(odb_t *odb, unsigned seconds);
+API_EXPORT void odb_set_refresh_threads(odb_t *odb, unsigned n);
 API_EXPORT time_t odb_get_cc_refresh_date(odb_t *odb, const char *cc);
 API_EXPORT bool_t odb_refresh_cc(odb_t *odb, const char *cc);
+API_EXPORT bool_t odb_refresh_cc_from_file(odb_t *odb, const char *cc,
+    const char *path);
 API_EXPORT bool_t odb_get_obstacles(odb_t *odb, int lat, int lon,
     add_obst_cb_t cb, void *userinfo);
+API_EXPORT size_t odb_get_obstacles_radius(odb_t *odb, geo_pos2_t center,
+    double radius, add_obst_cb_t cb, void *userinfo);
+API_EXPORT size_t odb_get_obstacles_corridor(odb_t *odb, geo_pos2_t start,
+    geo_pos2_t end, double half_width, add_obst_cb_t cb, void *userinfo);
 
 API_EXPORT void odb_set_proxy(odb_t *odb, const char *proxy);
 API_EXPORT size_t odb_get_proxy(odb_t *odb, char *proxy, size_t cap);
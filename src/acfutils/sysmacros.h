@@ -130,10 +130,16 @@ extern "C" {
 #define	BE64(x)	(x)
 #define	BE32(x)	(x)
 #define	BE16(x)	(x)
+#define	LE64(x)	BSWAP64(x)
+#define	LE32(x)	BSWAP32(x)
+#define	LE16(x)	BSWAP16(x)
 #else	/* __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__ */
 #define	BE64(x)	BSWAP64(x)
 #define	BE32(x)	BSWAP32(x)
 #define	BE16(x)	BSWAP16(x)
+#define	LE64(x)	(x)
+#define	LE32(x)	(x)
+#define	LE16(x)	(x)
 #endif	/* __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__ */
 
 #define	DESTROY(x)	do { free(x); (x) = NULL; } while (0)
@@ -196,6 +202,8 @@ extern "C" {
 
 #define	highbit64(x)	(64 - __builtin_clzll(x) - 1)
 #define	highbit32(x)	(32 - __builtin_clzll(x) - 1)
+#define	lowbit64(x)	((unsigned)__builtin_ctzll(x))
+#define	lowbit32(x)	((unsigned)__builtin_ctz(x))
 
 #elif  defined(_MSC_VER)
 
@@ -214,8 +222,24 @@ highbit64(unsigned long long x)
 	_BitScanReverse64(&idx, x);
 	return (idx);
 }
+
+static inline unsigned
+lowbit32(unsigned int x)
+{
+	unsigned long idx;
+	_BitScanForward(&idx, x);
+	return (idx);
+}
+
+static inline unsigned
+lowbit64(unsigned long long x)
+{
+	unsigned long idx;
+	_BitScanForward64(&idx, x);
+	return (idx);
+}
 #else
-#error	"Compiler platform unsupported, please add highbit definition"
+#error	"Compiler platform unsupported, please add highbit/lowbit definition"
 #endif
 
 #ifndef	MIN
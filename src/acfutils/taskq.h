@@ -27,27 +27,88 @@
 #define	_ACFUTILS_TASKQ_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#include "core.h"
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
 
 typedef struct taskq_s taskq_t;
+typedef struct taskq_task_s taskq_handle_t;
+
+/*
+ * Priority classes for taskq_submit2. In a regular taskq, tasks in a
+ * higher priority class are always started before any task in a lower
+ * one. With TASKQ_FLAG_WORK_STEALING, this ordering is only best-effort:
+ * it holds within each worker's queue, but a worker may run a lower
+ * priority task from its own queue (or steal one) while a higher
+ * priority task waits in another worker's queue.
+ */
+typedef enum {
+	TASKQ_PRIO_HIGH,
+	TASKQ_PRIO_NORMAL,
+	TASKQ_PRIO_LOW,
+	TASKQ_NUM_PRIOS
+} taskq_prio_t;
+
+/*
+ * Flags for taskq_alloc2.
+ *
+ * TASKQ_FLAG_WORK_STEALING: instead of a single shared task list, each
+ *	worker thread gets its own task queue. Tasks submitted from a worker
+ *	thread go onto that worker's queue, tasks submitted from outside
+ *	are spread over all queues. Idle workers steal tasks from randomly
+ *	chosen busy workers. This greatly reduces lock contention when
+ *	processing large numbers of small tasks, at the cost of no longer
+ *	guaranteeing that tasks are started in submission order. In this
+ *	mode, the maximum number of threads is capped at
+ *	TASKQ_WS_MAX_THREADS.
+ */
+#define	TASKQ_FLAG_WORK_STEALING	(1u << 0)
+#define	TASKQ_WS_MAX_THREADS		64
 
 typedef void *(*taskq_init_thr_t)(void *userinfo);
 typedef void (*taskq_fini_thr_t)(void *userinfo, void *thr_info);
 typedef void (*taskq_proc_task_t)(void *userinfo, void *thr_info, void *task);
 typedef void (*taskq_discard_task_t)(void *userinfo, void *task);
 
+typedef struct taskq_group_s taskq_group_t;
+typedef void (*taskq_group_func_t)(void *arg);
+typedef void (*lacf_parallel_for_func_t)(void *userinfo, size_t begin,
+    size_t end);
+
 API_EXPORT taskq_t *taskq_alloc(unsigned num_threads_min,
     unsigned num_threads_max, uint64_t thr_stop_delay_us,
     taskq_init_thr_t init_func,taskq_fini_thr_t fini_func,
     taskq_proc_task_t proc_func, taskq_discard_task_t discard_func,
     void *userinfo);
+API_EXPORT taskq_t *taskq_alloc2(unsigned num_threads_min,
+    unsigned num_threads_max, uint64_t thr_stop_delay_us,
+    taskq_init_thr_t init_func, taskq_fini_thr_t fini_func,
+    taskq_proc_task_t proc_func, taskq_discard_task_t discard_func,
+    void *userinfo, unsigned flags);
 API_EXPORT void taskq_free(taskq_t *tq);
 
 API_EXPORT void taskq_submit(taskq_t *tq, void *task);
+API_EXPORT void taskq_submit_batch(taskq_t *tq, void **tasks, size_t n);
+API_EXPORT taskq_handle_t *taskq_submit2(taskq_t *tq, void *task,
+    taskq_prio_t prio, uint64_t deadline_us);
+API_EXPORT bool taskq_cancel(taskq_t *tq, taskq_handle_t *handle);
+API_EXPORT void taskq_wait(taskq_t *tq, taskq_handle_t *handle);
+API_EXPORT bool taskq_is_done(const taskq_handle_t *handle);
+API_EXPORT void taskq_handle_release(taskq_handle_t *handle);
+
+API_EXPORT taskq_group_t *taskq_group_alloc(taskq_t *tq);
+API_EXPORT void taskq_group_free(taskq_group_t *grp);
+API_EXPORT void taskq_group_submit(taskq_group_t *grp,
+    taskq_group_func_t func, void *arg);
+API_EXPORT void taskq_group_join(taskq_group_t *grp);
+
+API_EXPORT void lacf_parallel_for(taskq_t *tq, size_t begin, size_t end,
+    size_t grain, lacf_parallel_for_func_t fn, void *userinfo);
 API_EXPORT bool taskq_wants_shutdown(taskq_t *tq);
 
 API_EXPORT void taskq_set_num_threads_min(taskq_t *tq, unsigned n_threads_min);
@@ -1022,6 +1022,7 @@ thread_set_prio(thread_t thr, int prio)
 #endif	/* !APL && !LIN */
 
 API_EXPORT void lacf_mask_sigpipe(void);
+API_EXPORT unsigned lacf_num_cpus(void);
 
 /**
  * This is a read-write mutex. RWMutexes are mutexes which allow multiple
@@ -46,7 +46,11 @@
 #include "acfutils/optional.h"
 #include "acfutils/perf.h"
 #include "acfutils/safe_alloc.h"
+#include "acfutils/stat.h"
+#include "acfutils/taskq.h"
+#include "acfutils/time.h"
 #include "acfutils/types.h"
+#include "acfutils/worker.h"
 
 #define	RWY_PROXIMITY_LAT_FRACT		3
 #define	RWY_PROXIMITY_LON_DISPL		609.57	/* meters, 2000 ft */
@@ -88,12 +92,61 @@ typedef enum {
 	VGSI_PAPI_3C =		5
 } vgsi_t;
 
-typedef struct tile_s {
+typedef struct adb_tile {
 	geo_pos2_t	pos;	/* tile position (see `geo_pos2tile_pos') */
 	avl_tree_t	arpts;	/* airport_t's sorted by `airport_compar' */
+	size_t		mem_sz;	/* of the airports, see `airport_mem_sz' */
+	uint64_t	last_used; /* microclock() of last use, for LRU */
+	bool_t		dirty;	/* needs rewriting by an incremental update */
 	avl_node_t	node;
 } tile_t;
 
+/*
+ * Runway geometry of a loaded airport in structure-of-arrays form, which
+ * load_airport computes for all of the airport's runways in one go. The
+ * runway bounding boxes are generated from it and adb_airport_rwys_at
+ * tests positions against it, many runways per pass. All coordinates are
+ * in the airport's fpp. The geometry, along with the bounding boxes, is
+ * carved out of a single allocation of RWY_GEOM_SZ bytes.
+ */
+typedef struct adb_rwy_geom {
+	unsigned	n_rwys;
+	runway_t	**rwys;		/* in the order of arpt->rwys */
+	/* per runway end, runway `i' has its ends at 2 * i and 2 * i + 1 */
+	double		*thr_x, *thr_y;		/* runway_end_t::thr_v */
+	double		*dthr_x, *dthr_y;	/* runway_end_t::dthr_v */
+	double		*dir_x, *dir_y;		/* unit vect to other thr_v */
+	double		*displ;
+	double		*blast;
+	double		*half_w;
+	double		*land_len;
+	/* lateral limits of apch_bbox due to close parallel runways */
+	double		*apch_l, *apch_r;
+	/*
+	 * Per runway. The rectangular areas are stored as longitudinal
+	 * extents and a lateral half-width in a frame with its origin at
+	 * dthr_v of end 0 and its axis pointing towards dthr_v of end 1.
+	 */
+	double		*org_x, *org_y;
+	double		*ax_x, *ax_y;
+	double		*len;
+	double		*s_min[ADB_RWY_AREA_APCH];
+	double		*s_max[ADB_RWY_AREA_APCH];
+	double		*lat[ADB_RWY_AREA_APCH];
+} adb_rwy_geom_t;
+
+#define	RWY_GEOM_END_FIELDS	12
+#define	RWY_GEOM_RWY_FIELDS	(5 + 3 * ADB_RWY_AREA_APCH)
+/* four rectangular bboxes of 5 points and two approach bboxes of 7 */
+#define	RWY_GEOM_BBOX_PTS	(4 * 5 + 2 * 7)
+#define	RWY_GEOM_RWY_SZ		(RWY_GEOM_BBOX_PTS * sizeof (vect2_t) + \
+	(2 * RWY_GEOM_END_FIELDS + RWY_GEOM_RWY_FIELDS) * sizeof (double) + \
+	sizeof (runway_t *))
+#define	RWY_GEOM_SZ(n_rwys)	\
+	(ARENA_ROUNDUP(sizeof (adb_rwy_geom_t)) + (n_rwys) * RWY_GEOM_RWY_SZ)
+/* positions tested per pass by adb_airport_rwys_at */
+#define	RWY_GEOM_BATCH		64
+
 typedef struct {
 	list_node_t	node;
 	char		*fname;
@@ -359,9 +412,280 @@ static void apt_dat_insert(airportdb_t *db, airport_t *arpt);
 static void free_airport(airport_t *arpt);
 
 static bool_t load_airport(airport_t *arpt);
-static void load_rwy_info(runway_t *rwy);
+static void unload_airport(airport_t *arpt);
 
 static arpt_index_t *create_arpt_index(airportdb_t *db, const airport_t *arpt);
+static void arpt_kdtree_build(airportdb_t *db);
+static void arpt_kdtree_free(airportdb_t *db);
+
+static void load_airports_in_tile(airportdb_t *db, geo_pos2_t tile_pos);
+static char *tile_cache_fname(const airportdb_t *db, geo_pos2_t tile_pos);
+static void free_tile(airportdb_t *db, tile_t *tile, bool_t do_remove);
+
+static void tile_loader_merge(airportdb_t *db);
+static void tile_loader_flush(airportdb_t *db);
+static unsigned tile_loader_request_nearest(airportdb_t *db,
+    geo_pos2_t my_pos);
+
+/*
+ * Approximate ratios of the in-memory size of the airports in a text cache
+ * tile to the size of the tile file, without and with their runway
+ * geometry (which is only allocated once an airport is loaded). They're
+ * only estimates: a tile which outgrows its reservation simply gets more
+ * arena blocks, whereas any excess reservation is wasted.
+ */
+#define	TEXT_TILE_MEM_FACT	3
+#define	TEXT_TILE_GEOM_MEM_FACT	6
+
+/*
+ * Per-tile allocation arena. All records of the airports loaded from a
+ * cache tile (the airports themselves, their runways, frequencies, ramp
+ * starts, bounding boxes and strings) are carved out of a few large
+ * blocks, which are released together when the last of those airports is
+ * freed. Strings are interned in the arena, so the country and city names
+ * shared by most airports of a tile are only stored once. Each airport
+ * holds a reference on its arena, since an airport can end up linked into
+ * a different tile than the one it was loaded from. Airports constructed
+ * during a cache rebuild have no arena and use the regular heap.
+ */
+#define	ARENA_BLK_MIN		(1 << 10)	/* bytes */
+#define	ARENA_BLK_MAX		(64 << 10)	/* bytes */
+#define	ARENA_ALIGN		16
+#define	ARENA_ROUNDUP(x)	\
+	(((x) + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1))
+
+typedef struct arena_blk {
+	struct arena_blk	*next;
+	size_t			sz;	/* usable bytes following the header */
+	size_t			used;
+} arena_blk_t;
+
+#define	ARENA_BLK_HDR_SZ	ARENA_ROUNDUP(sizeof (arena_blk_t))
+
+typedef struct adb_arena {
+	unsigned	refcnt;		/* atomic */
+	arena_blk_t	*blks;		/* allocations come from the head */
+	size_t		next_blk_sz;
+	size_t		reserve;	/* size of the first block, if set */
+	/* open-addressing hash table of the interned strings */
+	char		**strs;
+	size_t		strs_cap;	/* power of 2 */
+	size_t		n_strs;
+} adb_arena_t;
+
+static adb_arena_t *
+arena_alloc(void)
+{
+	adb_arena_t *arena = safe_calloc(1, sizeof (*arena));
+
+	arena->refcnt = 1;
+	arena->next_blk_sz = ARENA_BLK_MIN;
+
+	return (arena);
+}
+
+/*
+ * Sizes the first block of an empty arena to hold roughly `sz' bytes. A
+ * tile usually only holds a few airports, so the exact size of the first
+ * block determines most of the arena's overhead.
+ */
+static void
+arena_reserve(adb_arena_t *arena, size_t sz)
+{
+	ASSERT(arena != NULL);
+	if (arena->blks == NULL)
+		arena->reserve = ARENA_ROUNDUP(sz);
+}
+
+static adb_arena_t *
+arena_hold(adb_arena_t *arena)
+{
+	ASSERT(arena != NULL);
+	VERIFY(__atomic_add_fetch(&arena->refcnt, 1, __ATOMIC_RELAXED) > 1);
+	return (arena);
+}
+
+static void
+arena_rele(adb_arena_t *arena)
+{
+	arena_blk_t *blk;
+
+	ASSERT(arena != NULL);
+	if (__atomic_sub_fetch(&arena->refcnt, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	while ((blk = arena->blks) != NULL) {
+		arena->blks = blk->next;
+		free(blk);
+	}
+	free(arena->strs);
+	ZERO_FREE(arena);
+}
+
+/*
+ * Returns `sz' bytes of zeroed memory from the arena. Allocations too
+ * large to share a block get a dedicated one, which is placed behind the
+ * current block, so that the remainder of that stays usable.
+ */
+static void *
+arena_zalloc(adb_arena_t *arena, size_t sz)
+{
+	arena_blk_t *blk = arena->blks;
+	void *p;
+
+	ASSERT(arena != NULL);
+	sz = ARENA_ROUNDUP(MAX(sz, 1));
+
+	if (blk == NULL || blk->used + sz > blk->sz) {
+		size_t blk_sz;
+
+		if (sz > ARENA_BLK_MAX / 4 && blk != NULL) {
+			arena_blk_t *big = safe_calloc(1,
+			    ARENA_BLK_HDR_SZ + sz);
+
+			big->sz = sz;
+			big->used = sz;
+			big->next = blk->next;
+			blk->next = big;
+			return ((uint8_t *)big + ARENA_BLK_HDR_SZ);
+		}
+		/*
+		 * Unless the caller has told us how much it needs, start
+		 * small and grow the blocks as the tile fills up.
+		 */
+		if (arena->reserve != 0) {
+			blk_sz = MAX(arena->reserve, sz);
+			arena->reserve = 0;
+		} else {
+			blk_sz = MAX(arena->next_blk_sz, sz);
+			arena->next_blk_sz = MIN(arena->next_blk_sz * 2,
+			    ARENA_BLK_MAX);
+		}
+		blk = safe_calloc(1, ARENA_BLK_HDR_SZ + blk_sz);
+		blk->sz = blk_sz;
+		blk->next = arena->blks;
+		arena->blks = blk;
+	}
+	p = (uint8_t *)blk + ARENA_BLK_HDR_SZ + blk->used;
+	blk->used += sz;
+
+	return (p);
+}
+
+static uint64_t
+arena_str_hash(const char *str)
+{
+	/* FNV-1a */
+	uint64_t h = 0xcbf29ce484222325llu;
+
+	for (; *str != '\0'; str++)
+		h = (h ^ (uint8_t)*str) * 0x100000001b3llu;
+	return (h);
+}
+
+static void
+arena_strs_grow(adb_arena_t *arena)
+{
+	size_t old_cap = arena->strs_cap;
+	char **old_strs = arena->strs;
+
+	arena->strs_cap = MAX(old_cap * 2, 16);
+	arena->strs = safe_calloc(arena->strs_cap, sizeof (*arena->strs));
+	for (size_t i = 0; i < old_cap; i++) {
+		size_t j;
+
+		if (old_strs[i] == NULL)
+			continue;
+		j = arena_str_hash(old_strs[i]) & (arena->strs_cap - 1);
+		while (arena->strs[j] != NULL)
+			j = (j + 1) & (arena->strs_cap - 1);
+		arena->strs[j] = old_strs[i];
+	}
+	free(old_strs);
+}
+
+/*
+ * Returns an interned copy of `str' in the arena. The returned string is
+ * shared and must not be modified.
+ */
+static char *
+arena_strdup(adb_arena_t *arena, const char *str)
+{
+	size_t i, l;
+
+	ASSERT(arena != NULL);
+	ASSERT(str != NULL);
+
+	if ((arena->n_strs + 1) * 2 > arena->strs_cap)
+		arena_strs_grow(arena);
+	for (i = arena_str_hash(str) & (arena->strs_cap - 1);
+	    arena->strs[i] != NULL; i = (i + 1) & (arena->strs_cap - 1)) {
+		if (strcmp(arena->strs[i], str) == 0)
+			return (arena->strs[i]);
+	}
+	l = strlen(str) + 1;
+	arena->strs[i] = arena_zalloc(arena, l);
+	memcpy(arena->strs[i], str, l);
+	arena->n_strs++;
+
+	return (arena->strs[i]);
+}
+
+/*
+ * Allocation helpers for the records of an airport, which go to the
+ * airport's arena if it has one, or to the heap otherwise.
+ */
+static void *
+arpt_zalloc(const airport_t *arpt, size_t sz)
+{
+	ASSERT(arpt != NULL);
+	if (arpt->arena != NULL)
+		return (arena_zalloc(arpt->arena, sz));
+	return (safe_calloc(1, sz));
+}
+
+static void
+arpt_free(const airport_t *arpt, void *p)
+{
+	ASSERT(arpt != NULL);
+	/* arena memory is only released together with the arena */
+	if (arpt->arena == NULL)
+		free(p);
+}
+
+static char *
+arpt_strdup(const airport_t *arpt, const char *str)
+{
+	ASSERT(arpt != NULL);
+	ASSERT(str != NULL);
+	if (arpt->arena != NULL)
+		return (arena_strdup(arpt->arena, str));
+	return (safe_strdup(str));
+}
+
+/*
+ * Replaces one of the airport's string fields with `str', which must have
+ * been allocated with malloc and is consumed by this function.
+ */
+static void
+arpt_set_str(airport_t *arpt, char **field, char *str)
+{
+	ASSERT(arpt != NULL);
+	ASSERT(field != NULL);
+
+	if (arpt->arena != NULL) {
+		*field = (str != NULL ? arena_strdup(arpt->arena, str) : NULL);
+		free(str);
+	} else {
+		free(*field);
+		*field = str;
+	}
+}
+
+/*
+ * The ICAO & IATA index keys are short, fixed-size identifiers, for which
+ * the multiply-mix hash is a lot cheaper than the default CRC64.
+ */
+static const htbl_opts_t index_htbl_opts = { .hash = HTBL_HASH_FAST };
 
 static void
 recreate_icao_iata_tables(airportdb_t *db, unsigned cap)
@@ -373,10 +697,12 @@ recreate_icao_iata_tables(airportdb_t *db, unsigned cap)
 	htbl2_empty(&db->iata_index, sizeof (arpt_index_t), NULL, NULL);
 	htbl2_destroy(&db->iata_index);
 
-	htbl2_create(&db->icao_index, MAX(P2ROUNDUP(cap), 16),
-	    AIRPORTDB_ICAO_LEN, sizeof (arpt_index_t), B_TRUE);
-	htbl2_create(&db->iata_index, MAX(P2ROUNDUP(cap), 16),
-	    AIRPORTDB_IATA_LEN, sizeof (arpt_index_t), B_TRUE);
+	htbl2_create_opts(&db->icao_index, MAX(P2ROUNDUP(cap), 16),
+	    AIRPORTDB_ICAO_LEN, sizeof (arpt_index_t), B_TRUE,
+	    &index_htbl_opts);
+	htbl2_create_opts(&db->iata_index, MAX(P2ROUNDUP(cap), 16),
+	    AIRPORTDB_IATA_LEN, sizeof (arpt_index_t), B_TRUE,
+	    &index_htbl_opts);
 }
 
 /*
@@ -463,6 +789,31 @@ ramp_start_compar(const void *a, const void *b)
 	return (0);
 }
 
+/*
+ * Allocates an empty airport, either from `arena' or, if that is NULL,
+ * from the heap.
+ */
+static airport_t *
+airport_alloc(adb_arena_t *arena)
+{
+	airport_t *arpt;
+
+	if (arena != NULL) {
+		arpt = arena_zalloc(arena, sizeof (*arpt));
+		arpt->arena = arena_hold(arena);
+	} else {
+		arpt = safe_calloc(1, sizeof (*arpt));
+	}
+	avl_create(&arpt->rwys, runway_compar, sizeof (runway_t),
+	    offsetof(runway_t, node));
+	list_create(&arpt->freqs, sizeof (freq_info_t),
+	    offsetof(freq_info_t, node));
+	avl_create(&arpt->ramp_starts, ramp_start_compar,
+	    sizeof (ramp_start_t), offsetof(ramp_start_t, node));
+
+	return (arpt);
+}
+
 /*
  * Retrieves the geo table tile which contains position `pos'. If create is
  * B_TRUE, if the tile doesn't exit, it will be created.
@@ -491,6 +842,9 @@ geo_table_get_tile(airportdb_t *db, geo_pos2_t pos, bool_t create,
 		tile->pos = pos;
 		avl_create(&tile->arpts, airport_compar, sizeof (airport_t),
 		    offsetof(airport_t, tile_node));
+		tile->mem_sz = 0;
+		tile->last_used = microclock();
+		tile->dirty = B_FALSE;
 		avl_insert(&db->geo_table, tile, where);
 		created = B_TRUE;
 	}
@@ -500,56 +854,6 @@ geo_table_get_tile(airportdb_t *db, geo_pos2_t pos, bool_t create,
 	return (tile);
 }
 
-/*
- * Given a runway threshold vector, direction vector, width, length and
- * threshold longitudinal displacement, prepares a bounding box which
- * encompasses that runway.
- */
-static vect2_t *
-make_rwy_bbox(vect2_t thresh_v, vect2_t dir_v, double width, double len,
-    double long_displ)
-{
-	vect2_t *bbox;
-	vect2_t len_displ_v;
-
-	ASSERT(!IS_NULL_VECT(thresh_v));
-	ASSERT(!IS_NULL_VECT(dir_v));
-	ASSERT(!isnan(width));
-	ASSERT(!isnan(len));
-	ASSERT(!isnan(long_displ));
-
-	bbox = safe_malloc(sizeof (*bbox) * 5);
-
-	/*
-	 * Displace the 'a' point from the runway threshold laterally
-	 * by 1/2 width to the right.
-	 */
-	bbox[0] = vect2_add(thresh_v, vect2_set_abs(vect2_norm(dir_v, B_TRUE),
-	    width / 2));
-	/* pull it back by `long_displ' */
-	bbox[0] = vect2_add(bbox[0], vect2_set_abs(vect2_neg(dir_v),
-	    long_displ));
-
-	/* do the same for the `d' point, but displace to the left */
-	bbox[3] = vect2_add(thresh_v, vect2_set_abs(vect2_norm(dir_v, B_FALSE),
-	    width / 2));
-	/* pull it back by `long_displ' */
-	bbox[3] = vect2_add(bbox[3], vect2_set_abs(vect2_neg(dir_v),
-	    long_displ));
-
-	/*
-	 * points `b' and `c' are along the runway simply as runway len +
-	 * long_displ
-	 */
-	len_displ_v = vect2_set_abs(dir_v, len + long_displ);
-	bbox[1] = vect2_add(bbox[0], len_displ_v);
-	bbox[2] = vect2_add(bbox[3], len_displ_v);
-
-	bbox[4] = NULL_VECT2;
-
-	return (bbox);
-}
-
 /*
  * Checks if the numerical runway type `t' is a hard-surface runway.
  */
@@ -607,6 +911,33 @@ apt_dat_insert(airportdb_t *db, airport_t *arpt)
 	avl_insert(&db->apt_dat, arpt, where);
 }
 
+/*
+ * Approximate amount of memory held by an airport, used to account the
+ * memory held by loaded tiles. This includes the runway geometry, if the
+ * airport is loaded. load_airport and unload_airport keep the tile's
+ * total up to date when they add or drop the geometry.
+ */
+static size_t
+airport_mem_sz(const airport_t *arpt)
+{
+	size_t sz = sizeof (*arpt);
+
+	if (arpt->rwy_geom != NULL)
+		sz += RWY_GEOM_SZ(arpt->rwy_geom->n_rwys);
+
+	sz += avl_numnodes(&arpt->rwys) * sizeof (runway_t);
+	sz += avl_numnodes(&arpt->ramp_starts) * sizeof (ramp_start_t);
+	sz += list_count(&arpt->freqs) * sizeof (freq_info_t);
+	if (arpt->name_orig != NULL)
+		sz += strlen(arpt->name_orig) + 1;
+	if (arpt->country != NULL)
+		sz += strlen(arpt->country) + 1;
+	if (arpt->city != NULL)
+		sz += strlen(arpt->city) + 1;
+
+	return (sz);
+}
+
 /*
  * Links an airport into the geo-tile cache. The airport must not have been
  * geo-linked before. While an airport is geo-linked, its refpt must not be
@@ -625,6 +956,8 @@ geo_link_airport(airportdb_t *db, airport_t *arpt)
 	ASSERT(!arpt->geo_linked);
 	VERIFY(avl_find(&tile->arpts, arpt, &where) == NULL);
 	avl_insert(&tile->arpts, arpt, where);
+	tile->mem_sz += airport_mem_sz(arpt);
+	arpt->tile = tile;
 	arpt->geo_linked = B_TRUE;
 }
 
@@ -642,6 +975,8 @@ geo_unlink_airport(airportdb_t *db, airport_t *arpt)
 	tile = geo_table_get_tile(db, GEO3_TO_GEO2(arpt->refpt), B_TRUE, NULL);
 	ASSERT(avl_find(&tile->arpts, arpt, NULL) == arpt);
 	avl_remove(&tile->arpts, arpt);
+	tile->mem_sz -= MIN(tile->mem_sz, airport_mem_sz(arpt));
+	arpt->tile = NULL;
 	arpt->geo_linked = B_FALSE;
 }
 
@@ -824,10 +1159,14 @@ concat_comps(char **comps, size_t count)
  * LON to this. If the apt.dat being parsed is a standard (non-extended) one,
  * the additional info is inferred later on from other sources during the
  * airport data cache creation process.
+ * If `db' is NULL, the duplicate check against already known airports is
+ * skipped. The parallel cache rebuild uses this and performs the check
+ * later, when merging the parsed airports into the database.
+ * If `arena' is non-NULL, the airport is allocated from it.
  */
 static airport_t *
 parse_apt_dat_1_line(airportdb_t *db, const char *line, iconv_t *cd_p,
-    airport_t **dup_arpt_p)
+    adb_arena_t *arena, airport_t **dup_arpt_p)
 {
 	/*
 	 * pre-allocate the buffer to be large enough that most names are
@@ -840,7 +1179,6 @@ parse_apt_dat_1_line(airportdb_t *db, const char *line, iconv_t *cd_p,
 	char **comps = strsplit(line, " ", B_TRUE, &ncomps);
 	airport_t *arpt = NULL;
 
-	ASSERT(db != NULL);
 	ASSERT(line != NULL);
 
 	if (dup_arpt_p != NULL)
@@ -860,8 +1198,7 @@ parse_apt_dat_1_line(airportdb_t *db, const char *line, iconv_t *cd_p,
 	name = concat_comps(&comps[5], ncomps - 5);
 	if (name == NULL)
 		name = safe_strdup("");
-	arpt = apt_dat_lookup(db, new_ident);
-	if (arpt != NULL) {
+	if (db != NULL && (arpt = apt_dat_lookup(db, new_ident)) != NULL) {
 		/*
 		 * This airport was already known from a previously loaded
 		 * apt.dat. Avoid overwriting its data.
@@ -871,11 +1208,7 @@ parse_apt_dat_1_line(airportdb_t *db, const char *line, iconv_t *cd_p,
 		arpt = NULL;
 		goto out;
 	}
-	arpt = safe_calloc(1, sizeof (*arpt));
-	avl_create(&arpt->rwys, runway_compar, sizeof (runway_t),
-	    offsetof(runway_t, node));
-	list_create(&arpt->freqs, sizeof (freq_info_t),
-	    offsetof(freq_info_t, node));
+	arpt = airport_alloc(arena);
 	lacf_strlcpy(arpt->ident, new_ident, sizeof (arpt->ident));
 	strtoupper(arpt->ident);
 	/*
@@ -891,17 +1224,13 @@ parse_apt_dat_1_line(airportdb_t *db, const char *line, iconv_t *cd_p,
 		lacf_strlcpy(arpt->cc, "ZZ", sizeof (arpt->cc));
 	}
 
-	avl_create(&arpt->ramp_starts, ramp_start_compar,
-	    sizeof (ramp_start_t), offsetof(ramp_start_t, node));
-
 	/*
 	 * Unfortunately, X-Plane's scenery authors put all kinds of
 	 * weird chars into their airport names. So we employ libiconv
 	 * to hopefully transliterate that junk away as much as possible.
 	 */
 	if (cd_p != NULL) {
-		LACF_DESTROY(arpt->name_orig);
-		arpt->name_orig = safe_strdup(name);
+		arpt_set_str(arpt, &arpt->name_orig, safe_strdup(name));
 		normalize_name(cd_p, name, arpt->name, sizeof (arpt->name));
 		strtoupper(arpt->name);
 	} else {
@@ -1162,7 +1491,7 @@ parse_apt_dat_freq_line(airport_t *arpt, char *line, bool_t use833)
 	comps = strsplit(line, " ", B_TRUE, &ncomps);
 	if (ncomps < 3)
 		goto out;
-	freq = safe_calloc(1, sizeof (*freq));
+	freq = arpt_zalloc(arpt, sizeof (*freq));
 	/*
 	 * When `use833' is provided, the line types start at 1050 instead
 	 * of 50. Also, the frequencies are specified in thousands of Hertz,
@@ -1223,9 +1552,11 @@ parse_apt_dat_100_line(airport_t *arpt, const char *line, bool_t hard_surf_only)
 	    (hard_surf_only && !rwy_is_hard(atoi(comps[2]))))
 		goto out;
 
-	rwy = safe_calloc(1, sizeof (*rwy));
+	rwy = arpt_zalloc(arpt, sizeof (*rwy));
 
 	rwy->arpt = arpt;
+	rwy->ends[0].dthr_v = NULL_VECT2;
+	rwy->ends[1].dthr_v = NULL_VECT2;
 	rwy->width = atof(comps[1]);
 	rwy->surf = atoi(comps[2]);
 
@@ -1281,7 +1612,7 @@ parse_apt_dat_100_line(airport_t *arpt, const char *line, bool_t hard_surf_only)
 	/* Validate the runway ends individually. */
 	if (!validate_rwy_end(&rwy->ends[0], error_descr) ||
 	    !validate_rwy_end(&rwy->ends[1], error_descr)) {
-		free(rwy);
+		arpt_free(arpt, rwy);
 		goto out;
 	}
 	/*
@@ -1290,18 +1621,19 @@ parse_apt_dat_100_line(airport_t *arpt, const char *line, bool_t hard_surf_only)
 	 */
 	if (vect3_dist(geo2ecef_ft(rwy->ends[0].thr, &wgs84),
 	    geo2ecef_ft(rwy->ends[1].thr, &wgs84)) < MIN_RWY_LEN) {
-		free(rwy);
+		arpt_free(arpt, rwy);
 		goto out;
 	}
 	/* Duplicate runway present? */
 	if (avl_find(&arpt->rwys, rwy, &where) != NULL) {
-		free(rwy);
+		arpt_free(arpt, rwy);
 		goto out;
 	}
 	avl_insert(&arpt->rwys, rwy, where);
 	if (arpt->load_complete) {
-		/* do a supplemental runway info load */
-		load_rwy_info(rwy);
+		/* rebuild the runway geometry to include the new runway */
+		unload_airport(arpt);
+		VERIFY(load_airport(arpt));
 	} else if (isnan(arpt->refpt.lat) || isnan(arpt->refpt.lon)) {
 		arpt->refpt.lat = NAN;
 		arpt->refpt.lon = NAN;
@@ -1368,13 +1700,13 @@ parse_apt_dat_1300_line(airport_t *arpt, const char *line,
 	rs = avl_find(&arpt->ramp_starts, &srch, &where);
 	if (rs != NULL)
 		goto out;
-	rs = safe_calloc(1, sizeof (*rs));
+	rs = arpt_zalloc(arpt, sizeof (*rs));
 	lacf_strlcpy(rs->name, srch.name, sizeof (rs->name));
 	rs->pos = GEO_POS2(atof(comps[1]), atof(comps[2]));
 	rs->hdgt = normalize_hdg(atof(comps[3]));
 	if (!is_valid_lat(rs->pos.lat) || !is_valid_lon(rs->pos.lon) ||
 	    !is_valid_hdg(rs->hdgt)) {
-		free(rs);
+		arpt_free(arpt, rs);
 		goto out;
 	}
 	if (strcmp(comps[4], "gate") == 0)
@@ -1494,12 +1826,12 @@ fill_dup_arpt_info(airport_t *arpt, const char *line, int row_code)
 			lacf_strlcpy(arpt->cc, comps[2], sizeof (arpt->cc));
 		} else if (strcmp(comps[1], "country") == 0 &&
 		    ncomps >= 3 && strcmp(comps[2], "-") != 0) {
-			LACF_DESTROY(arpt->country);
-			arpt->country = concat_comps(&comps[2], ncomps - 2);
+			arpt_set_str(arpt, &arpt->country,
+			    concat_comps(&comps[2], ncomps - 2));
 		} else if (strcmp(comps[1], "city") == 0 &&
 		    ncomps >= 3 && strcmp(comps[2], "-") != 0) {
-			LACF_DESTROY(arpt->city);
-			arpt->city = concat_comps(&comps[2], ncomps - 2);
+			arpt_set_str(arpt, &arpt->city,
+			    concat_comps(&comps[2], ncomps - 2));
 		}
 		free_strlist(comps, ncomps);
 	}
@@ -1523,38 +1855,149 @@ parse_attr_country(char **comps, size_t n_comps, int version, airport_t *arpt)
 	ASSERT(comps != NULL);
 	ASSERT(arpt != NULL);
 
-	LACF_DESTROY(arpt->country);
+	arpt_set_str(arpt, &arpt->country, NULL);
 	arpt->cc3[0] = '\0';
 
 	if (n_comps == 0)
 		return;
 	if (version < 1200) {
-		arpt->country = concat_comps(comps, n_comps);
+		arpt_set_str(arpt, &arpt->country,
+		    concat_comps(comps, n_comps));
 	} else {
 		if (strlen(comps[0]) == 3 && isupper(comps[0][0]) &&
 		    isupper(comps[0][1]) && isupper(comps[0][2])) {
-			arpt->country = iso3166_cc3_to_name(comps[0]);
+			arpt_set_str(arpt, &arpt->country,
+			    iso3166_cc3_to_name(comps[0]));
+		}
+		if (arpt->country == NULL) {
+			arpt_set_str(arpt, &arpt->country,
+			    concat_comps(comps, n_comps));
+		}
+	}
+}
+
+/*
+ * Parses a single non-'1' line of an airport record in apt.dat into the
+ * airport in `arpt_p'. If the line invalidates the airport, the airport
+ * is freed and `arpt_p' is set to NULL.
+ */
+static void
+parse_apt_dat_line(const airportdb_t *db, airport_t **arpt_p, char *line,
+    int row_code, int version)
+{
+	airport_t *arpt;
+	char **comps;
+	size_t ncomps;
+
+	ASSERT(db != NULL);
+	ASSERT(arpt_p != NULL);
+	ASSERT(line != NULL);
+	arpt = *arpt_p;
+	ASSERT(arpt != NULL);
+
+	switch (row_code) {
+	case 21:
+		parse_apt_dat_21_line(arpt, line);
+		break;
+	case 50 ... 56:
+		parse_apt_dat_freq_line(arpt, line, B_FALSE);
+		break;
+	case 100:
+		parse_apt_dat_100_line(arpt, line, db->ifr_only);
+		break;
+	case 1050 ... 1056:
+		parse_apt_dat_freq_line(arpt, line, B_TRUE);
+		break;
+	case 1300:
+		parse_apt_dat_1300_line(arpt, line,
+		    db->normalize_gate_names);
+		break;
+	case 1302:
+		comps = strsplit(line, " ", B_TRUE, &ncomps);
+		/*
+		 * '1302' lines are meta-info lines introduced since
+		 * X-Plane 11. This line can contain varying numbers
+		 * of components, but we only care when it's 3.
+		 */
+		if (ncomps < 3) {
+			free_strlist(comps, ncomps);
+			break;
+		}
+		/* Necessary check prior to modifying the refpt. */
+		ASSERT(!arpt->geo_linked);
+		/*
+		 * X-Plane 11 introduced these to remove the need
+		 * for an Airports.txt.
+		 */
+		if (strcmp(comps[1], "icao_code") == 0 &&
+		    is_valid_icao_code(comps[2])) {
+			lacf_strlcpy(arpt->icao, comps[2],
+			    sizeof (arpt->icao));
+		} else if (strcmp(comps[1], "iata_code") == 0 &&
+		    is_valid_iata_code(comps[2])) {
+			lacf_strlcpy(arpt->iata, comps[2],
+			    sizeof (arpt->iata));
+		} else if (strcmp(comps[1], "country") == 0) {
+			parse_attr_country(&comps[2], ncomps - 2,
+			    version, arpt);
+		} else if (strcmp(comps[1], "city") == 0) {
+			arpt_set_str(arpt, &arpt->city,
+			    concat_comps(&comps[2], ncomps - 2));
+		} else if (strcmp(comps[1], "name_orig") == 0) {
+			arpt_set_str(arpt, &arpt->name_orig,
+			    concat_comps(&comps[2], ncomps - 2));
+		} else if (strcmp(comps[1], "transition_alt") == 0) {
+			IF_LET(float, TA_ft, extract_TA_TL_ft(comps,
+			    ncomps))
+				arpt->TA = TA_ft;
+				arpt->TA_m = FEET2MET(TA_ft);
+			IF_LET_END
+		} else if (strcmp(comps[1], "transition_level") == 0) {
+			IF_LET(float, TL_ft, extract_TA_TL_ft(comps,
+			    ncomps))
+				arpt->TL = TL_ft;
+				arpt->TL_m = FEET2MET(TL_ft);
+			IF_LET_END
+		} else if (strcmp(comps[1], "datum_lat") == 0) {
+			double lat = atof(comps[2]);
+			if (is_valid_lat(lat)) {
+				arpt->refpt.lat = lat;
+				arpt->refpt_m.lat = lat;
+			} else {
+				free_airport(arpt);
+				*arpt_p = NULL;
+			}
+		} else if (strcmp(comps[1], "datum_lon") == 0) {
+			double lon = atof(comps[2]);
+			if (is_valid_lon(lon)) {
+				arpt->refpt.lon = lon;
+				arpt->refpt_m.lon = lon;
+			}
+		} else if (strcmp(comps[1], "region_code") == 0 &&
+		    strcmp(comps[1], "-") != 0) {
+			lacf_strlcpy(arpt->cc, comps[2],
+			    sizeof (arpt->cc));
 		}
-		if (arpt->country == NULL)
-			arpt->country = concat_comps(comps, n_comps);
+
+		free_strlist(comps, ncomps);
+		break;
 	}
 }
 
 /*
  * Parses an apt.dat (either from regular scenery or from CACHE_DIR) to
- * cache the airports contained in it.
+ * cache the airports contained in it. If `arena' is non-NULL, the airports
+ * are allocated from it.
  */
 static void
 read_apt_dat(airportdb_t *db, const char *apt_dat_fname, bool_t fail_ok,
-    iconv_t *cd_p, bool_t fill_in_dups)
+    iconv_t *cd_p, adb_arena_t *arena, bool_t fill_in_dups)
 {
 	FILE *apt_dat_f;
 	airport_t *arpt = NULL, *dup_arpt = NULL;
 	char *line = NULL;
 	size_t linecap = 0;
 	int line_num = 0, version = 0;
-	char **comps;
-	size_t ncomps;
 
 	ASSERT(db != NULL);
 	ASSERT(apt_dat_fname != NULL);
@@ -1594,7 +2037,7 @@ read_apt_dat(airportdb_t *db, const char *apt_dat_fname, bool_t fail_ok,
 			dup_arpt = NULL;
 		}
 		if (row_code == 1) {
-			arpt = parse_apt_dat_1_line(db, line, cd_p,
+			arpt = parse_apt_dat_1_line(db, line, cd_p, arena,
 			    fill_in_dups ? &dup_arpt : NULL);
 		}
 		if (arpt == NULL) {
@@ -1603,95 +2046,7 @@ read_apt_dat(airportdb_t *db, const char *apt_dat_fname, bool_t fail_ok,
 			continue;
 		}
 
-		switch (row_code) {
-		case 21:
-			parse_apt_dat_21_line(arpt, line);
-			break;
-		case 50 ... 56:
-			parse_apt_dat_freq_line(arpt, line, B_FALSE);
-			break;
-		case 100:
-			parse_apt_dat_100_line(arpt, line, db->ifr_only);
-			break;
-		case 1050 ... 1056:
-			parse_apt_dat_freq_line(arpt, line, B_TRUE);
-			break;
-		case 1300:
-			parse_apt_dat_1300_line(arpt, line,
-			    db->normalize_gate_names);
-			break;
-		case 1302:
-			comps = strsplit(line, " ", B_TRUE, &ncomps);
-			/*
-			 * '1302' lines are meta-info lines introduced since
-			 * X-Plane 11. This line can contain varying numbers
-			 * of components, but we only care when it's 3.
-			 */
-			if (ncomps < 3) {
-				free_strlist(comps, ncomps);
-				continue;
-			}
-			/* Necessary check prior to modifying the refpt. */
-			ASSERT(!arpt->geo_linked);
-			/*
-			 * X-Plane 11 introduced these to remove the need
-			 * for an Airports.txt.
-			 */
-			if (strcmp(comps[1], "icao_code") == 0 &&
-			    is_valid_icao_code(comps[2])) {
-				lacf_strlcpy(arpt->icao, comps[2],
-				    sizeof (arpt->icao));
-			} else if (strcmp(comps[1], "iata_code") == 0 &&
-			    is_valid_iata_code(comps[2])) {
-				lacf_strlcpy(arpt->iata, comps[2],
-				    sizeof (arpt->iata));
-			} else if (strcmp(comps[1], "country") == 0) {
-				parse_attr_country(&comps[2], ncomps - 2,
-				    version, arpt);
-			} else if (strcmp(comps[1], "city") == 0) {
-				LACF_DESTROY(arpt->city);
-				arpt->city = concat_comps(&comps[2],
-				    ncomps - 2);
-			} else if (strcmp(comps[1], "name_orig") == 0) {
-				LACF_DESTROY(arpt->name_orig);
-				arpt->name_orig = concat_comps(&comps[2],
-				    ncomps - 2);
-			} else if (strcmp(comps[1], "transition_alt") == 0) {
-				IF_LET(float, TA_ft, extract_TA_TL_ft(comps,
-				    ncomps))
-					arpt->TA = TA_ft;
-					arpt->TA_m = FEET2MET(TA_ft);
-				IF_LET_END
-			} else if (strcmp(comps[1], "transition_level") == 0) {
-				IF_LET(float, TL_ft, extract_TA_TL_ft(comps,
-				    ncomps))
-					arpt->TL = TL_ft;
-					arpt->TL_m = FEET2MET(TL_ft);
-				IF_LET_END
-			} else if (strcmp(comps[1], "datum_lat") == 0) {
-				double lat = atof(comps[2]);
-				if (is_valid_lat(lat)) {
-					arpt->refpt.lat = lat;
-					arpt->refpt_m.lat = lat;
-				} else {
-					free_airport(arpt);
-					arpt = NULL;
-				}
-			} else if (strcmp(comps[1], "datum_lon") == 0) {
-				double lon = atof(comps[2]);
-				if (is_valid_lon(lon)) {
-					arpt->refpt.lon = lon;
-					arpt->refpt_m.lon = lon;
-				}
-			} else if (strcmp(comps[1], "region_code") == 0 &&
-			    strcmp(comps[1], "-") != 0) {
-				lacf_strlcpy(arpt->cc, comps[2],
-				    sizeof (arpt->cc));
-			}
-
-			free_strlist(comps, ncomps);
-			break;
-		}
+		parse_apt_dat_line(db, &arpt, line, row_code, version);
 	}
 
 	if (arpt != NULL)
@@ -1701,34 +2056,952 @@ read_apt_dat(airportdb_t *db, const char *apt_dat_fname, bool_t fail_ok,
 	fclose(apt_dat_f);
 }
 
-static bool_t
-write_apt_dat(const airportdb_t *db, const airport_t *arpt)
+/*
+ * apt.dat files are split into chunks of roughly this size, which are
+ * parsed in parallel during a cache rebuild. Chunks only ever start on
+ * an airport ('1') row.
+ */
+#define	APT_DAT_CHUNK_SZ	(4 << 20)	/* bytes */
+
+/*
+ * An airport record parsed from an apt.dat chunk, before it gets merged
+ * into the database. `arpt' is NULL if the airport was rejected during
+ * parsing, but we still need the record to replicate the duplicate
+ * handling of read_apt_dat. For the lowest priority apt.dat, we also keep
+ * the record's '1302' lines to fill in duplicate airports.
+ */
+typedef struct {
+	char		ident[AIRPORTDB_IDENT_LEN];
+	airport_t	*arpt;
+	char		**meta_lines;
+	size_t		n_meta_lines;
+	list_node_t	node;
+} apt_dat_rec_t;
+
+typedef struct {
+	const char	*fname;
+	long		start;		/* file offset of the first line */
+	long		end;		/* file offset past the end, or -1 */
+	bool_t		has_hdr;	/* chunk starts with the file header */
+	int		version;
+	bool_t		fill_in_dups;
+	adb_arena_t	*arena;		/* optional, see parse_apt_dat_1_line */
+	list_t		recs;		/* apt_dat_rec_t's in file order */
+} apt_dat_chunk_t;
+
+typedef struct {
+	const airportdb_t	*db;
+	apt_dat_chunk_t		*chunks;
+} apt_dat_parse_t;
+
+/*
+ * Splits an apt.dat into chunks of roughly APT_DAT_CHUNK_SZ and appends
+ * them to `chunks'. The version header is read here, since every chunk
+ * needs it.
+ */
+static void
+apt_dat_split_chunks(const char *fname, bool_t fill_in_dups,
+    apt_dat_chunk_t **chunks, size_t *n_chunks, size_t *cap)
 {
-	char lat_lon[16];
-	char *fname;
 	FILE *fp;
-	geo_pos2_t p;
-	bool_t exists;
+	char *line = NULL;
+	size_t linecap = 0;
+	int version = 0;
+	long hdr_end, size, start = 0;
 
-	ASSERT(db != NULL);
-	ASSERT(arpt != NULL);
+	ASSERT(fname != NULL);
+	ASSERT(chunks != NULL);
+	ASSERT(n_chunks != NULL);
+	ASSERT(cap != NULL);
 
-	p = geo_pos2tile_pos(GEO3_TO_GEO2(arpt->refpt), B_FALSE);
-	snprintf(lat_lon, sizeof (lat_lon), TILE_NAME_FMT, p.lat, p.lon);
-	fname = apt_dat_cache_dir(db, GEO3_TO_GEO2(arpt->refpt), lat_lon);
+	/*
+	 * Binary mode, so we can seek to arbitrary offsets. strip_space
+	 * takes care of any CR-LF line endings.
+	 */
+	fp = fopen(fname, "rb");
+	if (fp == NULL)
+		return;
+	/* Same as in read_apt_dat, the version is the second line */
+	for (int line_num = 1; line_num <= 2; line_num++) {
+		int row_code;
 
-	exists = file_exists(fname, NULL);
-	fp = fopen(fname, "a");
-	if (fp == NULL) {
-		logMsg("Error writing file %s: %s", fname, strerror(errno));
-		return (B_FALSE);
+		if (getline(&line, &linecap, fp) <= 0)
+			break;
+		strip_space(line);
+		if (line_num == 2 && sscanf(line, "%d", &row_code) == 1)
+			version = row_code;
 	}
-	if (!exists) {
-		fprintf(fp, "I\n"
-		    "1200 libacfutils airportdb version %d\n"
-		    "\n", ARPTDB_CACHE_VERSION);
+	hdr_end = ftell(fp);
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+
+	for (;;) {
+		apt_dat_chunk_t *chunk;
+		long off = MAX(start + APT_DAT_CHUNK_SZ, hdr_end);
+		long end = -1;
+
+		if (off < size) {
+			/* Skip to the first airport line at or past `off' */
+			fseek(fp, off - 1, SEEK_SET);
+			(void) getline(&line, &linecap, fp);
+			for (;;) {
+				long pos = ftell(fp);
+				int row_code;
+
+				if (getline(&line, &linecap, fp) <= 0)
+					break;
+				strip_space(line);
+				if (sscanf(line, "%d", &row_code) == 1 &&
+				    row_code == 1) {
+					end = pos;
+					break;
+				}
+			}
+		}
+		if (*n_chunks == *cap) {
+			*cap = MAX(*cap * 2, 16);
+			*chunks = safe_realloc(*chunks,
+			    *cap * sizeof (**chunks));
+		}
+		chunk = &(*chunks)[(*n_chunks)++];
+		chunk->fname = fname;
+		chunk->start = start;
+		chunk->end = end;
+		chunk->has_hdr = (start == 0);
+		chunk->version = version;
+		chunk->fill_in_dups = fill_in_dups;
+		chunk->arena = NULL;
+		list_create(&chunk->recs, sizeof (apt_dat_rec_t),
+		    offsetof(apt_dat_rec_t, node));
+		if (end < 0)
+			break;
+		start = end;
 	}
-	ASSERT(!IS_NULL_GEO_POS(arpt->refpt));
+
+	free(line);
+	fclose(fp);
+}
+
+/*
+ * Parses the airports in one apt.dat chunk into chunk->recs. This mirrors
+ * read_apt_dat, except that no duplicate check is performed (that is done
+ * by apt_dat_merge_chunk) and the database isn't touched, so multiple
+ * chunks can be parsed concurrently.
+ */
+static void
+apt_dat_parse_chunk(const airportdb_t *db, apt_dat_chunk_t *chunk,
+    iconv_t *cd_p)
+{
+	FILE *fp;
+	apt_dat_rec_t *rec = NULL;
+	char *line = NULL;
+	size_t linecap = 0;
+	/* only the first chunk contains the header */
+	int line_num = (chunk->has_hdr ? 0 : 2);
+
+	ASSERT(db != NULL);
+	ASSERT(chunk != NULL);
+
+	fp = fopen(chunk->fname, "rb");
+	if (fp == NULL) {
+		logMsg("Can't open %s: %s", chunk->fname, strerror(errno));
+		return;
+	}
+	if (fseek(fp, chunk->start, SEEK_SET) != 0) {
+		logMsg("Error reading %s: %s", chunk->fname, strerror(errno));
+		fclose(fp);
+		return;
+	}
+	while (!feof(fp)) {
+		int row_code;
+
+		if (chunk->end >= 0 && ftell(fp) >= chunk->end)
+			break;
+		line_num++;
+		if (getline(&line, &linecap, fp) <= 0)
+			continue;
+		strip_space(line);
+
+		if (sscanf(line, "%d", &row_code) != 1)
+			continue;
+		/* The version header was read in apt_dat_split_chunks */
+		if (line_num == 2)
+			continue;
+		if (row_code == 1 || row_code == 16 || row_code == 17)
+			rec = NULL;
+		if (row_code == 1) {
+			airport_t *arpt = parse_apt_dat_1_line(NULL, line,
+			    cd_p, chunk->arena, NULL);
+
+			if (arpt != NULL) {
+				rec = safe_calloc(1, sizeof (*rec));
+				lacf_strlcpy(rec->ident, arpt->ident,
+				    sizeof (rec->ident));
+				rec->arpt = arpt;
+				list_insert_tail(&chunk->recs, rec);
+			}
+			continue;
+		}
+		if (rec == NULL)
+			continue;
+		if (chunk->fill_in_dups && row_code == 1302) {
+			rec->meta_lines = safe_realloc(rec->meta_lines,
+			    (rec->n_meta_lines + 1) *
+			    sizeof (*rec->meta_lines));
+			rec->meta_lines[rec->n_meta_lines++] =
+			    safe_strdup(line);
+		}
+		if (rec->arpt != NULL) {
+			parse_apt_dat_line(db, &rec->arpt, line, row_code,
+			    chunk->version);
+		}
+	}
+
+	free(line);
+	fclose(fp);
+}
+
+static void
+apt_dat_parse_chunks(void *userinfo, size_t begin, size_t end)
+{
+	apt_dat_parse_t *parse = userinfo;
+	/* iconv descriptors are stateful, so each thread needs its own */
+	iconv_t cd = iconv_open("ASCII//TRANSLIT", "UTF-8");
+
+	for (size_t i = begin; i < end; i++)
+		apt_dat_parse_chunk(parse->db, &parse->chunks[i], &cd);
+	iconv_close(cd);
+}
+
+/*
+ * Merges the airports parsed from a chunk into the database. This must be
+ * called on the chunks in apt.dat priority & file order, so that the first
+ * apt.dat to define an airport wins, exactly as in read_apt_dat.
+ */
+static void
+apt_dat_merge_chunk(airportdb_t *db, apt_dat_chunk_t *chunk)
+{
+	apt_dat_rec_t *rec;
+
+	ASSERT(db != NULL);
+	ASSERT(chunk != NULL);
+
+	while ((rec = list_remove_head(&chunk->recs)) != NULL) {
+		/*
+		 * Besides the duplicate check, the lookup also loads the
+		 * existing airport (which resolves its runway lengths for
+		 * the index), just like in parse_apt_dat_1_line.
+		 */
+		airport_t *dup_arpt = apt_dat_lookup(db, rec->ident);
+
+		if (dup_arpt != NULL) {
+			if (rec->arpt != NULL)
+				free_airport(rec->arpt);
+			for (size_t i = 0; i < rec->n_meta_lines; i++) {
+				fill_dup_arpt_info(dup_arpt,
+				    rec->meta_lines[i], 1302);
+			}
+		} else {
+			read_apt_dat_insert(db, rec->arpt);
+		}
+		free_strlist(rec->meta_lines, rec->n_meta_lines);
+		free(rec);
+	}
+	list_destroy(&chunk->recs);
+}
+
+/*
+ * Parallel version of calling read_apt_dat on every apt.dat in
+ * `apt_dat_files'. The files are split into chunks, which are parsed on
+ * `tq' into separate airport lists and then merged into the database in
+ * priority order. The resulting database is identical to the serial one.
+ */
+static void
+read_apt_dats_parallel(airportdb_t *db, list_t *apt_dat_files, taskq_t *tq)
+{
+	apt_dat_parse_t parse = { .db = db, .chunks = NULL };
+	size_t n_chunks = 0, cap = 0;
+
+	ASSERT(db != NULL);
+	ASSERT(apt_dat_files != NULL);
+
+	for (apt_dats_entry_t *e = list_head(apt_dat_files); e != NULL;
+	    e = list_next(apt_dat_files, e)) {
+		bool_t fill_in_dups = (list_next(apt_dat_files, e) == NULL);
+		apt_dat_split_chunks(e->fname, fill_in_dups, &parse.chunks,
+		    &n_chunks, &cap);
+	}
+	lacf_parallel_for(tq, 0, n_chunks, 1, apt_dat_parse_chunks, &parse);
+	for (size_t i = 0; i < n_chunks; i++)
+		apt_dat_merge_chunk(db, &parse.chunks[i]);
+	free(parse.chunks);
+}
+
+/*
+ * Binary airport cache. Next to each text tile in the cache, we also keep
+ * a binary copy of it (with a ".bin" suffix), which can be loaded by simply
+ * mapping it into memory, instead of re-parsing the text. The file consists
+ * of a header, followed by flat arrays of fixed-size records and a string
+ * table. The records refer to each other and into the string table by
+ * index and offset, rather than by pointer, and are all naturally aligned,
+ * so they can be read straight out of the mapping. The text tiles remain
+ * the authoritative copy. The binary tiles are generated from them and
+ * whenever a binary tile is missing or fails validation, we fall back to
+ * parsing the text tile. Runway thresholds are stored already projected
+ * into the airport's fpp, which saves load_airport from doing so.
+ */
+#define	ADB_BIN_MAGIC		0x43424441u	/* "ADBC" in little endian */
+#define	ADB_BIN_VERSION		2
+#define	ADB_BIN_SUFFIX		".bin"
+#define	ADB_BIN_NO_STR		UINT32_MAX
+
+typedef struct {
+	uint32_t	magic;		/* ADB_BIN_MAGIC */
+	uint32_t	version;	/* ADB_BIN_VERSION */
+	uint32_t	n_arpts;
+	uint32_t	n_rwys;
+	uint32_t	n_freqs;
+	uint32_t	n_ramps;
+	uint32_t	strtab_sz;	/* bytes */
+	uint32_t	pad;
+} adb_bin_hdr_t;
+
+typedef struct {
+	char		ident[AIRPORTDB_IDENT_LEN];
+	char		icao[AIRPORTDB_ICAO_LEN];
+	char		iata[AIRPORTDB_IATA_LEN];
+	char		cc[AIRPORTDB_CC_LEN];
+	char		cc3[AIRPORTDB_CC_LEN];
+	char		name[24];
+	/* string table offsets, or ADB_BIN_NO_STR */
+	uint32_t	name_orig;
+	uint32_t	country;
+	uint32_t	city;
+	/* ranges in the runway, frequency and ramp start arrays */
+	uint32_t	rwy_idx;
+	uint32_t	n_rwys;
+	uint32_t	freq_idx;
+	uint32_t	n_freqs;
+	uint32_t	ramp_idx;
+	uint32_t	n_ramps;
+	uint32_t	in_navdb;
+	uint32_t	have_iaps;
+	uint32_t	pad;
+	geo_pos3_t	refpt;
+	geo_pos3_t	refpt_m;
+	double		TA;
+	double		TL;
+	double		TA_m;
+	double		TL_m;
+} adb_bin_arpt_t;
+
+typedef struct {
+	char		id[4];
+	uint32_t	pad;
+	geo_pos3_t	thr;
+	geo_pos3_t	thr_m;
+	double		displ;
+	double		blast;
+	double		gpa;
+	double		tch;
+	double		tch_m;
+	vect2_t		dthr_v;		/* thr in the airport's fpp */
+} adb_bin_rwy_end_t;
+
+typedef struct {
+	double			width;
+	adb_bin_rwy_end_t	ends[2];
+	char			joint_id[8];
+	char			rev_joint_id[8];
+	int32_t			surf;
+	uint32_t		pad;
+} adb_bin_rwy_t;
+
+typedef struct {
+	int32_t		type;
+	uint32_t	pad;
+	uint64_t	freq;
+	char		name[32];
+} adb_bin_freq_t;
+
+typedef struct {
+	char		name[32];
+	geo_pos2_t	pos;
+	float		hdgt;
+	int32_t		type;
+} adb_bin_ramp_t;
+
+CTASSERT(sizeof (adb_bin_hdr_t) % 8 == 0);
+CTASSERT(sizeof (adb_bin_arpt_t) % 8 == 0);
+CTASSERT(sizeof (adb_bin_rwy_t) % 8 == 0);
+CTASSERT(sizeof (adb_bin_freq_t) % 8 == 0);
+CTASSERT(sizeof (adb_bin_ramp_t) % 8 == 0);
+CTASSERT(sizeof (((adb_bin_arpt_t *)NULL)->name) ==
+    sizeof (((airport_t *)NULL)->name));
+CTASSERT(sizeof (((adb_bin_rwy_end_t *)NULL)->id) ==
+    sizeof (((runway_end_t *)NULL)->id));
+CTASSERT(sizeof (((adb_bin_rwy_t *)NULL)->joint_id) ==
+    sizeof (((runway_t *)NULL)->joint_id));
+CTASSERT(sizeof (((adb_bin_freq_t *)NULL)->name) ==
+    sizeof (((freq_info_t *)NULL)->name));
+CTASSERT(sizeof (((adb_bin_ramp_t *)NULL)->name) ==
+    sizeof (((ramp_start_t *)NULL)->name));
+
+/* A binary tile being assembled by write_apt_dat_bin */
+typedef struct {
+	adb_bin_hdr_t	hdr;
+	adb_bin_arpt_t	*arpts;
+	adb_bin_rwy_t	*rwys;
+	adb_bin_freq_t	*freqs;
+	adb_bin_ramp_t	*ramps;
+	char		*strtab;
+	size_t		arpts_cap;
+	size_t		rwys_cap;
+	size_t		freqs_cap;
+	size_t		ramps_cap;
+	size_t		strtab_cap;
+} adb_bin_t;
+
+static void *
+adb_bin_grow(void *array, size_t *cap, size_t n, size_t elem_sz)
+{
+	if (n < *cap)
+		return (array);
+	*cap = MAX(*cap * 2, 16);
+	return (safe_realloc(array, *cap * elem_sz));
+}
+
+static uint32_t
+adb_bin_add_str(adb_bin_t *bin, const char *str)
+{
+	size_t l;
+	uint32_t off;
+
+	if (str == NULL)
+		return (ADB_BIN_NO_STR);
+	l = strlen(str) + 1;
+	while (bin->hdr.strtab_sz + l > bin->strtab_cap) {
+		bin->strtab_cap = MAX(bin->strtab_cap * 2, 256);
+		bin->strtab = safe_realloc(bin->strtab, bin->strtab_cap);
+	}
+	off = bin->hdr.strtab_sz;
+	memcpy(&bin->strtab[off], str, l);
+	bin->hdr.strtab_sz += l;
+
+	return (off);
+}
+
+static void
+adb_bin_add_arpt(adb_bin_t *bin, const airport_t *arpt)
+{
+	adb_bin_arpt_t *ba;
+	/* same projection as load_airport, so the thresholds match */
+	fpp_t fpp = ortho_fpp_init(GEO3_TO_GEO2(arpt->refpt), 0, &wgs84,
+	    B_FALSE);
+
+	bin->arpts = adb_bin_grow(bin->arpts, &bin->arpts_cap,
+	    bin->hdr.n_arpts, sizeof (*bin->arpts));
+	ba = &bin->arpts[bin->hdr.n_arpts++];
+	memset(ba, 0, sizeof (*ba));
+	lacf_strlcpy(ba->ident, arpt->ident, sizeof (ba->ident));
+	lacf_strlcpy(ba->icao, arpt->icao, sizeof (ba->icao));
+	lacf_strlcpy(ba->iata, arpt->iata, sizeof (ba->iata));
+	lacf_strlcpy(ba->cc, arpt->cc, sizeof (ba->cc));
+	lacf_strlcpy(ba->cc3, arpt->cc3, sizeof (ba->cc3));
+	lacf_strlcpy(ba->name, arpt->name, sizeof (ba->name));
+	ba->name_orig = adb_bin_add_str(bin, arpt->name_orig);
+	ba->country = adb_bin_add_str(bin, arpt->country);
+	ba->city = adb_bin_add_str(bin, arpt->city);
+	ba->in_navdb = arpt->in_navdb;
+	ba->have_iaps = arpt->have_iaps;
+	ba->refpt = arpt->refpt;
+	ba->refpt_m = arpt->refpt_m;
+	ba->TA = arpt->TA;
+	ba->TL = arpt->TL;
+	ba->TA_m = arpt->TA_m;
+	ba->TL_m = arpt->TL_m;
+
+	ba->rwy_idx = bin->hdr.n_rwys;
+	for (const runway_t *rwy = avl_first(&arpt->rwys); rwy != NULL;
+	    rwy = AVL_NEXT(&arpt->rwys, rwy)) {
+		adb_bin_rwy_t *br;
+
+		bin->rwys = adb_bin_grow(bin->rwys, &bin->rwys_cap,
+		    bin->hdr.n_rwys, sizeof (*bin->rwys));
+		br = &bin->rwys[bin->hdr.n_rwys++];
+		memset(br, 0, sizeof (*br));
+		br->width = rwy->width;
+		for (int i = 0; i < 2; i++) {
+			const runway_end_t *re = &rwy->ends[i];
+			adb_bin_rwy_end_t *bre = &br->ends[i];
+
+			lacf_strlcpy(bre->id, re->id, sizeof (bre->id));
+			bre->thr = re->thr;
+			bre->thr_m = re->thr_m;
+			bre->displ = re->displ;
+			bre->blast = re->blast;
+			bre->gpa = re->gpa;
+			bre->tch = re->tch;
+			bre->tch_m = re->tch_m;
+			bre->dthr_v = geo2fpp(GEO3_TO_GEO2(re->thr), &fpp);
+		}
+		lacf_strlcpy(br->joint_id, rwy->joint_id,
+		    sizeof (br->joint_id));
+		lacf_strlcpy(br->rev_joint_id, rwy->rev_joint_id,
+		    sizeof (br->rev_joint_id));
+		br->surf = rwy->surf;
+		ba->n_rwys++;
+	}
+	ba->freq_idx = bin->hdr.n_freqs;
+	for (const freq_info_t *freq = list_head(&arpt->freqs); freq != NULL;
+	    freq = list_next(&arpt->freqs, freq)) {
+		adb_bin_freq_t *bf;
+
+		bin->freqs = adb_bin_grow(bin->freqs, &bin->freqs_cap,
+		    bin->hdr.n_freqs, sizeof (*bin->freqs));
+		bf = &bin->freqs[bin->hdr.n_freqs++];
+		memset(bf, 0, sizeof (*bf));
+		bf->type = freq->type;
+		bf->freq = freq->freq;
+		lacf_strlcpy(bf->name, freq->name, sizeof (bf->name));
+		ba->n_freqs++;
+	}
+	ba->ramp_idx = bin->hdr.n_ramps;
+	for (const ramp_start_t *rs = avl_first(&arpt->ramp_starts);
+	    rs != NULL; rs = AVL_NEXT(&arpt->ramp_starts, rs)) {
+		adb_bin_ramp_t *br;
+
+		bin->ramps = adb_bin_grow(bin->ramps, &bin->ramps_cap,
+		    bin->hdr.n_ramps, sizeof (*bin->ramps));
+		br = &bin->ramps[bin->hdr.n_ramps++];
+		memset(br, 0, sizeof (*br));
+		lacf_strlcpy(br->name, rs->name, sizeof (br->name));
+		br->pos = rs->pos;
+		br->hdgt = rs->hdgt;
+		br->type = rs->type;
+		ba->n_ramps++;
+	}
+}
+
+static bool_t
+adb_bin_fwrite(FILE *fp, const void *buf, size_t n, size_t elem_sz)
+{
+	return (n == 0 || fwrite(buf, elem_sz, n, fp) == n);
+}
+
+/*
+ * Generates the binary version of the text cache tile in `fname'. To
+ * guarantee that loading either one results in exactly the same airports,
+ * the binary tile is produced by parsing the text tile, just like
+ * load_airports_in_tile would.
+ */
+static bool_t
+write_apt_dat_bin(const airportdb_t *db, const char *fname)
+{
+	apt_dat_chunk_t *chunks = NULL;
+	size_t n_chunks = 0, cap = 0;
+	adb_bin_t bin = {
+	    .hdr = { .magic = ADB_BIN_MAGIC, .version = ADB_BIN_VERSION }
+	};
+	char *bin_fname;
+	FILE *fp;
+	bool_t res;
+
+	ASSERT(db != NULL);
+	ASSERT(fname != NULL);
+
+	apt_dat_split_chunks(fname, B_FALSE, &chunks, &n_chunks, &cap);
+	for (size_t i = 0; i < n_chunks; i++) {
+		apt_dat_rec_t *rec;
+
+		apt_dat_parse_chunk(db, &chunks[i], NULL);
+		while ((rec = list_remove_head(&chunks[i].recs)) != NULL) {
+			/* Same as read_apt_dat_insert */
+			if (rec->arpt != NULL) {
+				if (avl_numnodes(&rec->arpt->rwys) != 0)
+					adb_bin_add_arpt(&bin, rec->arpt);
+				free_airport(rec->arpt);
+			}
+			free(rec);
+		}
+		list_destroy(&chunks[i].recs);
+	}
+	free(chunks);
+
+	bin_fname = sprintf_alloc("%s" ADB_BIN_SUFFIX, fname);
+	fp = fopen(bin_fname, "wb");
+	if (fp == NULL) {
+		logMsg("Error writing file %s: %s", bin_fname,
+		    strerror(errno));
+		res = B_FALSE;
+		goto out;
+	}
+	res = (adb_bin_fwrite(fp, &bin.hdr, 1, sizeof (bin.hdr)) &&
+	    adb_bin_fwrite(fp, bin.arpts, bin.hdr.n_arpts,
+	    sizeof (*bin.arpts)) &&
+	    adb_bin_fwrite(fp, bin.rwys, bin.hdr.n_rwys,
+	    sizeof (*bin.rwys)) &&
+	    adb_bin_fwrite(fp, bin.freqs, bin.hdr.n_freqs,
+	    sizeof (*bin.freqs)) &&
+	    adb_bin_fwrite(fp, bin.ramps, bin.hdr.n_ramps,
+	    sizeof (*bin.ramps)) &&
+	    adb_bin_fwrite(fp, bin.strtab, bin.hdr.strtab_sz, 1));
+	if (fclose(fp) != 0)
+		res = B_FALSE;
+	if (!res) {
+		logMsg("Error writing file %s: %s", bin_fname,
+		    strerror(errno));
+		(void) remove_file(bin_fname, B_TRUE);
+	}
+out:
+	free(bin_fname);
+	free(bin.arpts);
+	free(bin.rwys);
+	free(bin.freqs);
+	free(bin.ramps);
+	free(bin.strtab);
+
+	return (res);
+}
+
+static bool_t
+adb_bin_str_ok(const char *str, size_t cap)
+{
+	return (memchr(str, '\0', cap) != NULL);
+}
+
+static bool_t
+adb_bin_strtab_ok(uint32_t off, uint32_t strtab_sz)
+{
+	return (off == ADB_BIN_NO_STR || off < strtab_sz);
+}
+
+static bool_t
+adb_bin_range_ok(uint32_t idx, uint32_t n, uint32_t total)
+{
+	return ((uint64_t)idx + n <= total);
+}
+
+/*
+ * Checks that the mapped binary tile in `buf' is complete and consistent,
+ * so that the loader doesn't need to worry about any out-of-bounds access.
+ */
+static bool_t
+adb_bin_validate(const uint8_t *buf, size_t sz)
+{
+	const adb_bin_hdr_t *hdr = (const adb_bin_hdr_t *)buf;
+	const adb_bin_arpt_t *arpts;
+	const adb_bin_rwy_t *rwys;
+	const adb_bin_freq_t *freqs;
+	const adb_bin_ramp_t *ramps;
+	const char *strtab;
+
+	if (sz < sizeof (*hdr) || hdr->magic != ADB_BIN_MAGIC ||
+	    hdr->version != ADB_BIN_VERSION) {
+		return (B_FALSE);
+	}
+	if (sizeof (*hdr) + (uint64_t)hdr->n_arpts * sizeof (*arpts) +
+	    (uint64_t)hdr->n_rwys * sizeof (*rwys) +
+	    (uint64_t)hdr->n_freqs * sizeof (*freqs) +
+	    (uint64_t)hdr->n_ramps * sizeof (*ramps) +
+	    hdr->strtab_sz != sz) {
+		return (B_FALSE);
+	}
+	arpts = (const adb_bin_arpt_t *)&buf[sizeof (*hdr)];
+	rwys = (const adb_bin_rwy_t *)&arpts[hdr->n_arpts];
+	freqs = (const adb_bin_freq_t *)&rwys[hdr->n_rwys];
+	ramps = (const adb_bin_ramp_t *)&freqs[hdr->n_freqs];
+	strtab = (const char *)&ramps[hdr->n_ramps];
+	if (hdr->strtab_sz != 0 && strtab[hdr->strtab_sz - 1] != '\0')
+		return (B_FALSE);
+
+	for (uint32_t i = 0; i < hdr->n_arpts; i++) {
+		const adb_bin_arpt_t *ba = &arpts[i];
+
+		if (!adb_bin_str_ok(ba->ident, sizeof (ba->ident)) ||
+		    !adb_bin_str_ok(ba->icao, sizeof (ba->icao)) ||
+		    !adb_bin_str_ok(ba->iata, sizeof (ba->iata)) ||
+		    !adb_bin_str_ok(ba->cc, sizeof (ba->cc)) ||
+		    !adb_bin_str_ok(ba->cc3, sizeof (ba->cc3)) ||
+		    !adb_bin_str_ok(ba->name, sizeof (ba->name)) ||
+		    !adb_bin_strtab_ok(ba->name_orig, hdr->strtab_sz) ||
+		    !adb_bin_strtab_ok(ba->country, hdr->strtab_sz) ||
+		    !adb_bin_strtab_ok(ba->city, hdr->strtab_sz) ||
+		    ba->n_rwys == 0 ||
+		    !adb_bin_range_ok(ba->rwy_idx, ba->n_rwys, hdr->n_rwys) ||
+		    !adb_bin_range_ok(ba->freq_idx, ba->n_freqs,
+		    hdr->n_freqs) ||
+		    !adb_bin_range_ok(ba->ramp_idx, ba->n_ramps,
+		    hdr->n_ramps) ||
+		    !is_valid_lat(ba->refpt.lat) ||
+		    !is_valid_lon(ba->refpt.lon)) {
+			return (B_FALSE);
+		}
+	}
+	for (uint32_t i = 0; i < hdr->n_rwys; i++) {
+		const adb_bin_rwy_t *br = &rwys[i];
+
+		if (!adb_bin_str_ok(br->ends[0].id, sizeof (br->ends[0].id)) ||
+		    !adb_bin_str_ok(br->ends[1].id, sizeof (br->ends[1].id)) ||
+		    !adb_bin_str_ok(br->joint_id, sizeof (br->joint_id)) ||
+		    !adb_bin_str_ok(br->rev_joint_id,
+		    sizeof (br->rev_joint_id)) ||
+		    !isfinite(br->ends[0].dthr_v.x) ||
+		    !isfinite(br->ends[0].dthr_v.y) ||
+		    !isfinite(br->ends[1].dthr_v.x) ||
+		    !isfinite(br->ends[1].dthr_v.y)) {
+			return (B_FALSE);
+		}
+	}
+	for (uint32_t i = 0; i < hdr->n_freqs; i++) {
+		if (!adb_bin_str_ok(freqs[i].name, sizeof (freqs[i].name)) ||
+		    freqs[i].type < FREQ_TYPE_REC ||
+		    freqs[i].type > FREQ_TYPE_DEP) {
+			return (B_FALSE);
+		}
+	}
+	for (uint32_t i = 0; i < hdr->n_ramps; i++) {
+		if (!adb_bin_str_ok(ramps[i].name, sizeof (ramps[i].name)) ||
+		    ramps[i].type < RAMP_START_GATE ||
+		    ramps[i].type > RAMP_START_MISC) {
+			return (B_FALSE);
+		}
+	}
+
+	return (B_TRUE);
+}
+
+static airport_t *
+adb_bin_load_arpt(const adb_bin_arpt_t *ba, const adb_bin_rwy_t *rwys,
+    const adb_bin_freq_t *freqs, const adb_bin_ramp_t *ramps,
+    const char *strtab, adb_arena_t *arena)
+{
+	airport_t *arpt = airport_alloc(arena);
+
+	lacf_strlcpy(arpt->ident, ba->ident, sizeof (arpt->ident));
+	lacf_strlcpy(arpt->icao, ba->icao, sizeof (arpt->icao));
+	lacf_strlcpy(arpt->iata, ba->iata, sizeof (arpt->iata));
+	lacf_strlcpy(arpt->cc, ba->cc, sizeof (arpt->cc));
+	lacf_strlcpy(arpt->cc3, ba->cc3, sizeof (arpt->cc3));
+	lacf_strlcpy(arpt->name, ba->name, sizeof (arpt->name));
+	if (ba->name_orig != ADB_BIN_NO_STR)
+		arpt->name_orig = arpt_strdup(arpt, &strtab[ba->name_orig]);
+	if (ba->country != ADB_BIN_NO_STR)
+		arpt->country = arpt_strdup(arpt, &strtab[ba->country]);
+	if (ba->city != ADB_BIN_NO_STR)
+		arpt->city = arpt_strdup(arpt, &strtab[ba->city]);
+	arpt->refpt = ba->refpt;
+	arpt->refpt_m = ba->refpt_m;
+	arpt->TA = ba->TA;
+	arpt->TL = ba->TL;
+	arpt->TA_m = ba->TA_m;
+	arpt->TL_m = ba->TL_m;
+	arpt->in_navdb = ba->in_navdb;
+	arpt->have_iaps = ba->have_iaps;
+
+	for (uint32_t i = 0; i < ba->n_rwys; i++) {
+		const adb_bin_rwy_t *br = &rwys[ba->rwy_idx + i];
+		runway_t *rwy = arpt_zalloc(arpt, sizeof (*rwy));
+
+		rwy->arpt = arpt;
+		rwy->width = br->width;
+		for (int j = 0; j < 2; j++) {
+			const adb_bin_rwy_end_t *bre = &br->ends[j];
+			runway_end_t *re = &rwy->ends[j];
+
+			lacf_strlcpy(re->id, bre->id, sizeof (re->id));
+			re->thr = bre->thr;
+			re->thr_m = bre->thr_m;
+			re->displ = bre->displ;
+			re->blast = bre->blast;
+			re->gpa = bre->gpa;
+			re->tch = bre->tch;
+			re->tch_m = bre->tch_m;
+			re->dthr_v = bre->dthr_v;
+		}
+		lacf_strlcpy(rwy->joint_id, br->joint_id,
+		    sizeof (rwy->joint_id));
+		lacf_strlcpy(rwy->rev_joint_id, br->rev_joint_id,
+		    sizeof (rwy->rev_joint_id));
+		rwy->surf = br->surf;
+		if (avl_find(&arpt->rwys, rwy, NULL) == NULL)
+			avl_add(&arpt->rwys, rwy);
+		else
+			arpt_free(arpt, rwy);
+	}
+	for (uint32_t i = 0; i < ba->n_freqs; i++) {
+		const adb_bin_freq_t *bf = &freqs[ba->freq_idx + i];
+		freq_info_t *freq = arpt_zalloc(arpt, sizeof (*freq));
+
+		freq->type = bf->type;
+		freq->freq = bf->freq;
+		lacf_strlcpy(freq->name, bf->name, sizeof (freq->name));
+		list_insert_tail(&arpt->freqs, freq);
+	}
+	for (uint32_t i = 0; i < ba->n_ramps; i++) {
+		const adb_bin_ramp_t *br = &ramps[ba->ramp_idx + i];
+		ramp_start_t *rs = arpt_zalloc(arpt, sizeof (*rs));
+
+		lacf_strlcpy(rs->name, br->name, sizeof (rs->name));
+		rs->pos = br->pos;
+		rs->hdgt = br->hdgt;
+		rs->type = br->type;
+		if (avl_find(&arpt->ramp_starts, rs, NULL) == NULL)
+			avl_add(&arpt->ramp_starts, rs);
+		else
+			arpt_free(arpt, rs);
+	}
+
+	return (arpt);
+}
+
+static size_t
+adb_bin_str_mem(const char *strtab, uint32_t off)
+{
+	if (off == ADB_BIN_NO_STR)
+		return (0);
+	return (ARENA_ROUNDUP(strlen(&strtab[off]) + 1));
+}
+
+static bool_t
+adb_bin_str_eq(const char *strtab, uint32_t off1, uint32_t off2)
+{
+	if (off1 == ADB_BIN_NO_STR || off2 == ADB_BIN_NO_STR)
+		return (off1 == off2);
+	return (strcmp(&strtab[off1], &strtab[off2]) == 0);
+}
+
+/*
+ * Arena bytes which adb_bin_load_arpt takes up for `ba'. Runway geometry
+ * is only allocated once an airport is loaded, so it's only counted if
+ * `with_geom' is set. Country and city names are interned, so they're
+ * only counted if they differ from those of `prev' (the previous airport
+ * constructed, if any), which catches most of the repeats in a tile.
+ */
+static size_t
+adb_bin_arpt_mem(const adb_bin_arpt_t *ba, const adb_bin_arpt_t *prev,
+    const char *strtab, bool_t with_geom)
+{
+	size_t sz = ARENA_ROUNDUP(sizeof (airport_t)) +
+	    ba->n_rwys * ARENA_ROUNDUP(sizeof (runway_t)) +
+	    ba->n_freqs * ARENA_ROUNDUP(sizeof (freq_info_t)) +
+	    ba->n_ramps * ARENA_ROUNDUP(sizeof (ramp_start_t)) +
+	    adb_bin_str_mem(strtab, ba->name_orig);
+
+	if (prev == NULL || !adb_bin_str_eq(strtab, ba->country, prev->country))
+		sz += adb_bin_str_mem(strtab, ba->country);
+	if (prev == NULL || !adb_bin_str_eq(strtab, ba->city, prev->city))
+		sz += adb_bin_str_mem(strtab, ba->city);
+	if (with_geom)
+		sz += ARENA_ROUNDUP(RWY_GEOM_SZ(ba->n_rwys));
+
+	return (sz);
+}
+
+/*
+ * Constructs the airports of a tile from its binary cache file and passes
+ * them to `insert_cb'. Airports for which the optional `skip_cb' returns
+ * B_TRUE aren't constructed at all. The airports are allocated from
+ * `arena', which is sized to fit the airports constructed, plus their
+ * runway geometry if `with_geom' is set (i.e. if the caller is going to
+ * load all of them right away). Returns B_FALSE if the file doesn't
+ * exist or is invalid, in which case nothing has been loaded and the
+ * caller should fall back to the text tile.
+ */
+static bool_t
+load_apt_dat_bin_impl(const char *fname, adb_arena_t *arena,
+    bool_t with_geom, bool_t (*skip_cb)(void *userinfo, const char *ident),
+    void (*insert_cb)(void *userinfo, airport_t *arpt), void *userinfo)
+{
+	size_t sz, mem = 0;
+	uint8_t *buf;
+	const adb_bin_hdr_t *hdr;
+	const adb_bin_arpt_t *arpts, *prev = NULL;
+	const adb_bin_rwy_t *rwys;
+	const adb_bin_freq_t *freqs;
+	const adb_bin_ramp_t *ramps;
+	const char *strtab;
+	bool_t *skip = NULL;
+
+	ASSERT(fname != NULL);
+	ASSERT(insert_cb != NULL);
+
+	buf = file2mmap(fname, &sz);
+	if (buf == NULL)
+		return (B_FALSE);
+	if (!adb_bin_validate(buf, sz)) {
+		logMsg("%s: invalid binary airport cache file, falling back "
+		    "to text cache", fname);
+		file_unmap(buf, sz);
+		return (B_FALSE);
+	}
+	hdr = (const adb_bin_hdr_t *)buf;
+	arpts = (const adb_bin_arpt_t *)&buf[sizeof (*hdr)];
+	rwys = (const adb_bin_rwy_t *)&arpts[hdr->n_arpts];
+	freqs = (const adb_bin_freq_t *)&rwys[hdr->n_rwys];
+	ramps = (const adb_bin_ramp_t *)&freqs[hdr->n_freqs];
+	strtab = (const char *)&ramps[hdr->n_ramps];
+
+	/* skip_cb can have side effects, so only call it once per airport */
+	if (skip_cb != NULL) {
+		skip = safe_calloc(MAX(hdr->n_arpts, 1), sizeof (*skip));
+		for (uint32_t i = 0; i < hdr->n_arpts; i++)
+			skip[i] = skip_cb(userinfo, arpts[i].ident);
+	}
+	if (arena != NULL) {
+		for (uint32_t i = 0; i < hdr->n_arpts; i++) {
+			if (skip != NULL && skip[i])
+				continue;
+			mem += adb_bin_arpt_mem(&arpts[i], prev, strtab,
+			    with_geom);
+			prev = &arpts[i];
+		}
+		arena_reserve(arena, mem);
+	}
+
+	for (uint32_t i = 0; i < hdr->n_arpts; i++) {
+		if (skip != NULL && skip[i])
+			continue;
+		insert_cb(userinfo, adb_bin_load_arpt(&arpts[i], rwys,
+		    freqs, ramps, strtab, arena));
+	}
+	free(skip);
+	file_unmap(buf, sz);
+
+	return (B_TRUE);
+}
+
+static bool_t
+load_apt_dat_bin_skip(void *userinfo, const char *ident)
+{
+	/* Same duplicate check as parse_apt_dat_1_line */
+	return (apt_dat_lookup(userinfo, ident) != NULL);
+}
+
+static void
+load_apt_dat_bin_insert(void *userinfo, airport_t *arpt)
+{
+	read_apt_dat_insert(userinfo, arpt);
+}
+
+/*
+ * Loads the airports of a tile from its binary cache file into the
+ * database. See load_apt_dat_bin_impl for the return value.
+ */
+static bool_t
+load_apt_dat_bin(airportdb_t *db, const char *fname, adb_arena_t *arena)
+{
+	ASSERT(db != NULL);
+	return (load_apt_dat_bin_impl(fname, arena, B_FALSE,
+	    load_apt_dat_bin_skip, load_apt_dat_bin_insert, db));
+}
+
+static void
+write_apt_dat_arpt(FILE *fp, const airport_t *arpt)
+{
+	ASSERT(fp != NULL);
+	ASSERT(arpt != NULL);
+	ASSERT(!IS_NULL_GEO_POS(arpt->refpt));
 
 	fprintf(fp, "1 %.0f 0 0 %s %s\n"
 	    "1302 datum_lat %f\n"
@@ -1797,22 +3070,132 @@ write_apt_dat(const airportdb_t *db, const airport_t *arpt)
 		    (unsigned long)floor(freq->freq / 1000), freq->name);
 	}
 	fprintf(fp, "\n");
-	fclose(fp);
-	free(fname);
-
-	return (B_TRUE);
 }
 
+/*
+ * Writes the cache file of a geo table tile, containing all of the tile's
+ * airports in ident order.
+ */
 static bool_t
-load_arinc424_arpt_data(const char *filename, airport_t *arpt)
+write_apt_dat(const airportdb_t *db, const tile_t *tile)
 {
-	char *line = NULL;
-	size_t linecap = 0;
+	char lat_lon[16];
+	char *fname;
 	FILE *fp;
-	int line_num = 0;
 
-	ASSERT(filename != NULL);
-	ASSERT(arpt != NULL);
+	ASSERT(db != NULL);
+	ASSERT(tile != NULL);
+
+	snprintf(lat_lon, sizeof (lat_lon), TILE_NAME_FMT, tile->pos.lat,
+	    tile->pos.lon);
+	fname = apt_dat_cache_dir(db, tile->pos, lat_lon);
+	fp = fopen(fname, "w");
+	if (fp == NULL) {
+		logMsg("Error writing file %s: %s", fname, strerror(errno));
+		free(fname);
+		return (B_FALSE);
+	}
+	fprintf(fp, "I\n"
+	    "1200 libacfutils airportdb version %d\n"
+	    "\n", ARPTDB_CACHE_VERSION);
+	for (const airport_t *arpt = avl_first(&tile->arpts); arpt != NULL;
+	    arpt = AVL_NEXT(&tile->arpts, arpt))
+		write_apt_dat_arpt(fp, arpt);
+	fclose(fp);
+	/*
+	 * The binary tile is just an accelerator, if we fail to write it,
+	 * we simply keep using the text tile.
+	 */
+	if (db->binary_cache)
+		(void) write_apt_dat_bin(db, fname);
+	free(fname);
+
+	return (B_TRUE);
+}
+
+typedef struct {
+	const airportdb_t	*db;
+	const tile_t		**tiles;
+	bool_t			success;	/* atomic */
+} apt_dat_write_t;
+
+static void
+write_apt_dats(void *userinfo, size_t begin, size_t end)
+{
+	apt_dat_write_t *wr = userinfo;
+
+	for (size_t i = begin; i < end; i++) {
+		if (!write_apt_dat(wr->db, wr->tiles[i])) {
+			__atomic_store_n(&wr->success, B_FALSE,
+			    __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/*
+ * Writes the cache files of all non-empty geo table tiles. Each tile goes
+ * into its own file, so the tiles can be written concurrently on `tq'.
+ * If `dirty_only' is set, only the tiles modified by an incremental update
+ * are written and the files of any tiles which were left empty by it are
+ * removed.
+ */
+static bool_t
+write_apt_dat_tiles(airportdb_t *db, taskq_t *tq, bool_t dirty_only)
+{
+	apt_dat_write_t wr = { .db = db, .success = B_TRUE };
+	size_t n_tiles = 0;
+
+	ASSERT(db != NULL);
+
+	wr.tiles = safe_calloc(MAX(avl_numnodes(&db->geo_table), 1),
+	    sizeof (*wr.tiles));
+	for (tile_t *tile = avl_first(&db->geo_table); tile != NULL;
+	    tile = AVL_NEXT(&db->geo_table, tile)) {
+		char *dirname;
+
+		if (dirty_only) {
+			if (!tile->dirty)
+				continue;
+			tile->dirty = B_FALSE;
+		}
+		if (avl_numnodes(&tile->arpts) == 0) {
+			if (dirty_only) {
+				char *fname = tile_cache_fname(db, tile->pos);
+				char *bin_fname = sprintf_alloc("%s"
+				    ADB_BIN_SUFFIX, fname);
+
+				(void) remove_file(fname, B_TRUE);
+				(void) remove_file(bin_fname, B_TRUE);
+				free(bin_fname);
+				free(fname);
+			}
+			continue;
+		}
+		dirname = apt_dat_cache_dir(db, tile->pos, NULL);
+		if (!create_directory(dirname)) {
+			free(dirname);
+			free(wr.tiles);
+			return (B_FALSE);
+		}
+		free(dirname);
+		wr.tiles[n_tiles++] = tile;
+	}
+	lacf_parallel_for(tq, 0, n_tiles, 1, write_apt_dats, &wr);
+	free(wr.tiles);
+
+	return (wr.success);
+}
+
+static bool_t
+load_arinc424_arpt_data(const char *filename, airport_t *arpt)
+{
+	char *line = NULL;
+	size_t linecap = 0;
+	FILE *fp;
+	int line_num = 0;
+
+	ASSERT(filename != NULL);
+	ASSERT(arpt != NULL);
 
 	/* airport already seen in previous version of the database, skip */
 	if (arpt->in_navdb)
@@ -1951,15 +3334,24 @@ load_CIFP_file(airportdb_t *db, const char *dirpath, const char *filename)
 	return (res);
 }
 
+typedef void (*CIFP_file_cb_t)(const char *dirpath, const char *filename,
+    void *userinfo);
+
+static void
+load_CIFP_file_cb(const char *dirpath, const char *filename, void *userinfo)
+{
+	(void) load_CIFP_file(userinfo, dirpath, filename);
+}
+
 /*
- * Loads all ARINC424-formatted procedures files from a CIFP directory
- * in the new X-Plane 11 navdata. This has to be OS-specific, because
+ * Calls `cb' on every file in a CIFP directory in the new X-Plane 11
+ * navdata, in directory order. This has to be OS-specific, because
  * directory enumeration isn't portable.
  */
 #if	IBM
 
 static bool_t
-load_CIFP_dir(airportdb_t *db, const char *dirpath)
+walk_CIFP_dir(const char *dirpath, CIFP_file_cb_t cb, void *userinfo)
 {
 	int dirpath_len = strlen(dirpath);
 	TCHAR *dirnameT = safe_calloc(dirpath_len + 1, sizeof (*dirnameT));
@@ -1967,8 +3359,8 @@ load_CIFP_dir(airportdb_t *db, const char *dirpath)
 	WIN32_FIND_DATA find_data;
 	HANDLE h_find;
 
-	ASSERT(db != NULL);
 	ASSERT(dirpath != NULL);
+	ASSERT(cb != NULL);
 
 	MultiByteToWideChar(CP_UTF8, 0, dirpath, -1, dirnameT, dirpath_len + 1);
 	StringCchPrintf(srchnameT, dirpath_len + 4, TEXT("%s\\*"), dirnameT);
@@ -1985,7 +3377,7 @@ load_CIFP_dir(airportdb_t *db, const char *dirpath)
 		char *filename = safe_calloc(l, sizeof (*filename));
 		WideCharToMultiByte(CP_UTF8, 0, find_data.cFileName, -1,
 		    filename, l, NULL, NULL);
-		(void) load_CIFP_file(db, dirpath, filename);
+		cb(dirpath, filename, userinfo);
 		free(filename);
 	} while (FindNextFile(h_find, &find_data));
 
@@ -2002,13 +3394,13 @@ errout:
 #else	/* !IBM */
 
 static bool_t
-load_CIFP_dir(airportdb_t *db, const char *dirpath)
+walk_CIFP_dir(const char *dirpath, CIFP_file_cb_t cb, void *userinfo)
 {
 	DIR *dp = opendir(dirpath);
 	struct dirent *de;
 
-	ASSERT(db != NULL);
 	ASSERT(dirpath != NULL);
+	ASSERT(cb != NULL);
 
 	if (dp == NULL)
 		return (B_FALSE);
@@ -2017,7 +3409,7 @@ load_CIFP_dir(airportdb_t *db, const char *dirpath)
 		if (strcmp(de->d_name, ".") == 0 ||
 		    strcmp(de->d_name, "..") == 0)
 			continue;
-		(void) load_CIFP_file(db, dirpath, de->d_name);
+		cb(dirpath, de->d_name, userinfo);
 	}
 
 	closedir(dp);
@@ -2027,6 +3419,16 @@ load_CIFP_dir(airportdb_t *db, const char *dirpath)
 
 #endif	/* !IBM */
 
+/*
+ * Loads all ARINC424-formatted procedures files from a CIFP directory.
+ */
+static bool_t
+load_CIFP_dir(airportdb_t *db, const char *dirpath)
+{
+	ASSERT(db != NULL);
+	return (walk_CIFP_dir(dirpath, load_CIFP_file_cb, db));
+}
+
 /*
  * Initiates the supplemental information loading from X-Plane 11 navdata.
  * Here we try to determine, for runways which lacked that info in apt.dat,
@@ -2062,6 +3464,88 @@ load_xp11_navdata(airportdb_t *db)
 	return (success);
 }
 
+static bool_t
+write_bin_cache_version(const airportdb_t *db)
+{
+	char *filename = mkpathname(db->cachedir, "bin_version", NULL);
+	FILE *fp = fopen(filename, "w");
+
+	if (fp == NULL) {
+		logMsg("Error writing new airport database, can't open "
+		    "%s for writing: %s", filename, strerror(errno));
+		free(filename);
+		return (B_FALSE);
+	}
+	fprintf(fp, "%d", ADB_BIN_VERSION);
+	fclose(fp);
+	free(filename);
+
+	return (B_TRUE);
+}
+
+static bool_t
+is_tile_name(const char *name)
+{
+	/* Must match TILE_NAME_FMT, e.g. "+45-075" */
+	if (strlen(name) != 7 || (name[0] != '+' && name[0] != '-') ||
+	    (name[3] != '+' && name[3] != '-'))
+		return (B_FALSE);
+	for (int i = 1; i < 7; i++) {
+		if (i != 3 && !isdigit((unsigned char)name[i]))
+			return (B_FALSE);
+	}
+	return (B_TRUE);
+}
+
+/*
+ * Brings the binary tiles of an otherwise up-to-date cache to the current
+ * ADB_BIN_VERSION by regenerating them from the text tiles. This way,
+ * enabling the binary cache, or changing its format, doesn't require
+ * rebuilding the entire cache from X-Plane's scenery.
+ */
+static bool_t
+migrate_bin_cache(const airportdb_t *db)
+{
+	DIR *dp;
+	struct dirent *de;
+
+	ASSERT(db != NULL);
+
+	dp = opendir(db->cachedir);
+	if (dp == NULL)
+		return (B_FALSE);
+	logMsg("Migrating airport database cache in %s to binary format "
+	    "version %d", db->cachedir, ADB_BIN_VERSION);
+	while ((de = readdir(dp)) != NULL) {
+		char *dirpath;
+		DIR *subdp;
+		struct dirent *subde;
+
+		if (!is_tile_name(de->d_name))
+			continue;
+		dirpath = mkpathname(db->cachedir, de->d_name, NULL);
+		subdp = opendir(dirpath);
+		if (subdp == NULL) {
+			free(dirpath);
+			continue;
+		}
+		while ((subde = readdir(subdp)) != NULL) {
+			char *fname;
+
+			if (!is_tile_name(subde->d_name))
+				continue;
+			fname = mkpathname(dirpath, subde->d_name, NULL);
+			(void) write_apt_dat_bin(db, fname);
+			free(fname);
+		}
+		closedir(subdp);
+		free(dirpath);
+	}
+	closedir(dp);
+
+	return (write_bin_cache_version(db));
+}
+
 /*
  * Checks to make sure our data cache is up to the newest version.
  */
@@ -2086,6 +3570,32 @@ check_cache_version(const airportdb_t *db, int app_version)
 	return (version == (ARPTDB_CACHE_VERSION | (app_version << 16)));
 }
 
+/*
+ * Same as check_cache_version, but for the binary cache. Since the binary
+ * cache is generated from the text cache, an outdated binary cache is
+ * simply migrated in place.
+ */
+static bool_t
+check_bin_cache_version(const airportdb_t *db)
+{
+	char *version_str;
+	int version = -1;
+
+	ASSERT(db != NULL);
+
+	if (!db->binary_cache)
+		return (B_TRUE);
+	if ((version_str = file2str(db->cachedir, "bin_version",
+	    NULL)) != NULL) {
+		version = atoi(version_str);
+		free(version_str);
+	}
+	if (version == ADB_BIN_VERSION)
+		return (B_TRUE);
+	/* If the migration fails, force a full rebuild */
+	return (migrate_bin_cache(db));
+}
+
 /**
  * Attempts to determine the AIRAC cycle currently in use in the navdata
  * on X-Plane 11/12. Sadly, there doesn't seem to be a nice data field for
@@ -2233,25 +3743,19 @@ destroy_apt_dats_list(list_t *list)
 	list_destroy(list);
 }
 
+/*
+ * Checks that the cache was built from exactly the apt.dats in
+ * `xp_apt_dats', in the same order.
+ */
 static bool_t
-cache_up_to_date(airportdb_t *db, list_t *xp_apt_dats, int app_version)
+apt_dats_list_matches(const airportdb_t *db, list_t *xp_apt_dats)
 {
 	list_t db_apt_dats;
 	bool_t result = B_TRUE;
 	apt_dats_entry_t *xp_e, *db_e;
-	bool_t vers_ok, cycle_ok;
 
 	ASSERT(db != NULL);
 	ASSERT(xp_apt_dats != NULL);
-	/*
-	 * We need to call both of these functions because check_airac_cycle
-	 * establishes what AIRAC cycle X-Plane uses and modifies `db', so
-	 * we'll need it later on when recreating the cache.
-	 */
-	vers_ok = check_cache_version(db, app_version);
-	cycle_ok = check_airac_cycle(db);
-	if (!vers_ok || !cycle_ok)
-		return (B_FALSE);
 
 	list_create(&db_apt_dats, sizeof (apt_dats_entry_t),
 	    offsetof(apt_dats_entry_t, node));
@@ -2314,155 +3818,1208 @@ create_arpt_index(airportdb_t *db, const airport_t *arpt)
 	return (idx);
 }
 
-static bool_t
-read_index_dat(airportdb_t *db)
+static bool_t
+read_index_dat(airportdb_t *db)
+{
+	char *index_filename;
+	FILE *index_file;
+	char *line = NULL;
+	size_t line_cap = 0;
+	size_t num_lines = 0;
+
+	ASSERT(db != NULL);
+	index_filename = mkpathname(db->cachedir, "index.dat", NULL);
+	index_file = fopen(index_filename, "r");
+
+	if (index_file == NULL)
+		return (B_FALSE);
+
+	if (!db->override_settings) {
+		conf_t *conf;
+		char *filename = mkpathname(db->cachedir, "settings.conf",
+		    NULL);
+
+		if (file_exists(filename, NULL) &&
+		    (conf = conf_read_file(filename, NULL)) != NULL) {
+			conf_get_b(conf, "ifr_only", &db->ifr_only);
+			conf_get_b(conf, "normalize_gate_names",
+			    &db->normalize_gate_names);
+			conf_free(conf);
+		}
+		LACF_DESTROY(filename);
+	}
+	while (lacf_getline(&line, &line_cap, index_file) > 0)
+		num_lines++;
+	rewind(index_file);
+
+	recreate_icao_iata_tables(db, num_lines);
+
+	while (lacf_getline(&line, &line_cap, index_file) > 0) {
+		arpt_index_t *idx = safe_calloc(1, sizeof (*idx));
+		avl_index_t where;
+
+		if (sscanf(line, "%7s %7s %3s %2s %f %f %f %hu %hu %hu",
+		    idx->ident, idx->icao, idx->iata, idx->cc,
+		    &idx->pos.lat, &idx->pos.lon, &idx->pos.elev,
+		    &idx->max_rwy_len, &idx->TA, &idx->TL) != 10) {
+			free(idx);
+			continue;
+		}
+		if (avl_find(&db->arpt_index, idx, &where) == NULL) {
+			avl_insert(&db->arpt_index, idx, where);
+			htbl2_set(&db->icao_index, idx->icao,
+			    sizeof (idx->icao), idx, sizeof (*idx));
+			if (strcmp(idx->iata, "-") != 0) {
+				htbl2_set(&db->iata_index, idx->iata,
+				    sizeof (idx->iata), idx, sizeof (*idx));
+			}
+		} else {
+			logMsg("WARNING: found duplicate airport ident %s "
+			    "in index. Skipping it. This shouldn't happen "
+			    "unless the index is damaged.", idx->ident);
+			free(idx);
+		}
+	}
+	free(line);
+	fclose(index_file);
+	free(index_filename);
+
+	return (B_TRUE);
+}
+
+static bool_t
+write_index_dat(const arpt_index_t *idx, FILE *index_file)
+{
+	ASSERT(idx != NULL);
+	ASSERT(index_file != NULL);
+	return (fprintf(index_file, "%s\t%s\t%s\t%s\t%f\t%f\t%.0f\t"
+	    "%hu\t%hu\t%hu\n",
+	    idx->ident, idx->icao[0] != '\0' ? idx->icao : "-",
+	    idx->iata[0] != '\0' ? idx->iata : "-",
+	    idx->cc[0] != '\0' ? idx->cc : "-",
+	    idx->pos.lat, idx->pos.lon, idx->pos.elev,
+	    idx->max_rwy_len, idx->TA, idx->TL) > 0);
+}
+
+static bool_t
+write_apt_dats_list(const airportdb_t *db, list_t *apt_dat_files)
+{
+	char *filename;
+	FILE *fp;
+
+	ASSERT(db != NULL);
+	ASSERT(apt_dat_files != NULL);
+
+	filename = mkpathname(db->cachedir, "apt_dats", NULL);
+	fp = fopen(filename, "w");
+	if (fp == NULL) {
+		logMsg("Error writing new airport database, can't open "
+		    "%s for writing: %s", filename, strerror(errno));
+		free(filename);
+		return (B_FALSE);
+	}
+	for (apt_dats_entry_t *e = list_head(apt_dat_files); e != NULL;
+	    e = list_next(apt_dat_files, e))
+		fprintf(fp, "%s\n", e->fname);
+	fclose(fp);
+	free(filename);
+
+	return (B_TRUE);
+}
+
+static bool_t
+recreate_cache_skeleton(airportdb_t *db, list_t *apt_dat_files, int app_version)
+{
+	char *filename;
+	FILE *fp;
+	bool_t exists, isdir;
+
+	ASSERT(db != NULL);
+	ASSERT(apt_dat_files != NULL);
+
+	exists = file_exists(db->cachedir, &isdir);
+	if ((exists && ((isdir && !remove_directory(db->cachedir)) ||
+	    (!isdir && !remove_file(db->cachedir, B_FALSE)))) ||
+	    !create_directory_recursive(db->cachedir))
+		return (B_FALSE);
+
+	filename = mkpathname(db->cachedir, "version", NULL);
+	fp = fopen(filename, "w");
+	if (fp == NULL) {
+		logMsg("Error writing new airport database, can't open "
+		    "%s for writing: %s", filename, strerror(errno));
+		free(filename);
+		return (B_FALSE);
+	}
+	fprintf(fp, "%d", (app_version << 16) | ARPTDB_CACHE_VERSION);
+	fclose(fp);
+	free(filename);
+
+	filename = mkpathname(db->cachedir, "airac_cycle", NULL);
+	fp = fopen(filename, "w");
+	if (fp == NULL) {
+		logMsg("Error writing new airport database, can't open "
+		    "%s for writing: %s", filename, strerror(errno));
+		free(filename);
+		return (B_FALSE);
+	}
+	fprintf(fp, "%d", db->xp_airac_cycle);
+	fclose(fp);
+	free(filename);
+
+	if (db->binary_cache && !write_bin_cache_version(db))
+		return (B_FALSE);
+
+	if (!write_apt_dats_list(db, apt_dat_files))
+		return (B_FALSE);
+
+	if (db->override_settings) {
+		conf_t *conf = conf_create_empty();
+
+		conf_set_b(conf, "ifr_only", db->ifr_only);
+		conf_set_b(conf, "normalize_gate_names",
+		    db->normalize_gate_names);
+		filename = mkpathname(db->cachedir, "settings.conf", NULL);
+		conf_write_file(conf, filename);
+		conf_free(conf);
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Incremental cache updates. Next to the cache, we keep a manifest of all
+ * the source files it was built from (the "sources" file): every apt.dat
+ * in priority order, followed by every CIFP file in the order in which
+ * load_xp11_navdata applies them. For each file we record its size, mtime
+ * and a hash of its contents. For apt.dats, we also record the file offset
+ * range and hash of each airport record. On startup, a file whose size and
+ * mtime haven't changed is assumed to be unchanged, all others are rescanned.
+ *
+ * The contents of an airport in the cache only depend on the records with
+ * its ident, in the order in which they are applied during a rebuild. So
+ * for every ident, we compute a signature over all of those records. The
+ * airports whose signature changed are re-resolved from just their own
+ * records, exactly as a full rebuild would, and then only their tiles and
+ * index entries are rewritten. Scenery ordering changes simply show up as
+ * changed signatures. Version or AIRAC cycle changes, as well as changes
+ * affecting a large portion of all airports, still cause a full rebuild.
+ */
+#define	SRC_MANIFEST_NAME	"sources"
+#define	SRC_MANIFEST_VERSION	1
+#define	SRC_HASH_INIT		0xcbf29ce484222325ull
+#define	SRC_HASH_MULT		0x9e3779b97f4a7c15ull
+/*
+ * If more than 1/SRC_UPDATE_MAX_FRACT of all airports changed, a full
+ * rebuild is cheaper than re-resolving each one individually.
+ */
+#define	SRC_UPDATE_MAX_FRACT	4
+/*
+ * The index only holds a single precision copy of an airport's position,
+ * so an airport close to a tile boundary may be in a neighboring tile.
+ */
+#define	IDX_POS_TOLERANCE	1e-4	/* degrees */
+
+typedef enum {
+	SRC_APT_DAT,
+	SRC_CIFP
+} src_type_t;
+
+typedef struct {
+	char		ident[AIRPORTDB_IDENT_LEN];
+	long		start;		/* file offset of the '1' row */
+	long		end;		/* file offset past the end */
+	uint64_t	hash;
+} src_rec_t;
+
+typedef struct {
+	src_type_t	type;
+	char		*path;
+	int64_t		size;		/* -1 if the file doesn't exist */
+	int64_t		mtime;
+	bool_t		scanned;	/* hash, version & recs are valid */
+	uint64_t	hash;
+	int		version;	/* apt.dat version header */
+	bool_t		fill_in_dups;	/* lowest priority apt.dat */
+	/*
+	 * For apt.dats, the airport records in file order. A CIFP file has
+	 * a single record for the ident it is named after.
+	 */
+	src_rec_t	*recs;
+	size_t		n_recs;
+} src_file_t;
+
+typedef struct {
+	int64_t		written;	/* mtime of the manifest file */
+	bool_t		rescanned;	/* some file was scanned again */
+	src_file_t	*files;
+	size_t		n_files;
+	size_t		cap;
+} src_manifest_t;
+
+typedef struct {
+	char		ident[AIRPORTDB_IDENT_LEN];
+	uint64_t	sig;
+	size_t		seq;		/* manifest order, for sorting */
+} src_sig_t;
+
+typedef enum {
+	CACHE_UP_TO_DATE,
+	CACHE_NEEDS_UPDATE,
+	CACHE_NEEDS_REBUILD
+} cache_state_t;
+
+static inline uint64_t
+src_mix(uint64_t h, uint64_t x)
+{
+	h = (h ^ x) * SRC_HASH_MULT;
+	return (h ^ (h >> 29));
+}
+
+/*
+ * A fast, non-cryptographic content hash, which consumes a whole word at
+ * a time. The result depends on the host's byte order, but the manifest
+ * never leaves the machine on which it was created.
+ */
+static uint64_t
+src_hash(const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint64_t h = src_mix(SRC_HASH_INIT, len);
+
+	for (; len >= sizeof (uint64_t); p += sizeof (uint64_t),
+	    len -= sizeof (uint64_t)) {
+		uint64_t w;
+
+		memcpy(&w, p, sizeof (w));
+		h = src_mix(h, w);
+	}
+	for (; len > 0; p++, len--)
+		h = src_mix(h, *p);
+
+	return (h);
+}
+
+static src_file_t *
+src_manifest_add(src_manifest_t *mf, src_type_t type, const char *path)
+{
+	src_file_t *src;
+
+	ASSERT(mf != NULL);
+	ASSERT(path != NULL);
+
+	if (mf->n_files == mf->cap) {
+		mf->cap = MAX(mf->cap * 2, 64);
+		mf->files = safe_realloc(mf->files,
+		    mf->cap * sizeof (*mf->files));
+	}
+	src = &mf->files[mf->n_files++];
+	memset(src, 0, sizeof (*src));
+	src->type = type;
+	src->path = safe_strdup(path);
+
+	return (src);
+}
+
+static src_rec_t *
+src_add_rec(src_file_t *src, size_t *cap)
+{
+	if (src->n_recs == *cap) {
+		*cap = MAX(*cap * 2, 64);
+		src->recs = safe_realloc(src->recs,
+		    *cap * sizeof (*src->recs));
+	}
+	memset(&src->recs[src->n_recs], 0, sizeof (*src->recs));
+	return (&src->recs[src->n_recs++]);
+}
+
+static void
+src_manifest_free(src_manifest_t *mf)
+{
+	ASSERT(mf != NULL);
+	for (size_t i = 0; i < mf->n_files; i++) {
+		free(mf->files[i].path);
+		free(mf->files[i].recs);
+	}
+	free(mf->files);
+	memset(mf, 0, sizeof (*mf));
+}
+
+/*
+ * The ident of the airport started by a '1' row, exactly as
+ * parse_apt_dat_1_line would determine it. Returns B_FALSE if the row
+ * wouldn't start an airport.
+ */
+static bool_t
+src_apt_dat_ident(char *line, char ident[AIRPORTDB_IDENT_LEN])
+{
+	size_t ncomps;
+	char **comps;
+	bool_t ok;
+
+	strip_space(line);
+	comps = strsplit(line, " ", B_TRUE, &ncomps);
+	ok = (strcmp(comps[0], "1") == 0 && ncomps >= 5 &&
+	    is_valid_elev(atof(comps[1])));
+	if (ok) {
+		lacf_strlcpy(ident, comps[4], AIRPORTDB_IDENT_LEN);
+		strtoupper(ident);
+	}
+	free_strlist(comps, ncomps);
+
+	return (ok);
+}
+
+/*
+ * Splits an apt.dat into airport records and hashes them. A record spans
+ * from its '1' row up to the next '1', '16' or '17' row, which is the part
+ * of the file that apt_dat_parse_chunk attributes to the airport.
+ */
+static void
+src_scan_apt_dat(src_file_t *src)
+{
+	size_t len, cap = 0, linecap = 0;
+	char *buf = file2mmap(src->path, &len);
+	char *line = NULL;
+	src_rec_t *rec = NULL;
+
+	free(src->recs);
+	src->recs = NULL;
+	src->n_recs = 0;
+	src->version = 0;
+	src->hash = src_hash(buf, len);
+
+	for (size_t off = 0, line_num = 1; off < len; line_num++) {
+		const char *eol = memchr(&buf[off], '\n', len - off);
+		size_t line_len = (eol != NULL ?
+		    (size_t)(eol - &buf[off]) + 1 : len - off);
+		/* enough to read the row code */
+		char prefix[16];
+		size_t n = MIN(line_len, sizeof (prefix) - 1);
+		int row_code;
+
+		memcpy(prefix, &buf[off], n);
+		prefix[n] = '\0';
+		if (sscanf(prefix, "%d", &row_code) != 1) {
+			off += line_len;
+			continue;
+		}
+		if (line_num == 2) {
+			/* same as in apt_dat_split_chunks */
+			src->version = row_code;
+		} else if (row_code == 1 || row_code == 16 || row_code == 17) {
+			char ident[AIRPORTDB_IDENT_LEN];
+
+			if (rec != NULL) {
+				rec->end = off;
+				rec = NULL;
+			}
+			if (line_len + 1 > linecap) {
+				linecap = line_len + 1;
+				line = safe_realloc(line, linecap);
+			}
+			memcpy(line, &buf[off], line_len);
+			line[line_len] = '\0';
+			if (row_code == 1 && src_apt_dat_ident(line, ident)) {
+				rec = src_add_rec(src, &cap);
+				lacf_strlcpy(rec->ident, ident,
+				    sizeof (rec->ident));
+				rec->start = off;
+			}
+		}
+		off += line_len;
+	}
+	if (rec != NULL)
+		rec->end = len;
+	for (size_t i = 0; i < src->n_recs; i++) {
+		src->recs[i].hash = src_hash(&buf[src->recs[i].start],
+		    src->recs[i].end - src->recs[i].start);
+	}
+	free(line);
+	if (buf != NULL)
+		file_unmap(buf, len);
+	src->scanned = B_TRUE;
+}
+
+static void
+src_scan_CIFP(src_file_t *src)
+{
+	size_t len;
+	void *buf = file2mmap(src->path, &len);
+
+	ASSERT3U(src->n_recs, ==, 1);
+	src->hash = src_hash(buf, len);
+	src->recs[0].hash = src->hash;
+	if (buf != NULL)
+		file_unmap(buf, len);
+	src->scanned = B_TRUE;
+}
+
+static void
+src_scan_files(void *userinfo, size_t begin, size_t end)
+{
+	src_manifest_t *mf = userinfo;
+
+	for (size_t i = begin; i < end; i++) {
+		src_file_t *src = &mf->files[i];
+
+		if (src->scanned)
+			continue;
+		if (src->type == SRC_APT_DAT)
+			src_scan_apt_dat(src);
+		else
+			src_scan_CIFP(src);
+	}
+}
+
+/*
+ * Scans all files in the manifest which weren't carried over from the
+ * previous manifest. The files are independent, so they can be scanned
+ * concurrently on `tq'.
+ */
+static void
+src_manifest_scan(src_manifest_t *mf, taskq_t *tq)
+{
+	ASSERT(mf != NULL);
+
+	for (size_t i = 0; i < mf->n_files; i++) {
+		if (!mf->files[i].scanned) {
+			mf->rescanned = B_TRUE;
+			break;
+		}
+	}
+	if (mf->rescanned)
+		lacf_parallel_for(tq, 0, mf->n_files, 1, src_scan_files, mf);
+}
+
+static void
+src_add_CIFP_cb(const char *dirpath, const char *filename, void *userinfo)
+{
+	src_manifest_t *mf = userinfo;
+	size_t len = strlen(filename);
+	src_file_t *src;
+	char *path;
+
+	/* the same filtering and ident derivation as in load_CIFP_file */
+	if (len < 4 || strcmp(&filename[len - 4], ".dat") != 0)
+		return;
+	path = mkpathname(dirpath, filename, NULL);
+	src = src_manifest_add(mf, SRC_CIFP, path);
+	free(path);
+	src->recs = safe_calloc(1, sizeof (*src->recs));
+	src->n_recs = 1;
+	lacf_strlcpy(src->recs[0].ident, filename,
+	    MIN(len - 3, sizeof (src->recs[0].ident)));
+	strtoupper(src->recs[0].ident);
+}
+
+static int
+src_file_compar(const void *a, const void *b)
+{
+	const src_file_t *sa = *(const src_file_t **)a;
+	const src_file_t *sb = *(const src_file_t **)b;
+
+	if (sa->type != sb->type)
+		return (sa->type < sb->type ? -1 : 1);
+	return (strcmp(sa->path, sb->path));
+}
+
+static void
+src_stat(src_file_t *src)
+{
+	struct stat st;
+
+	if (stat(src->path, &st) == 0) {
+		src->size = st.st_size;
+		src->mtime = st.st_mtime;
+	} else {
+		src->size = -1;
+		src->mtime = 0;
+	}
+}
+
+/*
+ * Carries over the scan results of an unchanged file from the previous
+ * manifest. A file modified in the same second as the previous manifest
+ * was written might have changed without its mtime showing it, so such
+ * files are always rescanned.
+ */
+static void
+src_carry_over(src_file_t *src, const src_file_t *old, int64_t written)
+{
+	if (!old->scanned || old->size != src->size ||
+	    old->mtime != src->mtime || old->mtime >= written)
+		return;
+	src->hash = old->hash;
+	src->version = old->version;
+	if (src->type == SRC_APT_DAT) {
+		src->n_recs = old->n_recs;
+		src->recs = safe_malloc(MAX(old->n_recs, 1) *
+		    sizeof (*src->recs));
+		memcpy(src->recs, old->recs, old->n_recs *
+		    sizeof (*src->recs));
+	} else {
+		src->recs[0].hash = old->hash;
+	}
+	src->scanned = B_TRUE;
+}
+
+/*
+ * Builds a manifest of the current source files: the apt.dats in
+ * `apt_dat_files', followed by the CIFP files which load_xp11_navdata would
+ * load, in the same order. Files which are unchanged from the `old'
+ * manifest (if provided) take over their scan results from there. All
+ * others are left for src_manifest_scan.
+ */
+static void
+src_manifest_build(const airportdb_t *db, list_t *apt_dat_files,
+    const src_manifest_t *old, src_manifest_t *mf)
+{
+	char *dirpath;
+	bool_t isdir;
+	const src_file_t **old_files = NULL;
+	size_t n_apt_dats = 0;
+
+	ASSERT(db != NULL);
+	ASSERT(apt_dat_files != NULL);
+	ASSERT(mf != NULL);
+
+	for (apt_dats_entry_t *e = list_head(apt_dat_files); e != NULL;
+	    e = list_next(apt_dat_files, e)) {
+		src_manifest_add(mf, SRC_APT_DAT, e->fname);
+		n_apt_dats++;
+	}
+	if (n_apt_dats != 0)
+		mf->files[n_apt_dats - 1].fill_in_dups = B_TRUE;
+	dirpath = mkpathname(db->xpdir, "Custom Data", "CIFP", NULL);
+	if (file_exists(dirpath, &isdir) && isdir)
+		(void) walk_CIFP_dir(dirpath, src_add_CIFP_cb, mf);
+	free(dirpath);
+	dirpath = mkpathname(db->xpdir, "Resources", "default data", "CIFP",
+	    NULL);
+	(void) walk_CIFP_dir(dirpath, src_add_CIFP_cb, mf);
+	free(dirpath);
+
+	if (old != NULL) {
+		old_files = safe_calloc(MAX(old->n_files, 1),
+		    sizeof (*old_files));
+		for (size_t i = 0; i < old->n_files; i++)
+			old_files[i] = &old->files[i];
+		qsort(old_files, old->n_files, sizeof (*old_files),
+		    src_file_compar);
+	}
+	for (size_t i = 0; i < mf->n_files; i++) {
+		src_file_t *src = &mf->files[i];
+		const src_file_t **old_src;
+
+		src_stat(src);
+		if (old_files == NULL)
+			continue;
+		old_src = bsearch(&src, old_files, old->n_files,
+		    sizeof (*old_files), src_file_compar);
+		if (old_src != NULL)
+			src_carry_over(src, *old_src, old->written);
+	}
+	free(old_files);
+}
+
+static bool_t
+src_manifest_write(const airportdb_t *db, const src_manifest_t *mf)
+{
+	char *filename;
+	FILE *fp;
+	bool_t success;
+
+	ASSERT(db != NULL);
+	ASSERT(mf != NULL);
+
+	filename = mkpathname(db->cachedir, SRC_MANIFEST_NAME, NULL);
+	fp = fopen(filename, "w");
+	if (fp == NULL) {
+		logMsg("Error writing airport database source manifest, "
+		    "can't open %s for writing: %s", filename,
+		    strerror(errno));
+		free(filename);
+		return (B_FALSE);
+	}
+	fprintf(fp, "V %d\n", SRC_MANIFEST_VERSION);
+	for (size_t i = 0; i < mf->n_files; i++) {
+		const src_file_t *src = &mf->files[i];
+
+		ASSERT(src->scanned);
+		if (src->type == SRC_CIFP) {
+			fprintf(fp, "C %lld %lld %llx %s %s\n",
+			    (long long)src->size, (long long)src->mtime,
+			    (unsigned long long)src->hash, src->recs[0].ident,
+			    src->path);
+			continue;
+		}
+		fprintf(fp, "A %lld %lld %llx %d %lu %s\n",
+		    (long long)src->size, (long long)src->mtime,
+		    (unsigned long long)src->hash, src->version,
+		    (unsigned long)src->n_recs, src->path);
+		for (size_t j = 0; j < src->n_recs; j++) {
+			const src_rec_t *rec = &src->recs[j];
+
+			fprintf(fp, "R %s %ld %ld %llx\n", rec->ident,
+			    rec->start, rec->end,
+			    (unsigned long long)rec->hash);
+		}
+	}
+	/* guards against using a truncated manifest */
+	fprintf(fp, "E\n");
+	success = (ferror(fp) == 0);
+	if (fclose(fp) != 0)
+		success = B_FALSE;
+	if (!success) {
+		logMsg("Error writing airport database source manifest %s",
+		    filename);
+		(void) remove_file(filename, B_TRUE);
+	}
+	free(filename);
+
+	return (success);
+}
+
+static bool_t
+src_manifest_read(const airportdb_t *db, src_manifest_t *mf)
+{
+	char *filename;
+	FILE *fp;
+	struct stat st;
+	char *line = NULL;
+	size_t linecap = 0, rec_cap = 0, n_apt_dats = 0;
+	src_file_t *src = NULL;
+	size_t recs_left = 0;
+	int version = -1;
+	bool_t complete = B_FALSE;
+
+	ASSERT(db != NULL);
+	ASSERT(mf != NULL);
+
+	filename = mkpathname(db->cachedir, SRC_MANIFEST_NAME, NULL);
+	fp = fopen(filename, "r");
+	if (fp == NULL || stat(filename, &st) != 0) {
+		if (fp != NULL)
+			fclose(fp);
+		free(filename);
+		return (B_FALSE);
+	}
+	free(filename);
+	mf->written = st.st_mtime;
+
+	while (!complete && lacf_getline(&line, &linecap, fp) > 0) {
+		long long size, mtime;
+		unsigned long long hash;
+		unsigned long n_recs;
+		int n = 0;
+
+		strip_space(line);
+		if (version != SRC_MANIFEST_VERSION) {
+			if (sscanf(line, "V %d", &version) != 1 ||
+			    version != SRC_MANIFEST_VERSION)
+				goto errout;
+		} else if (line[0] == 'A') {
+			int apt_version;
+
+			if (recs_left != 0 || sscanf(line,
+			    "A %lld %lld %llx %d %lu %n", &size, &mtime, &hash,
+			    &apt_version, &n_recs, &n) != 5 || n == 0 ||
+			    line[n] == '\0')
+				goto errout;
+			src = src_manifest_add(mf, SRC_APT_DAT, &line[n]);
+			src->size = size;
+			src->mtime = mtime;
+			src->hash = hash;
+			src->version = apt_version;
+			src->scanned = B_TRUE;
+			recs_left = n_recs;
+			rec_cap = 0;
+			n_apt_dats++;
+		} else if (line[0] == 'R') {
+			src_rec_t *rec;
+			unsigned long long rec_hash;
+
+			if (recs_left == 0)
+				goto errout;
+			rec = src_add_rec(src, &rec_cap);
+			if (sscanf(line, "R %7s %ld %ld %llx", rec->ident,
+			    &rec->start, &rec->end, &rec_hash) != 4)
+				goto errout;
+			rec->hash = rec_hash;
+			recs_left--;
+		} else if (line[0] == 'C') {
+			char ident[AIRPORTDB_IDENT_LEN];
+
+			if (recs_left != 0 || sscanf(line,
+			    "C %lld %lld %llx %7s %n", &size, &mtime, &hash,
+			    ident, &n) != 4 || n == 0 || line[n] == '\0')
+				goto errout;
+			src = src_manifest_add(mf, SRC_CIFP, &line[n]);
+			src->size = size;
+			src->mtime = mtime;
+			src->hash = hash;
+			src->scanned = B_TRUE;
+			src->recs = safe_calloc(1, sizeof (*src->recs));
+			src->n_recs = 1;
+			lacf_strlcpy(src->recs[0].ident, ident,
+			    sizeof (src->recs[0].ident));
+			src->recs[0].hash = hash;
+		} else if (strcmp(line, "E") == 0 && recs_left == 0) {
+			complete = B_TRUE;
+		} else {
+			goto errout;
+		}
+	}
+	if (!complete)
+		goto errout;
+	if (n_apt_dats != 0) {
+		for (size_t i = mf->n_files; i > 0; i--) {
+			if (mf->files[i - 1].type == SRC_APT_DAT) {
+				mf->files[i - 1].fill_in_dups = B_TRUE;
+				break;
+			}
+		}
+	}
+	free(line);
+	fclose(fp);
+
+	return (B_TRUE);
+errout:
+	logMsg("Airport database source manifest in %s is damaged, ignoring "
+	    "it", db->cachedir);
+	free(line);
+	fclose(fp);
+	src_manifest_free(mf);
+
+	return (B_FALSE);
+}
+
+static int
+src_sig_compar(const void *a, const void *b)
+{
+	const src_sig_t *sa = a, *sb = b;
+	int res = strcmp(sa->ident, sb->ident);
+
+	if (res != 0)
+		return (res);
+	if (sa->seq != sb->seq)
+		return (sa->seq < sb->seq ? -1 : 1);
+	return (0);
+}
+
+static int
+src_sig_ident_compar(const void *key, const void *elem)
+{
+	const src_sig_t *sig = elem;
+	return (strcmp(key, sig->ident));
+}
+
+static bool_t
+src_sig_contains(const src_sig_t *sigs, size_t n_sigs, const char *ident)
+{
+	return (bsearch(ident, sigs, n_sigs, sizeof (*sigs),
+	    src_sig_ident_compar) != NULL);
+}
+
+/*
+ * Computes the signature of every ident in the manifest, which covers the
+ * contents of all of its records and how they get applied, but not the
+ * names of the files they come from. Returns an array sorted by ident.
+ */
+static src_sig_t *
+src_manifest_sigs(const src_manifest_t *mf, size_t *n_sigs)
+{
+	size_t n = 0, n_out = 0;
+	src_sig_t *sigs;
+
+	ASSERT(mf != NULL);
+	ASSERT(n_sigs != NULL);
+
+	for (size_t i = 0; i < mf->n_files; i++)
+		n += mf->files[i].n_recs;
+	sigs = safe_calloc(MAX(n, 1), sizeof (*sigs));
+	n = 0;
+	for (size_t i = 0; i < mf->n_files; i++) {
+		const src_file_t *src = &mf->files[i];
+		uint64_t key = src_mix(SRC_HASH_INIT, src->type);
+
+		ASSERT(src->scanned);
+		key = src_mix(key, (uint64_t)src->version);
+		key = src_mix(key, src->fill_in_dups);
+		for (size_t j = 0; j < src->n_recs; j++, n++) {
+			lacf_strlcpy(sigs[n].ident, src->recs[j].ident,
+			    sizeof (sigs[n].ident));
+			sigs[n].sig = src_mix(key, src->recs[j].hash);
+			sigs[n].seq = n;
+		}
+	}
+	qsort(sigs, n, sizeof (*sigs), src_sig_compar);
+	/* fold all entries of an ident into its first one, in order */
+	for (size_t i = 0; i < n; i++) {
+		if (n_out != 0 &&
+		    strcmp(sigs[n_out - 1].ident, sigs[i].ident) == 0) {
+			sigs[n_out - 1].sig = src_mix(sigs[n_out - 1].sig,
+			    sigs[i].sig);
+		} else {
+			sigs[n_out] = sigs[i];
+			sigs[n_out].sig = src_mix(SRC_HASH_INIT, sigs[i].sig);
+			n_out++;
+		}
+	}
+	*n_sigs = n_out;
+
+	return (sigs);
+}
+
+/*
+ * Returns the idents whose signature differs between `old_mf' and `mf',
+ * including any which were added or removed, sorted by ident.
+ */
+static src_sig_t *
+src_manifest_diff(const src_manifest_t *old_mf, const src_manifest_t *mf,
+    size_t *n_diff, size_t *n_total)
+{
+	size_t n_old, n_new, i = 0, j = 0, n = 0;
+	src_sig_t *old_sigs = src_manifest_sigs(old_mf, &n_old);
+	src_sig_t *new_sigs = src_manifest_sigs(mf, &n_new);
+	src_sig_t *diff = safe_calloc(MAX(n_old + n_new, 1), sizeof (*diff));
+
+	while (i < n_old || j < n_new) {
+		int res;
+
+		if (i == n_old)
+			res = 1;
+		else if (j == n_new)
+			res = -1;
+		else
+			res = strcmp(old_sigs[i].ident, new_sigs[j].ident);
+		if (res < 0) {
+			diff[n++] = old_sigs[i++];
+		} else if (res > 0) {
+			diff[n++] = new_sigs[j++];
+		} else {
+			if (old_sigs[i].sig != new_sigs[j].sig)
+				diff[n++] = new_sigs[j];
+			i++;
+			j++;
+		}
+	}
+	free(old_sigs);
+	free(new_sigs);
+	*n_diff = n;
+	*n_total = MAX(n_old, n_new);
+
+	return (diff);
+}
+
+/*
+ * Determines what needs to be done to bring the cache up to date. Fills
+ * in `mf' with the manifest of the current source files. If the cache
+ * needs an incremental update, `affected' is filled with the idents of
+ * the airports which need to be re-resolved.
+ */
+static cache_state_t
+cache_state(airportdb_t *db, list_t *xp_apt_dats, int app_version,
+    src_manifest_t *mf, src_sig_t **affected, size_t *n_affected)
+{
+	src_manifest_t old_mf = { .files = NULL };
+	bool_t vers_ok, cycle_ok, have_old_mf;
+	cache_state_t state;
+
+	ASSERT(db != NULL);
+	ASSERT(xp_apt_dats != NULL);
+	ASSERT(mf != NULL);
+	ASSERT(affected != NULL);
+	ASSERT(n_affected != NULL);
+	/*
+	 * We need to call both of these functions because check_airac_cycle
+	 * establishes what AIRAC cycle X-Plane uses and modifies `db', so
+	 * we'll need it later on when recreating the cache.
+	 */
+	vers_ok = check_cache_version(db, app_version);
+	cycle_ok = check_airac_cycle(db);
+	have_old_mf = (vers_ok && cycle_ok && src_manifest_read(db, &old_mf));
+	src_manifest_build(db, xp_apt_dats, have_old_mf ? &old_mf : NULL, mf);
+	if (!vers_ok || !cycle_ok) {
+		state = CACHE_NEEDS_REBUILD;
+	} else if (!have_old_mf) {
+		/*
+		 * Caches from before the manifest was introduced. We can't
+		 * tell what changed, so we only check the apt.dat list.
+		 */
+		state = (apt_dats_list_matches(db, xp_apt_dats) ?
+		    CACHE_UP_TO_DATE : CACHE_NEEDS_REBUILD);
+	} else {
+		size_t n_total;
+
+		src_manifest_scan(mf, NULL);
+		*affected = src_manifest_diff(&old_mf, mf, n_affected,
+		    &n_total);
+		if (*n_affected == 0 && apt_dats_list_matches(db, xp_apt_dats))
+			state = CACHE_UP_TO_DATE;
+		else if (*n_affected > n_total / SRC_UPDATE_MAX_FRACT)
+			state = CACHE_NEEDS_REBUILD;
+		else
+			state = CACHE_NEEDS_UPDATE;
+	}
+	src_manifest_free(&old_mf);
+	/* Only bother with the binary cache if the rest is up to date */
+	if (state != CACHE_NEEDS_REBUILD && !check_bin_cache_version(db))
+		state = CACHE_NEEDS_REBUILD;
+
+	return (state);
+}
+
+static void
+free_arpt_index(airportdb_t *db)
+{
+	void *cookie = NULL;
+	arpt_index_t *idx;
+
+	ASSERT(db != NULL);
+	/* the k-d tree points into the index */
+	arpt_kdtree_free(db);
+	while ((idx = avl_destroy_nodes(&db->arpt_index, &cookie)) != NULL)
+		free(idx);
+}
+
+/*
+ * Drops everything loaded from the cache, so that a full rebuild can start
+ * over after a failed incremental update.
+ */
+static void
+adb_reset(airportdb_t *db)
 {
-	char *index_filename;
-	FILE *index_file;
-	char *line = NULL;
-	size_t line_cap = 0;
-	size_t num_lines = 0;
+	void *cookie = NULL;
+	tile_t *tile;
 
 	ASSERT(db != NULL);
-	index_filename = mkpathname(db->cachedir, "index.dat", NULL);
-	index_file = fopen(index_filename, "r");
 
-	if (index_file == NULL)
-		return (B_FALSE);
+	free_arpt_index(db);
+	recreate_icao_iata_tables(db, 16);
+	while ((tile = avl_destroy_nodes(&db->geo_table, &cookie)) != NULL)
+		free_tile(db, tile, B_FALSE);
+	ASSERT0(avl_numnodes(&db->apt_dat));
+}
 
-	if (!db->override_settings) {
-		conf_t *conf;
-		char *filename = mkpathname(db->cachedir, "settings.conf",
-		    NULL);
+/*
+ * Removes the cached version of an airport from the database and its
+ * index entry. The tile which held it is marked dirty.
+ */
+static bool_t
+adb_update_remove(airportdb_t *db, const char *ident)
+{
+	arpt_index_t srch_idx, *idx;
+	airport_t srch_arpt, *arpt;
+	tile_t *tile;
 
-		if (file_exists(filename, NULL) &&
-		    (conf = conf_read_file(filename, NULL)) != NULL) {
-			conf_get_b(conf, "ifr_only", &db->ifr_only);
-			conf_get_b(conf, "normalize_gate_names",
-			    &db->normalize_gate_names);
-			conf_free(conf);
+	lacf_strlcpy(srch_idx.ident, ident, sizeof (srch_idx.ident));
+	idx = avl_find(&db->arpt_index, &srch_idx, NULL);
+	if (idx == NULL)
+		return (B_TRUE);	/* a new airport */
+	for (int i = -1; i <= 1; i += 2) {
+		for (int j = -1; j <= 1; j += 2) {
+			load_airports_in_tile(db, GEO_POS2(
+			    idx->pos.lat + i * IDX_POS_TOLERANCE,
+			    idx->pos.lon + j * IDX_POS_TOLERANCE));
 		}
-		LACF_DESTROY(filename);
 	}
-	while (lacf_getline(&line, &line_cap, index_file) > 0)
-		num_lines++;
-	rewind(index_file);
+	lacf_strlcpy(srch_arpt.ident, ident, sizeof (srch_arpt.ident));
+	arpt = avl_find(&db->apt_dat, &srch_arpt, NULL);
+	if (arpt == NULL) {
+		logMsg("Airport %s is in the airport database index, but not "
+		    "in its tiles.", ident);
+		return (B_FALSE);
+	}
+	tile = geo_table_get_tile(db, GEO3_TO_GEO2(arpt->refpt), B_FALSE,
+	    NULL);
+	ASSERT(tile != NULL);
+	tile->dirty = B_TRUE;
+	geo_unlink_airport(db, arpt);
+	avl_remove(&db->apt_dat, arpt);
+	free_airport(arpt);
+	/*
+	 * The k-d tree points into the index. It's rebuilt once the update
+	 * succeeds and stays gone if it doesn't.
+	 */
+	arpt_kdtree_free(db);
+	avl_remove(&db->arpt_index, idx);
+	free(idx);
 
-	recreate_icao_iata_tables(db, num_lines);
+	return (B_TRUE);
+}
 
-	while (lacf_getline(&line, &line_cap, index_file) > 0) {
-		arpt_index_t *idx = safe_calloc(1, sizeof (*idx));
-		avl_index_t where;
+/*
+ * Resolves the `affected' airports from their records in the sources in
+ * `mf' into `scratch', replicating exactly what a full rebuild does for
+ * them: all of an ident's apt.dat records are merged in priority order,
+ * and then its CIFP files are applied.
+ */
+static void
+adb_update_resolve(airportdb_t *db, airportdb_t *scratch,
+    const src_manifest_t *mf, const src_sig_t *affected, size_t n_affected,
+    taskq_t *tq)
+{
+	apt_dat_parse_t parse = { .db = db, .chunks = NULL };
+	size_t n_chunks = 0, cap = 0;
 
-		if (sscanf(line, "%7s %7s %3s %2s %f %f %f %hu %hu %hu",
-		    idx->ident, idx->icao, idx->iata, idx->cc,
-		    &idx->pos.lat, &idx->pos.lon, &idx->pos.elev,
-		    &idx->max_rwy_len, &idx->TA, &idx->TL) != 10) {
-			free(idx);
+	for (size_t i = 0; i < mf->n_files; i++) {
+		const src_file_t *src = &mf->files[i];
+
+		if (src->type != SRC_APT_DAT)
 			continue;
-		}
-		if (avl_find(&db->arpt_index, idx, &where) == NULL) {
-			avl_insert(&db->arpt_index, idx, where);
-			htbl2_set(&db->icao_index, idx->icao,
-			    sizeof (idx->icao), idx, sizeof (*idx));
-			if (strcmp(idx->iata, "-") != 0) {
-				htbl2_set(&db->iata_index, idx->iata,
-				    sizeof (idx->iata), idx, sizeof (*idx));
+		for (size_t j = 0; j < src->n_recs; j++) {
+			const src_rec_t *rec = &src->recs[j];
+			apt_dat_chunk_t *chunk;
+
+			if (!src_sig_contains(affected, n_affected, rec->ident))
+				continue;
+			if (n_chunks == cap) {
+				cap = MAX(cap * 2, 16);
+				parse.chunks = safe_realloc(parse.chunks,
+				    cap * sizeof (*parse.chunks));
 			}
-		} else {
-			logMsg("WARNING: found duplicate airport ident %s "
-			    "in index. Skipping it. This shouldn't happen "
-			    "unless the index is damaged.", idx->ident);
-			free(idx);
+			chunk = &parse.chunks[n_chunks++];
+			chunk->fname = src->path;
+			chunk->start = rec->start;
+			chunk->end = rec->end;
+			chunk->has_hdr = B_FALSE;
+			chunk->version = src->version;
+			chunk->fill_in_dups = src->fill_in_dups;
+			chunk->arena = NULL;
+			list_create(&chunk->recs, sizeof (apt_dat_rec_t),
+			    offsetof(apt_dat_rec_t, node));
 		}
 	}
-	free(line);
-	fclose(index_file);
-	free(index_filename);
+	lacf_parallel_for(tq, 0, n_chunks, 1, apt_dat_parse_chunks, &parse);
+	for (size_t i = 0; i < n_chunks; i++)
+		apt_dat_merge_chunk(scratch, &parse.chunks[i]);
+	free(parse.chunks);
 
-	return (B_TRUE);
+	for (size_t i = 0; i < mf->n_files; i++) {
+		const src_file_t *src = &mf->files[i];
+		airport_t *arpt;
+
+		if (src->type != SRC_CIFP ||
+		    !src_sig_contains(affected, n_affected, src->recs[0].ident))
+			continue;
+		arpt = apt_dat_lookup(scratch, src->recs[0].ident);
+		if (arpt != NULL)
+			(void) load_arinc424_arpt_data(src->path, arpt);
+	}
 }
 
 static bool_t
-write_index_dat(const arpt_index_t *idx, FILE *index_file)
+adb_update_index(airportdb_t *db)
 {
-	ASSERT(idx != NULL);
-	ASSERT(index_file != NULL);
-	return (fprintf(index_file, "%s\t%s\t%s\t%s\t%f\t%f\t%.0f\t"
-	    "%hu\t%hu\t%hu\n",
-	    idx->ident, idx->icao[0] != '\0' ? idx->icao : "-",
-	    idx->iata[0] != '\0' ? idx->iata : "-",
-	    idx->cc[0] != '\0' ? idx->cc : "-",
-	    idx->pos.lat, idx->pos.lon, idx->pos.elev,
-	    idx->max_rwy_len, idx->TA, idx->TL) > 0);
+	char *filename = mkpathname(db->cachedir, "index.dat", NULL);
+	FILE *fp = fopen(filename, "w");
+	bool_t success;
+
+	if (fp == NULL) {
+		logMsg("Error creating airport database index file %s: %s",
+		    filename, strerror(errno));
+		free(filename);
+		return (B_FALSE);
+	}
+	for (const arpt_index_t *idx = avl_first(&db->arpt_index);
+	    idx != NULL; idx = AVL_NEXT(&db->arpt_index, idx))
+		write_index_dat(idx, fp);
+	success = (ferror(fp) == 0);
+	fclose(fp);
+	free(filename);
+	/*
+	 * Reload the index from the file, so its contents are exactly the
+	 * same as the next time the cache is opened.
+	 */
+	free_arpt_index(db);
+
+	return (success && read_index_dat(db));
 }
 
+/*
+ * Incrementally updates the cache, by re-resolving only the `affected'
+ * airports from the sources listed in `mf'. Returns B_FALSE if the update
+ * failed, or the cache turned out to be inconsistent. The caller must then
+ * reset the database using adb_reset and perform a full rebuild.
+ */
 static bool_t
-recreate_cache_skeleton(airportdb_t *db, list_t *apt_dat_files, int app_version)
+adb_update_cache(airportdb_t *db, list_t *apt_dat_files,
+    const src_manifest_t *mf, const src_sig_t *affected, size_t n_affected,
+    taskq_t *tq)
 {
+	airportdb_t scratch = { .inited = B_FALSE };
 	char *filename;
-	FILE *fp;
-	bool_t exists, isdir;
+	bool_t success = B_FALSE;
 
 	ASSERT(db != NULL);
 	ASSERT(apt_dat_files != NULL);
+	ASSERT(mf != NULL);
 
-	exists = file_exists(db->cachedir, &isdir);
-	if ((exists && ((isdir && !remove_directory(db->cachedir)) ||
-	    (!isdir && !remove_file(db->cachedir, B_FALSE)))) ||
-	    !create_directory_recursive(db->cachedir))
-		return (B_FALSE);
-
-	filename = mkpathname(db->cachedir, "version", NULL);
-	fp = fopen(filename, "w");
-	if (fp == NULL) {
-		logMsg("Error writing new airport database, can't open "
-		    "%s for writing: %s", filename, strerror(errno));
-		free(filename);
+	if (!read_index_dat(db))
 		return (B_FALSE);
-	}
-	fprintf(fp, "%d", (app_version << 16) | ARPTDB_CACHE_VERSION);
-	fclose(fp);
+	logMsg("Updating airport database cache in %s (%lu airports "
+	    "changed)", db->cachedir, (unsigned long)n_affected);
+	/*
+	 * If we get interrupted from here on, the missing apt_dats list
+	 * forces a full rebuild next time around.
+	 */
+	filename = mkpathname(db->cachedir, SRC_MANIFEST_NAME, NULL);
+	(void) remove_file(filename, B_TRUE);
 	free(filename);
-
-	filename = mkpathname(db->cachedir, "airac_cycle", NULL);
-	fp = fopen(filename, "w");
-	if (fp == NULL) {
-		logMsg("Error writing new airport database, can't open "
-		    "%s for writing: %s", filename, strerror(errno));
-		free(filename);
-		return (B_FALSE);
-	}
-	fprintf(fp, "%d", db->xp_airac_cycle);
-	fclose(fp);
+	filename = mkpathname(db->cachedir, "apt_dats", NULL);
+	(void) remove_file(filename, B_TRUE);
 	free(filename);
+	/* the index hash tables are repopulated by adb_update_index */
+	recreate_icao_iata_tables(db, 16);
 
-	filename = mkpathname(db->cachedir, "apt_dats", NULL);
-	fp = fopen(filename, "w");
-	if (fp == NULL) {
-		logMsg("Error writing new airport database, can't open "
-		    "%s for writing: %s", filename, strerror(errno));
-		free(filename);
-		return (B_FALSE);
+	for (size_t i = 0; i < n_affected; i++) {
+		if (!adb_update_remove(db, affected[i].ident))
+			return (B_FALSE);
 	}
-	for (apt_dats_entry_t *e = list_head(apt_dat_files); e != NULL;
-	    e = list_next(apt_dat_files, e))
-		fprintf(fp, "%s\n", e->fname);
-	fclose(fp);
-	free(filename);
 
-	if (db->override_settings) {
-		conf_t *conf = conf_create_empty();
+	airportdb_create(&scratch, db->xpdir, db->cachedir);
+	scratch.ifr_only = db->ifr_only;
+	scratch.normalize_gate_names = db->normalize_gate_names;
+	adb_update_resolve(db, &scratch, mf, affected, n_affected, tq);
+	for (airport_t *arpt = avl_first(&scratch.apt_dat), *next_arpt;
+	    arpt != NULL; arpt = next_arpt) {
+		tile_t *tile;
 
-		conf_set_b(conf, "ifr_only", db->ifr_only);
-		conf_set_b(conf, "normalize_gate_names",
-		    db->normalize_gate_names);
-		filename = mkpathname(db->cachedir, "settings.conf", NULL);
-		conf_write_file(conf, filename);
-		conf_free(conf);
+		next_arpt = AVL_NEXT(&scratch.apt_dat, arpt);
+		geo_unlink_airport(&scratch, arpt);
+		avl_remove(&scratch.apt_dat, arpt);
+		/* same as in adb_recreate_cache */
+		if (!arpt->have_iaps && db->ifr_only) {
+			free_airport(arpt);
+			continue;
+		}
+		/* the tile must be loaded before we can add to it */
+		load_airports_in_tile(db, GEO3_TO_GEO2(arpt->refpt));
+		if (avl_find(&db->apt_dat, arpt, NULL) != NULL) {
+			logMsg("Airport %s is in the airport database tiles, "
+			    "but not in its index.", arpt->ident);
+			free_airport(arpt);
+			goto out;
+		}
+		apt_dat_insert(db, arpt);
+		geo_link_airport(db, arpt);
+		tile = geo_table_get_tile(db, GEO3_TO_GEO2(arpt->refpt),
+		    B_FALSE, NULL);
+		tile->dirty = B_TRUE;
+		(void) create_arpt_index(db, arpt);
 	}
+	if (!write_apt_dat_tiles(db, tq, B_TRUE) || !adb_update_index(db) ||
+	    !write_apt_dats_list(db, apt_dat_files))
+		goto out;
+	/* the manifest goes last, it marks the cache as complete */
+	(void) src_manifest_write(db, mf);
+	success = B_TRUE;
+out:
+	airportdb_destroy(&scratch);
 
-	return (B_TRUE);
+	return (success);
 }
 
 /**
@@ -2471,14 +5028,17 @@ recreate_cache_skeleton(airportdb_t *db, list_t *apt_dat_files, int app_version)
  * the disk cache will be empty, and this function will interrogate X-Plane's
  * installed scenery to rebuild the cache. If the cache already exists, this
  * function checks for changes in X-Plane's scenery and/or navdata and if
- * necessary rebuilds the cache, or simply loads it as-is.
+ * necessary updates the cache, or simply loads it as-is. Changes to
+ * individual apt.dat or CIFP files only cause the affected airports to be
+ * updated in the cache. A change of the cache version, app_version or
+ * AIRAC cycle causes the entire cache to be rebuilt.
  *
- * Please note that on first run (or if a scenery change is detected), this
- * function can take quite a bit of time to run (tens of seconds to minutes,
- * if the machine is particularly slow and has lots of scenery). You are
- * therefore encouraged to run it only once at startup. If you need to create
- * multiple \ref airportdb instances, create them in sequence, NOT in
- * parallel! This function perform disk I/O an the cache is NOT designed for
+ * Please note that on first run (or if a large scenery change is detected),
+ * this function can take quite a bit of time to run (tens of seconds to
+ * minutes, if the machine is particularly slow and has lots of scenery).
+ * You are therefore encouraged to run it only once at startup. If you need
+ * to create multiple \ref airportdb instances, create them in sequence, NOT
+ * in parallel! This function perform disk I/O an the cache is NOT designed for
  * concurrent writing! Once created by the first instance of \ref airportdb,
  * subsequent \ref airportdb instances will not need to rebuild and will
  * simply read the cache as-is, so this function will return nearly instantly.
@@ -2502,19 +5062,30 @@ bool_t
 adb_recreate_cache(airportdb_t *db, int app_version)
 {
 	list_t apt_dat_files;
-	bool_t success = B_TRUE;
+	src_manifest_t mf = { .files = NULL };
+	src_sig_t *affected = NULL;
+	size_t n_affected = 0;
+	cache_state_t state;
+	bool_t success = B_TRUE, updated = B_FALSE;
 	char *index_filename = NULL;
 	FILE *index_file = NULL;
-	iconv_t cd;
 	char *prev_locale = NULL, *saved_locale = NULL;
+	unsigned n_threads;
+	taskq_t *tq = NULL;
 
 	ASSERT(db != NULL);
 
+	/* the background loader mustn't read the cache while we rebuild it */
+	tile_loader_flush(db);
 	list_create(&apt_dat_files, sizeof (apt_dats_entry_t),
 	    offsetof(apt_dats_entry_t, node));
 	find_all_apt_dats(db, &apt_dat_files);
-	if (cache_up_to_date(db, &apt_dat_files, app_version) &&
-	    read_index_dat(db)) {
+	state = cache_state(db, &apt_dat_files, app_version, &mf, &affected,
+	    &n_affected);
+	if (state == CACHE_UP_TO_DATE && read_index_dat(db)) {
+		/* saves rescanning files which were touched, but unchanged */
+		if (mf.rescanned)
+			(void) src_manifest_write(db, &mf);
 		goto out;
 	}
 	/* This is needed to get iconv transliteration to work correctly */
@@ -2522,18 +5093,47 @@ adb_recreate_cache(airportdb_t *db, int app_version)
 	if (prev_locale != NULL)
 		saved_locale = safe_strdup(prev_locale);
 	setlocale(LC_CTYPE, "");
-	/* First scan all the provided apt.dat files */
-	cd = iconv_open("ASCII//TRANSLIT", "UTF-8");
-	for (apt_dats_entry_t *e = list_head(&apt_dat_files); e != NULL;
-	    e = list_next(&apt_dat_files, e)) {
-		bool_t fill_in_dups = (list_next(&apt_dat_files, e) == NULL);
-		read_apt_dat(db, e->fname, B_TRUE, &cd, fill_in_dups);
+	/*
+	 * The calling thread participates in lacf_parallel_for, so we only
+	 * need n_threads - 1 workers.
+	 */
+	n_threads = (db->rebuild_threads != 0 ? db->rebuild_threads :
+	    lacf_num_cpus());
+	if (n_threads > 1) {
+		tq = taskq_alloc2(0, MIN(n_threads - 1, TASKQ_WS_MAX_THREADS),
+		    0, NULL, NULL, NULL, NULL, NULL, TASKQ_FLAG_WORK_STEALING);
+	}
+	if (state == CACHE_NEEDS_UPDATE) {
+		updated = adb_update_cache(db, &apt_dat_files, &mf, affected,
+		    n_affected, tq);
+		if (!updated) {
+			logMsg("Incremental update of airport database cache "
+			    "in %s failed, rebuilding it from scratch.",
+			    db->cachedir);
+			adb_reset(db);
+		}
+	}
+	/* Otherwise, scan all the provided apt.dat files */
+	if (!updated && tq != NULL) {
+		read_apt_dats_parallel(db, &apt_dat_files, tq);
+	} else if (!updated) {
+		iconv_t cd = iconv_open("ASCII//TRANSLIT", "UTF-8");
+
+		for (apt_dats_entry_t *e = list_head(&apt_dat_files);
+		    e != NULL; e = list_next(&apt_dat_files, e)) {
+			bool_t fill_in_dups =
+			    (list_next(&apt_dat_files, e) == NULL);
+			read_apt_dat(db, e->fname, B_TRUE, &cd, NULL,
+			    fill_in_dups);
+		}
+		iconv_close(cd);
 	}
-	iconv_close(cd);
 	if (saved_locale != NULL) {
 		setlocale(LC_CTYPE, saved_locale);
 		free(saved_locale);
 	}
+	if (updated)
+		goto out;
 	if (!load_xp11_navdata(db)) {
 		success = B_FALSE;
 		goto out;
@@ -2578,25 +5178,24 @@ adb_recreate_cache(airportdb_t *db, int app_version)
 			write_index_dat(idx, index_file);
 		}
 	}
-	for (airport_t *arpt = avl_first(&db->apt_dat); arpt != NULL;
-	    arpt = AVL_NEXT(&db->apt_dat, arpt)) {
-		char *dirname;
-
-		ASSERT(arpt->geo_linked);
-		ASSERT(avl_numnodes(&arpt->rwys) != 0);
-
-		dirname = apt_dat_cache_dir(db, GEO3_TO_GEO2(arpt->refpt),
-		    NULL);
-		if (!create_directory(dirname) || !write_apt_dat(db, arpt)) {
-			free(dirname);
-			success = B_FALSE;
-			goto out;
-		}
-		free(dirname);
+	if (!write_apt_dat_tiles(db, tq, B_FALSE)) {
+		success = B_FALSE;
+		goto out;
 	}
+	fclose(index_file);
+	index_file = NULL;
+	/* the manifest goes last, it marks the cache as complete */
+	src_manifest_scan(&mf, tq);
+	(void) src_manifest_write(db, &mf);
 out:
+	if (success)
+		arpt_kdtree_build(db);
+	if (tq != NULL)
+		taskq_free(tq);
 	adb_unload_distant_airport_tiles(db, NULL_GEO_POS2);
 	destroy_apt_dats_list(&apt_dat_files);
+	src_manifest_free(&mf);
+	free(affected);
 	free(index_filename);
 	if (index_file != NULL)
 		fclose(index_file);
@@ -2604,6 +5203,136 @@ out:
 	return (success);
 }
 
+/*
+ * Carves `n' elements of `elem_sz' bytes off the front of a runway
+ * geometry allocation.
+ */
+static void *
+rwy_geom_carve(uint8_t **p, size_t n, size_t elem_sz)
+{
+	void *res = *p;
+	*p += n * elem_sz;
+	return (res);
+}
+
+static adb_rwy_geom_t *
+rwy_geom_alloc(const airport_t *arpt, unsigned n_rwys, vect2_t **pts)
+{
+	adb_rwy_geom_t *g = arpt_zalloc(arpt, RWY_GEOM_SZ(n_rwys));
+	uint8_t *p = (uint8_t *)g + ARENA_ROUNDUP(sizeof (*g));
+	unsigned n_ends = 2 * n_rwys;
+
+	g->n_rwys = n_rwys;
+	*pts = rwy_geom_carve(&p, n_rwys * RWY_GEOM_BBOX_PTS,
+	    sizeof (vect2_t));
+#define	CARVE(field, n)	(g->field = rwy_geom_carve(&p, (n), sizeof (double)))
+	CARVE(thr_x, n_ends);
+	CARVE(thr_y, n_ends);
+	CARVE(dthr_x, n_ends);
+	CARVE(dthr_y, n_ends);
+	CARVE(dir_x, n_ends);
+	CARVE(dir_y, n_ends);
+	CARVE(displ, n_ends);
+	CARVE(blast, n_ends);
+	CARVE(half_w, n_ends);
+	CARVE(land_len, n_ends);
+	CARVE(apch_l, n_ends);
+	CARVE(apch_r, n_ends);
+	CARVE(org_x, n_rwys);
+	CARVE(org_y, n_rwys);
+	CARVE(ax_x, n_rwys);
+	CARVE(ax_y, n_rwys);
+	CARVE(len, n_rwys);
+	for (int i = 0; i < ADB_RWY_AREA_APCH; i++) {
+		CARVE(s_min[i], n_rwys);
+		CARVE(s_max[i], n_rwys);
+		CARVE(lat[i], n_rwys);
+	}
+#undef	CARVE
+	g->rwys = rwy_geom_carve(&p, n_rwys, sizeof (runway_t *));
+	ASSERT3U(p - (uint8_t *)g, ==, RWY_GEOM_SZ(n_rwys));
+
+	return (g);
+}
+
+/*
+ * Computes the thresholds, directions and rectangular areas of all
+ * runways. The thresholds (dthr_x/dthr_y), displacements, blastpads and
+ * widths must have been filled in. Straight-line math only, so the
+ * compiler can vectorize it.
+ *
+ * RAAS runway proximity entry bounding box is defined as:
+ *
+ *              1000ft                                   1000ft
+ *            |<======>|                               |<======>|
+ *            |        |                               |        |
+ *     ---- d +-------------------------------------------------+ c
+ * 1.5x  ^    |        |                               |        |
+ *  rwy  |    |        |                               |        |
+ * width |    |        +-------------------------------+        |
+ *       v    |        | ====  ----         ----  ==== |        |
+ *     -------|-thresh-x ==== - - - - - - - - - - ==== |        |
+ *       ^    |        | ====  ----         ----  ==== |        |
+ * 1.5x  |    |        +-------------------------------+        |
+ *  rwy  |    |                                                 |
+ * width v    |                                                 |
+ *     ---- a +-------------------------------------------------+ b
+ */
+static void
+rwy_geom_compute(adb_rwy_geom_t *g)
+{
+	for (unsigned i = 0; i < g->n_rwys; i++) {
+		unsigned e1 = 2 * i, e2 = 2 * i + 1;
+		double dx = g->dthr_x[e2] - g->dthr_x[e1];
+		double dy = g->dthr_y[e2] - g->dthr_y[e1];
+		double dlen = sqrt(dx * dx + dy * dy);
+		double ux = dx / dlen, uy = dy / dlen;
+		double displ1 = g->displ[e1], displ2 = g->displ[e2];
+		double blast1 = g->blast[e1], blast2 = g->blast[e2];
+		double t1x = g->dthr_x[e1] + ux * displ1;
+		double t1y = g->dthr_y[e1] + uy * displ1;
+		double t2x = g->dthr_x[e2] - ux * displ2;
+		double t2y = g->dthr_y[e2] - uy * displ2;
+		double tx = t2x - t1x, ty = t2y - t1y;
+		double len = sqrt(tx * tx + ty * ty);
+		double inv_len = (len > 0 ? 1 / len : 0);
+		double l1x = g->dthr_x[e2] - t1x, l1y = g->dthr_y[e2] - t1y;
+		double l2x = g->dthr_x[e1] - t2x, l2y = g->dthr_y[e1] - t2y;
+		double half_w = g->half_w[e1];
+		double bonus1 = MAX(displ1, RWY_PROXIMITY_LON_DISPL - displ1);
+		double bonus2 = MAX(displ2, RWY_PROXIMITY_LON_DISPL - displ2);
+
+		g->thr_x[e1] = t1x;
+		g->thr_y[e1] = t1y;
+		g->thr_x[e2] = t2x;
+		g->thr_y[e2] = t2y;
+		g->dir_x[e1] = tx * inv_len;
+		g->dir_y[e1] = ty * inv_len;
+		g->dir_x[e2] = -tx * inv_len;
+		g->dir_y[e2] = -ty * inv_len;
+		g->land_len[e1] = sqrt(l1x * l1x + l1y * l1y);
+		g->land_len[e2] = sqrt(l2x * l2x + l2y * l2y);
+
+		g->org_x[i] = g->dthr_x[e1];
+		g->org_y[i] = g->dthr_y[e1];
+		g->ax_x[i] = ux;
+		g->ax_y[i] = uy;
+		g->len[i] = len;
+		g->s_min[ADB_RWY_AREA_RWY][i] = displ1;
+		g->s_max[ADB_RWY_AREA_RWY][i] = displ1 + len;
+		g->lat[ADB_RWY_AREA_RWY][i] = half_w;
+		g->s_min[ADB_RWY_AREA_TORA][i] = 0;
+		g->s_max[ADB_RWY_AREA_TORA][i] = dlen;
+		g->lat[ADB_RWY_AREA_TORA][i] = half_w;
+		g->s_min[ADB_RWY_AREA_ASDA][i] = -blast1;
+		g->s_max[ADB_RWY_AREA_ASDA][i] = dlen + blast2;
+		g->lat[ADB_RWY_AREA_ASDA][i] = half_w;
+		g->s_min[ADB_RWY_AREA_PROX][i] = displ1 - bonus1;
+		g->s_max[ADB_RWY_AREA_PROX][i] = displ1 + len + bonus2;
+		g->lat[ADB_RWY_AREA_PROX][i] = RWY_PROXIMITY_LAT_FRACT * half_w;
+	}
+}
+
 /*
  * The approach proximity bounding box is constructed as follows:
  *
@@ -2625,211 +5354,239 @@ out:
  * If there is another parallel runway, we make sure our bounding boxes
  * don't overlap. We do this by introducing two additional points, b1 and
  * c1, in between a and b or c and d respectively. We essentially shear
- * the overlapping excess from the bounding polygon.
+ * the overlapping excess from the bounding polygon. This computes the
+ * lateral limits at which the shearing happens into apch_l and apch_r,
+ * or INFINITY if the box isn't sheared on that side.
  */
-static vect2_t *
-make_apch_prox_bbox(const runway_t *rwy, int end_i)
+static void
+rwy_geom_apch_limits(const airport_t *arpt, adb_rwy_geom_t *g)
 {
-	const runway_end_t *end, *oend;
-	const fpp_t *fpp;
-	double limit_left = 1000000, limit_right = 1000000;
-	vect2_t x, a, b, b1, c, c1, d, thr_v, othr_v, dir_v;
-	vect2_t *bbox = safe_calloc(7, sizeof (vect2_t));
-	size_t n_pts = 0;
-
-	ASSERT(rwy != NULL);
-	fpp = &rwy->arpt->fpp;
-	ASSERT(end_i == 0 || end_i == 1);
-
-	/*
-	 * By pre-initing the whole array to null vectors, we can make the
-	 * bbox either contain 4, 5 or 6 points, depending on whether
-	 * shearing due to a close parallel runway needs to be applied.
-	 */
-	for (int i = 0; i < 7; i++)
-		bbox[i] = NULL_VECT2;
+	unsigned n_ends = 2 * g->n_rwys;
+	int *num_ids = safe_malloc(n_ends * sizeof (*num_ids));
 
-	end = &rwy->ends[end_i];
-	oend = &rwy->ends[!end_i];
-	thr_v = end->thr_v;
-	othr_v = oend->thr_v;
-	dir_v = vect2_sub(othr_v, thr_v);
-
-	x = vect2_add(thr_v, vect2_set_abs(vect2_neg(dir_v),
-	    RWY_APCH_PROXIMITY_LON_DISPL));
-	a = vect2_add(x, vect2_set_abs(vect2_norm(dir_v, B_TRUE),
-	    rwy->width / 2 + RWY_APCH_PROXIMITY_LAT_DISPL));
-	b = vect2_add(thr_v, vect2_set_abs(vect2_norm(dir_v, B_TRUE),
-	    rwy->width / 2));
-	c = vect2_add(thr_v, vect2_set_abs(vect2_norm(dir_v, B_FALSE),
-	    rwy->width / 2));
-	d = vect2_add(x, vect2_set_abs(vect2_norm(dir_v, B_FALSE),
-	    rwy->width / 2 + RWY_APCH_PROXIMITY_LAT_DISPL));
-
-	b1 = NULL_VECT2;
-	c1 = NULL_VECT2;
-
-	/*
-	 * If our rwy_id designator contains a L/C/R, then we need to
-	 * look for another parallel runway.
-	 */
-	if (strlen(end->id) >= 3) {
-		int my_num_id = atoi(end->id);
+	for (unsigned e = 0; e < n_ends; e++) {
+		num_ids[e] = atoi(g->rwys[e / 2]->ends[e % 2].id);
+		g->apch_l[e] = INFINITY;
+		g->apch_r[e] = INFINITY;
+	}
+	for (unsigned e = 0; e < n_ends; e++) {
+		const runway_end_t *end = &g->rwys[e / 2]->ends[e % 2];
+		double limit_l = INFINITY, limit_r = INFINITY;
 
-		for (const runway_t *orwy = avl_first(&rwy->arpt->rwys);
-		    orwy != NULL; orwy = AVL_NEXT(&rwy->arpt->rwys, orwy)) {
-			const runway_end_t *orwy_end;
-			vect2_t othr_v, v;
-			double a, dist;
+		/*
+		 * If our rwy_id designator contains a L/C/R, then we need to
+		 * look for another parallel runway.
+		 */
+		if (strlen(end->id) < 3)
+			continue;
+		for (unsigned j = 0; j < g->n_rwys; j++) {
+			unsigned o;
+			double vx, vy, dist;
 
-			if (orwy == rwy)
+			if (j == e / 2)
 				continue;
-			if (atoi(orwy->ends[0].id) == my_num_id)
-				orwy_end = &orwy->ends[0];
-			else if (atoi(orwy->ends[1].id) == my_num_id)
-				orwy_end = &orwy->ends[1];
+			if (num_ids[2 * j] == num_ids[e])
+				o = 2 * j;
+			else if (num_ids[2 * j + 1] == num_ids[e])
+				o = 2 * j + 1;
 			else
 				continue;
-
 			/*
-			 * This is a parallel runway, measure the
-			 * distance to it from us.
+			 * This is a parallel runway, measure the distance
+			 * to it from us.
 			 */
-			othr_v = geo2fpp(GEO3_TO_GEO2(orwy_end->thr), fpp);
-			v = vect2_sub(othr_v, thr_v);
-			if (IS_ZERO_VECT2(v)) {
+			vx = g->dthr_x[o] - g->thr_x[e];
+			vy = g->dthr_y[o] - g->thr_y[e];
+			if (vx == 0 && vy == 0) {
+				const runway_end_t *oend =
+				    &g->rwys[j]->ends[o % 2];
 				logMsg("CAUTION: your nav DB is looking very "
 				    "strange: runways %s and %s at %s are on "
 				    "top of each other (coords: %fx%f)",
-				    end->id, orwy_end->id, rwy->arpt->icao,
-				    orwy_end->thr.lat, orwy_end->thr.lon);
+				    end->id, oend->id, arpt->icao,
+				    oend->thr.lat, oend->thr.lon);
 				continue;
 			}
-			a = rel_hdg(dir2hdg(dir_v), dir2hdg(v));
-			dist = fabs(sin(DEG2RAD(a)) * vect2_abs(v));
+			/* lateral offset, positive to our right */
+			dist = vx * g->dir_y[e] - vy * g->dir_x[e];
+			if (dist < 0)
+				limit_l = MIN(-dist / 2, limit_l);
+			else
+				limit_r = MIN(dist / 2, limit_r);
+		}
+		if (limit_l < RWY_APCH_PROXIMITY_LAT_DISPL)
+			g->apch_l[e] = limit_l;
+		if (limit_r < RWY_APCH_PROXIMITY_LAT_DISPL)
+			g->apch_r[e] = limit_r;
+	}
+	free(num_ids);
+}
+
+/*
+ * Generates one of the rectangular bounding boxes of runway `i' into
+ * `bbox', which must have room for 5 points.
+ */
+static vect2_t *
+rwy_geom_rect_bbox(const adb_rwy_geom_t *g, unsigned i, adb_rwy_area_t area,
+    vect2_t *bbox)
+{
+	vect2_t org = VECT2(g->org_x[i], g->org_y[i]);
+	vect2_t ax = VECT2(g->ax_x[i], g->ax_y[i]);
+	vect2_t lat_v = vect2_scmul(vect2_norm(ax, B_TRUE), g->lat[area][i]);
+	vect2_t start = vect2_add(org, vect2_scmul(ax, g->s_min[area][i]));
+	vect2_t end = vect2_add(org, vect2_scmul(ax, g->s_max[area][i]));
+
+	ASSERT3U(area, <, ADB_RWY_AREA_APCH);
+
+	bbox[0] = vect2_add(start, lat_v);
+	bbox[1] = vect2_add(end, lat_v);
+	bbox[2] = vect2_sub(end, lat_v);
+	bbox[3] = vect2_sub(start, lat_v);
+	bbox[4] = NULL_VECT2;
+
+	return (bbox);
+}
+
+/*
+ * Point b1 or c1 of the approach bounding box, where the sloped side of
+ * the box reaches the lateral `limit' (see rwy_geom_apch_limits).
+ */
+static vect2_t
+rwy_geom_apch_shear_pt(vect2_t thr_v, vect2_t dir_v, vect2_t side_v,
+    double half_w, double limit)
+{
+	double s = -(limit - half_w) * (RWY_APCH_PROXIMITY_LON_DISPL /
+	    RWY_APCH_PROXIMITY_LAT_DISPL);
+
+	return (vect2_add(vect2_add(thr_v, vect2_scmul(dir_v, s)),
+	    vect2_scmul(side_v, limit)));
+}
+
+/*
+ * Generates the approach bounding box of runway end `e' into `bbox',
+ * which must have room for 7 points. The box has 4, 5 or 6 points,
+ * depending on whether it is sheared by close parallel runways.
+ */
+static vect2_t *
+rwy_geom_apch_bbox(const adb_rwy_geom_t *g, unsigned e, vect2_t *bbox)
+{
+	vect2_t thr_v = VECT2(g->thr_x[e], g->thr_y[e]);
+	vect2_t dir_v = VECT2(g->dir_x[e], g->dir_y[e]);
+	vect2_t right_v = vect2_norm(dir_v, B_TRUE);
+	vect2_t left_v = vect2_neg(right_v);
+	vect2_t x = vect2_add(thr_v, vect2_scmul(dir_v,
+	    -RWY_APCH_PROXIMITY_LON_DISPL));
+	double half_w = g->half_w[e];
+	double far_w = half_w + RWY_APCH_PROXIMITY_LAT_DISPL;
+	size_t n_pts = 0;
 
-			if (a < 0)
-				limit_left = MIN(dist / 2, limit_left);
-			else
-				limit_right = MIN(dist / 2, limit_right);
-		}
-	}
+	for (int i = 0; i < 7; i++)
+		bbox[i] = NULL_VECT2;
 
-	if (limit_left < RWY_APCH_PROXIMITY_LAT_DISPL) {
-		c1 = vect2vect_isect(vect2_sub(d, c), c, vect2_neg(dir_v),
-		    vect2_add(thr_v, vect2_set_abs(vect2_norm(dir_v, B_FALSE),
-		    limit_left)), B_FALSE);
-		d = vect2_add(x, vect2_set_abs(vect2_norm(dir_v, B_FALSE),
-		    limit_left));
+	bbox[n_pts++] = vect2_add(x, vect2_scmul(right_v,
+	    MIN(far_w, g->apch_r[e])));
+	if (isfinite(g->apch_r[e])) {
+		bbox[n_pts++] = rwy_geom_apch_shear_pt(thr_v, dir_v, right_v,
+		    half_w, g->apch_r[e]);
 	}
-	if (limit_right < RWY_APCH_PROXIMITY_LAT_DISPL) {
-		b1 = vect2vect_isect(vect2_sub(b, a), a, vect2_neg(dir_v),
-		    vect2_add(thr_v, vect2_set_abs(vect2_norm(dir_v, B_TRUE),
-		    limit_right)), B_FALSE);
-		a = vect2_add(x, vect2_set_abs(vect2_norm(dir_v, B_TRUE),
-		    limit_right));
+	bbox[n_pts++] = vect2_add(thr_v, vect2_scmul(right_v, half_w));
+	bbox[n_pts++] = vect2_add(thr_v, vect2_scmul(left_v, half_w));
+	if (isfinite(g->apch_l[e])) {
+		bbox[n_pts++] = rwy_geom_apch_shear_pt(thr_v, dir_v, left_v,
+		    half_w, g->apch_l[e]);
 	}
-
-	bbox[n_pts++] = a;
-	if (!IS_NULL_VECT(b1))
-		bbox[n_pts++] = b1;
-	bbox[n_pts++] = b;
-	bbox[n_pts++] = c;
-	if (!IS_NULL_VECT(c1))
-		bbox[n_pts++] = c1;
-	bbox[n_pts++] = d;
+	bbox[n_pts++] = vect2_add(x, vect2_scmul(left_v,
+	    MIN(far_w, g->apch_l[e])));
 
 	return (bbox);
 }
 
 /*
- * Prepares a runway's bounding box vector coordinates using the airport
- * coord fpp transform.
+ * Prepares the runways' vector coordinates and bounding boxes using the
+ * airport coord fpp transform. The runway thresholds come projected from
+ * binary cache tiles, otherwise we project them here.
  */
 static void
-load_rwy_info(runway_t *rwy)
+load_rwy_geom(airport_t *arpt)
 {
-	ASSERT(rwy != NULL);
-	ASSERT(rwy->arpt->load_complete);
-	/*
-	 * RAAS runway proximity entry bounding box is defined as:
-	 *
-	 *              1000ft                                   1000ft
-	 *            |<======>|                               |<======>|
-	 *            |        |                               |        |
-	 *     ---- d +-------------------------------------------------+ c
-	 * 1.5x  ^    |        |                               |        |
-	 *  rwy  |    |        |                               |        |
-	 * width |    |        +-------------------------------+        |
-	 *       v    |        | ====  ----         ----  ==== |        |
-	 *     -------|-thresh-x ==== - - - - - - - - - - ==== |        |
-	 *       ^    |        | ====  ----         ----  ==== |        |
-	 * 1.5x  |    |        +-------------------------------+        |
-	 *  rwy  |    |                                                 |
-	 * width v    |                                                 |
-	 *     ---- a +-------------------------------------------------+ b
-	 */
-	vect2_t dt1v = geo2fpp(GEO3_TO_GEO2(rwy->ends[0].thr), &rwy->arpt->fpp);
-	vect2_t dt2v = geo2fpp(GEO3_TO_GEO2(rwy->ends[1].thr), &rwy->arpt->fpp);
-	double displ1 = rwy->ends[0].displ;
-	double displ2 = rwy->ends[1].displ;
-	double blast1 = rwy->ends[0].blast;
-	double blast2 = rwy->ends[1].blast;
-
-	vect2_t dir_v = vect2_sub(dt2v, dt1v);
-	double dlen = vect2_abs(dir_v);
-	double hdg1 = dir2hdg(dir_v);
-	double hdg2 = dir2hdg(vect2_neg(dir_v));
-
-	vect2_t t1v = vect2_add(dt1v, vect2_set_abs(dir_v, displ1));
-	vect2_t t2v = vect2_add(dt2v, vect2_set_abs(vect2_neg(dir_v), displ2));
-	double len = vect2_abs(vect2_sub(t2v, t1v));
+	unsigned n_rwys = avl_numnodes(&arpt->rwys), i = 0;
+	vect2_t *pts;
+	adb_rwy_geom_t *g;
 
-	double prox_lon_bonus1 = MAX(displ1, RWY_PROXIMITY_LON_DISPL - displ1);
-	double prox_lon_bonus2 = MAX(displ2, RWY_PROXIMITY_LON_DISPL - displ2);
+	ASSERT(arpt->load_complete);
+	ASSERT3P(arpt->rwy_geom, ==, NULL);
 
-	rwy->ends[0].thr_v = t1v;
-	rwy->ends[1].thr_v = t2v;
-	rwy->ends[0].dthr_v = dt1v;
-	rwy->ends[1].dthr_v = dt2v;
-	rwy->ends[0].hdg = hdg1;
-	rwy->ends[1].hdg = hdg2;
-	rwy->ends[0].land_len = vect2_abs(vect2_sub(dt2v, t1v));
-	rwy->ends[1].land_len = vect2_abs(vect2_sub(dt1v, t2v));
-	rwy->length = len;
-
-	ASSERT(rwy->rwy_bbox == NULL);
-
-	rwy->rwy_bbox = make_rwy_bbox(t1v, dir_v, rwy->width, len, 0);
-	rwy->tora_bbox = make_rwy_bbox(dt1v, dir_v, rwy->width, dlen, 0);
-	rwy->asda_bbox = make_rwy_bbox(dt1v, dir_v, rwy->width,
-	    dlen + blast2, blast1);
-	rwy->prox_bbox = make_rwy_bbox(t1v, dir_v, RWY_PROXIMITY_LAT_FRACT *
-	    rwy->width, len + prox_lon_bonus2, prox_lon_bonus1);
-
-	rwy->ends[0].apch_bbox = make_apch_prox_bbox(rwy, 0);
-	rwy->ends[1].apch_bbox = make_apch_prox_bbox(rwy, 1);
+	g = rwy_geom_alloc(arpt, n_rwys, &pts);
+	for (runway_t *rwy = avl_first(&arpt->rwys); rwy != NULL;
+	    rwy = AVL_NEXT(&arpt->rwys, rwy), i++) {
+		g->rwys[i] = rwy;
+		for (unsigned j = 0; j < 2; j++) {
+			runway_end_t *re = &rwy->ends[j];
+			unsigned e = 2 * i + j;
+
+			if (IS_NULL_VECT(re->dthr_v)) {
+				re->dthr_v = geo2fpp(GEO3_TO_GEO2(re->thr),
+				    &arpt->fpp);
+			}
+			g->dthr_x[e] = re->dthr_v.x;
+			g->dthr_y[e] = re->dthr_v.y;
+			g->displ[e] = re->displ;
+			g->blast[e] = re->blast;
+			g->half_w[e] = rwy->width / 2;
+		}
+	}
+	rwy_geom_compute(g);
+	rwy_geom_apch_limits(arpt, g);
+
+	for (i = 0; i < n_rwys; i++) {
+		runway_t *rwy = g->rwys[i];
+		vect2_t dir_v = vect2_sub(rwy->ends[1].dthr_v,
+		    rwy->ends[0].dthr_v);
+
+		for (unsigned j = 0; j < 2; j++) {
+			runway_end_t *re = &rwy->ends[j];
+			unsigned e = 2 * i + j;
+
+			re->thr_v = VECT2(g->thr_x[e], g->thr_y[e]);
+			re->land_len = g->land_len[e];
+			re->apch_bbox = rwy_geom_apch_bbox(g, e, pts);
+			pts += 7;
+		}
+		rwy->ends[0].hdg = dir2hdg(dir_v);
+		rwy->ends[1].hdg = dir2hdg(vect2_neg(dir_v));
+		rwy->length = g->len[i];
+
+		rwy->rwy_bbox = rwy_geom_rect_bbox(g, i, ADB_RWY_AREA_RWY, pts);
+		rwy->tora_bbox = rwy_geom_rect_bbox(g, i, ADB_RWY_AREA_TORA,
+		    pts + 5);
+		rwy->asda_bbox = rwy_geom_rect_bbox(g, i, ADB_RWY_AREA_ASDA,
+		    pts + 10);
+		rwy->prox_bbox = rwy_geom_rect_bbox(g, i, ADB_RWY_AREA_PROX,
+		    pts + 15);
+		pts += 20;
+	}
+	arpt->rwy_geom = g;
 }
 
 static void
-unload_rwy_info(runway_t *rwy)
+unload_rwy_geom(airport_t *arpt)
 {
-	ASSERT(rwy != NULL);
-	ASSERT(rwy->rwy_bbox != NULL);
+	ASSERT(arpt->rwy_geom != NULL);
 
-	free(rwy->rwy_bbox);
-	rwy->rwy_bbox = NULL;
-	free(rwy->tora_bbox);
-	rwy->tora_bbox = NULL;
-	free(rwy->asda_bbox);
-	rwy->asda_bbox = NULL;
-	free(rwy->prox_bbox);
-	rwy->prox_bbox = NULL;
-
-	free(rwy->ends[0].apch_bbox);
-	rwy->ends[0].apch_bbox = NULL;
-	free(rwy->ends[1].apch_bbox);
-	rwy->ends[1].apch_bbox = NULL;
+	for (runway_t *rwy = avl_first(&arpt->rwys); rwy != NULL;
+	    rwy = AVL_NEXT(&arpt->rwys, rwy)) {
+		rwy->rwy_bbox = NULL;
+		rwy->tora_bbox = NULL;
+		rwy->asda_bbox = NULL;
+		rwy->prox_bbox = NULL;
+		for (int i = 0; i < 2; i++) {
+			rwy->ends[i].apch_bbox = NULL;
+			rwy->ends[i].dthr_v = NULL_VECT2;
+		}
+	}
+	/* the bounding boxes live in the same allocation */
+	arpt_free(arpt, arpt->rwy_geom);
+	arpt->rwy_geom = NULL;
 }
 
 /*
@@ -2852,16 +5609,16 @@ load_airport(airport_t *arpt)
 	    isnan(arpt->refpt.elev))
 		return (B_FALSE);
 
-	/* must go ahead of load_rwy_info to not trip an assertion */
+	/* must go ahead of load_rwy_geom to not trip an assertion */
 	arpt->load_complete = B_TRUE;
 
 	arpt->fpp = ortho_fpp_init(GEO3_TO_GEO2(arpt->refpt), 0, &wgs84,
 	    B_FALSE);
 	arpt->ecef = geo2ecef_ft(arpt->refpt, &wgs84);
 
-	for (runway_t *rwy = avl_first(&arpt->rwys); rwy != NULL;
-	    rwy = AVL_NEXT(&arpt->rwys, rwy))
-		load_rwy_info(rwy);
+	load_rwy_geom(arpt);
+	if (arpt->tile != NULL)
+		arpt->tile->mem_sz += RWY_GEOM_SZ(arpt->rwy_geom->n_rwys);
 
 	return (B_TRUE);
 }
@@ -2872,9 +5629,11 @@ unload_airport(airport_t *arpt)
 	ASSERT(arpt != NULL);
 	if (!arpt->load_complete)
 		return;
-	for (runway_t *rwy = avl_first(&arpt->rwys); rwy != NULL;
-	    rwy = AVL_NEXT(&arpt->rwys, rwy))
-		unload_rwy_info(rwy);
+	if (arpt->tile != NULL) {
+		arpt->tile->mem_sz -= MIN(arpt->tile->mem_sz,
+		    RWY_GEOM_SZ(arpt->rwy_geom->n_rwys));
+	}
+	unload_rwy_geom(arpt);
 	arpt->load_complete = B_FALSE;
 }
 
@@ -2892,18 +5651,23 @@ free_airport(airport_t *arpt)
 
 	cookie = NULL;
 	while ((rs = avl_destroy_nodes(&arpt->ramp_starts, &cookie)) != NULL)
-		free(rs);
+		arpt_free(arpt, rs);
 	avl_destroy(&arpt->ramp_starts);
 
 	cookie = NULL;
 	while ((rwy = avl_destroy_nodes(&arpt->rwys, &cookie)) != NULL)
-		free(rwy);
+		arpt_free(arpt, rwy);
 	avl_destroy(&arpt->rwys);
 
 	while ((freq = list_remove_head(&arpt->freqs)) != NULL)
-		free(freq);
+		arpt_free(arpt, freq);
 	list_destroy(&arpt->freqs);
 	ASSERT(!list_link_active(&arpt->cur_arpts_node));
+	if (arpt->arena != NULL) {
+		/* this also releases the strings and the airport itself */
+		arena_rele(arpt->arena);
+		return;
+	}
 	LACF_DESTROY(arpt->name_orig);
 	LACF_DESTROY(arpt->city);
 	LACF_DESTROY(arpt->country);
@@ -2926,6 +5690,7 @@ find_nearest_airports_tile(airportdb_t *db, vect3_t ecef,
 
 	if (tile == NULL)
 		return;
+	tile->last_used = microclock();
 	for (airport_t *arpt = avl_first(&tile->arpts); arpt != NULL;
 	    arpt = AVL_NEXT(&tile->arpts, arpt)) {
 		vect3_t arpt_ecef = geo2ecef_ft(arpt->refpt, &wgs84);
@@ -2954,14 +5719,38 @@ find_nearest_airports_tile(airportdb_t *db, vect3_t ecef,
  */
 list_t *
 adb_find_nearest_airports(airportdb_t *db, geo_pos2_t my_pos)
+{
+	return (adb_find_nearest_airports2(db, my_pos, NULL));
+}
+
+/**
+ * Same as adb_find_nearest_airports(), but with asynchronous loading
+ * enabled (see adb_set_async_load()), this also queues the loading of any
+ * of the tiles around `my_pos' which aren't loaded yet, without waiting
+ * for them.
+ *
+ * @param n_pending Optional return argument, which will be filled with the
+ *	number of tiles around `my_pos' which are still being loaded, and
+ *	whose airports are thus missing from the returned list. This is
+ *	always 0 with synchronous loading.
+ */
+list_t *
+adb_find_nearest_airports2(airportdb_t *db, geo_pos2_t my_pos,
+    unsigned *n_pending)
 {
 	vect3_t ecef;
 	list_t *l;
+	unsigned pending = 0;
 
 	ASSERT(db != NULL);
 	ASSERT(!IS_NULL_GEO_POS(my_pos));
 	ecef = geo2ecef_ft(GEO_POS3(my_pos.lat, my_pos.lon, 0), &wgs84);
 
+	if (db->loader != NULL) {
+		tile_loader_merge(db);
+		pending = tile_loader_request_nearest(db, my_pos);
+	}
+
 	l = safe_malloc(sizeof (*l));
 	list_create(l, sizeof (airport_t), offsetof(airport_t, cur_arpts_node));
 	for (int i = -1; i <= 1; i++) {
@@ -2969,6 +5758,8 @@ adb_find_nearest_airports(airportdb_t *db, geo_pos2_t my_pos)
 			find_nearest_airports_tile(db, ecef,
 			    GEO_POS2(my_pos.lat + i, my_pos.lon + j), l);
 	}
+	if (n_pending != NULL)
+		*n_pending = pending;
 
 	return (l);
 }
@@ -2993,66 +5784,593 @@ adb_free_nearest_airport_list(list_t *l)
 	ZERO_FREE(l);
 }
 
+/*
+ * Returns the path of the text cache file of the tile containing tile_pos.
+ */
+static char *
+tile_cache_fname(const airportdb_t *db, geo_pos2_t tile_pos)
+{
+	char *cache_dir, *fname;
+	char lat_lon[16];
+
+	tile_pos = geo_pos2tile_pos(tile_pos, B_FALSE);
+	cache_dir = apt_dat_cache_dir(db, tile_pos, NULL);
+	snprintf(lat_lon, sizeof (lat_lon), TILE_NAME_FMT,
+	    tile_pos.lat, tile_pos.lon);
+	fname = mkpathname(cache_dir, lat_lon, NULL);
+	free(cache_dir);
+
+	return (fname);
+}
+
 static void
 load_airports_in_tile(airportdb_t *db, geo_pos2_t tile_pos)
 {
 	bool_t created;
-	char *cache_dir, *fname;
-	char lat_lon[16];
+	tile_t *tile;
+	char *fname;
+	adb_arena_t *arena;
 
 	ASSERT(db != NULL);
 	ASSERT(!IS_NULL_GEO_POS(tile_pos));
 
-	(void) geo_table_get_tile(db, tile_pos, B_TRUE, &created);
+	tile = geo_table_get_tile(db, tile_pos, B_TRUE, &created);
+	tile->last_used = microclock();
 	if (!created)
 		return;
 
-	tile_pos = geo_pos2tile_pos(tile_pos, B_FALSE);
-	cache_dir = apt_dat_cache_dir(db, tile_pos, NULL);
-	snprintf(lat_lon, sizeof (lat_lon), TILE_NAME_FMT,
-	    tile_pos.lat, tile_pos.lon);
-	fname = mkpathname(cache_dir, lat_lon, NULL);
-	if (file_exists(fname, NULL))
-		read_apt_dat(db, fname, B_FALSE, NULL, B_FALSE);
-	free(cache_dir);
+	fname = tile_cache_fname(db, tile_pos);
+	arena = arena_alloc();
+	if (db->binary_cache) {
+		char *bin_fname = sprintf_alloc("%s" ADB_BIN_SUFFIX, fname);
+		bool_t loaded = load_apt_dat_bin(db, bin_fname, arena);
+
+		free(bin_fname);
+		if (loaded)
+			goto out;
+	}
+	if (file_exists(fname, NULL)) {
+		arena_reserve(arena, TEXT_TILE_MEM_FACT *
+		    MAX(filesz(fname), 0));
+		read_apt_dat(db, fname, B_FALSE, NULL, arena, B_FALSE);
+	}
+out:
+	/* the airports loaded hold on to the arena from here on */
+	arena_rele(arena);
+	free(fname);
+}
+
+static void
+free_tile(airportdb_t *db, tile_t *tile, bool_t do_remove)
+{
+	void *cookie = NULL;
+	airport_t *arpt;
+
+	ASSERT(db != NULL);
+	ASSERT(tile != NULL);
+
+	while ((arpt = avl_destroy_nodes(&tile->arpts, &cookie)) != NULL) {
+		avl_remove(&db->apt_dat, arpt);
+		free_airport(arpt);
+	}
+	avl_destroy(&tile->arpts);
+
+	if (do_remove)
+		avl_remove(&db->geo_table, tile);
+	ZERO_FREE(tile);
+}
+
+/**
+ * Sets the distance limit within which airports are loaded from disk.
+ * A loaded airport has all its information resolved, such as the ECEF
+ * positions of the threshold, all bounding boxes constructed, etc.
+ * The default airport load limit for a newly created airportdb is
+ * 14,816 meters (8nm).
+ *
+ * @param db The database for which to set the load limit.
+ * @param limit The distance limit in meters.
+ */
+void
+adb_set_airport_load_limit(airportdb_t *db, double limit)
+{
+	ASSERT(db != NULL);
+	db->load_limit = limit;
+}
+
+/**
+ * Sets the number of threads used to rebuild the airport database cache
+ * in adb_recreate_cache(). The cache contents don't depend on this
+ * setting. The default for a newly created airportdb is 0, which means
+ * one thread per CPU.
+ *
+ * The multi-threaded rebuild is there so the rebuild can scale with the
+ * number of CPUs; it has not yet been measured to be faster than the
+ * single-threaded one. Rebuilds with more threads than CPUs only add
+ * overhead: with 2 threads on a single CPU, src/test/adbbench measured
+ * 0.84x to 0.99x the single-threaded speed.
+ *
+ * @param db The database for which to set the thread count.
+ * @param n The number of threads to use, 0 to use one per CPU, or 1
+ *	to rebuild the cache on the calling thread only.
+ */
+void
+adb_set_rebuild_threads(airportdb_t *db, unsigned n)
+{
+	ASSERT(db != NULL);
+	db->rebuild_threads = n;
+}
+
+/*
+ * Asynchronous tile loading. Tile load requests are queued by priority
+ * and picked up by a single background worker, which parses the tile into
+ * a detached set of airports, without touching the database. Finished
+ * tiles are merged into the database by tile_loader_merge on the caller's
+ * thread, the next time it calls into the airportdb, so the locking
+ * requirements of the database don't change. Until then, the tile simply
+ * isn't resident. If a tile gets loaded synchronously in the meantime
+ * (e.g. by an airport lookup), the background result is discarded.
+ */
+#define	TILE_PREFETCH_STEP	10000	/* meters */
+#define	TILE_PREFETCH_MAX	64	/* steps along the projected track */
+#define	MAX_WANTED_TILES	(9 + TILE_PREFETCH_MAX)
+
+typedef enum {
+	TILE_REQ_QUEUED,
+	TILE_REQ_BUSY,
+	TILE_REQ_DONE
+} tile_req_state_t;
+
+typedef struct {
+	geo_pos2_t		pos;	/* geo_table key */
+	double			prio;	/* lower loads sooner */
+	uint64_t		gen;	/* loader gen of the last request */
+	tile_req_state_t	state;
+	airport_t		**arpts; /* loaded airports, once done */
+	size_t			n_arpts;
+	size_t			cap_arpts;
+	avl_node_t		reqs_node;
+	avl_node_t		queue_node;
+	list_node_t		done_node;
+} tile_req_t;
+
+struct adb_loader {
+	const airportdb_t	*db;
+	mutex_t			lock;
+	condvar_t		cv;	/* signalled when a tile is done */
+	avl_tree_t		reqs;	/* all outstanding requests by pos */
+	avl_tree_t		queue;	/* TILE_REQ_QUEUED by prio */
+	list_t			done;	/* TILE_REQ_DONE, waiting for a merge */
+	uint64_t		gen;
+	worker_t		worker;
+};
+
+typedef struct {
+	geo_pos2_t		pos;
+	double			prio;
+} tile_want_t;
+
+static int
+tile_req_pos_compar(const void *a, const void *b)
+{
+	const tile_req_t *ra = a, *rb = b;
+
+	if (ra->pos.lat < rb->pos.lat)
+		return (-1);
+	if (ra->pos.lat > rb->pos.lat)
+		return (1);
+	if (ra->pos.lon < rb->pos.lon)
+		return (-1);
+	if (ra->pos.lon > rb->pos.lon)
+		return (1);
+	return (0);
+}
+
+static int
+tile_req_prio_compar(const void *a, const void *b)
+{
+	const tile_req_t *ra = a, *rb = b;
+
+	if (ra->prio < rb->prio)
+		return (-1);
+	if (ra->prio > rb->prio)
+		return (1);
+	return (tile_req_pos_compar(a, b));
+}
+
+static void
+tile_req_free(tile_req_t *req)
+{
+	for (size_t i = 0; i < req->n_arpts; i++)
+		free_airport(req->arpts[i]);
+	free(req->arpts);
+	free(req);
+}
+
+static void
+tile_req_add_arpt(void *userinfo, airport_t *arpt)
+{
+	tile_req_t *req = userinfo;
+
+	/* Same as read_apt_dat_insert */
+	if (arpt == NULL)
+		return;
+	if (avl_numnodes(&arpt->rwys) == 0) {
+		free_airport(arpt);
+		return;
+	}
+	if (req->n_arpts == req->cap_arpts) {
+		req->cap_arpts = MAX(req->cap_arpts * 2, 16);
+		req->arpts = safe_realloc(req->arpts,
+		    req->cap_arpts * sizeof (*req->arpts));
+	}
+	req->arpts[req->n_arpts++] = arpt;
+}
+
+/*
+ * Parses a tile into req->arpts on the worker thread. This only reads the
+ * database's immutable settings. The airports are also fully loaded here,
+ * so that doesn't need to happen on the caller's thread either.
+ */
+static void
+tile_req_load(const airportdb_t *db, tile_req_t *req)
+{
+	char *fname = tile_cache_fname(db, req->pos);
+	bool_t loaded = B_FALSE;
+	adb_arena_t *arena = arena_alloc();
+
+	if (db->binary_cache) {
+		char *bin_fname = sprintf_alloc("%s" ADB_BIN_SUFFIX, fname);
+
+		loaded = load_apt_dat_bin_impl(bin_fname, arena, B_TRUE, NULL,
+		    tile_req_add_arpt, req);
+		free(bin_fname);
+	}
+	if (!loaded && file_exists(fname, NULL)) {
+		apt_dat_chunk_t *chunks = NULL;
+		size_t n_chunks = 0, cap = 0;
+
+		/* all of these airports get loaded right away */
+		arena_reserve(arena, TEXT_TILE_GEOM_MEM_FACT *
+		    MAX(filesz(fname), 0));
+		apt_dat_split_chunks(fname, B_FALSE, &chunks, &n_chunks, &cap);
+		for (size_t i = 0; i < n_chunks; i++) {
+			apt_dat_rec_t *rec;
+
+			chunks[i].arena = arena;
+			apt_dat_parse_chunk(db, &chunks[i], NULL);
+			while ((rec = list_remove_head(&chunks[i].recs)) !=
+			    NULL) {
+				tile_req_add_arpt(req, rec->arpt);
+				free(rec);
+			}
+			list_destroy(&chunks[i].recs);
+		}
+		free(chunks);
+	}
+	for (size_t i = 0; i < req->n_arpts; i++)
+		(void) load_airport(req->arpts[i]);
+	arena_rele(arena);
 	free(fname);
 }
 
-static void
-free_tile(airportdb_t *db, tile_t *tile, bool_t do_remove)
+static bool_t
+tile_loader_worker(void *userinfo)
+{
+	struct adb_loader *ldr = userinfo;
+	tile_req_t *req;
+
+	mutex_enter(&ldr->lock);
+	while ((req = avl_first(&ldr->queue)) != NULL) {
+		avl_remove(&ldr->queue, req);
+		req->state = TILE_REQ_BUSY;
+		mutex_exit(&ldr->lock);
+
+		tile_req_load(ldr->db, req);
+
+		mutex_enter(&ldr->lock);
+		req->state = TILE_REQ_DONE;
+		list_insert_tail(&ldr->done, req);
+		cv_broadcast(&ldr->cv);
+	}
+	mutex_exit(&ldr->lock);
+
+	return (B_TRUE);
+}
+
+/*
+ * Merges all tiles finished by the worker into the database.
+ */
+static void
+tile_loader_merge(airportdb_t *db)
+{
+	struct adb_loader *ldr = db->loader;
+	list_t done;
+	tile_req_t *req;
+
+	if (ldr == NULL)
+		return;
+
+	list_create(&done, sizeof (tile_req_t),
+	    offsetof(tile_req_t, done_node));
+	mutex_enter(&ldr->lock);
+	list_move_tail(&done, &ldr->done);
+	for (req = list_head(&done); req != NULL; req = list_next(&done, req))
+		avl_remove(&ldr->reqs, req);
+	mutex_exit(&ldr->lock);
+
+	while ((req = list_remove_head(&done)) != NULL) {
+		bool_t created;
+
+		(void) geo_table_get_tile(db, req->pos, B_TRUE, &created);
+		for (size_t i = 0; created && i < req->n_arpts; i++) {
+			/* Same duplicate check as load_apt_dat_bin */
+			if (apt_dat_lookup(db, req->arpts[i]->ident) == NULL) {
+				read_apt_dat_insert(db, req->arpts[i]);
+				req->arpts[i] = NULL;
+			}
+		}
+		for (size_t i = 0; i < req->n_arpts; i++) {
+			if (req->arpts[i] != NULL)
+				free_airport(req->arpts[i]);
+		}
+		req->n_arpts = 0;
+		tile_req_free(req);
+	}
+	list_destroy(&done);
+}
+
+/*
+ * Drops all queued tile loads and waits for the worker to finish the one
+ * it's working on, then discards all unmerged results.
+ */
+static void
+tile_loader_flush(airportdb_t *db)
+{
+	struct adb_loader *ldr = db->loader;
+	tile_req_t *req;
+	void *cookie = NULL;
+
+	if (ldr == NULL)
+		return;
+
+	mutex_enter(&ldr->lock);
+	while ((req = avl_destroy_nodes(&ldr->queue, &cookie)) != NULL) {
+		avl_remove(&ldr->reqs, req);
+		tile_req_free(req);
+	}
+	avl_destroy(&ldr->queue);
+	avl_create(&ldr->queue, tile_req_prio_compar, sizeof (tile_req_t),
+	    offsetof(tile_req_t, queue_node));
+	while (avl_numnodes(&ldr->reqs) != list_count(&ldr->done))
+		cv_wait(&ldr->cv, &ldr->lock);
+	while ((req = list_remove_head(&ldr->done)) != NULL) {
+		avl_remove(&ldr->reqs, req);
+		tile_req_free(req);
+	}
+	mutex_exit(&ldr->lock);
+}
+
+/*
+ * Queues a tile load, or updates the priority of an already queued one.
+ * Must be called with the loader lock held. Returns B_TRUE if the tile
+ * is now pending, or B_FALSE if it's already resident. `added' is set
+ * if a new load was queued, which the worker must be woken up for.
+ */
+static bool_t
+tile_loader_request(airportdb_t *db, geo_pos2_t pos, double prio,
+    bool_t *added)
+{
+	struct adb_loader *ldr = db->loader;
+	tile_req_t srch, *req;
+	avl_index_t where;
+	tile_t *tile;
+
+	srch.pos = GEO_POS2(floor(pos.lat), floor(pos.lon));
+	tile = geo_table_get_tile(db, srch.pos, B_FALSE, NULL);
+	if (tile != NULL) {
+		tile->last_used = microclock();
+		return (B_FALSE);
+	}
+	req = avl_find(&ldr->reqs, &srch, &where);
+	if (req == NULL) {
+		req = safe_calloc(1, sizeof (*req));
+		req->pos = srch.pos;
+		req->prio = prio;
+		req->gen = ldr->gen;
+		req->state = TILE_REQ_QUEUED;
+		avl_insert(&ldr->reqs, req, where);
+		avl_add(&ldr->queue, req);
+		*added = B_TRUE;
+	} else if (req->state == TILE_REQ_QUEUED &&
+	    (req->gen != ldr->gen || prio < req->prio)) {
+		avl_remove(&ldr->queue, req);
+		req->prio = (req->gen != ldr->gen ? prio :
+		    MIN(prio, req->prio));
+		req->gen = ldr->gen;
+		avl_add(&ldr->queue, req);
+	} else {
+		req->gen = ldr->gen;
+	}
+
+	return (B_TRUE);
+}
+
+static void
+add_wanted_tile(tile_want_t *want, size_t *n_want, geo_pos2_t pos,
+    double prio)
+{
+	pos = GEO_POS2(floor(pos.lat), floor(pos.lon));
+	for (size_t i = 0; i < *n_want; i++) {
+		if (want[i].pos.lat == pos.lat && want[i].pos.lon == pos.lon) {
+			want[i].prio = MIN(want[i].prio, prio);
+			return;
+		}
+	}
+	ASSERT3U(*n_want, <, MAX_WANTED_TILES);
+	want[*n_want].pos = pos;
+	want[*n_want].prio = prio;
+	(*n_want)++;
+}
+
+/*
+ * Determines which tiles we want loaded around `my_pos' and in what order.
+ * These are the 3x3 tiles around the aircraft, ordered by distance, with
+ * tiles behind the aircraft counted as up to twice as far away as tiles
+ * ahead of it. If the track is known, we also want the tiles along the
+ * projected track, up to `lookahead' meters ahead. Priorities only need to
+ * order the tiles, so the distances to the 3x3 tiles' centers are computed
+ * on a local flat-earth approximation.
+ */
+static size_t
+nearest_tiles_wanted(geo_pos2_t my_pos, double trk, double lookahead,
+    tile_want_t want[MAX_WANTED_TILES])
+{
+	size_t n_want = 0;
+	vect2_t dir = (isnan(trk) ? NULL_VECT2 : hdg2dir(trk));
+	double cos_lat = cos(DEG2RAD(my_pos.lat));
+
+	for (int i = -1; i <= 1; i++) {
+		for (int j = -1; j <= 1; j++) {
+			geo_pos2_t pos = GEO_POS2(my_pos.lat + i,
+			    my_pos.lon + j);
+			vect2_t d = VECT2((floor(pos.lon) + 0.5 - my_pos.lon) *
+			    cos_lat, floor(pos.lat) + 0.5 - my_pos.lat);
+			double prio = 0;
+
+			if (i != 0 || j != 0) {
+				prio = NM2MET(60 * vect2_abs(d));
+				if (!IS_NULL_VECT(dir) && prio > 0) {
+					prio *= 1.5 - 0.5 * vect2_dotprod(dir,
+					    d) / vect2_abs(d);
+				}
+			}
+			add_wanted_tile(want, &n_want, pos, prio);
+		}
+	}
+	if (!isnan(trk) && lookahead > 0) {
+		/* same as geo_displace, but with one projection setup */
+		fpp_t fpp = gnomo_fpp_init(my_pos, 0, &wgs84, B_TRUE);
+		vect2_t dir = hdg2dir(trk);
+
+		for (int i = 1; i <= TILE_PREFETCH_MAX &&
+		    i * TILE_PREFETCH_STEP <= lookahead; i++) {
+			double dist = i * TILE_PREFETCH_STEP;
+			vect2_t v = vect2_set_abs(dir,
+			    EARTH_MSL * tan(dist / EARTH_MSL));
+
+			add_wanted_tile(want, &n_want, fpp2geo(v, &fpp), dist);
+		}
+	}
+
+	return (n_want);
+}
+
+/*
+ * Queues the loading of any of the 3x3 tiles around `my_pos' which aren't
+ * loaded yet. Returns the number of those tiles which are pending.
+ */
+static unsigned
+tile_loader_request_nearest(airportdb_t *db, geo_pos2_t my_pos)
+{
+	struct adb_loader *ldr = db->loader;
+	tile_want_t want[MAX_WANTED_TILES];
+	size_t n_want = nearest_tiles_wanted(my_pos, NAN, 0, want);
+	unsigned pending = 0;
+	bool_t added = B_FALSE;
+
+	mutex_enter(&ldr->lock);
+	for (size_t i = 0; i < n_want; i++) {
+		if (tile_loader_request(db, want[i].pos, want[i].prio,
+		    &added))
+			pending++;
+	}
+	mutex_exit(&ldr->lock);
+	if (added)
+		worker_wake_up(&ldr->worker);
+
+	return (pending);
+}
+
+static int
+tile_want_compar(const void *a, const void *b)
+{
+	const tile_want_t *wa = a, *wb = b;
+
+	if (wa->prio < wb->prio)
+		return (-1);
+	if (wa->prio > wb->prio)
+		return (1);
+	return (0);
+}
+
+/**
+ * Switches the airport database between synchronous and asynchronous
+ * tile loading. In asynchronous mode, adb_load_nearest_airport_tiles()
+ * and adb_load_nearest_airport_tiles2() only queue the tiles for loading
+ * on a background thread and return immediately. Loaded tiles become
+ * visible to adb_find_nearest_airports() & co. on the next call into the
+ * database after they're finished. Lookups of individual airports (e.g.
+ * adb_airport_lookup()) still load their tile synchronously if it isn't
+ * loaded yet. The default for a newly created airportdb is synchronous.
+ *
+ * While asynchronous loading is enabled, you mustn't change any of the
+ * settings in the \ref airportdb_t structure.
+ */
+void
+adb_set_async_load(airportdb_t *db, bool_t flag)
 {
-	void *cookie = NULL;
-	airport_t *arpt;
+	struct adb_loader *ldr;
 
 	ASSERT(db != NULL);
-	ASSERT(tile != NULL);
 
-	while ((arpt = avl_destroy_nodes(&tile->arpts, &cookie)) != NULL) {
-		avl_remove(&db->apt_dat, arpt);
-		free_airport(arpt);
+	if (flag && db->loader == NULL) {
+		ldr = safe_calloc(1, sizeof (*ldr));
+		ldr->db = db;
+		mutex_init(&ldr->lock);
+		cv_init(&ldr->cv);
+		avl_create(&ldr->reqs, tile_req_pos_compar,
+		    sizeof (tile_req_t), offsetof(tile_req_t, reqs_node));
+		avl_create(&ldr->queue, tile_req_prio_compar,
+		    sizeof (tile_req_t), offsetof(tile_req_t, queue_node));
+		list_create(&ldr->done, sizeof (tile_req_t),
+		    offsetof(tile_req_t, done_node));
+		worker_init(&ldr->worker, tile_loader_worker, 0, ldr,
+		    "adb_loader");
+		db->loader = ldr;
+	} else if (!flag && db->loader != NULL) {
+		tile_loader_flush(db);
+		ldr = db->loader;
+		worker_fini(&ldr->worker);
+		ASSERT0(avl_numnodes(&ldr->reqs));
+		avl_destroy(&ldr->reqs);
+		avl_destroy(&ldr->queue);
+		list_destroy(&ldr->done);
+		cv_destroy(&ldr->cv);
+		mutex_destroy(&ldr->lock);
+		ZERO_FREE(ldr);
+		db->loader = NULL;
 	}
-	avl_destroy(&tile->arpts);
-
-	if (do_remove)
-		avl_remove(&db->geo_table, tile);
-	ZERO_FREE(tile);
 }
 
 /**
- * Sets the distance limit within which airports are loaded from disk.
- * A loaded airport has all its information resolved, such as the ECEF
- * positions of the threshold, all bounding boxes constructed, etc.
- * The default airport load limit for a newly created airportdb is
- * 14,816 meters (8nm).
+ * Sets a memory budget for loaded airport tiles. When set, the next
+ * adb_unload_distant_airport_tiles() call only unloads tiles once the
+ * (approximate) memory held by loaded tiles exceeds the budget, starting
+ * with the least recently used ones. The estimate covers the tiles
+ * themselves (including empty ones), their airports and the runway
+ * geometry of loaded airports. The 3x3 tiles around the aircraft
+ * are never unloaded this way. The default for a newly created airportdb
+ * is 0, which unloads all tiles outside of the 3x3 tiles around the
+ * aircraft.
  *
- * @param db The database for which to set the load limit.
- * @param limit The distance limit in meters.
+ * @param db The database for which to set the memory budget.
+ * @param bytes The memory budget in bytes, or 0 to unload by distance.
  */
 void
-adb_set_airport_load_limit(airportdb_t *db, double limit)
+adb_set_tile_mem_budget(airportdb_t *db, size_t bytes)
 {
 	ASSERT(db != NULL);
-	db->load_limit = limit;
+	db->tile_mem_budget = bytes;
 }
 
 /**
@@ -3060,6 +6378,8 @@ adb_set_airport_load_limit(airportdb_t *db, double limit)
  * position. The distance limit is set using adb_set_airport_load_limit().
  * A loaded airport has all its information resolved, such as the ECEF
  * positions of the threshold, all bounding boxes constructed, etc.
+ * This is the same as calling adb_load_nearest_airport_tiles2() without
+ * a track.
  *
  * @param db The database for which to perform the load.
  * @param my_pos The 2-space geographic position around which to perform
@@ -3068,14 +6388,105 @@ adb_set_airport_load_limit(airportdb_t *db, double limit)
 void
 load_nearest_airport_tiles(airportdb_t *db, geo_pos2_t my_pos)
 {
+	adb_load_nearest_airport_tiles2(db, my_pos, NAN, 0);
+}
+
+/**
+ * Same as adb_load_nearest_airport_tiles(), but also takes the aircraft's
+ * track into account. Tiles are loaded in order of distance, preferring
+ * tiles ahead of the aircraft, and the tiles along the projected track
+ * are loaded as well. With asynchronous loading (see adb_set_async_load()),
+ * this only queues the loads and returns immediately. Any previously
+ * queued loads of tiles which are no longer wanted are dropped, so this
+ * should be called at regular intervals as the aircraft moves.
+ *
+ * @param db The database for which to perform the load.
+ * @param my_pos The 2-space geographic position around which to perform
+ *	the load. This MUST be a valid geographic coordinate.
+ * @param trk The aircraft's true track in degrees, or `NAN' if unknown.
+ * @param lookahead Distance in meters along the projected track, up to
+ *	which tiles are also loaded. Pass 0 to only load the tiles around
+ *	`my_pos'.
+ */
+void
+adb_load_nearest_airport_tiles2(airportdb_t *db, geo_pos2_t my_pos,
+    double trk, double lookahead)
+{
+	tile_want_t want[MAX_WANTED_TILES];
+	size_t n_want;
+
 	ASSERT(db != NULL);
 	ASSERT(!IS_NULL_GEO_POS(my_pos));
 
-	for (int i = -1; i <= 1; i++) {
-		for (int j = -1; j <= 1; j++)
-			load_airports_in_tile(db, GEO_POS2(my_pos.lat + i,
-			    my_pos.lon + j));
+	n_want = nearest_tiles_wanted(my_pos, trk, lookahead, want);
+	if (db->loader == NULL) {
+		qsort(want, n_want, sizeof (*want), tile_want_compar);
+		for (size_t i = 0; i < n_want; i++)
+			load_airports_in_tile(db, want[i].pos);
+	} else {
+		struct adb_loader *ldr = db->loader;
+		tile_req_t *req, *next_req;
+		bool_t added = B_FALSE;
+
+		tile_loader_merge(db);
+		mutex_enter(&ldr->lock);
+		ldr->gen++;
+		for (size_t i = 0; i < n_want; i++) {
+			(void) tile_loader_request(db, want[i].pos,
+			    want[i].prio, &added);
+		}
+		/* drop queued loads we no longer want */
+		for (req = avl_first(&ldr->queue); req != NULL;
+		    req = next_req) {
+			next_req = AVL_NEXT(&ldr->queue, req);
+			if (req->gen != ldr->gen) {
+				avl_remove(&ldr->queue, req);
+				avl_remove(&ldr->reqs, req);
+				tile_req_free(req);
+			}
+		}
+		mutex_exit(&ldr->lock);
+		if (added)
+			worker_wake_up(&ldr->worker);
+	}
+}
+
+/**
+ * Returns the tiles whose loading has been queued with asynchronous
+ * loading enabled, but which aren't loaded yet.
+ *
+ * @param db The database to query.
+ * @param tiles Optional return array, which will be filled with the
+ *	positions of the south-west corners of up to `max_tiles' pending
+ *	tiles. Pending tiles are listed in no particular order.
+ * @param max_tiles Capacity of the `tiles' array.
+ *
+ * @return The total number of pending tiles.
+ */
+size_t
+adb_pending_airport_tiles(airportdb_t *db, geo_pos2_t *tiles,
+    size_t max_tiles)
+{
+	struct adb_loader *ldr;
+	size_t n = 0;
+
+	ASSERT(db != NULL);
+	ASSERT(tiles != NULL || max_tiles == 0);
+
+	tile_loader_merge(db);
+	ldr = db->loader;
+	if (ldr == NULL)
+		return (0);
+
+	mutex_enter(&ldr->lock);
+	for (const tile_req_t *req = avl_first(&ldr->reqs); req != NULL;
+	    req = AVL_NEXT(&ldr->reqs, req), n++) {
+		if (n < max_tiles)
+			tiles[n] = req->pos;
 	}
+	mutex_exit(&ldr->lock);
+
+	return (n);
 }
 
 static double
@@ -3089,17 +6500,81 @@ lon_delta(double x, double y)
 		return (fabs((180 - u) - (-180 - d)));
 }
 
+static bool_t
+tile_is_distant(const tile_t *tile, geo_pos2_t my_pos)
+{
+	return (IS_NULL_GEO_POS(my_pos) ||
+	    fabs(tile->pos.lat - floor(my_pos.lat)) > 1 ||
+	    lon_delta(tile->pos.lon, floor(my_pos.lon)) > 1);
+}
+
 static void
 unload_distant_airport_tiles_i(airportdb_t *db, tile_t *tile, geo_pos2_t my_pos)
 {
 	ASSERT(db != NULL);
 	ASSERT(tile != NULL);
-	if (IS_NULL_GEO_POS(my_pos) ||
-	    fabs(tile->pos.lat - floor(my_pos.lat)) > 1 ||
-	    lon_delta(tile->pos.lon, floor(my_pos.lon)) > 1)
+	if (tile_is_distant(tile, my_pos))
 		free_tile(db, tile, B_TRUE);
 }
 
+static int
+tile_lru_compar(const void *a, const void *b)
+{
+	const tile_t *ta = *(const tile_t **)a, *tb = *(const tile_t **)b;
+
+	if (ta->last_used < tb->last_used)
+		return (-1);
+	if (ta->last_used > tb->last_used)
+		return (1);
+	return (0);
+}
+
+/*
+ * Approximate amount of memory held by a loaded tile. Besides its
+ * airports, a tile costs its own record, which is charged even if the
+ * tile holds no airports, so that the budget also limits the number of
+ * empty tiles kept around.
+ */
+static size_t
+tile_mem_sz(const tile_t *tile)
+{
+	return (sizeof (*tile) + tile->mem_sz);
+}
+
+/*
+ * Unloads the least recently used distant tiles until the loaded tiles
+ * fit into db->tile_mem_budget.
+ */
+static void
+unload_lru_airport_tiles(airportdb_t *db, geo_pos2_t my_pos)
+{
+	size_t total = 0, n_distant = 0;
+	tile_t **distant;
+
+	ASSERT(db != NULL);
+	ASSERT(!IS_NULL_GEO_POS(my_pos));
+
+	for (const tile_t *tile = avl_first(&db->geo_table); tile != NULL;
+	    tile = AVL_NEXT(&db->geo_table, tile))
+		total += tile_mem_sz(tile);
+	if (total <= db->tile_mem_budget)
+		return;
+
+	distant = safe_malloc(avl_numnodes(&db->geo_table) *
+	    sizeof (*distant));
+	for (tile_t *tile = avl_first(&db->geo_table); tile != NULL;
+	    tile = AVL_NEXT(&db->geo_table, tile)) {
+		if (tile_is_distant(tile, my_pos))
+			distant[n_distant++] = tile;
+	}
+	qsort(distant, n_distant, sizeof (*distant), tile_lru_compar);
+	for (size_t i = 0; i < n_distant && total > db->tile_mem_budget; i++) {
+		total -= MIN(total, tile_mem_sz(distant[i]));
+		free_tile(db, distant[i], B_TRUE);
+	}
+	free(distant);
+}
+
 /**
  * Unloads airports that are beyond the airport load limit distance from
  * a given position. This frees some memory allocations for the airports.
@@ -3121,6 +6596,14 @@ adb_unload_distant_airport_tiles(airportdb_t *db, geo_pos2_t my_pos)
 	ASSERT(db != NULL);
 	/* my_pos can be NULL_GEO_POS2 */
 
+	if (IS_NULL_GEO_POS(my_pos))
+		tile_loader_flush(db);
+	else
+		tile_loader_merge(db);
+	if (!IS_NULL_GEO_POS(my_pos) && db->tile_mem_budget != 0) {
+		unload_lru_airport_tiles(db, my_pos);
+		return;
+	}
 	for (tile = avl_first(&db->geo_table); tile != NULL; tile = next_tile) {
 		next_tile = AVL_NEXT(&db->geo_table, tile);
 		unload_distant_airport_tiles_i(db, tile, my_pos);
@@ -3166,6 +6649,11 @@ airportdb_create(airportdb_t *db, const char *xpdir, const char *cachedir)
 	db->load_limit = ARPT_LOAD_LIMIT;
 	db->ifr_only = B_TRUE;
 	db->normalize_gate_names = B_FALSE;
+	db->rebuild_threads = 0;
+	db->binary_cache = B_TRUE;
+	db->arpt_kdtree = NULL;
+	db->loader = NULL;
+	db->tile_mem_budget = 0;
 
 	mutex_init(&db->lock);
 
@@ -3179,10 +6667,10 @@ airportdb_create(airportdb_t *db, const char *xpdir, const char *cachedir)
 	 * Just some defaults - we'll resize the tables later when
 	 * we actually read the index file.
 	 */
-	htbl2_create(&db->icao_index, 16, AIRPORTDB_ICAO_LEN,
-	    sizeof (arpt_index_t), B_TRUE);
-	htbl2_create(&db->iata_index, 16, AIRPORTDB_IATA_LEN,
-	    sizeof (arpt_index_t), B_TRUE);
+	htbl2_create_opts(&db->icao_index, 16, AIRPORTDB_ICAO_LEN,
+	    sizeof (arpt_index_t), B_TRUE, &index_htbl_opts);
+	htbl2_create_opts(&db->iata_index, 16, AIRPORTDB_IATA_LEN,
+	    sizeof (arpt_index_t), B_TRUE, &index_htbl_opts);
 }
 
 /**
@@ -3194,15 +6682,13 @@ airportdb_destroy(airportdb_t *db)
 {
 	tile_t *tile;
 	void *cookie;
-	arpt_index_t *idx;
 
 	ASSERT(db != NULL);
 	if (!db->inited)
 		return;
 
-	cookie = NULL;
-	while ((idx = avl_destroy_nodes(&db->arpt_index, &cookie)) != NULL)
-		free(idx);
+	adb_set_async_load(db, B_FALSE);
+	free_arpt_index(db);
 	avl_destroy(&db->arpt_index);
 
 	/* airports are freed in the free_tile function */
@@ -3458,6 +6944,382 @@ adb_airport_index_walk(const airportdb_t *db,
 	return (avl_numnodes(&db->arpt_index));
 }
 
+/*
+ * The spatial index is an implicit k-d tree over the ECEF positions (in
+ * meters) of all entries in arpt_index. The subtree covering nodes[lo, hi)
+ * has its splitting node at the middle of that range, with all nodes
+ * before it having a coordinate on the splitting axis less than or equal
+ * to, and all nodes after it greater than or equal to, the splitting
+ * node's. Each subtree is split along the axis on which it spans the
+ * largest distance. Ranges of up to KD_LEAF_SZ nodes aren't split any
+ * further and are simply scanned. The tree is immutable once built, so it
+ * can be queried from any number of threads without locking.
+ */
+#define	KD_LEAF_SZ	8
+
+typedef struct {
+	double			ecef[3];
+	const arpt_index_t	*idx;
+	unsigned		axis;
+} arpt_kdnode_t;
+
+struct arpt_kdtree {
+	arpt_kdnode_t		*nodes;
+	size_t			n_nodes;
+};
+
+typedef struct {
+	double			dist2;
+	const arpt_index_t	*idx;
+} arpt_kdheap_t;
+
+typedef struct {
+	double			q[3];
+	arpt_kdheap_t		*heap;		/* max-heap on dist2 */
+	size_t			n_heap;
+	size_t			max_heap;
+	double			max_dist2;
+} arpt_kdnearest_t;
+
+static inline double
+kd_dist2(const double a[3], const double b[3])
+{
+	return (POW2(a[0] - b[0]) + POW2(a[1] - b[1]) + POW2(a[2] - b[2]));
+}
+
+static void
+kd_pos2ecef(geo_pos2_t pos, double ecef[3])
+{
+	vect3_t v = geo2ecef_mtr(GEO_POS3(pos.lat, pos.lon, 0), &wgs84);
+
+	ecef[0] = v.x;
+	ecef[1] = v.y;
+	ecef[2] = v.z;
+}
+
+static inline void
+kd_swap(arpt_kdnode_t *nodes, size_t a, size_t b)
+{
+	arpt_kdnode_t tmp = nodes[a];
+	nodes[a] = nodes[b];
+	nodes[b] = tmp;
+}
+
+/*
+ * Reorders nodes[lo, hi) so that nodes[k] ends up where it would be if the
+ * range were sorted on `axis', with nothing greater before it and nothing
+ * smaller after it. Uses a three-way partition, so runs of identical
+ * coordinates don't degrade it.
+ */
+static void
+kd_select(arpt_kdnode_t *nodes, size_t lo, size_t hi, size_t k, unsigned axis)
+{
+	while (hi - lo > 1) {
+		double pivot = nodes[lo + (hi - lo) / 2].ecef[axis];
+		size_t lt = lo, i = lo, gt = hi;
+
+		while (i < gt) {
+			double v = nodes[i].ecef[axis];
+
+			if (v < pivot)
+				kd_swap(nodes, lt++, i++);
+			else if (v > pivot)
+				kd_swap(nodes, i, --gt);
+			else
+				i++;
+		}
+		if (k < lt)
+			hi = lt;
+		else if (k >= gt)
+			lo = gt;
+		else
+			return;
+	}
+}
+
+static void
+kd_build(arpt_kdnode_t *nodes, size_t lo, size_t hi)
+{
+	while (hi - lo > KD_LEAF_SZ) {
+		double min_v[3] = { INFINITY, INFINITY, INFINITY };
+		double max_v[3] = { -INFINITY, -INFINITY, -INFINITY };
+		size_t mid = lo + (hi - lo) / 2;
+		unsigned axis = 0;
+
+		for (size_t i = lo; i < hi; i++) {
+			for (unsigned a = 0; a < 3; a++) {
+				min_v[a] = MIN(min_v[a], nodes[i].ecef[a]);
+				max_v[a] = MAX(max_v[a], nodes[i].ecef[a]);
+			}
+		}
+		for (unsigned a = 1; a < 3; a++) {
+			if (max_v[a] - min_v[a] > max_v[axis] - min_v[axis])
+				axis = a;
+		}
+		kd_select(nodes, lo, hi, mid, axis);
+		nodes[mid].axis = axis;
+		kd_build(nodes, lo, mid);
+		lo = mid + 1;
+	}
+}
+
+static void
+arpt_kdtree_free(airportdb_t *db)
+{
+	ASSERT(db != NULL);
+	if (db->arpt_kdtree != NULL) {
+		free(db->arpt_kdtree->nodes);
+		ZERO_FREE(db->arpt_kdtree);
+	}
+}
+
+static void
+arpt_kdtree_build(airportdb_t *db)
+{
+	struct arpt_kdtree *tree = safe_calloc(1, sizeof (*tree));
+	size_t i = 0;
+
+	ASSERT(db != NULL);
+
+	tree->n_nodes = avl_numnodes(&db->arpt_index);
+	tree->nodes = safe_calloc(MAX(tree->n_nodes, 1),
+	    sizeof (*tree->nodes));
+	for (const arpt_index_t *idx = avl_first(&db->arpt_index);
+	    idx != NULL; idx = AVL_NEXT(&db->arpt_index, idx), i++) {
+		vect3_t v = geo2ecef_ft(GEO_POS3(idx->pos.lat, idx->pos.lon,
+		    idx->pos.elev), &wgs84);
+
+		tree->nodes[i].ecef[0] = v.x;
+		tree->nodes[i].ecef[1] = v.y;
+		tree->nodes[i].ecef[2] = v.z;
+		tree->nodes[i].idx = idx;
+	}
+	kd_build(tree->nodes, 0, tree->n_nodes);
+
+	arpt_kdtree_free(db);
+	db->arpt_kdtree = tree;
+}
+
+static size_t
+kd_radius(const arpt_kdnode_t *nodes, size_t lo, size_t hi, const double q[3],
+    double radius, void (*found_cb)(const arpt_index_t *idx, void *userinfo),
+    void *userinfo)
+{
+	size_t n_found = 0;
+
+	while (hi - lo > KD_LEAF_SZ) {
+		size_t mid = lo + (hi - lo) / 2;
+		const arpt_kdnode_t *node = &nodes[mid];
+		double d = q[node->axis] - node->ecef[node->axis];
+
+		if (kd_dist2(q, node->ecef) < POW2(radius)) {
+			if (found_cb != NULL)
+				found_cb(node->idx, userinfo);
+			n_found++;
+		}
+		/* descend into the near side, only recurse on the far one */
+		if (d <= 0) {
+			if (-d < radius) {
+				n_found += kd_radius(nodes, mid + 1, hi, q,
+				    radius, found_cb, userinfo);
+			}
+			hi = mid;
+		} else {
+			if (d < radius) {
+				n_found += kd_radius(nodes, lo, mid, q, radius,
+				    found_cb, userinfo);
+			}
+			lo = mid + 1;
+		}
+	}
+	for (size_t i = lo; i < hi; i++) {
+		if (kd_dist2(q, nodes[i].ecef) < POW2(radius)) {
+			if (found_cb != NULL)
+				found_cb(nodes[i].idx, userinfo);
+			n_found++;
+		}
+	}
+
+	return (n_found);
+}
+
+static void
+kd_heap_push(arpt_kdnearest_t *kn, double dist2, const arpt_index_t *idx)
+{
+	arpt_kdheap_t *heap = kn->heap;
+	size_t i;
+
+	if (kn->n_heap == kn->max_heap) {
+		/* replace the current farthest result and sift it down */
+		i = 0;
+		for (;;) {
+			size_t l = 2 * i + 1, r = l + 1, big = i;
+			double big_d2 = dist2;
+
+			if (l < kn->n_heap && heap[l].dist2 > big_d2) {
+				big = l;
+				big_d2 = heap[l].dist2;
+			}
+			if (r < kn->n_heap && heap[r].dist2 > big_d2)
+				big = r;
+			if (big == i)
+				break;
+			heap[i] = heap[big];
+			i = big;
+		}
+	} else {
+		for (i = kn->n_heap++; i > 0 &&
+		    heap[(i - 1) / 2].dist2 < dist2; i = (i - 1) / 2)
+			heap[i] = heap[(i - 1) / 2];
+	}
+	heap[i].dist2 = dist2;
+	heap[i].idx = idx;
+}
+
+static inline double
+kd_nearest_limit(const arpt_kdnearest_t *kn)
+{
+	if (kn->n_heap == kn->max_heap)
+		return (MIN(kn->heap[0].dist2, kn->max_dist2));
+	return (kn->max_dist2);
+}
+
+static void
+kd_nearest(const arpt_kdnode_t *nodes, size_t lo, size_t hi,
+    arpt_kdnearest_t *kn)
+{
+	while (hi - lo > KD_LEAF_SZ) {
+		size_t mid = lo + (hi - lo) / 2;
+		const arpt_kdnode_t *node = &nodes[mid];
+		double d = kn->q[node->axis] - node->ecef[node->axis];
+		double dist2 = kd_dist2(kn->q, node->ecef);
+
+		if (dist2 < kd_nearest_limit(kn))
+			kd_heap_push(kn, dist2, node->idx);
+		/*
+		 * Search the near side first, so the far side is more likely
+		 * to get pruned by the results found there.
+		 */
+		if (d <= 0) {
+			kd_nearest(nodes, lo, mid, kn);
+			if (POW2(d) >= kd_nearest_limit(kn))
+				return;
+			lo = mid + 1;
+		} else {
+			kd_nearest(nodes, mid + 1, hi, kn);
+			if (POW2(d) >= kd_nearest_limit(kn))
+				return;
+			hi = mid;
+		}
+	}
+	for (size_t i = lo; i < hi; i++) {
+		double dist2 = kd_dist2(kn->q, nodes[i].ecef);
+
+		if (dist2 < kd_nearest_limit(kn))
+			kd_heap_push(kn, dist2, nodes[i].idx);
+	}
+}
+
+/**
+ * Locates the airports in the airport index which are closest to a given
+ * position, without loading any airport tiles. Distances are measured in
+ * a straight line in ECEF space, from the position at sea level to the
+ * airport's reference point (at its elevation), same as
+ * adb_find_nearest_airports(). The index can be queried without holding
+ * the database lock, as long as adb_recreate_cache() isn't running.
+ *
+ * @param db The airport database to search.
+ * @param pos The position around which to search.
+ * @param max_dist Maximum distance (in meters) of airports to return.
+ *	Pass `INFINITY` to not limit the distance.
+ * @param results Return array of at least `max_results` elements, which
+ *	will be filled with the nearest airports found, nearest first.
+ * @param dists Optional return array of at least `max_results` elements,
+ *	which will be filled with the distances (in meters) of the airports
+ *	returned in `results`. May be `NULL`.
+ * @param max_results Maximum number of airports to return.
+ *
+ * @return The number of airports placed into `results`.
+ */
+size_t
+adb_airport_index_nearest(const airportdb_t *db, geo_pos2_t pos,
+    double max_dist, const arpt_index_t **results, double *dists,
+    size_t max_results)
+{
+	enum { KD_STACK_HEAP = 16 };
+	arpt_kdheap_t stack_heap[KD_STACK_HEAP];
+	arpt_kdnearest_t kn = { .n_heap = 0 };
+	size_t n;
+
+	ASSERT(db != NULL);
+	ASSERT(!IS_NULL_GEO_POS(pos));
+	ASSERT(results != NULL || max_results == 0);
+
+	if (db->arpt_kdtree == NULL || max_results == 0)
+		return (0);
+
+	kd_pos2ecef(pos, kn.q);
+	kn.max_heap = max_results;
+	kn.max_dist2 = POW2(max_dist);
+	if (max_results <= KD_STACK_HEAP)
+		kn.heap = stack_heap;
+	else
+		kn.heap = safe_malloc(max_results * sizeof (*kn.heap));
+	kd_nearest(db->arpt_kdtree->nodes, 0, db->arpt_kdtree->n_nodes, &kn);
+
+	/* pop the max-heap from the back to sort the results */
+	n = kn.n_heap;
+	while (kn.n_heap > 0) {
+		arpt_kdheap_t far = kn.heap[0];
+		arpt_kdheap_t last = kn.heap[--kn.n_heap];
+
+		if (kn.n_heap > 0) {
+			kn.max_heap = kn.n_heap;
+			kd_heap_push(&kn, last.dist2, last.idx);
+		}
+		results[kn.n_heap] = far.idx;
+		if (dists != NULL)
+			dists[kn.n_heap] = sqrt(far.dist2);
+	}
+	if (kn.heap != stack_heap)
+		free(kn.heap);
+
+	return (n);
+}
+
+/**
+ * Locates all airports in the airport index within a given distance of
+ * a position, without loading any airport tiles. Distances are measured
+ * the same way as in adb_airport_index_nearest(). The index can be queried
+ * without holding the database lock, as long as adb_recreate_cache()
+ * isn't running.
+ *
+ * @param db The airport database to search.
+ * @param pos The position around which to search.
+ * @param radius The search radius in meters.
+ * @param found_cb Optional callback, which will be called for every airport
+ *	found, in no particular order.
+ * @param userinfo Custom pointer user info argument, which will be passed
+ *	to the `found_cb` callback function in its second argument.
+ *
+ * @return The number of airports found.
+ */
+size_t
+adb_airport_index_radius(const airportdb_t *db, geo_pos2_t pos, double radius,
+    void (*found_cb)(const arpt_index_t *idx, void *userinfo), void *userinfo)
+{
+	double q[3];
+
+	ASSERT(db != NULL);
+	ASSERT(!IS_NULL_GEO_POS(pos));
+
+	if (db->arpt_kdtree == NULL)
+		return (0);
+	kd_pos2ecef(pos, q);
+	return (kd_radius(db->arpt_kdtree->nodes, 0,
+	    db->arpt_kdtree->n_nodes, q, radius, found_cb, userinfo));
+}
+
 /**
  * Performs a search in an airport for a runway matching a given runway ID
  * at one of its ends.
@@ -3500,6 +7362,114 @@ adb_airport_find_runway(airport_t *arpt, const char *rwy_id, runway_t **rwy_p,
 	return (B_FALSE);
 }
 
+static void
+rwy_geom_test_rect(const adb_rwy_geom_t *g, adb_rwy_area_t area,
+    vect2_t pos_v, unsigned start, unsigned n, uint8_t *hit)
+{
+	const double *org_x = &g->org_x[start], *org_y = &g->org_y[start];
+	const double *ax_x = &g->ax_x[start], *ax_y = &g->ax_y[start];
+	const double *s_min = &g->s_min[area][start];
+	const double *s_max = &g->s_max[area][start];
+	const double *lat = &g->lat[area][start];
+
+	for (unsigned i = 0; i < n; i++) {
+		double dx = pos_v.x - org_x[i], dy = pos_v.y - org_y[i];
+		double s = dx * ax_x[i] + dy * ax_y[i];
+		double c = dx * ax_y[i] - dy * ax_x[i];
+
+		hit[i] = (s >= s_min[i]) & (s <= s_max[i]) & (c <= lat[i]) &
+		    (-c <= lat[i]);
+	}
+}
+
+static void
+rwy_geom_test_apch(const adb_rwy_geom_t *g, vect2_t pos_v, unsigned start,
+    unsigned n, uint8_t *hit)
+{
+	const double *thr_x = &g->thr_x[start], *thr_y = &g->thr_y[start];
+	const double *dir_x = &g->dir_x[start], *dir_y = &g->dir_y[start];
+	const double *half_w = &g->half_w[start];
+	const double *apch_l = &g->apch_l[start], *apch_r = &g->apch_r[start];
+	const double slope = RWY_APCH_PROXIMITY_LAT_DISPL /
+	    RWY_APCH_PROXIMITY_LON_DISPL;
+
+	for (unsigned i = 0; i < n; i++) {
+		double dx = pos_v.x - thr_x[i], dy = pos_v.y - thr_y[i];
+		double s = dx * dir_x[i] + dy * dir_y[i];
+		double c = dx * dir_y[i] - dy * dir_x[i];
+		double w = half_w[i] - s * slope;
+		double w_l = (w < apch_l[i] ? w : apch_l[i]);
+		double w_r = (w < apch_r[i] ? w : apch_r[i]);
+
+		hit[i] = (s >= -RWY_APCH_PROXIMITY_LON_DISPL) & (s <= 0) &
+		    (c <= w_r) & (-c <= w_l);
+	}
+}
+
+/**
+ * Finds all runways of an airport with a particular area containing a
+ * position. This is equivalent to calling point_in_poly() on the area's
+ * bounding box of every runway (or runway end), but tests many runways
+ * per pass over precomputed geometry.
+ *
+ * @param arpt The airport to search. It must be loaded, which all
+ *	airports returned by the lookup functions are.
+ * @param pos_v The position to test, in the airport's `fpp`.
+ * @param area The runway area to test against. For ADB_RWY_AREA_APCH,
+ *	each runway end is tested separately.
+ * @param rwys Return array, which will be filled with up to
+ *	`max_results` matching runways. May be `NULL` if `max_results`
+ *	is 0.
+ * @param ends Optional return array, which will be filled with the
+ *	index of the matching runway end for ADB_RWY_AREA_APCH, or 0 for
+ *	the other areas.
+ * @param max_results Capacity of `rwys` and `ends`.
+ *
+ * @return The total number of matches, which can be more than
+ *	`max_results`.
+ */
+size_t
+adb_airport_rwys_at(const airport_t *arpt, vect2_t pos_v,
+    adb_rwy_area_t area, runway_t **rwys, unsigned *ends, size_t max_results)
+{
+	const adb_rwy_geom_t *g;
+	bool_t apch = (area == ADB_RWY_AREA_APCH);
+	unsigned n;
+	size_t n_found = 0;
+
+	ASSERT(arpt != NULL);
+	ASSERT(arpt->load_complete);
+	g = arpt->rwy_geom;
+	ASSERT(g != NULL);
+	ASSERT3U(area, <, ADB_NUM_RWY_AREAS);
+	ASSERT(rwys != NULL || max_results == 0);
+
+	n = (apch ? 2 * g->n_rwys : g->n_rwys);
+	for (unsigned start = 0; start < n; start += RWY_GEOM_BATCH) {
+		unsigned n_batch = MIN(n - start, RWY_GEOM_BATCH);
+		uint8_t hit[RWY_GEOM_BATCH];
+
+		if (apch)
+			rwy_geom_test_apch(g, pos_v, start, n_batch, hit);
+		else
+			rwy_geom_test_rect(g, area, pos_v, start, n_batch, hit);
+		for (unsigned i = 0; i < n_batch; i++) {
+			if (!hit[i])
+				continue;
+			if (n_found < max_results) {
+				unsigned idx = start + i;
+
+				rwys[n_found] = g->rwys[apch ? idx / 2 : idx];
+				if (ends != NULL)
+					ends[n_found] = (apch ? idx % 2 : 0);
+			}
+			n_found++;
+		}
+	}
+
+	return (n_found);
+}
+
 airport_t *
 adb_matching_airport_in_tile_with_TATL(airportdb_t *db, geo_pos2_t pos,
     const char *search_icao)
@@ -305,7 +305,7 @@ chartdb_want_to_stop(chartdb_t *cdb)
 	ASSERT(cdb != NULL);
 
 	mutex_enter(&cdb->lock);
-	result = (list_head(&cdb->loader_queue) == &cdb->loader_cmd_purge);
+	result = cdb->loader_stop;
 	mutex_exit(&cdb->lock);
 
 	return (result);
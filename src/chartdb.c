@@ -47,6 +47,7 @@
 #include "acfutils/chartdb.h"
 #include "acfutils/helpers.h"
 #include "acfutils/list.h"
+#include "acfutils/lru.h"
 #include "acfutils/mt_cairo_render.h"
 #include "acfutils/png.h"
 #include "acfutils/stat.h"
@@ -64,6 +65,10 @@
 #define	RETRY_INTVAL	30	/* seconds */
 #define	WRITE_BUFSZ	4096	/* bytes */
 #define	READ_BUFSZ	4096	/* bytes */
+/* share of the load limit given to the PNG tier (the rest holds surfaces) */
+#define	PNG_CACHE_SHARE	4	/* 1/4 */
+#define	DFL_LOADER_THREADS	2	/* per PDF & PNG load stage */
+#define	LOADER_THR_STOP_DELAY	SEC2USEC(10)
 
 #define	DESTROY_HANDLE(__handle__)	\
 	do { \
@@ -264,25 +269,54 @@ loader_init(void *userinfo)
 }
 
 static void
-loader_purge(chartdb_t *cdb)
+surf_evict(void *obj, void *userinfo)
 {
-	for (chart_arpt_t *arpt = avl_first(&cdb->arpts); arpt != NULL;
-	    arpt = AVL_NEXT(&cdb->arpts, arpt)) {
-		for (chart_t *chart = avl_first(&arpt->charts); chart != NULL;
-		    chart = AVL_NEXT(&arpt->charts, chart)) {
-			if (chart->surf != NULL) {
-				cairo_surface_destroy(chart->surf);
-				chart->surf = NULL;
-			}
-			if (chart->png_data != NULL) {
-				free(chart->png_data);
-				chart->png_data = NULL;
-				chart->png_data_len = 0;
-			}
-		}
+	chart_t *chart = obj;
+
+	UNUSED(userinfo);
+	CAIRO_SURFACE_DESTROY(chart->surf);
+}
+
+static void
+png_evict(void *obj, void *userinfo)
+{
+	chart_t *chart = obj;
+
+	UNUSED(userinfo);
+	if (chart->png_data != NULL) {
+		memset(chart->png_data, 0, chart->png_data_len);
+		free(chart->png_data);
+		chart->png_data = NULL;
+		chart->png_data_len = 0;
 	}
-	while (list_remove_head(&cdb->load_seq) != NULL)
-		;
+}
+
+/*
+ * Drops a chart's PNG data, e.g. because it no longer matches what's
+ * about to be loaded. Must be called with cdb->lock held.
+ */
+static void
+png_drop(chartdb_t *cdb, chart_t *chart)
+{
+	if (lru_contains(&cdb->png_cache, chart))
+		lru_remove(&cdb->png_cache, chart);
+	png_evict(chart, NULL);
+}
+
+static void
+set_cache_budgets(chartdb_t *cdb)
+{
+	uint64_t png_budget = cdb->load_limit / PNG_CACHE_SHARE;
+
+	lru_set_budget(&cdb->png_cache, png_budget);
+	lru_set_budget(&cdb->surf_cache, cdb->load_limit - png_budget);
+}
+
+static void
+loader_purge(chartdb_t *cdb)
+{
+	lru_purge(&cdb->surf_cache);
+	lru_purge(&cdb->png_cache);
 }
 
 chart_arpt_t *
@@ -950,8 +984,12 @@ invert_surface(cairo_surface_t *surf)
 	cairo_surface_mark_dirty(surf);
 }
 
+/*
+ * Decodes the chart's `png_data'. The caller must have pinned the chart
+ * in the PNG cache, so the data can't be evicted while we're at it.
+ */
 static cairo_surface_t *
-chart_get_surface_nocache(chartdb_t *cdb, chart_t *chart)
+chart_decode_png_data(chartdb_t *cdb, chart_t *chart)
 {
 	int width, height;
 	uint8_t *png_pixels;
@@ -960,9 +998,8 @@ chart_get_surface_nocache(chartdb_t *cdb, chart_t *chart)
 
 	ASSERT(cdb != NULL);
 	ASSERT(chart != NULL);
+	ASSERT(chart->png_data != NULL);
 
-	if (chart->png_data == NULL)
-		return (NULL);
 	png_pixels = png_load_from_buffer_cairo_argb32(chart->png_data,
 	    chart->png_data_len, &width, &height);
 	if (png_pixels == NULL)
@@ -978,6 +1015,7 @@ chart_get_surface_nocache(chartdb_t *cdb, chart_t *chart)
 	return (surf);
 }
 
+/* Must be called with cdb->lock held. */
 static bool_t
 chart_needs_get(chartdb_t *cdb, chart_t *chart)
 {
@@ -1005,74 +1043,90 @@ chart_needs_get(chartdb_t *cdb, chart_t *chart)
 	}
 }
 
-static cairo_surface_t *
-chart_get_surface(chartdb_t *cdb, chart_t *chart)
+static bool_t
+chart_png_data_matches(const chart_t *chart)
 {
-	char *path = NULL, *ext = NULL;
-	cairo_surface_t *surf = NULL;
+	return (chart->png_data != NULL &&
+	    chart->png_page == chart->load_page &&
+	    chart->png_zoom == chart->zoom &&
+	    (chart->filename_night == NULL ||
+	    chart->png_night == chart->night));
+}
 
-	ASSERT(cdb != NULL);
-	ASSERT(chart != NULL);
+static bool_t
+chart_is_pdf(const chart_t *chart)
+{
+	const char *ext = strrchr(chart->filename, '.');
 
-	if (chart->load_cb != NULL)
-		return (chart->load_cb(chart));
-	if (chart_needs_get(cdb, chart)) {
-		chart->refreshed = B_TRUE;
-		if (!prov[cdb->prov].get_chart(chart)) {
-			mutex_enter(&cdb->lock);
-			chart->load_error = B_TRUE;
-			mutex_exit(&cdb->lock);
-			goto out;
-		}
-	}
-	chart->night_prev = chart->night;
-	if (cdb->disallow_caching) {
-		surf = chart_get_surface_nocache(cdb, chart);
-		goto out;
-	}
-	path = chartdb_mkpath(chart);
-	ext = strrchr(path, '.');
-	if (ext != NULL &&
-	    (strcmp(&ext[1], "pdf") == 0 || strcmp(&ext[1], "PDF") == 0)) {
-		if (cdb->pdfinfo_path == NULL ||
-		    cdb->pdftoppm_path == NULL) {
-			logMsg("Attempted to load PDF chart, but this chart "
-			    "DB instance doesn't support PDF conversion");
-			mutex_enter(&cdb->lock);
-			chart->load_error = B_TRUE;
-			mutex_exit(&cdb->lock);
-			goto out;
-		}
-		if (chart->num_pages == -1) {
-			chart->num_pages = chartdb_pdf_count_pages_file(
-			    cdb->pdfinfo_path, path);
-		}
-		if (chart->num_pages == -1) {
-			mutex_enter(&cdb->lock);
-			chart->load_error = B_TRUE;
-			mutex_exit(&cdb->lock);
-			goto out;
-		}
-		path = chartdb_pdf_convert_file(cdb->pdftoppm_path, path,
-		    chart->load_page, chart->zoom);
-		if (path == NULL) {
-			mutex_enter(&cdb->lock);
-			chart->load_page = chart->cur_page;
-			chart->load_error = B_TRUE;
-			mutex_exit(&cdb->lock);
-			goto out;
-		}
+	return (ext != NULL &&
+	    (strcmp(&ext[1], "pdf") == 0 || strcmp(&ext[1], "PDF") == 0));
+}
+
+/*
+ * Pins the chart's PNG data for the rest of the load job, so it can be
+ * used without holding cdb->lock. Must be called with cdb->lock held.
+ */
+static void
+chart_load_pin_png(chartdb_t *cdb, chart_t *chart)
+{
+	if (!chart->load_png_pinned) {
+		lru_touch(&cdb->png_cache, chart);
+		lru_pin(&cdb->png_cache, chart);
+		chart->load_png_pinned = B_TRUE;
 	}
-	surf = cairo_image_surface_create_from_png(path);
-out:
-	free(path);
-	return (surf);
+}
+
+/*
+ * Picks the stage which decodes the chart once any download is out of
+ * the way. Must be called with cdb->lock held.
+ */
+static load_stage_t
+chart_decode_stage(const chartdb_t *cdb, const chart_t *chart)
+{
+	if (!cdb->disallow_caching && chart_is_pdf(chart) &&
+	    !chart_png_data_matches(chart))
+		return (LOAD_PDF);
+	return (LOAD_PNG);
+}
+
+static load_stage_t
+chart_first_stage(chartdb_t *cdb, chart_t *chart)
+{
+	/* custom loaders and downloads run on the provider's thread */
+	if (chart->load_cb != NULL)
+		return (LOAD_PROV);
+	if (cdb->disallow_caching)
+		return (chart_needs_get(cdb, chart) ? LOAD_PROV : LOAD_PNG);
+	if (!chart->refreshed)
+		return (LOAD_PROV);
+	return (chart_decode_stage(cdb, chart));
+}
+
+/*
+ * When the chart file has gone missing from the disk cache since we
+ * last downloaded it, sends the job back to the provider stage to fetch
+ * it again. Only does so once per job, so a provider which doesn't
+ * produce the file can't bounce the job back and forth forever.
+ */
+static bool_t
+chart_refetch_missing(chartdb_t *cdb, chart_t *chart, const char *path)
+{
+	bool_t refetch;
+
+	if (file_exists(path, NULL))
+		return (B_FALSE);
+	mutex_enter(&cdb->lock);
+	refetch = !chart->load_fetched;
+	if (refetch)
+		chart->refreshed = B_FALSE;
+	mutex_exit(&cdb->lock);
+
+	return (refetch);
 }
 
 static void
-loader_load(chartdb_t *cdb, chart_t *chart)
+chart_install_surface(chartdb_t *cdb, chart_t *chart, cairo_surface_t *surf)
 {
-	cairo_surface_t *surf = chart_get_surface(cdb, chart);
 	cairo_status_t st;
 
 	if (surf == NULL)
@@ -1091,35 +1145,468 @@ loader_load(chartdb_t *cdb, chart_t *chart)
 		CAIRO_SURFACE_DESTROY(chart->surf);
 		chart->surf = surf;
 		chart->cur_page = chart->load_page;
+		lru_insert(&cdb->surf_cache, chart,
+		    (uint64_t)cairo_image_surface_get_stride(surf) *
+		    cairo_image_surface_get_height(surf));
 		mutex_exit(&cdb->lock);
 	} else {
 		logMsg("Can't load chart %s PNG file %s", chart->name,
 		    cairo_status_to_string(st));
+		cairo_surface_destroy(surf);
 		mutex_enter(&cdb->lock);
 		chart->load_error = B_TRUE;
 		mutex_exit(&cdb->lock);
 	}
 }
 
-static uint64_t
-chart_mem_usage(chartdb_t *cdb)
+static load_stage_t
+chart_load_error(chartdb_t *cdb, chart_t *chart)
+{
+	mutex_enter(&cdb->lock);
+	chart->load_error = B_TRUE;
+	mutex_exit(&cdb->lock);
+	return (LOAD_DONE);
+}
+
+/*
+ * Provider stage: runs custom chart loaders and downloads the chart if
+ * we don't have an up-to-date copy.
+ */
+static load_stage_t
+chart_load_prov(chartdb_t *cdb, chart_t *chart)
+{
+	load_stage_t next;
+	bool_t needs_get;
+
+	if (chart->load_cb != NULL) {
+		chart_install_surface(cdb, chart, chart->load_cb(chart));
+		return (LOAD_DONE);
+	}
+
+	mutex_enter(&cdb->lock);
+	/*
+	 * The provider replaces `png_data' behind the cache's back, so
+	 * the old data must stay put until it's done.
+	 */
+	if (lru_contains(&cdb->png_cache, chart))
+		chart_load_pin_png(cdb, chart);
+	needs_get = chart_needs_get(cdb, chart);
+	if (needs_get) {
+		chart->refreshed = B_TRUE;
+		chart->load_fetched = B_TRUE;
+	}
+	mutex_exit(&cdb->lock);
+
+	if (needs_get) {
+		bool_t ok = prov[cdb->prov].get_chart(chart);
+
+		mutex_enter(&cdb->lock);
+		if (cdb->disallow_caching) {
+			if (ok && chart->png_data != NULL) {
+				lru_insert(&cdb->png_cache, chart,
+				    chart->png_data_len);
+				chart_load_pin_png(cdb, chart);
+			}
+		} else if (ok) {
+			/* any rendering we held is of the old chart file */
+			if (chart->load_png_pinned) {
+				lru_unpin(&cdb->png_cache, chart);
+				chart->load_png_pinned = B_FALSE;
+			}
+			png_drop(cdb, chart);
+		}
+		mutex_exit(&cdb->lock);
+		if (!ok)
+			return (chart_load_error(cdb, chart));
+	}
+
+	mutex_enter(&cdb->lock);
+	chart->night_prev = chart->night;
+	next = chart_decode_stage(cdb, chart);
+	mutex_exit(&cdb->lock);
+
+	return (next);
+}
+
+#ifdef	LACF_WITH_POPPLER
+
+/*
+ * Renders the requested page of a PDF chart in-process, straight into
+ * the chart's surface. The surface goes into the surface cache only;
+ * nothing is kept in the PNG cache, so once the surface is evicted,
+ * viewing the page again renders it again. poppler can't stop a render
+ * once it has started, so a cancelled job only gets to skip it if the
+ * cancellation arrives first.
+ *
+ * @return B_FALSE if poppler couldn't render the chart, in which case
+ *	the caller should fall back to pdftoppm.
+ */
+static bool_t
+chart_load_pdf_inproc(chartdb_t *cdb, chart_t *chart, const void *pdf_data,
+    size_t pdf_len)
+{
+	chartdb_pdf_t *pdf = chartdb_pdf_open(pdf_data, pdf_len);
+	cairo_surface_t *surf;
+	bool_t stop;
+
+	if (pdf == NULL)
+		return (B_FALSE);
+	chart->num_pages = chartdb_pdf_num_pages(pdf);
+	mutex_enter(&cdb->lock);
+	stop = (cdb->loader_stop || chart->load_cancel);
+	mutex_exit(&cdb->lock);
+	if (stop) {
+		chartdb_pdf_close(pdf);
+		return (B_TRUE);
+	}
+	surf = chartdb_pdf_render_page(pdf, chart->load_page, chart->zoom);
+	chartdb_pdf_close(pdf);
+	if (surf == NULL)
+		return (B_FALSE);
+	chart_install_surface(cdb, chart, surf);
+
+	return (B_TRUE);
+}
+
+#endif	/* LACF_WITH_POPPLER */
+
+/*
+ * PDF stage: renders the requested page of a PDF chart. When built with
+ * poppler, this happens in-process. Otherwise (or if poppler fails),
+ * pdftoppm renders the page to PNG. The PNG is kept in the PNG cache, so
+ * that viewing the same page again only has to decode the PNG, rather
+ * than render the PDF again.
+ */
+static load_stage_t
+chart_load_pdf(chartdb_t *cdb, chart_t *chart)
+{
+	char *path = chartdb_mkpath(chart);
+	void *pdf_data;
+	size_t pdf_len, png_len;
+	uint8_t *png_data;
+
+	if (chart_refetch_missing(cdb, chart, path)) {
+		free(path);
+		return (LOAD_PROV);
+	}
+	pdf_data = file2buf(path, &pdf_len);
+	if (pdf_data == NULL) {
+		logMsg("Error converting chart %s: can't read input: %s",
+		    path, strerror(errno));
+		goto errout;
+	}
+#ifdef	LACF_WITH_POPPLER
+	if (chart_load_pdf_inproc(cdb, chart, pdf_data, pdf_len)) {
+		free(pdf_data);
+		free(path);
+		return (LOAD_DONE);
+	}
+#endif	/* LACF_WITH_POPPLER */
+	if (cdb->pdfinfo_path == NULL || cdb->pdftoppm_path == NULL) {
+		logMsg("Attempted to load PDF chart, but this chart "
+		    "DB instance doesn't support PDF conversion");
+		free(pdf_data);
+		goto errout;
+	}
+	if (chart->num_pages == -1) {
+		chart->num_pages = chartdb_pdf_count_pages_file(
+		    cdb->pdfinfo_path, path);
+	}
+	if (chart->num_pages == -1) {
+		free(pdf_data);
+		goto errout;
+	}
+	png_data = chartdb_pdf_convert_direct(cdb->pdftoppm_path, pdf_data,
+	    pdf_len, chart->load_page, chart->zoom, &png_len);
+	free(pdf_data);
+	if (png_data == NULL) {
+		mutex_enter(&cdb->lock);
+		chart->load_page = chart->cur_page;
+		mutex_exit(&cdb->lock);
+		goto errout;
+	}
+	free(path);
+
+	mutex_enter(&cdb->lock);
+	png_drop(cdb, chart);
+	chart->png_data = png_data;
+	chart->png_data_len = png_len;
+	chart->png_page = chart->load_page;
+	chart->png_zoom = chart->zoom;
+	chart->png_night = chart->night;
+	lru_insert(&cdb->png_cache, chart, png_len);
+	chart_load_pin_png(cdb, chart);
+	mutex_exit(&cdb->lock);
+
+	return (LOAD_PNG);
+errout:
+	free(path);
+	return (chart_load_error(cdb, chart));
+}
+
+/*
+ * PNG stage: decodes the chart's PNG data (or PNG file, for providers
+ * which cache PNG charts on disk) and installs the result as the
+ * chart's surface.
+ */
+static load_stage_t
+chart_load_png(chartdb_t *cdb, chart_t *chart)
 {
-	uint64_t total = 0;
+	cairo_surface_t *surf;
+	char *path;
 
-	for (chart_t *c = list_head(&cdb->load_seq); c != NULL;
-	    c = list_next(&cdb->load_seq, c)) {
-		if (c->surf != NULL) {
-			unsigned w = cairo_image_surface_get_stride(c->surf);
-			unsigned h = cairo_image_surface_get_height(c->surf);
+	mutex_enter(&cdb->lock);
+	if (chart->png_data != NULL &&
+	    (cdb->disallow_caching || chart_png_data_matches(chart))) {
+		chart_load_pin_png(cdb, chart);
+		mutex_exit(&cdb->lock);
+		chart_install_surface(cdb, chart,
+		    chart_decode_png_data(cdb, chart));
+		return (LOAD_DONE);
+	}
+	mutex_exit(&cdb->lock);
+	if (cdb->disallow_caching)
+		return (LOAD_DONE);
+	if (chart_is_pdf(chart))
+		return (chart_load_error(cdb, chart));
 
-			total += w * h * 4;
+	path = chartdb_mkpath(chart);
+	if (chart_refetch_missing(cdb, chart, path)) {
+		free(path);
+		return (LOAD_PROV);
+	}
+	surf = cairo_image_surface_create_from_png(path);
+	free(path);
+	chart_install_surface(cdb, chart, surf);
+
+	return (LOAD_DONE);
+}
+
+/*
+ * Trims both cache tiers back to their budgets. The chart which was
+ * just loaded is the one being looked at, so it's kept even if it alone
+ * exceeds the budget.
+ */
+static void
+cache_trim(chartdb_t *cdb, chart_t *chart)
+{
+	bool_t pin_surf = lru_contains(&cdb->surf_cache, chart);
+	bool_t pin_png = lru_contains(&cdb->png_cache, chart);
+
+	if (pin_surf)
+		lru_pin(&cdb->surf_cache, chart);
+	if (pin_png)
+		lru_pin(&cdb->png_cache, chart);
+	lru_trim(&cdb->surf_cache);
+	lru_trim(&cdb->png_cache);
+	if (pin_surf)
+		lru_unpin(&cdb->surf_cache, chart);
+	if (pin_png)
+		lru_unpin(&cdb->png_cache, chart);
+}
+
+/*
+ * Queues a chart's load job for `stage'. Must be called with cdb->lock
+ * held.
+ */
+static void
+chart_load_submit(chartdb_t *cdb, chart_t *chart, load_stage_t stage)
+{
+	ASSERT(chart->load_busy);
+	ASSERT3U(stage, <, NUM_LOAD_STAGES);
+
+	chart->load_stage = stage;
+	chart->load_running = B_FALSE;
+	if (stage == LOAD_PROV) {
+		list_insert_tail(&cdb->loader_queue, chart);
+		worker_wake_up(&cdb->loader);
+	} else {
+		ASSERT3P(chart->load_handle, ==, NULL);
+		chart->load_handle = taskq_submit2(cdb->load_tq[stage], chart,
+		    TASKQ_PRIO_NORMAL, 0);
+	}
+}
+
+/*
+ * Starts a load job for a chart, using the chart's current `load_page',
+ * `zoom' and `night'. These mustn't change until the job is done. Must
+ * be called with cdb->lock held.
+ */
+static void
+chart_load_start(chartdb_t *cdb, chart_t *chart)
+{
+	ASSERT(!chart->load_busy);
+
+	chart->load_busy = B_TRUE;
+	chart->load_fetched = B_FALSE;
+	chart->load_cancel = B_FALSE;
+	list_insert_tail(&cdb->load_jobs, chart);
+	chart_load_submit(cdb, chart, chart_first_stage(cdb, chart));
+}
+
+/* Must be called with cdb->lock held. */
+static void
+chart_load_done(chartdb_t *cdb, chart_t *chart)
+{
+	ASSERT(chart->load_busy);
+
+	if (chart->load_png_pinned) {
+		lru_unpin(&cdb->png_cache, chart);
+		chart->load_png_pinned = B_FALSE;
+	}
+	chart->load_busy = B_FALSE;
+	chart->load_running = B_FALSE;
+	list_remove(&cdb->load_jobs, chart);
+	cache_trim(cdb, chart);
+}
+
+/*
+ * Cancels all chart load jobs which are waiting in a queue. Jobs which
+ * are already being processed are only flagged with `load_cancel'. Most
+ * stages run to completion anyway, since their results end up in the
+ * caches, but in-process PDF rendering is skipped if it hasn't started
+ * yet. Must be called with cdb->lock held.
+ */
+static void
+chart_load_cancel_queued(chartdb_t *cdb)
+{
+	chart_t *next;
+
+	for (chart_t *chart = list_head(&cdb->load_jobs); chart != NULL;
+	    chart = next) {
+		next = list_next(&cdb->load_jobs, chart);
+		if (chart->load_running) {
+			chart->load_cancel = B_TRUE;
+			continue;
+		}
+		if (chart->load_stage == LOAD_PROV) {
+			list_remove(&cdb->loader_queue, chart);
+		} else {
+			/*
+			 * If this fails, a taskq thread has already picked
+			 * up the job and is waiting for cdb->lock.
+			 */
+			if (!taskq_cancel(cdb->load_tq[chart->load_stage],
+			    chart->load_handle))
+				continue;
+			taskq_handle_release(chart->load_handle);
+			chart->load_handle = NULL;
 		}
-		total += c->png_data_len;
+		chart_load_done(cdb, chart);
 	}
+}
 
-	return (total);
+/*
+ * Runs one stage of a chart's load job and passes the job on to the
+ * next stage. Called without cdb->lock held.
+ */
+static void
+chart_load_run(chartdb_t *cdb, chart_t *chart, load_stage_t stage)
+{
+	load_stage_t next = LOAD_DONE;
+
+	switch (stage) {
+	case LOAD_PROV:
+		next = chart_load_prov(cdb, chart);
+		break;
+	case LOAD_PDF:
+		next = chart_load_pdf(cdb, chart);
+		break;
+	case LOAD_PNG:
+		next = chart_load_png(cdb, chart);
+		break;
+	default:
+		VERIFY_FAIL();
+	}
+	mutex_enter(&cdb->lock);
+	if (next == LOAD_DONE || cdb->loader_stop || chart->load_cancel)
+		chart_load_done(cdb, chart);
+	else
+		chart_load_submit(cdb, chart, next);
+	mutex_exit(&cdb->lock);
+}
+
+static void
+load_tq_proc(void *userinfo, void *thr_info, void *task)
+{
+	chartdb_t *cdb = userinfo;
+	chart_t *chart = task;
+	load_stage_t stage;
+
+	UNUSED(thr_info);
+
+	mutex_enter(&cdb->lock);
+	ASSERT(chart->load_busy);
+	ASSERT(!chart->load_running);
+	taskq_handle_release(chart->load_handle);
+	chart->load_handle = NULL;
+	if (cdb->loader_stop) {
+		chart_load_done(cdb, chart);
+		mutex_exit(&cdb->lock);
+		return;
+	}
+	chart->load_running = B_TRUE;
+	stage = chart->load_stage;
+	mutex_exit(&cdb->lock);
+
+	chart_load_run(cdb, chart, stage);
+}
+
+static void
+load_tq_discard(void *userinfo, void *task)
+{
+	/* chart_load_cancel_queued() cleans up after cancelled jobs */
+	UNUSED(userinfo);
+	UNUSED(task);
+}
+
+static void
+wx_proc(void *userinfo, void *thr_info, void *task)
+{
+	chartdb_t *cdb = userinfo;
+	wx_req_t *req = task;
+	chart_arpt_t *arpt = req->arpt;
+	char *text;
+
+	UNUSED(thr_info);
+
+	if (req->metar)
+		text = download_metar(cdb, arpt->icao);
+	else
+		text = download_taf(cdb, arpt->icao);
+
+	mutex_enter(&cdb->lock);
+	if (req->metar) {
+		free(arpt->metar);
+		arpt->metar = text;
+		arpt->metar_load_t = time(NULL);
+		if (text == NULL)
+			arpt->metar_load_t -= MAX_METAR_AGE - RETRY_INTVAL;
+		arpt->metar_busy = B_FALSE;
+	} else {
+		free(arpt->taf);
+		arpt->taf = text;
+		arpt->taf_load_t = time(NULL);
+		if (text == NULL)
+			arpt->taf_load_t -= MAX_TAF_AGE - RETRY_INTVAL;
+		arpt->taf_busy = B_FALSE;
+	}
+	mutex_exit(&cdb->lock);
+
+	free(req);
+}
+
+static void
+wx_discard(void *userinfo, void *task)
+{
+	UNUSED(userinfo);
+	free(task);
 }
 
+/*
+ * The provider stage. Providers aren't reentrant, so this is a single
+ * thread, which also runs the provider's init and fini callbacks.
+ */
 static bool_t
 loader(void *userinfo)
 {
@@ -1137,62 +1624,16 @@ loader(void *userinfo)
 		mutex_enter(&cdb->lock);
 	}
 	while ((chart = list_remove_head(&cdb->loader_queue)) != NULL) {
-		if (chart == &cdb->loader_cmd_purge) {
-			loader_purge(cdb);
-		} else if (chart == &cdb->loader_cmd_metar) {
-			char *metar;
-
-			chart->arpt->metar_load_t = time(NULL);
-			mutex_exit(&cdb->lock);
-			metar = download_metar(cdb, chart->arpt->icao);
-			mutex_enter(&cdb->lock);
-			if (chart->arpt->metar != NULL)
-				free(chart->arpt->metar);
-			chart->arpt->metar = metar;
-			if (metar == NULL) {
-				chart->arpt->metar_load_t = time(NULL) -
-				    (MAX_METAR_AGE - RETRY_INTVAL);
-			}
-		} else if (chart == &cdb->loader_cmd_taf) {
-			char *taf;
-
-			chart->arpt->taf_load_t = time(NULL);
-			mutex_exit(&cdb->lock);
-			taf = download_taf(cdb, chart->arpt->icao);
-			mutex_enter(&cdb->lock);
-			if (chart->arpt->taf != NULL)
-				free(chart->arpt->taf);
-			chart->arpt->taf = taf;
-			if (taf == NULL) {
-				chart->arpt->taf_load_t = time(NULL) -
-				    (MAX_TAF_AGE - RETRY_INTVAL);
-			}
-		} else {
-			mutex_exit(&cdb->lock);
-			loader_load(cdb, chart);
-			mutex_enter(&cdb->lock);
-			/* Move to the head of the load sequence list */
-			if (list_link_active(&chart->load_seq_node))
-				list_remove(&cdb->load_seq, chart);
-			list_insert_head(&cdb->load_seq, chart);
-
-			while (list_count(&cdb->load_seq) > 1 &&
-			    chart_mem_usage(cdb) > cdb->load_limit) {
-				chart_t *c = list_tail(&cdb->load_seq);
-
-				if (c->surf != NULL) {
-					cairo_surface_destroy(c->surf);
-					c->surf = NULL;
-				}
-				if (c->png_data != NULL) {
-					free(c->png_data);
-					c->png_data = NULL;
-					c->png_data_len = 0;
-				}
-				list_remove(&cdb->load_seq, c);
-			}
-		}
+		ASSERT(chart->load_busy);
+		ASSERT3U(chart->load_stage, ==, LOAD_PROV);
+		chart->load_running = B_TRUE;
+		mutex_exit(&cdb->lock);
+		chart_load_run(cdb, chart, LOAD_PROV);
+		mutex_enter(&cdb->lock);
 	}
+	/* picks up changes to the load limit */
+	lru_trim(&cdb->surf_cache);
+	lru_trim(&cdb->png_cache);
 	mutex_exit(&cdb->lock);
 
 	return (B_TRUE);
@@ -1265,8 +1706,20 @@ chartdb_init(const char *cache_path, const char *pdftoppm_path,
 	    offsetof(chart_t, loader_node));
 	list_create(&cdb->loader_arpt_queue, sizeof (chart_arpt_t),
 	    offsetof(chart_arpt_t, loader_node));
-	list_create(&cdb->load_seq, sizeof (chart_t),
-	    offsetof(chart_t, load_seq_node));
+	list_create(&cdb->load_jobs, sizeof (chart_t),
+	    offsetof(chart_t, load_job_node));
+	for (load_stage_t stage = LOAD_PDF; stage < NUM_LOAD_STAGES; stage++) {
+		cdb->load_tq[stage] = taskq_alloc(0, DFL_LOADER_THREADS,
+		    LOADER_THR_STOP_DELAY, NULL, NULL, load_tq_proc,
+		    load_tq_discard, cdb);
+	}
+	cdb->wx_tq = taskq_alloc(0, 1, LOADER_THR_STOP_DELAY, NULL, NULL,
+	    wx_proc, wx_discard, cdb);
+	lru_create(&cdb->surf_cache, sizeof (chart_t),
+	    offsetof(chart_t, surf_lru_node), 0, surf_evict, NULL);
+	lru_create(&cdb->png_cache, sizeof (chart_t),
+	    offsetof(chart_t, png_lru_node), 0, png_evict, NULL);
+	set_cache_budgets(cdb);
 
 	worker_init2(&cdb->loader, loader_init, loader, loader_fini, 0, cdb,
 	    "chartdb");
@@ -1280,11 +1733,22 @@ chartdb_fini(chartdb_t *cdb)
 	void *cookie;
 	chart_arpt_t *arpt;
 
+	mutex_enter(&cdb->lock);
+	cdb->loader_stop = B_TRUE;
+	chart_load_cancel_queued(cdb);
+	mutex_exit(&cdb->lock);
+	/* jobs still running finish without moving on to another stage */
+	for (load_stage_t stage = LOAD_PDF; stage < NUM_LOAD_STAGES; stage++)
+		taskq_free(cdb->load_tq[stage]);
+	taskq_free(cdb->wx_tq);
 	worker_fini(&cdb->loader);
+	ASSERT0(list_count(&cdb->load_jobs));
+	list_destroy(&cdb->load_jobs);
 
-	while(list_remove_head(&cdb->load_seq) != NULL)
-		;
-	list_destroy(&cdb->load_seq);
+	lru_purge(&cdb->surf_cache);
+	lru_destroy(&cdb->surf_cache);
+	lru_purge(&cdb->png_cache);
+	lru_destroy(&cdb->png_cache);
 	while(list_remove_head(&cdb->loader_queue) != NULL)
 		;
 	list_destroy(&cdb->loader_queue);
@@ -1349,23 +1813,37 @@ void
 chartdb_set_load_limit(chartdb_t *cdb, uint64_t bytes)
 {
 	bytes = MAX(bytes, 16 << 20);
+	mutex_enter(&cdb->lock);
 	if (cdb->load_limit != bytes) {
 		cdb->load_limit = bytes;
+		set_cache_budgets(cdb);
 		worker_wake_up(&cdb->loader);
 	}
+	mutex_exit(&cdb->lock);
+}
+
+void
+chartdb_set_loader_threads(chartdb_t *cdb, unsigned n)
+{
+	ASSERT(cdb != NULL);
+	if (n == 0)
+		n = lacf_num_cpus();
+	for (load_stage_t stage = LOAD_PDF; stage < NUM_LOAD_STAGES; stage++)
+		taskq_set_num_threads_max(cdb->load_tq[stage], n);
 }
 
 void
 chartdb_purge(chartdb_t *cdb)
 {
 	mutex_enter(&cdb->lock);
-
-	/* purge the queue */
-	while (list_remove_head(&cdb->loader_queue) != NULL)
-		;
-	list_insert_tail(&cdb->loader_queue, &cdb->loader_cmd_purge);
-	worker_wake_up(&cdb->loader);
-
+	chart_load_cancel_queued(cdb);
+	/*
+	 * Running load jobs pin the chart's PNG data (see
+	 * chart_load_pin_png()) before touching it without the lock, so
+	 * lru_purge() leaves it alone. Surfaces are only ever replaced
+	 * with the lock held.
+	 */
+	loader_purge(cdb);
 	mutex_exit(&cdb->lock);
 }
 
@@ -1427,8 +1905,7 @@ chartdb_get_chart_names(chartdb_t *cdb, const char *icao, chart_type_t type,
 			 * everything the loader is doing and try and get
 			 * the airport load in as quickly as possible.
 			 */
-			while (list_remove_head(&cdb->loader_queue) != NULL)
-				;
+			chart_load_cancel_queued(cdb);
 			worker_wake_up(&cdb->loader);
 		}
 		mutex_exit(&cdb->lock);
@@ -1657,20 +2134,31 @@ chartdb_get_chart_surface(chartdb_t *cdb, const char *icao,
 		return (B_FALSE);
 	}
 
+	/*
+	 * While a load job for the chart is in flight, repeated requests
+	 * are coalesced into it. If they asked for something different,
+	 * that's picked up by the first request after the job is done.
+	 * The chart is still wanted, so a cancellation by a request for
+	 * another chart no longer applies.
+	 */
+	if (chart->load_busy)
+		chart->load_cancel = B_FALSE;
 	if ((chart->surf == NULL || chart->zoom != zoom ||
 	    chart->night != night || chart->cur_page != page) &&
-	    !list_link_active(&chart->loader_node)) {
+	    !chart->load_busy) {
 		chart->zoom = zoom;
 		chart->load_page = page;
 		chart->night = night;
-		CAIRO_SURFACE_DESTROY(chart->surf);
+		if (chart->surf != NULL) {
+			lru_remove(&cdb->surf_cache, chart);
+			CAIRO_SURFACE_DESTROY(chart->surf);
+		}
 		/*
-		 * Dump everything else in the queue so we get in first.
+		 * The UI has moved on to this chart, so drop loads of other
+		 * charts which haven't started yet so we get in first.
 		 */
-		while (list_remove_head(&cdb->loader_queue) != NULL)
-			;
-		list_insert_tail(&cdb->loader_queue, chart);
-		worker_wake_up(&cdb->loader);
+		chart_load_cancel_queued(cdb);
+		chart_load_start(cdb, chart);
 	}
 
 	if (chart->surf != NULL && page == chart->cur_page &&
@@ -1716,31 +2204,22 @@ get_metar_taf_common(chartdb_t *cdb, const char *icao, bool_t metar)
 		if (arpt->taf != NULL)
 			result = safe_strdup(arpt->taf);
 	} else {
-		if (metar) {
-			if (!list_link_active(
-			    &cdb->loader_cmd_metar.loader_node)) {
-				/* Initiate async download of METAR */
-				cdb->loader_cmd_metar.arpt = arpt;
-				list_insert_tail(&cdb->loader_queue,
-				    &cdb->loader_cmd_metar);
-				worker_wake_up(&cdb->loader);
-			}
-			/* If we have an old METAR, return that for now */
-			if (arpt->metar != NULL)
-				result = safe_strdup(arpt->metar);
-		} else {
-			if (!list_link_active(
-			    &cdb->loader_cmd_taf.loader_node)) {
-				/* Initiate async download of TAF */
-				cdb->loader_cmd_taf.arpt = arpt;
-				list_insert_tail(&cdb->loader_queue,
-				    &cdb->loader_cmd_taf);
-				worker_wake_up(&cdb->loader);
-			}
-			/* If we have an old TAF, return that for now */
-			if (arpt->taf != NULL)
-				result = safe_strdup(arpt->taf);
+		bool_t *busy = (metar ? &arpt->metar_busy : &arpt->taf_busy);
+
+		if (!*busy) {
+			/* Initiate async download of METAR/TAF */
+			wx_req_t *req = safe_calloc(1, sizeof (*req));
+
+			req->arpt = arpt;
+			req->metar = metar;
+			*busy = B_TRUE;
+			taskq_submit(cdb->wx_tq, req);
 		}
+		/* If we have an old METAR/TAF, return that for now */
+		if (metar && arpt->metar != NULL)
+			result = safe_strdup(arpt->metar);
+		else if (!metar && arpt->taf != NULL)
+			result = safe_strdup(arpt->taf);
 	}
 
 	mutex_exit(&cdb->lock);
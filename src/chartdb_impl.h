@@ -25,6 +25,8 @@
 #include "acfutils/avl.h"
 #include "acfutils/chartdb.h"
 #include "acfutils/list.h"
+#include "acfutils/lru.h"
+#include "acfutils/taskq.h"
 #include "acfutils/thread.h"
 #include "acfutils/worker.h"
 
@@ -37,6 +39,18 @@ typedef struct chart_s chart_t;
 
 typedef cairo_surface_t *(*chart_load_cb_t)(chart_t *chart);
 
+/*
+ * Chart loading is split into stages, each with its own queue, so that a
+ * slow download doesn't hold up rendering or decoding of other charts.
+ */
+typedef enum {
+	LOAD_PROV,	/* provider thread: custom loaders & downloads */
+	LOAD_PDF,	/* PDF rasterization */
+	LOAD_PNG,	/* PNG decoding */
+	LOAD_DONE,
+	NUM_LOAD_STAGES = LOAD_DONE
+} load_stage_t;
+
 typedef enum {
 	PROV_AERONAV_FAA_GOV,
 	PROV_AUTOROUTER_AERO,
@@ -69,13 +83,39 @@ struct chart_s {
 	bool_t		night;
 	bool_t		night_prev;
 	bool_t		refreshed;
-	/* Only present when `disallow_caching' is set in chartdb_t */
+	/*
+	 * When `disallow_caching' is set in chartdb_t, this is the chart
+	 * image as supplied by the provider. Otherwise, it's the rendering
+	 * of page `png_page' of a PDF chart at `png_zoom' (and `png_night',
+	 * if the chart has a separate night version).
+	 */
 	void		*png_data;
 	size_t		png_data_len;
+	int		png_page;
+	double		png_zoom;
+	bool_t		png_night;
+	/*
+	 * A chart has at most one load job in flight, which passes through
+	 * the load stages. Requests for the chart which arrive while the
+	 * job is in flight are coalesced into it.
+	 */
+	bool_t		load_busy;
+	bool_t		load_running;	/* being processed by a stage */
+	bool_t		load_fetched;	/* the provider stage downloaded it */
+	bool_t		load_png_pinned;
+	/*
+	 * Set when the UI has moved on to another chart while the job was
+	 * running. Stages which can stop part way through give up early.
+	 */
+	bool_t		load_cancel;
+	load_stage_t	load_stage;
+	taskq_handle_t	*load_handle;	/* while queued on a taskq */
 
 	avl_node_t	node;
 	list_node_t	loader_node;
-	list_node_t	load_seq_node;
+	list_node_t	load_job_node;
+	lru_node_t	surf_lru_node;
+	lru_node_t	png_lru_node;
 };
 
 struct chart_arpt_s {
@@ -90,6 +130,8 @@ struct chart_arpt_s {
 	time_t		metar_load_t;
 	char		*taf;
 	time_t		taf_load_t;
+	bool_t		metar_busy;
+	bool_t		taf_busy;
 	char		*codename;
 	bool_t		load_complete;
 
@@ -122,20 +164,27 @@ struct chartdb_s {
 	void			*prov_priv;
 	bool_t			init_complete;
 
+	/* immutable once created */
+	taskq_t		*load_tq[NUM_LOAD_STAGES];	/* except LOAD_PROV */
+	taskq_t		*wx_tq;		/* METAR & TAF downloads */
+
 	/* protected by `lock' */
-	list_t		loader_queue;
+	list_t		loader_queue;	/* charts in the LOAD_PROV stage */
 	list_t		loader_arpt_queue;
-	list_t		load_seq;
+	list_t		load_jobs;	/* charts with `load_busy' set */
+	lru_t		surf_cache;	/* charts with a `surf' */
+	lru_t		png_cache;	/* charts with `png_data' */
 	uint64_t	load_limit;
 
 	/* protected by `lock' */
 	char		*proxy;
-
-	chart_t		loader_cmd_purge;
-	chart_t		loader_cmd_metar;
-	chart_t		loader_cmd_taf;
 };
 
+typedef struct {
+	chart_arpt_t	*arpt;
+	bool_t		metar;		/* METAR if set, TAF otherwise */
+} wx_req_t;
+
 typedef struct {
 	const char	*name;
 	bool_t		(*init)(chartdb_t *cdb);
@@ -165,6 +214,18 @@ int chartdb_pdf_count_pages_file(const char *pdfinfo_path, const char *path);
 int chartdb_pdf_count_pages_direct(const char *pdfinfo_path,
     const uint8_t *buf, size_t len);
 
+#ifdef	LACF_WITH_POPPLER
+typedef struct chartdb_pdf_s chartdb_pdf_t;
+
+chartdb_pdf_t *chartdb_pdf_open(const void *data, size_t len);
+void chartdb_pdf_close(chartdb_pdf_t *pdf);
+int chartdb_pdf_num_pages(const chartdb_pdf_t *pdf);
+bool_t chartdb_pdf_page_dims(const chartdb_pdf_t *pdf, int page_nr,
+    double zoom, int *width, int *height);
+cairo_surface_t *chartdb_pdf_render_page(const chartdb_pdf_t *pdf,
+    int page_nr, double zoom);
+#endif	/* LACF_WITH_POPPLER */
+
 #ifdef	__cplusplus
 }
 #endif
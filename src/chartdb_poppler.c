@@ -0,0 +1,195 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+
+/*
+ * In-process PDF rasterization for chartdb using poppler-glib. This
+ * renders straight into a cairo image surface, which saves the chart
+ * loader from starting pdfinfo and pdftoppm for every page and from
+ * encoding and then decoding a full-page PNG. It's only built when the
+ * library is configured with poppler support (LACF_WITH_POPPLER), in
+ * which case the pdftoppm path remains as the fallback for documents
+ * poppler-glib can't open.
+ *
+ * A chartdb_pdf_t isn't thread-safe, but separate documents can be used
+ * from separate threads concurrently.
+ */
+
+#include <math.h>
+
+#include <poppler.h>
+
+#include "acfutils/assert.h"
+#include "acfutils/helpers.h"
+#include "acfutils/log.h"
+#include "acfutils/safe_alloc.h"
+
+#include "chartdb_impl.h"
+
+struct chartdb_pdf_s {
+	PopplerDocument	*doc;
+};
+
+/*
+ * Same resolution as we ask pdftoppm for, so charts come out the same
+ * size no matter which path rendered them.
+ */
+static double
+zoom2scale(double zoom)
+{
+	return ((int)(100 * clamp(zoom, 0.1, 10.0)) / 72.0);
+}
+
+/**
+ * Opens a PDF document held in memory. The data isn't copied, so it
+ * must remain valid until the document is closed.
+ *
+ * @return The document, or NULL if it couldn't be parsed.
+ */
+chartdb_pdf_t *
+chartdb_pdf_open(const void *data, size_t len)
+{
+	GBytes *bytes;
+	GError *err = NULL;
+	PopplerDocument *doc;
+	chartdb_pdf_t *pdf;
+
+	ASSERT(data != NULL || len == 0);
+
+	bytes = g_bytes_new_static(data, len);
+	doc = poppler_document_new_from_bytes(bytes, NULL, &err);
+	g_bytes_unref(bytes);
+	if (doc == NULL) {
+		logMsg("Error opening PDF: %s", err != NULL ? err->message :
+		    "unknown error");
+		if (err != NULL)
+			g_error_free(err);
+		return (NULL);
+	}
+	pdf = safe_calloc(1, sizeof (*pdf));
+	pdf->doc = doc;
+
+	return (pdf);
+}
+
+void
+chartdb_pdf_close(chartdb_pdf_t *pdf)
+{
+	if (pdf == NULL)
+		return;
+	g_object_unref(pdf->doc);
+	free(pdf);
+}
+
+int
+chartdb_pdf_num_pages(const chartdb_pdf_t *pdf)
+{
+	ASSERT(pdf != NULL);
+	return (poppler_document_get_n_pages(pdf->doc));
+}
+
+static PopplerPage *
+get_page(const chartdb_pdf_t *pdf, int page_nr)
+{
+	PopplerPage *page;
+
+	if (page_nr < 0 || page_nr >= poppler_document_get_n_pages(pdf->doc))
+		return (NULL);
+	page = poppler_document_get_page(pdf->doc, page_nr);
+	if (page == NULL)
+		logMsg("Error loading PDF page %d", page_nr + 1);
+	return (page);
+}
+
+static void
+page_dims(PopplerPage *page, double zoom, int *width, int *height)
+{
+	double w, h;
+
+	poppler_page_get_size(page, &w, &h);
+	*width = MAX(ceil(w * zoom2scale(zoom)), 1);
+	*height = MAX(ceil(h * zoom2scale(zoom)), 1);
+}
+
+/**
+ * Determines the size in pixels of page `page_nr' (starting at 0) when
+ * rendered at `zoom'.
+ *
+ * @return B_TRUE if the page exists, B_FALSE otherwise.
+ */
+bool_t
+chartdb_pdf_page_dims(const chartdb_pdf_t *pdf, int page_nr, double zoom,
+    int *width, int *height)
+{
+	PopplerPage *page;
+
+	ASSERT(pdf != NULL);
+	ASSERT(width != NULL);
+	ASSERT(height != NULL);
+
+	if ((page = get_page(pdf, page_nr)) == NULL)
+		return (B_FALSE);
+	page_dims(page, zoom, width, height);
+	g_object_unref(page);
+
+	return (B_TRUE);
+}
+
+/**
+ * Renders a whole page at `zoom' into a new image surface. This is a
+ * single poppler_page_render() call, since poppler-glib can neither
+ * cancel a render in progress nor render a page piecemeal without
+ * redoing most of the work for every piece. Areas which the page leaves
+ * transparent come out white, like they do from pdftoppm.
+ *
+ * @return The surface, or NULL if the page doesn't exist or rendering
+ *	failed.
+ */
+cairo_surface_t *
+chartdb_pdf_render_page(const chartdb_pdf_t *pdf, int page_nr, double zoom)
+{
+	double scale = zoom2scale(zoom);
+	PopplerPage *page;
+	cairo_surface_t *surf;
+	cairo_t *cr;
+	int w, h;
+
+	ASSERT(pdf != NULL);
+
+	if ((page = get_page(pdf, page_nr)) == NULL)
+		return (NULL);
+	page_dims(page, zoom, &w, &h);
+	surf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+	if (cairo_surface_status(surf) == CAIRO_STATUS_SUCCESS) {
+		cr = cairo_create(surf);
+		cairo_set_source_rgb(cr, 1, 1, 1);
+		cairo_paint(cr);
+		cairo_scale(cr, scale, scale);
+		poppler_page_render(page, cr);
+		cairo_destroy(cr);
+	}
+	g_object_unref(page);
+	if (cairo_surface_status(surf) != CAIRO_STATUS_SUCCESS) {
+		logMsg("Error rendering PDF page %d: %s", page_nr + 1,
+		    cairo_status_to_string(cairo_surface_status(surf)));
+		cairo_surface_destroy(surf);
+		return (NULL);
+	}
+	cairo_surface_flush(surf);
+
+	return (surf);
+}
@@ -25,11 +25,46 @@
 #include <7zCrc.h>
 #include <7zFile.h>
 #include <7zVersion.h>
+#include <LzmaDec.h>
+#include <Lzma2Dec.h>
 
 #include "acfutils/assert.h"
 #include "acfutils/compress.h"
+#include "acfutils/helpers.h"
 #include "acfutils/safe_alloc.h"
 
+#define	kInputBufSize	((size_t)1 << 18)
+/* 7z coder method IDs, see lzma/C/7zDec.c */
+#define	METHOD_LZMA	0x30101
+#define	METHOD_LZMA2	0x21
+/*
+ * Minimum amount of output decompress_7z_stream_fill() produces per call,
+ * so that callers asking for a few bytes at a time don't pay the decoder
+ * call overhead for each of them.
+ */
+#define	STREAM_FILL_MIN	((size_t)1 << 20)
+
+struct decompress_7z_stream_s {
+	ISzAlloc	alloc;
+	CFileInStream	archive;
+	CLookToRead2	look;
+	CSzArEx		db;
+	bool_t		is_lzma2;
+	CLzmaDec	lzma;
+	CLzma2Dec	lzma2;
+	UInt64		in_left;	/* packed bytes not yet consumed */
+	uint8_t		*out_buf;	/* set on first fill */
+	size_t		out_len;
+	size_t		out_pos;
+	bool_t		has_crc;
+	uint32_t	crc;
+	bool_t		failed;
+	/* decompress_7z_stream_read() state */
+	uint8_t		*ring;		/* dictionary, set on first read */
+	size_t		ring_sz;
+	uint32_t	crc_run;
+};
+
 /**
  * Performs a light-weight & quick test to see if some data might constitute
  * a 7-zip archive.
@@ -60,7 +95,6 @@ test_7z(const void *in_buf, size_t len)
 void *
 decompress_7z(const char *filename, size_t *out_len)
 {
-#define	kInputBufSize	((size_t)1 << 18)
 	void *out_buf = NULL;
 	static const ISzAlloc g_Alloc = { SzAlloc, SzFree };
 	ISzAlloc allocImp = g_Alloc;
@@ -110,3 +144,296 @@ out:
 
 	return (out_buf);
 }
+
+/**
+ * Opens the first file contained in a 7-zip archive for incremental
+ * decompression. Unlike decompress_7z(), which always decompresses the
+ * whole file, this lets you decompress only as much of the start of the
+ * file as you need using decompress_7z_stream_fill().
+ *
+ * Only files compressed with plain LZMA or LZMA2 (which is what 7-zip
+ * uses by default) can be streamed. For anything else, this returns
+ * NULL and you should fall back to decompress_7z().
+ *
+ * @param filename The full path to the file holding the 7-zip archive.
+ * @param out_len Return argument, which will be filled with the full
+ *	decompressed size of the file.
+ * @return A stream handle, or NULL if the archive couldn't be opened or
+ *	its first file can't be streamed. Close the stream using
+ *	decompress_7z_stream_close().
+ */
+decompress_7z_stream_t *
+decompress_7z_stream_open(const char *filename, size_t *out_len)
+{
+	static const ISzAlloc g_Alloc = { SzAlloc, SzFree };
+	decompress_7z_stream_t *st = safe_calloc(1, sizeof (*st));
+	const CSzAr *ar = &st->db.db;
+	UInt32 folder;
+	CSzFolder f;
+	CSzData sd;
+	const CSzCoderInfo *coder;
+	const Byte *props;
+	UInt32 pack_idx;
+
+	ASSERT(filename != NULL);
+	ASSERT(out_len != NULL);
+
+	st->alloc = g_Alloc;
+	LzmaDec_CONSTRUCT(&st->lzma);
+	Lzma2Dec_CONSTRUCT(&st->lzma2);
+	SzArEx_Init(&st->db);
+	if (InFile_Open(&st->archive.file, filename)) {
+		free(st);
+		return (NULL);
+	}
+	FileInStream_CreateVTable(&st->archive);
+	LookToRead2_CreateVTable(&st->look, False);
+	st->look.buf = ISzAlloc_Alloc(&st->alloc, kInputBufSize);
+	st->look.bufSize = kInputBufSize;
+	st->look.realStream = &st->archive.vt;
+	LookToRead2_INIT(&st->look);
+
+	CrcGenerateTable();
+	if (SzArEx_Open(&st->db, &st->look.vt, &st->alloc, &st->alloc) !=
+	    SZ_OK || st->db.NumFiles == 0 || SzArEx_IsDir(&st->db, 0))
+		goto errout;
+	folder = st->db.FileToFolder[0];
+	/* The file must be non-empty and the first one in its folder */
+	if (folder == (UInt32)-1 || st->db.FolderToFile[folder] != 0)
+		goto errout;
+
+	props = ar->CodersData + ar->FoCodersOffsets[folder];
+	sd.Data = props;
+	sd.Size = ar->FoCodersOffsets[folder + 1] -
+	    ar->FoCodersOffsets[folder];
+	if (SzGetNextFolderItem(&f, &sd) != SZ_OK || f.NumCoders != 1 ||
+	    f.NumPackStreams != 1)
+		goto errout;
+	coder = &f.Coders[0];
+	props += coder->PropsOffset;
+	if (coder->MethodID == METHOD_LZMA) {
+		if (LzmaDec_AllocateProbs(&st->lzma, props, coder->PropsSize,
+		    &st->alloc) != SZ_OK)
+			goto errout;
+	} else if (coder->MethodID == METHOD_LZMA2) {
+		if (coder->PropsSize != 1 || Lzma2Dec_AllocateProbs(&st->lzma2,
+		    props[0], &st->alloc) != SZ_OK)
+			goto errout;
+		st->is_lzma2 = B_TRUE;
+	} else {
+		goto errout;
+	}
+
+	pack_idx = ar->FoStartPackStreamIndex[folder];
+	st->in_left = ar->PackPositions[pack_idx + 1] -
+	    ar->PackPositions[pack_idx];
+	if (LookInStream_SeekTo(&st->look.vt,
+	    st->db.dataPos + ar->PackPositions[pack_idx]) != SZ_OK)
+		goto errout;
+
+	st->out_len = SzArEx_GetFileSize(&st->db, 0);
+	st->has_crc = SzBitWithVals_Check(&st->db.CRCs, 0);
+	if (st->has_crc)
+		st->crc = st->db.CRCs.Vals[0];
+	*out_len = st->out_len;
+
+	return (st);
+errout:
+	decompress_7z_stream_close(st);
+	return (NULL);
+}
+
+/*
+ * Runs the decoder once, up to `limit' in its dictionary buffer.
+ * @return The new dictionary position, or -1 on error.
+ */
+static ssize_t
+decode_to_dic(decompress_7z_stream_t *st, size_t limit)
+{
+	const void *in = NULL;
+	size_t lookahead = MIN(kInputBufSize, st->in_left);
+	size_t old_pos = (st->is_lzma2 ? st->lzma2.decoder.dicPos :
+	    st->lzma.dicPos);
+	SizeT in_proc, new_pos;
+	ELzmaStatus status;
+	SRes res;
+
+	if (ILookInStream_Look(&st->look.vt, &in, &lookahead) != SZ_OK)
+		return (-1);
+	in_proc = lookahead;
+	if (st->is_lzma2) {
+		res = Lzma2Dec_DecodeToDic(&st->lzma2, limit, in, &in_proc,
+		    LZMA_FINISH_ANY, &status);
+		new_pos = st->lzma2.decoder.dicPos;
+	} else {
+		res = LzmaDec_DecodeToDic(&st->lzma, limit, in, &in_proc,
+		    LZMA_FINISH_ANY, &status);
+		new_pos = st->lzma.dicPos;
+	}
+	if (res != SZ_OK || (in_proc == 0 && new_pos == old_pos))
+		return (-1);
+	st->in_left -= in_proc;
+	if (ILookInStream_Skip(&st->look.vt, in_proc) != SZ_OK)
+		return (-1);
+
+	return (new_pos);
+}
+
+/**
+ * Decompresses more of a file opened with decompress_7z_stream_open().
+ * @param st The stream to decompress.
+ * @param out_buf The buffer to decompress into. This must be large enough
+ *	to hold the entire decompressed file (the `out_len` returned from
+ *	decompress_7z_stream_open()) and you must pass the same buffer on
+ *	every call, as the decompressor uses the data already written to
+ *	it as its dictionary. Only the bytes up to the returned length are
+ *	ever written, so the rest of the buffer stays untouched (and for
+ *	a fresh allocation, usually not even backed by physical memory).
+ * @param upto Decompresses until at least this many bytes from the start
+ *	of the file are available in `out_buf`. The decompressor may run
+ *	somewhat further ahead. Pass `SIZE_MAX` to decompress everything.
+ * @return The number of bytes from the start of the file which are now
+ *	available in `out_buf`, or -1 if the archive is corrupt. Once the
+ *	whole file has been decompressed, its CRC is verified and a
+ *	mismatch is also reported as -1. Errors are sticky.
+ */
+ssize_t
+decompress_7z_stream_fill(decompress_7z_stream_t *st, void *out_buf,
+    size_t upto)
+{
+	ASSERT(st != NULL);
+	ASSERT(out_buf != NULL);
+	ASSERT3P(st->ring, ==, NULL);
+
+	if (st->failed)
+		return (-1);
+	if (st->out_buf == NULL) {
+		st->out_buf = out_buf;
+		if (st->is_lzma2) {
+			st->lzma2.decoder.dic = out_buf;
+			st->lzma2.decoder.dicBufSize = st->out_len;
+			Lzma2Dec_Init(&st->lzma2);
+		} else {
+			st->lzma.dic = out_buf;
+			st->lzma.dicBufSize = st->out_len;
+			LzmaDec_Init(&st->lzma);
+		}
+	}
+	ASSERT3P(st->out_buf, ==, out_buf);
+	if (st->out_pos == st->out_len)
+		return (st->out_len);
+
+	upto = MIN(upto, st->out_len);
+	while (st->out_pos < upto) {
+		size_t limit = MIN(MAX(upto, st->out_pos + STREAM_FILL_MIN),
+		    st->out_len);
+		ssize_t new_pos = decode_to_dic(st, limit);
+
+		if (new_pos < 0)
+			goto errout;
+		st->out_pos = new_pos;
+	}
+	if (st->out_pos == st->out_len && st->has_crc &&
+	    CrcCalc(st->out_buf, st->out_len) != st->crc)
+		goto errout;
+
+	return (st->out_pos);
+errout:
+	st->failed = B_TRUE;
+	return (-1);
+}
+
+/**
+ * Decompresses the next part of a file opened with
+ * decompress_7z_stream_open() into a caller-supplied buffer of any size.
+ * Unlike decompress_7z_stream_fill(), the output doesn't need to be kept
+ * around: the decompressor keeps its own dictionary instead, which is
+ * never larger than the dictionary size the archive was compressed with
+ * (or the file, if that is smaller). You can't mix calls to this
+ * function with decompress_7z_stream_fill() on the same stream.
+ * @param st The stream to decompress.
+ * @param buf The buffer to place the next part of the file into.
+ * @param cap The number of bytes available in `buf'.
+ * @return The number of bytes placed in `buf'. This is only less than
+ *	`cap' once the end of the file has been reached, and 0 if it
+ *	already had been. Returns -1 if the archive is corrupt, including
+ *	when the whole file has been decompressed and its CRC doesn't
+ *	match. Errors are sticky.
+ */
+ssize_t
+decompress_7z_stream_read(decompress_7z_stream_t *st, void *buf, size_t cap)
+{
+	uint8_t *out = buf;
+	size_t produced = 0;
+
+	ASSERT(st != NULL);
+	ASSERT(buf != NULL || cap == 0);
+	ASSERT3P(st->out_buf, ==, NULL);
+
+	if (st->failed)
+		return (-1);
+	if (st->ring == NULL && st->out_len != 0) {
+		size_t dic_sz = (st->is_lzma2 ? st->lzma2.decoder.prop.dicSize :
+		    st->lzma.prop.dicSize);
+
+		st->ring_sz = MIN(MAX(dic_sz, 1), st->out_len);
+		st->ring = safe_malloc(st->ring_sz);
+		if (st->is_lzma2) {
+			st->lzma2.decoder.dic = st->ring;
+			st->lzma2.decoder.dicBufSize = st->ring_sz;
+			Lzma2Dec_Init(&st->lzma2);
+		} else {
+			st->lzma.dic = st->ring;
+			st->lzma.dicBufSize = st->ring_sz;
+			LzmaDec_Init(&st->lzma);
+		}
+		st->crc_run = CRC_INIT_VAL;
+	}
+	while (produced < cap && st->out_pos < st->out_len) {
+		SizeT *dic_pos = (st->is_lzma2 ? &st->lzma2.decoder.dicPos :
+		    &st->lzma.dicPos);
+		size_t old_pos, limit;
+		ssize_t new_pos;
+
+		/* The dictionary is a ring, wrap around once it's full */
+		if (*dic_pos == st->ring_sz)
+			*dic_pos = 0;
+		old_pos = *dic_pos;
+		limit = old_pos + MIN(MIN(cap - produced,
+		    st->out_len - st->out_pos), st->ring_sz - old_pos);
+		new_pos = decode_to_dic(st, limit);
+		if (new_pos < 0)
+			goto errout;
+		memcpy(&out[produced], &st->ring[old_pos], new_pos - old_pos);
+		st->crc_run = CrcUpdate(st->crc_run, &st->ring[old_pos],
+		    new_pos - old_pos);
+		produced += new_pos - old_pos;
+		st->out_pos += new_pos - old_pos;
+		if (st->out_pos == st->out_len && st->has_crc &&
+		    CRC_GET_DIGEST(st->crc_run) != st->crc)
+			goto errout;
+	}
+
+	return (produced);
+errout:
+	st->failed = B_TRUE;
+	return (-1);
+}
+
+/**
+ * Closes a stream opened with decompress_7z_stream_open(). This does not
+ * free the output buffer passed to decompress_7z_stream_fill().
+ */
+void
+decompress_7z_stream_close(decompress_7z_stream_t *st)
+{
+	if (st == NULL)
+		return;
+	LzmaDec_FreeProbs(&st->lzma, &st->alloc);
+	Lzma2Dec_FreeProbs(&st->lzma2, &st->alloc);
+	SzArEx_Free(&st->db, &st->alloc);
+	ISzAlloc_Free(&st->alloc, st->look.buf);
+	File_Close(&st->archive.file);
+	free(st->ring);
+	free(st);
+}
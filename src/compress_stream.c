@@ -0,0 +1,748 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "acfutils/assert.h"
+#include "acfutils/compress.h"
+#include "acfutils/helpers.h"
+#include "acfutils/safe_alloc.h"
+
+#define	MINIZ_HEADER_FILE_ONLY
+/* We use the real zlib above, keep miniz from aliasing it */
+#define	MINIZ_NO_ZLIB_COMPATIBLE_NAMES
+#include "zip/miniz.h"
+
+/*
+ * Size of the input buffer of streams reading from a file and of the
+ * output chunks handed to the callback of push streams.
+ */
+#define	STREAM_BUF_SZ	((size_t)1 << 16)
+/* Enough to tell all supported formats apart, see detect_fmt() */
+#define	MAGIC_LEN	6
+
+struct decompress_stream_s {
+	decompress_fmt_t	fmt;
+	bool_t			eof;
+	bool_t			failed;
+	uint64_t		size;		/* UINT64_MAX if unknown */
+
+	/* Input of pull streams, either a file or a memory buffer */
+	FILE			*fp;
+	const uint8_t		*mem;
+	size_t			mem_len;
+	size_t			mem_pos;
+	uint8_t			*in_buf;
+
+	/* DECOMPRESS_FMT_ZLIB & DECOMPRESS_FMT_GZIP */
+	z_stream		zs;
+	bool_t			zs_inited;
+	bool_t			zs_end;		/* saw Z_STREAM_END */
+	bool_t			zs_trailer;	/* at trailing garbage */
+
+	/* DECOMPRESS_FMT_7Z */
+	decompress_7z_stream_t	*st7z;
+
+	/* DECOMPRESS_FMT_ZIP */
+	mz_zip_archive		zip;
+	bool_t			zip_inited;
+	mz_zip_reader_extract_iter_state *zip_iter;
+
+	/* Push streams */
+	decompress_stream_cb_t	cb;
+	void			*userinfo;
+	uint8_t			*out_buf;
+	uint8_t			hold[MAGIC_LEN];
+	size_t			n_hold;
+
+	/* decompress_stream_getline() read-ahead */
+	uint8_t			*rd_buf;
+	size_t			rd_len;
+	size_t			rd_pos;
+};
+
+static bool_t
+test_gzip(const void *buf, size_t len)
+{
+	const uint8_t *buf8 = buf;
+	return (len >= 2 && buf8[0] == 0x1f && buf8[1] == 0x8b);
+}
+
+static bool_t
+test_zip(const void *buf, size_t len)
+{
+	static const uint8_t magic[] = { 'P', 'K', 3, 4 };
+	return (len >= sizeof (magic) &&
+	    memcmp(buf, magic, sizeof (magic)) == 0);
+}
+
+/*
+ * Guesses the format from the first few bytes of the input. Anything
+ * which isn't recognized as compressed is assumed to be uncompressed.
+ */
+static decompress_fmt_t
+detect_fmt(const void *buf, size_t len)
+{
+	if (test_7z(buf, len))
+		return (DECOMPRESS_FMT_7Z);
+	if (test_zip(buf, len))
+		return (DECOMPRESS_FMT_ZIP);
+	if (test_gzip(buf, len))
+		return (DECOMPRESS_FMT_GZIP);
+	if (zlib_test(buf, len))
+		return (DECOMPRESS_FMT_ZLIB);
+	return (DECOMPRESS_FMT_NONE);
+}
+
+static bool_t
+zs_init(decompress_stream_t *st)
+{
+	/* 15 is the maximum window size, +16 tells zlib to expect gzip */
+	int window_bits = (st->fmt == DECOMPRESS_FMT_GZIP ? 15 + 16 : 15);
+
+	if (inflateInit2(&st->zs, window_bits) != Z_OK)
+		return (B_FALSE);
+	st->zs_inited = B_TRUE;
+	return (B_TRUE);
+}
+
+/*
+ * Feeds the input currently set up in st->zs to the decompressor,
+ * producing at most `cap' bytes of output into `out'.
+ * @return The number of bytes produced, or -1 on error.
+ */
+static ssize_t
+zs_inflate(decompress_stream_t *st, void *out, size_t cap)
+{
+	int ret;
+
+	/*
+	 * A gzip file can consist of several members, which are to be
+	 * decompressed as if they were one (zlib_compress_chunked() adds
+	 * empty members carrying its index). Anything after the end of a
+	 * zlib stream (such as the index appended by
+	 * zlib_compress_chunked()) is ignored, as is anything after a
+	 * gzip member which doesn't start with the gzip magic number.
+	 */
+	if (st->zs_end) {
+		if (st->fmt != DECOMPRESS_FMT_GZIP || st->zs.avail_in == 0)
+			return (0);
+		if (st->zs_trailer || st->zs.next_in[0] != 0x1f) {
+			st->zs_trailer = B_TRUE;
+			st->zs.avail_in = 0;
+			return (0);
+		}
+		if (inflateReset(&st->zs) != Z_OK)
+			return (-1);
+		st->zs_end = B_FALSE;
+	}
+	st->zs.next_out = out;
+	st->zs.avail_out = cap;
+	ret = inflate(&st->zs, Z_NO_FLUSH);
+	switch (ret) {
+	case Z_STREAM_END:
+		st->zs_end = B_TRUE;
+		break;
+	case Z_OK:
+		break;
+	case Z_BUF_ERROR:
+		/* no progress possible, caller needs to supply more input */
+		break;
+	default:
+		return (-1);
+	}
+	return (cap - st->zs.avail_out);
+}
+
+static decompress_stream_t *
+stream_alloc(decompress_fmt_t fmt)
+{
+	decompress_stream_t *st = safe_calloc(1, sizeof (*st));
+
+	st->fmt = fmt;
+	st->size = UINT64_MAX;
+	return (st);
+}
+
+static bool_t
+pull_init(decompress_stream_t *st)
+{
+	switch (st->fmt) {
+	case DECOMPRESS_FMT_NONE:
+		if (st->fp == NULL)
+			st->size = st->mem_len;
+		return (B_TRUE);
+	case DECOMPRESS_FMT_ZLIB:
+	case DECOMPRESS_FMT_GZIP:
+		if (st->fp != NULL)
+			st->in_buf = safe_malloc(STREAM_BUF_SZ);
+		return (zs_init(st));
+	case DECOMPRESS_FMT_ZIP:
+		if (st->fp != NULL) {
+			if (!mz_zip_reader_init_cfile(&st->zip, st->fp, 0, 0))
+				return (B_FALSE);
+		} else {
+			if (!mz_zip_reader_init_mem(&st->zip, st->mem,
+			    st->mem_len, 0))
+				return (B_FALSE);
+		}
+		st->zip_inited = B_TRUE;
+		if (mz_zip_reader_get_num_files(&st->zip) == 0 ||
+		    mz_zip_reader_is_file_a_directory(&st->zip, 0)) {
+			return (B_FALSE);
+		}
+		st->zip_iter = mz_zip_reader_extract_iter_new(&st->zip, 0, 0);
+		if (st->zip_iter == NULL)
+			return (B_FALSE);
+		st->size = st->zip_iter->file_stat.m_uncomp_size;
+		return (B_TRUE);
+	default:
+		return (B_FALSE);
+	}
+}
+
+/**
+ * Opens a file for incremental decompression. You then pull the
+ * decompressed data out of it in pieces of whatever size suits you
+ * using decompress_stream_read() or decompress_stream_getline(). Memory
+ * use is bounded and doesn't depend on the size of the file: for zlib,
+ * gzip and zip it is a few hundred kB, for 7-zip the dictionary size the
+ * archive was created with (16 MB for 7-zip's default settings).
+ *
+ * For 7-zip and zip archives, the first file in the archive is read.
+ * 7-zip archives must use plain LZMA or LZMA2 compression (which is what
+ * 7-zip uses by default), see decompress_7z_stream_open().
+ *
+ * @param filename The full path to the file.
+ * @param fmt The format of the file. Pass DECOMPRESS_FMT_AUTO to detect
+ *	it from the file's contents. Files which aren't recognized as any
+ *	of the compressed formats are then read as-is.
+ * @return A stream handle, or NULL if the file couldn't be opened or
+ *	isn't in a format we can read. Close the stream using
+ *	decompress_stream_close().
+ */
+decompress_stream_t *
+decompress_stream_open(const char *filename, decompress_fmt_t fmt)
+{
+	decompress_stream_t *st;
+	FILE *fp;
+
+	ASSERT(filename != NULL);
+
+	fp = fopen(filename, "rb");
+	if (fp == NULL)
+		return (NULL);
+	if (fmt == DECOMPRESS_FMT_AUTO) {
+		uint8_t magic[MAGIC_LEN];
+		size_t n = fread(magic, 1, sizeof (magic), fp);
+
+		fmt = detect_fmt(magic, n);
+		rewind(fp);
+	}
+	st = stream_alloc(fmt);
+	if (fmt == DECOMPRESS_FMT_7Z) {
+		size_t len;
+
+		/* The LZMA SDK does its own file I/O */
+		fclose(fp);
+		st->st7z = decompress_7z_stream_open(filename, &len);
+		if (st->st7z == NULL) {
+			free(st);
+			return (NULL);
+		}
+		st->size = len;
+		return (st);
+	}
+	st->fp = fp;
+	if (fmt == DECOMPRESS_FMT_NONE) {
+		ssize_t sz = filesz(filename);
+		if (sz >= 0)
+			st->size = sz;
+	}
+	if (!pull_init(st)) {
+		decompress_stream_close(st);
+		return (NULL);
+	}
+	return (st);
+}
+
+/**
+ * Same as decompress_stream_open(), but reads the compressed data from
+ * a memory buffer. 7-zip archives can only be read from files, so
+ * DECOMPRESS_FMT_7Z isn't supported here.
+ * @param buf The compressed data. This must remain valid and unchanged
+ *	until the stream is closed.
+ * @param len The number of bytes in `buf'.
+ * @param fmt The format of the data, or DECOMPRESS_FMT_AUTO to detect it.
+ */
+decompress_stream_t *
+decompress_stream_open_mem(const void *buf, size_t len, decompress_fmt_t fmt)
+{
+	decompress_stream_t *st;
+
+	ASSERT(buf != NULL || len == 0);
+
+	if (fmt == DECOMPRESS_FMT_AUTO)
+		fmt = detect_fmt(buf, len);
+	if (fmt == DECOMPRESS_FMT_7Z)
+		return (NULL);
+	st = stream_alloc(fmt);
+	st->mem = buf;
+	st->mem_len = len;
+	if (!pull_init(st)) {
+		decompress_stream_close(st);
+		return (NULL);
+	}
+	return (st);
+}
+
+/*
+ * Makes more input available to the zlib decompressor of a pull stream.
+ */
+static bool_t
+zs_refill(decompress_stream_t *st)
+{
+	if (st->zs.avail_in != 0)
+		return (B_TRUE);
+	if (st->fp != NULL) {
+		size_t n = fread(st->in_buf, 1, STREAM_BUF_SZ, st->fp);
+
+		if (n == 0 && ferror(st->fp))
+			return (B_FALSE);
+		st->zs.next_in = st->in_buf;
+		st->zs.avail_in = n;
+	} else {
+		/* avail_in is only 32 bits wide */
+		size_t n = MIN(st->mem_len - st->mem_pos, UINT32_MAX);
+
+		st->zs.next_in = (uint8_t *)&st->mem[st->mem_pos];
+		st->zs.avail_in = n;
+		st->mem_pos += n;
+	}
+	return (B_TRUE);
+}
+
+static ssize_t
+pull_read(decompress_stream_t *st, void *buf, size_t cap)
+{
+	uint8_t *out = buf;
+	size_t produced = 0;
+
+	switch (st->fmt) {
+	case DECOMPRESS_FMT_NONE:
+		if (st->fp != NULL) {
+			produced = fread(buf, 1, cap, st->fp);
+			if (produced < cap && ferror(st->fp))
+				return (-1);
+		} else {
+			produced = MIN(cap, st->mem_len - st->mem_pos);
+			memcpy(buf, &st->mem[st->mem_pos], produced);
+			st->mem_pos += produced;
+		}
+		return (produced);
+	case DECOMPRESS_FMT_ZLIB:
+	case DECOMPRESS_FMT_GZIP:
+		while (produced < cap) {
+			bool_t in_eof;
+			ssize_t n;
+
+			if (!zs_refill(st))
+				return (-1);
+			/* zs_refill() only comes up empty at the end */
+			in_eof = (st->zs.avail_in == 0);
+			if (st->zs_end && (in_eof || st->zs_trailer ||
+			    st->fmt == DECOMPRESS_FMT_ZLIB))
+				break;
+			/* zlib's avail_out is only 32 bits wide */
+			n = zs_inflate(st, &out[produced],
+			    MIN(cap - produced, UINT32_MAX));
+			if (n < 0 || (n == 0 && in_eof && !st->zs_end)) {
+				/* corrupt or truncated */
+				return (-1);
+			}
+			produced += n;
+		}
+		return (produced);
+	case DECOMPRESS_FMT_7Z:
+		return (decompress_7z_stream_read(st->st7z, buf, cap));
+	case DECOMPRESS_FMT_ZIP:
+		produced = mz_zip_reader_extract_iter_read(st->zip_iter, buf,
+		    cap);
+		if (st->zip_iter->status < 0)
+			return (-1);
+		/*
+		 * Reading stops short only at the end of the entry, so that
+		 * is where its size and CRC get checked.
+		 */
+		if (produced < cap && (st->zip_iter->out_buf_ofs !=
+		    st->zip_iter->file_stat.m_uncomp_size ||
+		    st->zip_iter->file_crc32 !=
+		    st->zip_iter->file_stat.m_crc32))
+			return (-1);
+		return (produced);
+	default:
+		VERIFY_FAIL();
+	}
+}
+
+/**
+ * Reads the next part of the decompressed data from a stream opened with
+ * decompress_stream_open() or decompress_stream_open_mem().
+ * @param st The stream to read from.
+ * @param buf The buffer to place the decompressed data into.
+ * @param cap The number of bytes available in `buf'.
+ * @return The number of bytes placed into `buf'. This is only less than
+ *	`cap' once the end of the data has been reached and 0 if it
+ *	already had been. Returns -1 if the data is corrupt, truncated or
+ *	fails its checksum. Errors are sticky.
+ */
+ssize_t
+decompress_stream_read(decompress_stream_t *st, void *buf, size_t cap)
+{
+	size_t produced = 0;
+	ssize_t n;
+
+	ASSERT(st != NULL);
+	ASSERT(buf != NULL || cap == 0);
+	ASSERT3P(st->cb, ==, NULL);
+
+	if (st->failed)
+		return (-1);
+	/* Hand out whatever decompress_stream_getline() read ahead first */
+	if (st->rd_pos < st->rd_len) {
+		produced = MIN(cap, st->rd_len - st->rd_pos);
+		memcpy(buf, &st->rd_buf[st->rd_pos], produced);
+		st->rd_pos += produced;
+	}
+	if (produced == cap || st->eof)
+		return (produced);
+	n = pull_read(st, (uint8_t *)buf + produced, cap - produced);
+	if (n < 0) {
+		st->failed = B_TRUE;
+		return (-1);
+	}
+	if ((size_t)n < cap - produced)
+		st->eof = B_TRUE;
+
+	return (produced + n);
+}
+
+/**
+ * Reads the next line of decompressed text from a pull stream, just
+ * like getline(). The line terminator ("\n" or "\r\n") is stripped.
+ * Lines may be of any length.
+ * @param st The stream to read from.
+ * @param linep Line buffer which will hold the new line. If the buffer
+ *	pointer is NULL, it is allocated. If it isn't long enough, it is
+ *	expanded. Free it using free() when you are done with it.
+ * @param linecap The capacity of *linep.
+ * @return The length of the line, or -1 once the end of the data has
+ *	been reached or if the data is corrupt. Use decompress_stream_error()
+ *	to tell those apart.
+ */
+ssize_t
+decompress_stream_getline(decompress_stream_t *st, char **linep,
+    size_t *linecap)
+{
+	size_t len = 0;
+	bool_t got_any = B_FALSE;
+
+	ASSERT(st != NULL);
+	ASSERT(linep != NULL);
+	ASSERT(linecap != NULL);
+	ASSERT3P(st->cb, ==, NULL);
+
+	if (st->rd_buf == NULL)
+		st->rd_buf = safe_malloc(STREAM_BUF_SZ);
+	for (;;) {
+		uint8_t *start, *nl;
+		size_t n;
+
+		if (st->rd_pos == st->rd_len) {
+			ssize_t got;
+
+			if (st->failed || st->eof)
+				break;
+			got = pull_read(st, st->rd_buf, STREAM_BUF_SZ);
+			if (got < 0) {
+				st->failed = B_TRUE;
+				break;
+			}
+			if ((size_t)got < STREAM_BUF_SZ)
+				st->eof = B_TRUE;
+			st->rd_pos = 0;
+			st->rd_len = got;
+			if (got == 0)
+				break;
+		}
+		got_any = B_TRUE;
+		start = &st->rd_buf[st->rd_pos];
+		n = st->rd_len - st->rd_pos;
+		nl = memchr(start, '\n', n);
+		if (nl != NULL)
+			n = nl - start;
+		if (len + n + 1 > *linecap) {
+			*linecap = MAX(len + n + 1, 2 * *linecap);
+			*linep = safe_realloc(*linep, *linecap);
+		}
+		memcpy(&(*linep)[len], start, n);
+		len += n;
+		st->rd_pos += n;
+		if (nl != NULL) {
+			/* consume the terminator */
+			st->rd_pos++;
+			break;
+		}
+	}
+	if (!got_any || st->failed)
+		return (-1);
+	/* Strip the CR of a CR-LF line terminator */
+	if (len != 0 && (*linep)[len - 1] == '\r')
+		len--;
+	(*linep)[len] = '\0';
+
+	return (len);
+}
+
+/**
+ * @return The total size of the decompressed data, if it is known in
+ *	advance (for uncompressed files and memory buffers, 7-zip and zip
+ *	archives), or `UINT64_MAX` if it isn't (zlib and gzip).
+ */
+uint64_t
+decompress_stream_size(const decompress_stream_t *st)
+{
+	ASSERT(st != NULL);
+	return (st->size);
+}
+
+/**
+ * @return The format of the stream. For streams opened with
+ *	DECOMPRESS_FMT_AUTO, this returns the detected format. For push
+ *	streams, the format is only known once the first few bytes of
+ *	data have been pushed and until then, DECOMPRESS_FMT_AUTO is
+ *	returned.
+ */
+decompress_fmt_t
+decompress_stream_fmt(const decompress_stream_t *st)
+{
+	ASSERT(st != NULL);
+	return (st->fmt);
+}
+
+/**
+ * @return `B_TRUE` if the stream encountered corrupt, truncated or
+ *	otherwise undecodable data.
+ */
+bool_t
+decompress_stream_error(const decompress_stream_t *st)
+{
+	ASSERT(st != NULL);
+	return (st->failed);
+}
+
+/**
+ * Creates a push-style decompression stream. Rather than pulling
+ * decompressed data out of the stream, you push compressed data into it
+ * using decompress_stream_push() as it becomes available (e.g. from a
+ * network download), and the decompressed data is handed to `cb' in
+ * chunks of at most 64 kB. Neither the compressed nor the decompressed
+ * data are ever buffered in full.
+ *
+ * Only zlib and gzip data can be decompressed this way, as 7-zip and zip
+ * archives keep the information needed to decompress them at the end.
+ *
+ * @param fmt The format of the data. Pass DECOMPRESS_FMT_AUTO to detect
+ *	it from the first few bytes pushed. Data which isn't recognized as
+ *	zlib or gzip is then passed through as-is.
+ * @param cb Callback receiving the decompressed data. If it returns
+ *	`B_FALSE', decompression is aborted and the stream fails.
+ * @param userinfo Argument passed to `cb'.
+ * @return A stream handle. Close it using decompress_stream_close().
+ */
+decompress_stream_t *
+decompress_stream_push_init(decompress_fmt_t fmt, decompress_stream_cb_t cb,
+    void *userinfo)
+{
+	decompress_stream_t *st;
+
+	ASSERT(fmt == DECOMPRESS_FMT_AUTO || fmt == DECOMPRESS_FMT_NONE ||
+	    fmt == DECOMPRESS_FMT_ZLIB || fmt == DECOMPRESS_FMT_GZIP);
+	ASSERT(cb != NULL);
+
+	st = stream_alloc(fmt);
+	st->cb = cb;
+	st->userinfo = userinfo;
+	st->out_buf = safe_malloc(STREAM_BUF_SZ);
+	if ((fmt == DECOMPRESS_FMT_ZLIB || fmt == DECOMPRESS_FMT_GZIP) &&
+	    !zs_init(st))
+		st->failed = B_TRUE;
+
+	return (st);
+}
+
+static bool_t
+push_impl(decompress_stream_t *st, const void *buf, size_t len)
+{
+	if (st->fmt == DECOMPRESS_FMT_NONE) {
+		for (size_t off = 0; off < len; off += STREAM_BUF_SZ) {
+			if (!st->cb((const uint8_t *)buf + off,
+			    MIN(len - off, STREAM_BUF_SZ), st->userinfo))
+				return (B_FALSE);
+		}
+		return (B_TRUE);
+	}
+
+	ASSERT(st->zs_inited);
+	while (len != 0) {
+		/* avail_in is only 32 bits wide */
+		size_t chunk = MIN(len, UINT32_MAX);
+
+		st->zs.next_in = (uint8_t *)buf;
+		st->zs.avail_in = chunk;
+		do {
+			ssize_t n;
+
+			if (st->zs_end && (st->zs_trailer ||
+			    st->fmt == DECOMPRESS_FMT_ZLIB)) {
+				/* trailing garbage, ignore */
+				st->zs.avail_in = 0;
+				break;
+			}
+			n = zs_inflate(st, st->out_buf, STREAM_BUF_SZ);
+			if (n < 0)
+				return (B_FALSE);
+			if (n != 0 && !st->cb(st->out_buf, n, st->userinfo))
+				return (B_FALSE);
+			if (n == 0 && !st->zs_end && st->zs.avail_in != 0 &&
+			    st->zs.avail_out != 0) {
+				/* no progress despite input & output space */
+				return (B_FALSE);
+			}
+		} while (st->zs.avail_in != 0 || st->zs.avail_out == 0);
+		buf = (const uint8_t *)buf + chunk;
+		len -= chunk;
+	}
+	return (B_TRUE);
+}
+
+/**
+ * Pushes the next part of the compressed data into a stream created
+ * with decompress_stream_push_init(). This calls the stream's callback
+ * with all the decompressed data which this makes available.
+ * @param st The stream to push the data into.
+ * @param buf The compressed data.
+ * @param len The number of bytes in `buf'.
+ * @return `B_TRUE` on success, `B_FALSE` if the data is corrupt or the
+ *	callback requested an abort. Errors are sticky.
+ */
+bool_t
+decompress_stream_push(decompress_stream_t *st, const void *buf, size_t len)
+{
+	ASSERT(st != NULL);
+	ASSERT(st->cb != NULL);
+	ASSERT(buf != NULL || len == 0);
+
+	if (st->failed)
+		return (B_FALSE);
+	if (st->fmt == DECOMPRESS_FMT_AUTO) {
+		/* Hold the data back until we can tell what it is */
+		size_t n = MIN(len, MAGIC_LEN - st->n_hold);
+
+		memcpy(&st->hold[st->n_hold], buf, n);
+		st->n_hold += n;
+		buf = (const uint8_t *)buf + n;
+		len -= n;
+		if (st->n_hold < MAGIC_LEN)
+			return (B_TRUE);
+		st->fmt = detect_fmt(st->hold, st->n_hold);
+		if (st->fmt != DECOMPRESS_FMT_ZLIB &&
+		    st->fmt != DECOMPRESS_FMT_GZIP)
+			st->fmt = DECOMPRESS_FMT_NONE;
+		else if (!zs_init(st))
+			goto errout;
+		if (!push_impl(st, st->hold, st->n_hold))
+			goto errout;
+	}
+	if (!push_impl(st, buf, len))
+		goto errout;
+
+	return (B_TRUE);
+errout:
+	st->failed = B_TRUE;
+	return (B_FALSE);
+}
+
+/**
+ * Tells a push stream that all of the compressed data has been pushed.
+ * @return `B_TRUE` if the data decompressed cleanly and completely,
+ *	`B_FALSE` if it was corrupt or truncated.
+ */
+bool_t
+decompress_stream_push_end(decompress_stream_t *st)
+{
+	ASSERT(st != NULL);
+	ASSERT(st->cb != NULL);
+
+	if (st->failed)
+		return (B_FALSE);
+	if (st->fmt == DECOMPRESS_FMT_AUTO) {
+		/* Less data than the magic number, pass it through */
+		st->fmt = DECOMPRESS_FMT_NONE;
+		if (!push_impl(st, st->hold, st->n_hold)) {
+			st->failed = B_TRUE;
+			return (B_FALSE);
+		}
+	}
+	st->eof = B_TRUE;
+	if (st->fmt == DECOMPRESS_FMT_NONE)
+		return (B_TRUE);
+	if (!st->zs_end)
+		st->failed = B_TRUE;
+
+	return (!st->failed);
+}
+
+/**
+ * Closes a decompression stream and frees all of its resources.
+ */
+void
+decompress_stream_close(decompress_stream_t *st)
+{
+	if (st == NULL)
+		return;
+	if (st->zs_inited)
+		inflateEnd(&st->zs);
+	if (st->st7z != NULL)
+		decompress_7z_stream_close(st->st7z);
+	if (st->zip_iter != NULL)
+		mz_zip_reader_extract_iter_free(st->zip_iter);
+	if (st->zip_inited)
+		mz_zip_reader_end(&st->zip);
+	if (st->fp != NULL)
+		fclose(st->fp);
+	free(st->in_buf);
+	free(st->out_buf);
+	free(st->rd_buf);
+	free(st);
+}
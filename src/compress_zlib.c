@@ -16,6 +16,7 @@
  * Copyright 2023 Saso Kiselkov. All rights reserved.
  */
 
+#include <limits.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -26,6 +27,7 @@
 #include "acfutils/assert.h"
 #include "acfutils/compress.h"
 #include "acfutils/safe_alloc.h"
+#include "acfutils/taskq.h"
 
 /**
  * Performs a light-weight & quick test to see if some data might constitute
@@ -176,3 +178,632 @@ out:
 
 	return (out_buf);
 }
+
+/*
+ * Chunked compression.
+ *
+ * zlib_compress_chunked() splits its input into fixed-size chunks and
+ * compresses each into a raw deflate frame of its own, which doesn't
+ * refer back to any earlier chunk. All frames but the last end in a
+ * sync flush (so they end on a byte boundary without a final block),
+ * which means the frames simply concatenate into one valid deflate
+ * stream. That's wrapped in a normal zlib or gzip header and trailer,
+ * with the checksums combined from the per-frame ones, so any zlib or
+ * gzip reader decompresses it as usual.
+ *
+ * After the trailer comes an index of the frames. All index fields are
+ * little-endian:
+ *	magic "LACFZIX1"
+ *	uint64_t chunk size
+ *	uint64_t total uncompressed size
+ *	uint64_t number of frames (N)
+ *	N x { uint64_t offset of the frame, uint32_t CRC-32 of its
+ *	    uncompressed data, uint32_t zero }
+ *	uint64_t end of the deflate data (i.e. end of the last frame)
+ *	uint32_t CRC-32 of all of the above
+ *	uint32_t zero
+ *	uint64_t size of the whole index, including this footer
+ *	magic "LACFZIX1"
+ * In a zlib stream, the index simply follows the trailer, and zlib
+ * readers ignore it as trailing data. gzip readers would complain about
+ * that (gzip -d exits with a warning status), so in a gzip file the index
+ * is carried in the extra field (FEXTRA, subfield ID "LX") of one or more
+ * empty gzip members following the data member. These decompress to
+ * nothing, so the whole file stays a valid multi-member gzip file. An
+ * extra field holds less than 64 kB, so larger indexes are split into
+ * pieces of CHUNKED_PIECE_MAX bytes, except for the first piece, which
+ * holds whatever is left over. That way, a reader which has found the
+ * index size in the footer (which lies just before the 10-byte tail of
+ * the last member) knows where each of the pieces lies.
+ */
+#define	CHUNKED_MAGIC		"LACFZIX1"
+#define	CHUNKED_MAGIC_LEN	8
+#define	CHUNKED_HDR_LEN		(CHUNKED_MAGIC_LEN + 3 * 8)
+#define	CHUNKED_ENT_LEN		16
+#define	CHUNKED_FTR_LEN		(4 + 4 + 8 + CHUNKED_MAGIC_LEN)
+#define	CHUNKED_DFL_CHUNK	((size_t)1 << 20)
+#define	CHUNKED_PIECE_MAX	65520
+#define	GZIP_HDR_LEN		10
+/* gzip header, XLEN and the subfield header */
+#define	GZIP_IDX_HDR_LEN	(GZIP_HDR_LEN + 2 + 4)
+/* empty final deflate block, CRC-32 and ISIZE */
+#define	GZIP_IDX_TRL_LEN	(2 + 4 + 4)
+
+static const uint8_t gz_idx_hdr[GZIP_HDR_LEN] = {
+    0x1f, 0x8b, Z_DEFLATED, 0x04 /* FEXTRA */, 0, 0, 0, 0, 0, 0xff
+};
+static const uint8_t gz_idx_trl[GZIP_IDX_TRL_LEN] = {
+    0x03, 0x00, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static inline void
+put_le16(uint8_t *p, uint16_t x)
+{
+	p[0] = x;
+	p[1] = x >> 8;
+}
+
+static inline void
+put_le32(uint8_t *p, uint32_t x)
+{
+	for (int i = 0; i < 4; i++)
+		p[i] = x >> (8 * i);
+}
+
+static inline void
+put_le64(uint8_t *p, uint64_t x)
+{
+	for (int i = 0; i < 8; i++)
+		p[i] = x >> (8 * i);
+}
+
+static inline uint16_t
+get_le16(const uint8_t *p)
+{
+	return ((uint16_t)p[0] | ((uint16_t)p[1] << 8));
+}
+
+static inline uint32_t
+get_le32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	    ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static inline uint64_t
+get_le64(const uint8_t *p)
+{
+	return (get_le32(p) | ((uint64_t)get_le32(&p[4]) << 32));
+}
+
+static inline size_t
+gzip_idx_pieces(size_t idx_len)
+{
+	return ((idx_len + CHUNKED_PIECE_MAX - 1) / CHUNKED_PIECE_MAX);
+}
+
+static inline size_t
+gzip_idx_piece_len(size_t idx_len, size_t i)
+{
+	if (i == 0) {
+		return (idx_len - (gzip_idx_pieces(idx_len) - 1) *
+		    CHUNKED_PIECE_MAX);
+	}
+	return (CHUNKED_PIECE_MAX);
+}
+
+/* Number of bytes taken up by the gzip members carrying an index. */
+static inline size_t
+gzip_idx_len(size_t idx_len)
+{
+	return (idx_len + gzip_idx_pieces(idx_len) *
+	    (GZIP_IDX_HDR_LEN + GZIP_IDX_TRL_LEN));
+}
+
+/*
+ * Wraps the pieces of an index into empty gzip members at `out'.
+ */
+static void
+gzip_idx_wrap(const uint8_t *idx, size_t idx_len, uint8_t *out)
+{
+	for (size_t i = 0, n = gzip_idx_pieces(idx_len); i < n; i++) {
+		size_t piece = gzip_idx_piece_len(idx_len, i);
+
+		memcpy(out, gz_idx_hdr, GZIP_HDR_LEN);
+		put_le16(&out[GZIP_HDR_LEN], piece + 4);
+		out[GZIP_HDR_LEN + 2] = 'L';
+		out[GZIP_HDR_LEN + 3] = 'X';
+		put_le16(&out[GZIP_HDR_LEN + 4], piece);
+		memcpy(&out[GZIP_IDX_HDR_LEN], idx, piece);
+		memcpy(&out[GZIP_IDX_HDR_LEN + piece], gz_idx_trl,
+		    GZIP_IDX_TRL_LEN);
+		idx += piece;
+		out += GZIP_IDX_HDR_LEN + piece + GZIP_IDX_TRL_LEN;
+	}
+}
+
+/*
+ * Reassembles an index of `idx_len' bytes from the empty gzip members at
+ * the end of `buf'.
+ * @return The index, or NULL if the members are malformed.
+ */
+static uint8_t *
+gzip_idx_unwrap(const uint8_t *buf, size_t len, size_t idx_len)
+{
+	const uint8_t *p;
+	uint8_t *idx, *q;
+
+	if (gzip_idx_len(idx_len) > len)
+		return (NULL);
+	p = &buf[len - gzip_idx_len(idx_len)];
+	idx = q = safe_malloc(idx_len);
+	for (size_t i = 0, n = gzip_idx_pieces(idx_len); i < n; i++) {
+		size_t piece = gzip_idx_piece_len(idx_len, i);
+
+		if (memcmp(p, gz_idx_hdr, GZIP_HDR_LEN) != 0 ||
+		    get_le16(&p[GZIP_HDR_LEN]) != piece + 4 ||
+		    p[GZIP_HDR_LEN + 2] != 'L' || p[GZIP_HDR_LEN + 3] != 'X' ||
+		    get_le16(&p[GZIP_HDR_LEN + 4]) != piece ||
+		    memcmp(&p[GZIP_IDX_HDR_LEN + piece], gz_idx_trl,
+		    GZIP_IDX_TRL_LEN) != 0) {
+			free(idx);
+			return (NULL);
+		}
+		memcpy(q, &p[GZIP_IDX_HDR_LEN], piece);
+		p += GZIP_IDX_HDR_LEN + piece + GZIP_IDX_TRL_LEN;
+		q += piece;
+	}
+	return (idx);
+}
+
+typedef struct {
+	const uint8_t	*in;
+	size_t		len;
+	size_t		chunk_sz;
+	int		level;
+	bool_t		gzip;
+	uint8_t		**frames;
+	size_t		*frame_len;
+	uint32_t	*crc;	/* CRC-32 of each chunk */
+	uint32_t	*adler;	/* Adler-32 of each chunk, for zlib */
+} chunked_comp_t;
+
+static void
+compress_frames(void *userinfo, size_t begin, size_t end)
+{
+	chunked_comp_t *cc = userinfo;
+
+	for (size_t i = begin; i < end; i++) {
+		size_t off = i * cc->chunk_sz;
+		size_t n = MIN(cc->chunk_sz, cc->len - off);
+		bool_t last = (off + n == cc->len);
+		z_stream strm = { .zalloc = Z_NULL };
+		size_t cap;
+
+		/* raw deflate, no zlib header or trailer */
+		VERIFY3S(deflateInit2(&strm, cc->level, Z_DEFLATED, -15, 8,
+		    Z_DEFAULT_STRATEGY), ==, Z_OK);
+		/* + room for the 5-byte empty block of a sync flush */
+		cap = deflateBound(&strm, n) + 16;
+		cc->frames[i] = safe_malloc(cap);
+		strm.next_in = (uint8_t *)&cc->in[off];
+		strm.avail_in = n;
+		strm.next_out = cc->frames[i];
+		strm.avail_out = cap;
+		VERIFY3S(deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH), ==,
+		    last ? Z_STREAM_END : Z_OK);
+		VERIFY0(strm.avail_in);
+		cc->frame_len[i] = cap - strm.avail_out;
+		deflateEnd(&strm);
+
+		cc->crc[i] = crc32(crc32(0, Z_NULL, 0), &cc->in[off], n);
+		if (!cc->gzip)
+			cc->adler[i] = adler32(adler32(0, Z_NULL, 0),
+			    &cc->in[off], n);
+	}
+}
+
+/**
+ * Compresses a buffer in independently compressed chunks, optionally
+ * in parallel on a task queue, and appends an index of the chunks.
+ *
+ * The output is a regular gzip file (or zlib stream, followed by the
+ * index as trailing data), which can be decompressed by
+ * zlib_decompress(), the decompress_stream_*() functions or any other
+ * zlib or gzip implementation. But thanks to the index,
+ * zlib_chunked_read() can also decompress any byte range of it without
+ * decompressing everything before that, and zlib_decompress_chunked()
+ * can decompress all of it in parallel.
+ *
+ * Since the chunks don't share a compression dictionary, the output is
+ * slightly larger than that of zlib_compress(). With the default chunk
+ * size, the difference is typically well under 1%.
+ *
+ * @param in_buf Input data buffer to be compressed.
+ * @param len Number of bytes in `in_buf'.
+ * @param level zlib compression level (0-9), or -1 for zlib's default.
+ * @param chunk_sz Uncompressed size of each chunk, which is also the
+ *	granularity of random access. Pass 0 for the default of 1 MB.
+ * @param gzip `B_TRUE` to produce a gzip (.gz) file, `B_FALSE` for a
+ *	zlib stream.
+ * @param tq Optional task queue on which to compress the chunks in
+ *	parallel. Pass NULL to compress them on the calling thread.
+ * @param out_len Output variable which will be filled with the number
+ *	of bytes in the returned buffer.
+ * @return The compressed data. Unlike zlib_compress(), this never fails,
+ *	even if the data doesn't compress. Use lacf_free() to free it.
+ */
+void *
+zlib_compress_chunked(const void *in_buf, size_t len, int level,
+    size_t chunk_sz, bool_t gzip, taskq_t *tq, size_t *out_len)
+{
+	chunked_comp_t cc = {
+	    .in = in_buf, .len = len, .level = level, .gzip = gzip,
+	    .chunk_sz = (chunk_sz != 0 ? chunk_sz : CHUNKED_DFL_CHUNK)
+	};
+	/* even empty input gets one (empty) frame */
+	size_t n_frames = MAX((len + cc.chunk_sz - 1) / cc.chunk_sz, 1);
+	size_t hdr_len = (gzip ? GZIP_HDR_LEN : 2);
+	size_t idx_len = CHUNKED_HDR_LEN + n_frames * CHUNKED_ENT_LEN + 8 +
+	    CHUNKED_FTR_LEN;
+	size_t total, off, idx_off;
+	uint32_t crc, adler;
+	uint8_t *out, *idx, *p;
+
+	ASSERT(in_buf != NULL || len == 0);
+	ASSERT3S(level, >=, -1);
+	ASSERT3S(level, <=, 9);
+	ASSERT(out_len != NULL);
+
+	cc.frames = safe_calloc(n_frames, sizeof (*cc.frames));
+	cc.frame_len = safe_calloc(n_frames, sizeof (*cc.frame_len));
+	cc.crc = safe_calloc(n_frames, sizeof (*cc.crc));
+	cc.adler = safe_calloc(n_frames, sizeof (*cc.adler));
+	lacf_parallel_for(tq, 0, n_frames, 1, compress_frames, &cc);
+
+	total = hdr_len;
+	for (size_t i = 0; i < n_frames; i++)
+		total += cc.frame_len[i];
+	/* 8-byte gzip trailer, 4-byte zlib trailer */
+	total += (gzip ? 8 : 4);
+	idx_off = total;
+	total += (gzip ? gzip_idx_len(idx_len) : idx_len);
+	out = safe_malloc(total);
+	idx = safe_malloc(idx_len);
+
+	if (gzip) {
+		static const uint8_t gz_hdr[GZIP_HDR_LEN] = {
+		    0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 0xff
+		};
+		memcpy(out, gz_hdr, sizeof (gz_hdr));
+		/* XFL: maximum compression or fastest algorithm used */
+		if (level == 9)
+			out[8] = 2;
+		else if (level == 1)
+			out[8] = 4;
+	} else {
+		/* CMF = deflate, 32k window; FLG with FLEVEL & FCHECK */
+		out[0] = 0x78;
+		out[1] = (level >= 0 && level <= 1 ? 0x01 :
+		    (level >= 7 ? 0xda : 0x9c));
+	}
+	off = hdr_len;
+	p = &idx[CHUNKED_HDR_LEN];
+	crc = crc32(0, Z_NULL, 0);
+	adler = adler32(0, Z_NULL, 0);
+	for (size_t i = 0; i < n_frames; i++) {
+		size_t n = MIN(cc.chunk_sz, len - i * cc.chunk_sz);
+
+		memcpy(&out[off], cc.frames[i], cc.frame_len[i]);
+		put_le64(p, off);
+		put_le32(&p[8], cc.crc[i]);
+		put_le32(&p[12], 0);
+		p += CHUNKED_ENT_LEN;
+		off += cc.frame_len[i];
+		crc = crc32_combine(crc, cc.crc[i], n);
+		adler = adler32_combine(adler, cc.adler[i], n);
+		free(cc.frames[i]);
+	}
+	put_le64(p, off);
+	p += 8;
+	if (gzip) {
+		put_le32(&out[off], crc);
+		put_le32(&out[off + 4], len);
+	} else {
+		out[off] = adler >> 24;
+		out[off + 1] = adler >> 16;
+		out[off + 2] = adler >> 8;
+		out[off + 3] = adler;
+	}
+
+	memcpy(idx, CHUNKED_MAGIC, CHUNKED_MAGIC_LEN);
+	put_le64(&idx[CHUNKED_MAGIC_LEN], cc.chunk_sz);
+	put_le64(&idx[CHUNKED_MAGIC_LEN + 8], len);
+	put_le64(&idx[CHUNKED_MAGIC_LEN + 16], n_frames);
+	put_le32(p, crc32(crc32(0, Z_NULL, 0), idx, p - idx));
+	put_le32(&p[4], 0);
+	put_le64(&p[8], idx_len);
+	memcpy(&p[16], CHUNKED_MAGIC, CHUNKED_MAGIC_LEN);
+	ASSERT3U(&p[16 + CHUNKED_MAGIC_LEN] - idx, ==, idx_len);
+	if (gzip)
+		gzip_idx_wrap(idx, idx_len, &out[idx_off]);
+	else
+		memcpy(&out[idx_off], idx, idx_len);
+	free(idx);
+
+	free(cc.frames);
+	free(cc.frame_len);
+	free(cc.crc);
+	free(cc.adler);
+	*out_len = total;
+
+	return (out);
+}
+
+typedef struct {
+	const uint8_t	*buf;
+	size_t		chunk_sz;
+	uint64_t	total;
+	size_t		n_frames;
+	const uint8_t	*ents;
+	uint64_t	data_end;
+	uint8_t		*gz_idx;	/* index reassembled from a gzip file */
+} chunked_idx_t;
+
+static void
+chunked_idx_fini(chunked_idx_t *idx)
+{
+	free(idx->gz_idx);
+	idx->gz_idx = NULL;
+}
+
+static inline uint64_t
+frame_off(const chunked_idx_t *idx, size_t i)
+{
+	if (i == idx->n_frames)
+		return (idx->data_end);
+	return (get_le64(&idx->ents[i * CHUNKED_ENT_LEN]));
+}
+
+/*
+ * Locates and validates the index appended by zlib_compress_chunked().
+ * On success, the index must be released with chunked_idx_fini().
+ */
+static bool_t
+chunked_idx_parse(const void *in_buf, size_t len, chunked_idx_t *idx)
+{
+	const uint8_t *buf = in_buf;
+	const uint8_t *ftr, *hdr;
+	uint64_t idx_len, n_frames, prev;
+	bool_t gzip = (len >= 2 && buf[0] == 0x1f && buf[1] == 0x8b);
+	size_t tail = (gzip ? GZIP_IDX_TRL_LEN : 0);
+	size_t idx_end;
+
+	memset(idx, 0, sizeof (*idx));
+	if (len < tail + CHUNKED_HDR_LEN + 8 + CHUNKED_FTR_LEN)
+		return (B_FALSE);
+	ftr = &buf[len - tail - CHUNKED_FTR_LEN];
+	if (memcmp(&ftr[16], CHUNKED_MAGIC, CHUNKED_MAGIC_LEN) != 0)
+		return (B_FALSE);
+	idx_len = get_le64(&ftr[8]);
+	if (idx_len > len || idx_len < CHUNKED_HDR_LEN + 8 + CHUNKED_FTR_LEN)
+		return (B_FALSE);
+	if (gzip) {
+		idx->gz_idx = gzip_idx_unwrap(buf, len, idx_len);
+		if (idx->gz_idx == NULL)
+			return (B_FALSE);
+		hdr = idx->gz_idx;
+		ftr = &hdr[idx_len - CHUNKED_FTR_LEN];
+		/* where the data member ends and the index members start */
+		idx_end = len - gzip_idx_len(idx_len);
+	} else {
+		hdr = &buf[len - idx_len];
+		idx_end = len - idx_len;
+	}
+	if (memcmp(hdr, CHUNKED_MAGIC, CHUNKED_MAGIC_LEN) != 0 ||
+	    crc32(crc32(0, Z_NULL, 0), hdr, ftr - hdr) != get_le32(ftr))
+		goto errout;
+	idx->buf = buf;
+	idx->chunk_sz = get_le64(&hdr[CHUNKED_MAGIC_LEN]);
+	idx->total = get_le64(&hdr[CHUNKED_MAGIC_LEN + 8]);
+	n_frames = get_le64(&hdr[CHUNKED_MAGIC_LEN + 16]);
+	if (idx->chunk_sz == 0 || n_frames == 0 ||
+	    n_frames != (idx_len - CHUNKED_HDR_LEN - 8 - CHUNKED_FTR_LEN) /
+	    CHUNKED_ENT_LEN ||
+	    n_frames != MAX((idx->total + idx->chunk_sz - 1) / idx->chunk_sz,
+	    1))
+		goto errout;
+	idx->n_frames = n_frames;
+	idx->ents = &hdr[CHUNKED_HDR_LEN];
+	idx->data_end = get_le64(&idx->ents[n_frames * CHUNKED_ENT_LEN]);
+	/* frames must be in order and lie within the data before the index */
+	prev = 0;
+	for (size_t i = 0; i <= n_frames; i++) {
+		uint64_t off = frame_off(idx, i);
+
+		if (off < prev || off > idx_end)
+			goto errout;
+		prev = off;
+	}
+	return (B_TRUE);
+errout:
+	chunked_idx_fini(idx);
+	return (B_FALSE);
+}
+
+/*
+ * Decompresses a single frame, which must decompress to exactly
+ * `out_len' bytes matching the CRC-32 from the index.
+ */
+static bool_t
+inflate_frame(const chunked_idx_t *idx, size_t i, uint8_t *out,
+    size_t out_len)
+{
+	uint64_t start = frame_off(idx, i), end = frame_off(idx, i + 1);
+	z_stream strm = { .zalloc = Z_NULL };
+	uint8_t dummy;
+	bool_t ok;
+	int ret;
+
+	VERIFY3S(inflateInit2(&strm, -15), ==, Z_OK);
+	strm.next_in = (uint8_t *)&idx->buf[start];
+	strm.avail_in = end - start;
+	strm.next_out = (out_len != 0 ? out : &dummy);
+	strm.avail_out = out_len;
+	ret = inflate(&strm, Z_SYNC_FLUSH);
+	ok = ((ret == Z_OK || ret == Z_STREAM_END ||
+	    (ret == Z_BUF_ERROR && out_len == 0)) &&
+	    strm.avail_out == 0 && strm.avail_in == 0 &&
+	    (i + 1 == idx->n_frames) == (ret == Z_STREAM_END) &&
+	    crc32(crc32(0, Z_NULL, 0), out, out_len) ==
+	    get_le32(&idx->ents[i * CHUNKED_ENT_LEN + 8]));
+	inflateEnd(&strm);
+
+	return (ok);
+}
+
+/**
+ * @return The total decompressed size of data produced by
+ *	zlib_compress_chunked(), or -1 if the data doesn't carry a valid
+ *	chunk index (e.g. because it was produced by zlib_compress()).
+ */
+ssize_t
+zlib_chunked_size(const void *in_buf, size_t len)
+{
+	chunked_idx_t idx;
+	uint64_t total;
+
+	ASSERT(in_buf != NULL || len == 0);
+	if (!chunked_idx_parse(in_buf, len, &idx))
+		return (-1);
+	total = idx.total;
+	chunked_idx_fini(&idx);
+	if (total > SSIZE_MAX)
+		return (-1);
+	return (total);
+}
+
+/**
+ * Decompresses a byte range of data produced by zlib_compress_chunked().
+ * Only the chunks overlapping the range are decompressed.
+ * @param in_buf The compressed data, including its chunk index.
+ * @param len Number of bytes in `in_buf'.
+ * @param off Offset in the decompressed data at which to start.
+ * @param out Buffer to place the decompressed data into.
+ * @param cap Number of bytes to decompress into `out'.
+ * @return The number of bytes placed into `out', which is less than
+ *	`cap' only if the range extends past the end of the data, or -1
+ *	if the data doesn't carry a valid chunk index or is corrupt.
+ */
+ssize_t
+zlib_chunked_read(const void *in_buf, size_t len, size_t off, void *out,
+    size_t cap)
+{
+	chunked_idx_t idx;
+	uint8_t *out8 = out, *tmp = NULL;
+	size_t done = 0;
+
+	ASSERT(in_buf != NULL || len == 0);
+	ASSERT(out != NULL || cap == 0);
+
+	if (!chunked_idx_parse(in_buf, len, &idx))
+		return (-1);
+	if (off >= idx.total) {
+		chunked_idx_fini(&idx);
+		return (0);
+	}
+	cap = MIN(cap, idx.total - off);
+	while (done < cap) {
+		size_t pos = off + done;
+		size_t i = pos / idx.chunk_sz;
+		size_t frame_start = i * idx.chunk_sz;
+		size_t frame_len = MIN(idx.chunk_sz, idx.total - frame_start);
+		size_t skip = pos - frame_start;
+		size_t n = MIN(frame_len - skip, cap - done);
+
+		if (skip == 0 && n == frame_len) {
+			/* whole frame wanted, decompress it in place */
+			if (!inflate_frame(&idx, i, &out8[done], frame_len))
+				goto errout;
+		} else {
+			if (tmp == NULL)
+				tmp = safe_malloc(idx.chunk_sz);
+			if (!inflate_frame(&idx, i, tmp, frame_len))
+				goto errout;
+			memcpy(&out8[done], &tmp[skip], n);
+		}
+		done += n;
+	}
+	free(tmp);
+	chunked_idx_fini(&idx);
+	return (done);
+errout:
+	free(tmp);
+	chunked_idx_fini(&idx);
+	return (-1);
+}
+
+typedef struct {
+	const chunked_idx_t	*idx;
+	uint8_t			*out;
+	bool_t			failed;
+} chunked_decomp_t;
+
+static void
+decompress_frames(void *userinfo, size_t begin, size_t end)
+{
+	chunked_decomp_t *cd = userinfo;
+	const chunked_idx_t *idx = cd->idx;
+
+	for (size_t i = begin; i < end; i++) {
+		size_t start = i * idx->chunk_sz;
+
+		if (!inflate_frame(idx, i, &cd->out[start],
+		    MIN(idx->chunk_sz, idx->total - start))) {
+			__atomic_store_n(&cd->failed, B_TRUE,
+			    __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/**
+ * Decompresses all of the data produced by zlib_compress_chunked(),
+ * optionally decompressing its chunks in parallel on a task queue.
+ * Data without a chunk index is handed to zlib_decompress() instead.
+ * @param in_buf The compressed data.
+ * @param len Number of bytes in `in_buf'.
+ * @param tq Optional task queue on which to decompress the chunks in
+ *	parallel. Pass NULL to decompress them on the calling thread.
+ * @param out_len Output variable which will be filled with the number
+ *	of bytes in the returned buffer.
+ * @return The decompressed data, or NULL if it is corrupt. Use
+ *	lacf_free() to free it.
+ */
+void *
+zlib_decompress_chunked(const void *in_buf, size_t len, taskq_t *tq,
+    size_t *out_len)
+{
+	chunked_idx_t idx;
+	chunked_decomp_t cd = { .idx = &idx };
+
+	ASSERT(in_buf != NULL || len == 0);
+	ASSERT(out_len != NULL);
+
+	if (!chunked_idx_parse(in_buf, len, &idx))
+		return (zlib_decompress((void *)in_buf, len, out_len));
+	if (idx.total > SIZE_MAX - 1) {
+		chunked_idx_fini(&idx);
+		return (NULL);
+	}
+	/* +1 so an empty result still yields a non-NULL buffer */
+	cd.out = safe_malloc(idx.total + 1);
+	lacf_parallel_for(tq, 0, idx.n_frames, 1, decompress_frames, &cd);
+	chunked_idx_fini(&idx);
+	if (cd.failed) {
+		free(cd.out);
+		return (NULL);
+	}
+	*out_len = idx.total;
+
+	return (cd.out);
+}
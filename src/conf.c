@@ -30,6 +30,7 @@
 #include "acfutils/assert.h"
 #include "acfutils/avl.h"
 #include "acfutils/base64.h"
+#include "acfutils/compress.h"
 #include "acfutils/conf.h"
 #include "acfutils/helpers.h"
 #include "acfutils/log.h"
@@ -173,42 +174,22 @@ conf_free(conf_t *conf)
 conf_t *
 conf_read_file(const char *filename, int *errline)
 {
-	uint8_t gz_magic[2];
-	FILE *fp = fopen(filename, "rb");
-	conf_t *conf;
-
-	if (fp == NULL) {
-		if (errline != NULL)
-			*errline = -1;
-		return (NULL);
-	}
 	/*
-	 * We automatically detect the 16-bit Gzip magic header. We know
-	 * a valid conf file will never contain this header unless it really
-	 * is Gzip compressed.
+	 * We automatically detect compressed files from their magic
+	 * numbers. A valid conf file will never start with any of those
+	 * unless it really is compressed.
 	 */
-	if (fread(gz_magic, 1, sizeof (gz_magic), fp) != sizeof (gz_magic)) {
+	decompress_stream_t *st = decompress_stream_open(filename,
+	    DECOMPRESS_FMT_AUTO);
+	conf_t *conf;
+
+	if (st == NULL) {
 		if (errline != NULL)
 			*errline = -1;
-		fclose(fp);
 		return (NULL);
 	}
-	rewind(fp);
-	if (gz_magic[0] == 0x1f && gz_magic[1] == 0x8b) {
-		gzFile gz_fp = gzopen(filename, "r");
-
-		fclose(fp);
-		if (gz_fp == NULL) {
-			if (errline != NULL)
-				*errline = -1;
-			return (NULL);
-		}
-		conf = conf_read2(gz_fp, errline, B_TRUE);
-		gzclose(gz_fp);
-	} else {
-		conf = conf_read2(fp, errline, B_FALSE);
-		fclose(fp);
-	}
+	conf = conf_read_stream(st, errline);
+	decompress_stream_close(st);
 
 	return (conf);
 }
@@ -368,6 +349,77 @@ errout:
 	return (NULL);
 }
 
+/*
+ * Same as parser_get_next_line(), but reads from a decompression stream.
+ */
+static ssize_t
+stream_get_next_line(decompress_stream_t *st, char **linep, size_t *linecap,
+    unsigned *linenum)
+{
+	for (;;) {
+		ssize_t len = decompress_stream_getline(st, linep, linecap);
+		char *hash;
+
+		if (len == -1)
+			return (-1);
+		(*linenum)++;
+		hash = strchr(*linep, '#');
+		if (hash != NULL)
+			*hash = '\0';
+		strip_space(*linep);
+		if (**linep == 0)
+			continue;
+		len = strlen(*linep);
+		/* substitute spaces for tabs */
+		for (ssize_t i = 0; i < len; i++) {
+			if ((*linep)[i] == '\t')
+				(*linep)[i] = ' ';
+		}
+		return (len);
+	}
+}
+
+/**
+ * Same as conf_read(), but reads the configuration from a decompression
+ * stream. This lets you parse configurations compressed using any of the
+ * formats supported by decompress_stream_open() (or pushed into a pipe
+ * from elsewhere) without first decompressing them in full.
+ * @return The parsed conf_t object, or NULL in case an error was found.
+ *	If errline is not NULL, it is set to the line number where the
+ *	error was encountered, or -1 if the stream couldn't be decompressed.
+ * @return Use conf_free() to free the returned structure.
+ */
+conf_t *
+conf_read_stream(decompress_stream_t *st, int *errline)
+{
+	conf_t *conf;
+	char *line = NULL;
+	size_t linecap = 0;
+	unsigned linenum = 0;
+
+	ASSERT(st != NULL);
+
+	conf = conf_create_empty();
+	while (stream_get_next_line(st, &line, &linecap, &linenum) > 0) {
+		if (!conf_parse_line(line, conf))
+			goto errout;
+	}
+	free(line);
+	if (decompress_stream_error(st)) {
+		conf_free(conf);
+		if (errline != NULL)
+			*errline = -1;
+		return (NULL);
+	}
+	return (conf);
+errout:
+	free(line);
+	conf_free(conf);
+	if (errline != NULL)
+		*errline = linenum;
+	return (NULL);
+}
+
 /**
  * Same as conf_read(), but takes an in-memory buffer containing the text
  * of the configuration.
@@ -481,14 +533,32 @@ conf_write_file2(const conf_t *conf, const char *filename, bool_t compressed)
 		res = (conf_write_impl(conf, fp, 0, B_FALSE, B_FALSE) >= 0);
 		fclose(fp);
 	} else {
-		gzFile fp = gzopen(filename_tmp, "w");
-
+		/*
+		 * Compressed output is produced in memory in independent
+		 * chunks, so it carries a chunk index and large files can
+		 * later be read back in parallel or piecemeal. The result
+		 * is still a regular gzip file.
+		 */
+		size_t len = conf_write_buf(conf, NULL, 0);
+		void *buf = safe_malloc(len);
+		void *comp;
+		size_t comp_len;
+		FILE *fp;
+
+		conf_write_buf(conf, buf, len);
+		/* len includes the terminating NUL, which isn't file data */
+		comp = zlib_compress_chunked(buf, len - 1, -1, 0, B_TRUE, NULL,
+		    &comp_len);
+		free(buf);
+		fp = fopen(filename_tmp, "wb");
 		if (fp == NULL) {
+			free(comp);
 			free(filename_tmp);
 			return (B_FALSE);
 		}
-		res = (conf_write_impl(conf, fp, 0, B_TRUE, B_FALSE) >= 0);
-		gzclose(fp);
+		res = (fwrite(comp, 1, comp_len, fp) == comp_len);
+		res &= (fclose(fp) == 0);
+		free(comp);
 	}
 	if (res) {
 #if	IBM
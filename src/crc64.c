@@ -20,18 +20,94 @@
  */
 
 #include <math.h>
+#include <stdbool.h>
+#include <string.h>
 
 #include <acfutils/crc64.h>
+#include <acfutils/sysmacros.h>
+
+#if	defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#define	CRC64_HAVE_CLMUL	1
+#else
+#define	CRC64_HAVE_CLMUL	0
+#endif
 
 /** ECMA-182, reflected form */
 #define	CRC64_POLY	0xC96C5795D7870F42ULL
 
-static uint64_t crc64_table[256];
+/*
+ * Slicing-by-8 tables. crc64_table[0] is the classic byte-at-a-time table,
+ * crc64_table[k][i] is the CRC of byte `i' followed by `k' zero bytes.
+ */
+static uint64_t crc64_table[8][256];
+/* x^(2^k) mod P, used for crc64_combine() and the folding constants */
+static uint64_t crc64_x2n_table[72];
 static uint64_t rand_seed = 0;
 
+#if	CRC64_HAVE_CLMUL
+/*
+ * Below this size, the setup cost of the carry-less multiply path doesn't
+ * pay off and we just use the slicing-by-8 tables.
+ */
+#define	CRC64_CLMUL_MIN_SZ	128
+
+static bool crc64_use_clmul = false;
+/*
+ * Folding constants for folding 128-bit lanes forward over distances of
+ * 128, 256, 384 and 512 bits. The low 64-bit half of each pair is
+ * x^(D+63) mod P, the high half is x^(D-1) mod P (bit-reflected, with
+ * the -1 compensating for the one-bit shift of a reflected carry-less
+ * multiply).
+ */
+static uint64_t crc64_fold_k[4][2];
+#endif	/* CRC64_HAVE_CLMUL */
+
+/*
+ * Multiplies two polynomials modulo CRC64_POLY in the bit-reflected
+ * representation used by the CRC register (x^0 is the MSB).
+ */
+static uint64_t
+crc64_multmodp(uint64_t a, uint64_t b)
+{
+	uint64_t m = 1ull << 63, p = 0;
+
+	if (a == 0)
+		return (0);
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+		m >>= 1;
+		b = (b & 1) ? (b >> 1) ^ CRC64_POLY : b >> 1;
+	}
+	return (p);
+}
+
+/*
+ * Returns x^(n * 2^k) mod CRC64_POLY.
+ */
+static uint64_t
+crc64_x2nmodp(uint64_t n, unsigned k)
+{
+	uint64_t p = 1ull << 63;	/* x^0 == 1 */
+
+	for (; n != 0; n >>= 1, k++) {
+		ASSERT3U(k, <, ARRAY_NUM_ELEM(crc64_x2n_table));
+		if (n & 1)
+			p = crc64_multmodp(crc64_x2n_table[k], p);
+	}
+	return (p);
+}
+
 /**
  * Initializes the CRC64 tables. Must be called before calling
- * any CRC64-related functions.
+ * any CRC64-related functions. This also detects whether the CPU
+ * supports carry-less multiplication (PCLMULQDQ), which is then used
+ * to speed up checksumming of large buffers.
  */
 void
 crc64_init(void)
@@ -39,11 +115,132 @@ crc64_init(void)
 	for (int i = 0; i < 256; i++) {
 		uint64_t *ct;
 		int j;
-		for (ct = crc64_table + i, *ct = i, j = 8; j > 0; j--)
+		for (ct = &crc64_table[0][i], *ct = i, j = 8; j > 0; j--)
 			*ct = (*ct >> 1) ^ (-(*ct & 1) & CRC64_POLY);
 	}
+	for (int k = 1; k < 8; k++) {
+		for (int i = 0; i < 256; i++) {
+			uint64_t c = crc64_table[k - 1][i];
+			crc64_table[k][i] = (c >> 8) ^
+			    crc64_table[0][c & 0xFF];
+		}
+	}
+	crc64_x2n_table[0] = 1ull << 62;	/* x^1 */
+	for (unsigned k = 1; k < ARRAY_NUM_ELEM(crc64_x2n_table); k++) {
+		crc64_x2n_table[k] = crc64_multmodp(crc64_x2n_table[k - 1],
+		    crc64_x2n_table[k - 1]);
+	}
+#if	CRC64_HAVE_CLMUL
+	for (unsigned i = 0; i < 4; i++) {
+		unsigned dist = (i + 1) * 128;
+		crc64_fold_k[i][0] = crc64_x2nmodp(dist + 63, 0);
+		crc64_fold_k[i][1] = crc64_x2nmodp(dist - 1, 0);
+	}
+	__builtin_cpu_init();
+	crc64_use_clmul = (__builtin_cpu_supports("pclmul") &&
+	    __builtin_cpu_supports("sse2"));
+#endif	/* CRC64_HAVE_CLMUL */
 }
 
+/*
+ * Portable slicing-by-8 implementation. Processes 8 input bytes per
+ * iteration using 8 independent table lookups.
+ */
+static uint64_t
+crc64_append_slice8(uint64_t crc, const uint8_t *in_bytes, size_t sz)
+{
+	/* bring the input pointer up to 8-byte alignment */
+	for (; sz != 0 && ((uintptr_t)in_bytes & 7) != 0; sz--, in_bytes++)
+		crc = (crc >> 8) ^ crc64_table[0][(crc ^ *in_bytes) & 0xFF];
+	for (; sz >= 8; sz -= 8, in_bytes += 8) {
+		uint64_t v;
+
+		memcpy(&v, in_bytes, sizeof (v));
+		crc ^= LE64(v);
+		crc = crc64_table[7][crc & 0xFF] ^
+		    crc64_table[6][(crc >> 8) & 0xFF] ^
+		    crc64_table[5][(crc >> 16) & 0xFF] ^
+		    crc64_table[4][(crc >> 24) & 0xFF] ^
+		    crc64_table[3][(crc >> 32) & 0xFF] ^
+		    crc64_table[2][(crc >> 40) & 0xFF] ^
+		    crc64_table[1][(crc >> 48) & 0xFF] ^
+		    crc64_table[0][crc >> 56];
+	}
+	for (; sz != 0; sz--, in_bytes++)
+		crc = (crc >> 8) ^ crc64_table[0][(crc ^ *in_bytes) & 0xFF];
+
+	return (crc);
+}
+
+#if	CRC64_HAVE_CLMUL
+
+__attribute__((target("sse2,pclmul")))
+static inline __m128i
+crc64_fold(__m128i x, __m128i k)
+{
+	return (_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+	    _mm_clmulepi64_si128(x, k, 0x11)));
+}
+
+/*
+ * Carry-less multiplication folding, as described in Intel's "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction". We
+ * fold four 128-bit lanes in parallel across the bulk of the input, then
+ * fold them into a single lane. Rather than doing a Barrett reduction
+ * at the end, the final 128-bit remainder is simply run through the
+ * slicing-by-8 tables, which keeps all polynomial constants derived from
+ * CRC64_POLY at init time.
+ */
+__attribute__((target("sse2,pclmul")))
+static uint64_t
+crc64_append_clmul(uint64_t crc, const uint8_t *in_bytes, size_t sz)
+{
+	const __m128i k128 = _mm_set_epi64x(crc64_fold_k[0][1],
+	    crc64_fold_k[0][0]);
+	const __m128i k256 = _mm_set_epi64x(crc64_fold_k[1][1],
+	    crc64_fold_k[1][0]);
+	const __m128i k384 = _mm_set_epi64x(crc64_fold_k[2][1],
+	    crc64_fold_k[2][0]);
+	const __m128i k512 = _mm_set_epi64x(crc64_fold_k[3][1],
+	    crc64_fold_k[3][0]);
+	__m128i x0, x1, x2, x3;
+	uint8_t rem[16];
+
+	ASSERT3U(sz, >=, 64);
+
+	x0 = _mm_loadu_si128((const __m128i *)in_bytes);
+	x1 = _mm_loadu_si128((const __m128i *)(in_bytes + 16));
+	x2 = _mm_loadu_si128((const __m128i *)(in_bytes + 32));
+	x3 = _mm_loadu_si128((const __m128i *)(in_bytes + 48));
+	x0 = _mm_xor_si128(x0, _mm_set_epi64x(0, (long long)crc));
+	in_bytes += 64;
+	sz -= 64;
+
+	for (; sz >= 64; sz -= 64, in_bytes += 64) {
+		x0 = _mm_xor_si128(crc64_fold(x0, k512),
+		    _mm_loadu_si128((const __m128i *)in_bytes));
+		x1 = _mm_xor_si128(crc64_fold(x1, k512),
+		    _mm_loadu_si128((const __m128i *)(in_bytes + 16)));
+		x2 = _mm_xor_si128(crc64_fold(x2, k512),
+		    _mm_loadu_si128((const __m128i *)(in_bytes + 32)));
+		x3 = _mm_xor_si128(crc64_fold(x3, k512),
+		    _mm_loadu_si128((const __m128i *)(in_bytes + 48)));
+	}
+	x0 = _mm_xor_si128(_mm_xor_si128(crc64_fold(x0, k384),
+	    crc64_fold(x1, k256)), _mm_xor_si128(crc64_fold(x2, k128), x3));
+
+	for (; sz >= 16; sz -= 16, in_bytes += 16) {
+		x0 = _mm_xor_si128(crc64_fold(x0, k128),
+		    _mm_loadu_si128((const __m128i *)in_bytes));
+	}
+	_mm_storeu_si128((__m128i *)rem, x0);
+	crc = crc64_append_slice8(0, rem, sizeof (rem));
+
+	return (crc64_append_slice8(crc, in_bytes, sz));
+}
+
+#endif	/* CRC64_HAVE_CLMUL */
+
 /**
  * Same as crc64_state_init(), but provided for linkage for Rust bridge.
  */
@@ -87,13 +284,35 @@ crc64(const void *input, size_t sz)
 uint64_t
 crc64_append(uint64_t crc, const void *input, size_t sz)
 {
-	const uint8_t *in_bytes = input;
-
-	ASSERT3U(crc64_table[128], ==, CRC64_POLY);
-	for (size_t i = 0; i < sz; i++)
-		crc = (crc >> 8) ^ crc64_table[(crc ^ in_bytes[i]) & 0xFF];
+	ASSERT3U(crc64_table[0][128], ==, CRC64_POLY);
+	ASSERT(input != NULL || sz == 0);
+#if	CRC64_HAVE_CLMUL
+	if (sz >= CRC64_CLMUL_MIN_SZ && crc64_use_clmul)
+		return (crc64_append_clmul(crc, input, sz));
+#endif
+	return (crc64_append_slice8(crc, input, sz));
+}
 
-	return (crc);
+/**
+ * Combines the CRC64 checksums of two adjacent blocks of data into the
+ * checksum of their concatenation. This lets you checksum a large buffer
+ * in chunks in parallel (e.g. on multiple threads) and merge the results.
+ * @param crc1 The checksum of the first block, as returned by crc64().
+ * @param crc2 The checksum of the second block, as returned by crc64().
+ * @param len2 The length of the second block in bytes.
+ * @return The same value as crc64() would have returned when run over
+ *	the first block immediately followed by the second block.
+ */
+uint64_t
+crc64_combine(uint64_t crc1, uint64_t crc2, uint64_t len2)
+{
+	ASSERT3U(crc64_table[0][128], ==, CRC64_POLY);
+	/*
+	 * crc64() starts with an all-ones register, so the second block's
+	 * checksum carries the all-ones initial state shifted over len2
+	 * bytes. Folding that into crc1 before shifting cancels it out.
+	 */
+	return (crc64_multmodp(crc64_x2nmodp(len2, 3), ~crc1) ^ crc2);
 }
 
 /**
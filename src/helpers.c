@@ -39,7 +39,9 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif	/* !IBM */
 
@@ -1192,6 +1194,98 @@ filesz(const char *filename)
 	return (st.st_size);
 }
 
+/**
+ * Maps the contents of a file read-only into memory. Unlike file2buf(),
+ * nothing is read up front. The file's pages are only brought into memory
+ * as they are accessed and can be shared between processes.
+ * @param filename The full path to the file to be mapped.
+ * @param bufsz Mandatory return argument, which will be filled with
+ *	the number of bytes in the file.
+ * @return A pointer to the file's contents. Use file_unmap() to release
+ *	the mapping when done. If the file couldn't be mapped, or is empty,
+ *	the function returns `NULL` instead.
+ */
+void *
+file2mmap(const char *filename, size_t *bufsz)
+{
+#if	IBM
+	unsigned len;
+	WCHAR *filenameW;
+	HANDLE fh, mh;
+	LARGE_INTEGER sz;
+	void *buf = NULL;
+
+	ASSERT(filename != NULL);
+	ASSERT(bufsz != NULL);
+	*bufsz = 0;
+
+	len = strlen(filename);
+	filenameW = safe_calloc(len + 1, sizeof (*filenameW));
+	MultiByteToWideChar(CP_UTF8, 0, filename, -1, filenameW, len + 1);
+	fh = CreateFileW(filenameW, GENERIC_READ, FILE_SHARE_READ, NULL,
+	    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	free(filenameW);
+	if (fh == INVALID_HANDLE_VALUE)
+		return (NULL);
+	if (!GetFileSizeEx(fh, &sz) || sz.QuadPart <= 0) {
+		CloseHandle(fh);
+		return (NULL);
+	}
+	/* The view keeps the mapping alive after the handles are closed */
+	mh = CreateFileMapping(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mh != NULL) {
+		buf = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mh);
+	}
+	CloseHandle(fh);
+	if (buf != NULL)
+		*bufsz = sz.QuadPart;
+
+	return (buf);
+#else	/* !IBM */
+	int fd;
+	struct stat st;
+	void *buf;
+
+	ASSERT(filename != NULL);
+	ASSERT(bufsz != NULL);
+	*bufsz = 0;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return (NULL);
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return (NULL);
+	}
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED)
+		return (NULL);
+	*bufsz = st.st_size;
+
+	return (buf);
+#endif	/* !IBM */
+}
+
+/**
+ * Releases a file mapping previously established using file2mmap().
+ * @param buf The pointer returned from file2mmap().
+ * @param bufsz The file size returned from file2mmap().
+ */
+void
+file_unmap(void *buf, size_t bufsz)
+{
+	if (buf == NULL)
+		return;
+#if	IBM
+	UNUSED(bufsz);
+	UnmapViewOfFile(buf);
+#else
+	munmap(buf, bufsz);
+#endif
+}
+
 #if	IBM
 
 void
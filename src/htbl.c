@@ -23,6 +23,7 @@
  * Copyright 2023 Saso Kiselkov. All rights reserved.
  */
 
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
@@ -31,6 +32,8 @@
 #include "acfutils/helpers.h"
 #define	__INCLUDED_FROM_HTBL_C__
 #include "acfutils/htbl.h"
+#include "acfutils/thread.h"
+#include "acfutils/tls.h"
 
 typedef struct {
 	list_node_t	bucket_node;
@@ -48,10 +51,125 @@ struct htbl_multi_value_s {
 	htbl_bucket_item_t	*item;
 };
 
+/*
+ * Constants of the multiply-mix hash used for HTBL_HASH_FAST. These are
+ * the default secret of wyhash (public domain, Wang Yi).
+ */
+#define	FH_SEED		0xa0761d6478bd642full
+#define	FH_K1		0xe7037ed1a0b428dbull
+#define	FH_K2		0x8ebc6af09c88c6e3ull
+#define	FH_K3		0x589965cc75374cc3ull
+
+/*
+ * 64x64 -> 128-bit multiply, folding the two halves of the product
+ * together using XOR.
+ */
+static inline uint64_t
+fh_mix(uint64_t a, uint64_t b)
+{
+#ifdef	__SIZEOF_INT128__
+	__uint128_t r = (__uint128_t)a * b;
+	return ((uint64_t)r ^ (uint64_t)(r >> 64));
+#else	/* !__SIZEOF_INT128__ */
+	uint64_t ha = a >> 32, hb = b >> 32;
+	uint64_t la = (uint32_t)a, lb = (uint32_t)b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32);
+	uint64_t lo = t + (rm1 << 32);
+	uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+	return (lo ^ hi);
+#endif	/* !__SIZEOF_INT128__ */
+}
+
+/*
+ * The hash only needs to be stable within a single process, so we don't
+ * care about host byte order in these.
+ */
+static inline uint64_t
+fh_r8(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof (v));
+	return (v);
+}
+
+static inline uint64_t
+fh_r4(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof (v));
+	return (v);
+}
+
+/**
+ * Fast 64-bit hash function used by hash tables created with
+ * \ref HTBL_HASH_FAST. It is a multiply-mix construction following
+ * wyhash, with dedicated code paths for the 4-, 8- and 16-byte keys
+ * which are the most common in hash tables. Unlike crc64(), it needs
+ * no global initialization. The result is only guaranteed to be stable
+ * within a single process, so don't store it persistently.
+ */
+uint64_t
+htbl_hash_fast(const void *key, size_t key_sz)
+{
+	const uint8_t *p = key;
+	uint64_t seed = FH_SEED ^ fh_mix(FH_SEED ^ FH_K1, FH_K2);
+	uint64_t a, b;
+
+	ASSERT(key != NULL || key_sz == 0);
+
+	switch (key_sz) {
+	case 4:
+		a = (fh_r4(p) << 32) | fh_r4(p);
+		b = 0;
+		break;
+	case 8:
+		a = fh_r8(p);
+		b = 0;
+		break;
+	case 16:
+		a = fh_r8(p);
+		b = fh_r8(p + 8);
+		break;
+	default:
+		if (key_sz < 4) {
+			a = (key_sz != 0 ? ((uint64_t)p[0] << 16) |
+			    ((uint64_t)p[key_sz >> 1] << 8) | p[key_sz - 1] :
+			    0);
+			b = 0;
+		} else if (key_sz <= 16) {
+			/* overlapping reads cover every byte in 5..15 */
+			size_t off = (key_sz >> 3) << 2;
+			a = (fh_r4(p) << 32) | fh_r4(p + off);
+			b = (fh_r4(p + key_sz - 4) << 32) |
+			    fh_r4(p + key_sz - 4 - off);
+		} else {
+			size_t i = key_sz;
+			for (; i > 16; i -= 16, p += 16) {
+				seed = fh_mix(fh_r8(p) ^ FH_K1,
+				    fh_r8(p + 8) ^ seed);
+			}
+			a = fh_r8(p + i - 16);
+			b = fh_r8(p + i - 8);
+		}
+		break;
+	}
+	a ^= FH_K1;
+	b ^= seed;
+	return (fh_mix(fh_mix(a, b) ^ FH_SEED ^ key_sz, b ^ FH_K1 ^ a));
+}
+
 static inline uint64_t
-H(const void *p, size_t l)
+H(const htbl_t *htbl, const void *p)
 {
-	return (crc64(p, l));
+	switch (htbl->hash) {
+	case HTBL_HASH_FAST:
+		return (htbl_hash_fast(p, htbl->key_sz));
+	case HTBL_HASH_CUSTOM:
+		return (htbl->hash_func(p, htbl->key_sz, htbl->hash_userinfo));
+	default:
+		return (crc64(p, htbl->key_sz));
+	}
 }
 
 static inline void
@@ -81,8 +199,870 @@ htbl2_check_types(const htbl2_t REQ_PTR(htbl), size_t key_sz, size_t value_sz)
 	htbl2_check_value_type(htbl->value_sz, value_sz);
 }
 
+/*
+ * Open-addressing backend (HTBL_LAYOUT_OPEN_ADDR).
+ *
+ * The table consists of an array of control bytes and a parallel array
+ * of fixed-size slots. Each slot holds the value pointer, immediately
+ * followed by the key bytes. A control byte is either OA_EMPTY,
+ * OA_DELETED (a tombstone), or holds the low 7 bits of the key's hash
+ * (the "h2" tag) for a full slot. Lookups compare a whole group of
+ * control bytes against the h2 tag at once and only touch the slots
+ * whose tag matched. The first OA_GROUP_WIDTH control bytes are mirrored
+ * past the end of the control array, so a group load starting anywhere
+ * in the table never needs to wrap around.
+ *
+ * Growing is incremental: when the current slot array runs out of room,
+ * it becomes the "old" table and a new, larger one is allocated. Every
+ * subsequent modifying operation moves OA_MIGRATE_STEP slots over from
+ * the old table, and lookups consult both tables until the migration
+ * is complete.
+ */
+#define	OA_EMPTY		((uint8_t)0x80)
+#define	OA_DELETED		((uint8_t)0xfe)
+#define	OA_IS_FULL(c)		(((c) & 0x80) == 0)
+#define	OA_MIGRATE_STEP		32
+
+#if	defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#define	OA_GROUP_WIDTH		16
+#define	OA_MASK_SHIFT		0
+typedef uint32_t oa_mask_t;
+
+static inline oa_mask_t
+oa_group_match(const uint8_t *ctrl, uint8_t h2)
+{
+	__m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+	return (_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(h2))));
+}
+
+static inline oa_mask_t
+oa_group_match_free(const uint8_t *ctrl)
+{
+	/* OA_EMPTY and OA_DELETED are the only bytes with the MSB set */
+	return (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl)));
+}
+
+#elif	defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+#define	OA_GROUP_WIDTH		8
+#define	OA_MASK_SHIFT		3
+#define	OA_NEON_MSBS		0x8080808080808080ull
+typedef uint64_t oa_mask_t;
+
+static inline oa_mask_t
+oa_group_match(const uint8_t *ctrl, uint8_t h2)
+{
+	uint8x8_t eq = vceq_u8(vld1_u8(ctrl), vdup_n_u8(h2));
+	return (vget_lane_u64(vreinterpret_u64_u8(eq), 0) & OA_NEON_MSBS);
+}
+
+static inline oa_mask_t
+oa_group_match_free(const uint8_t *ctrl)
+{
+	return (vget_lane_u64(vreinterpret_u64_u8(vld1_u8(ctrl)), 0) &
+	    OA_NEON_MSBS);
+}
+
+#else	/* !__SSE2__ && !__ARM_NEON */
+
+#define	OA_GROUP_WIDTH		8
+#define	OA_MASK_SHIFT		0
+typedef uint32_t oa_mask_t;
+
+static inline oa_mask_t
+oa_group_match(const uint8_t *ctrl, uint8_t h2)
+{
+	oa_mask_t mask = 0;
+	for (unsigned i = 0; i < OA_GROUP_WIDTH; i++)
+		mask |= (oa_mask_t)(ctrl[i] == h2) << i;
+	return (mask);
+}
+
+static inline oa_mask_t
+oa_group_match_free(const uint8_t *ctrl)
+{
+	oa_mask_t mask = 0;
+	for (unsigned i = 0; i < OA_GROUP_WIDTH; i++)
+		mask |= (oa_mask_t)(ctrl[i] >> 7) << i;
+	return (mask);
+}
+
+#endif	/* !__SSE2__ && !__ARM_NEON */
+
+/* Returns the group-relative index of the lowest match in `mask' */
+static inline unsigned
+oa_mask_first(oa_mask_t mask)
+{
+	ASSERT(mask != 0);
+	return (lowbit64(mask) >> OA_MASK_SHIFT);
+}
+
+typedef struct {
+	uint8_t		*ctrl;
+	uint8_t		*slots;
+	size_t		cap;		/* power of 2, >= OA_GROUP_WIDTH */
+	size_t		count;		/* number of full slots */
+	size_t		growth_left;	/* empty slots we may still fill */
+} oa_tbl_t;
+
+struct htbl_oa_s {
+	size_t		slot_sz;
+	oa_tbl_t	cur;
+	oa_tbl_t	old;		/* old.cap == 0 if not migrating */
+	size_t		mig_pos;	/* next slot in `old' to migrate */
+	/*
+	 * htbl_foreach calls in progress. Walks only read the table, so
+	 * callers may run several of them concurrently under a shared
+	 * lock. Hence the count is only accessed atomically.
+	 */
+	unsigned	walkers;
+};
+
+static inline void **
+oa_slot_value(const htbl_oa_t *oa, const oa_tbl_t *tbl, size_t idx)
+{
+	return ((void **)&tbl->slots[idx * oa->slot_sz]);
+}
+
+static inline uint8_t *
+oa_slot_key(const htbl_oa_t *oa, const oa_tbl_t *tbl, size_t idx)
+{
+	return (&tbl->slots[idx * oa->slot_sz + sizeof (void *)]);
+}
+
+static inline void
+oa_set_ctrl(oa_tbl_t *tbl, size_t idx, uint8_t c)
+{
+	ASSERT3U(idx, <, tbl->cap);
+	tbl->ctrl[idx] = c;
+	if (idx < OA_GROUP_WIDTH)
+		tbl->ctrl[tbl->cap + idx] = c;
+}
+
+static void
+oa_tbl_alloc(const htbl_oa_t *oa, oa_tbl_t *tbl, size_t cap)
+{
+	ASSERT3U(cap, >=, OA_GROUP_WIDTH);
+	ASSERT0(cap & (cap - 1));
+	tbl->cap = cap;
+	tbl->count = 0;
+	/* max load factor 7/8 */
+	tbl->growth_left = cap - cap / 8;
+	tbl->ctrl = safe_malloc(cap + OA_GROUP_WIDTH);
+	memset(tbl->ctrl, OA_EMPTY, cap + OA_GROUP_WIDTH);
+	tbl->slots = safe_malloc(cap * oa->slot_sz);
+}
+
+static void
+oa_tbl_free(oa_tbl_t *tbl)
+{
+	free(tbl->ctrl);
+	free(tbl->slots);
+	memset(tbl, 0, sizeof (*tbl));
+}
+
+/*
+ * Locates `key' in `tbl'. Returns the slot index, or SIZE_MAX if the key
+ * isn't present.
+ */
+static size_t
+oa_tbl_find(const htbl_oa_t *oa, const oa_tbl_t *tbl, const void *key,
+    size_t key_sz, uint64_t h)
+{
+	size_t mask = tbl->cap - 1;
+	uint8_t h2 = h & 0x7f;
+
+	for (size_t pos = (h >> 7) & mask, step = 0;;) {
+		const uint8_t *group = &tbl->ctrl[pos];
+
+		for (oa_mask_t m = oa_group_match(group, h2); m != 0;
+		    m &= m - 1) {
+			size_t idx = (pos + oa_mask_first(m)) & mask;
+			if (memcmp(oa_slot_key(oa, tbl, idx), key,
+			    key_sz) == 0) {
+				return (idx);
+			}
+		}
+		/*
+		 * An empty slot in the group terminates the probe sequence.
+		 * Tombstones have the MSB set too, but don't count, so check
+		 * for OA_EMPTY specifically.
+		 */
+		if (oa_group_match(group, OA_EMPTY) != 0)
+			return (SIZE_MAX);
+		step += OA_GROUP_WIDTH;
+		if (step >= tbl->cap)
+			return (SIZE_MAX);
+		pos = (pos + step) & mask;
+	}
+}
+
+/*
+ * Returns the index of the first empty or deleted slot on the probe
+ * sequence of hash `h'. The table must have at least one free slot.
+ */
+static size_t
+oa_tbl_find_free(const oa_tbl_t *tbl, uint64_t h)
+{
+	size_t mask = tbl->cap - 1;
+
+	for (size_t pos = (h >> 7) & mask, step = 0;;) {
+		oa_mask_t m = oa_group_match_free(&tbl->ctrl[pos]);
+
+		if (m != 0)
+			return ((pos + oa_mask_first(m)) & mask);
+		step += OA_GROUP_WIDTH;
+		VERIFY3U(step, <, tbl->cap);
+		pos = (pos + step) & mask;
+	}
+}
+
+/*
+ * Stores a key known not to be present in `tbl'. The caller must make sure
+ * that `tbl->growth_left' is non-zero.
+ */
+static void
+oa_tbl_insert(const htbl_oa_t *oa, oa_tbl_t *tbl, const void *key,
+    size_t key_sz, uint64_t h, void *value)
+{
+	size_t idx = oa_tbl_find_free(tbl, h);
+
+	/* Reusing a tombstone doesn't consume growth room */
+	if (tbl->ctrl[idx] == OA_EMPTY) {
+		ASSERT(tbl->growth_left != 0);
+		tbl->growth_left--;
+	}
+	oa_set_ctrl(tbl, idx, h & 0x7f);
+	*oa_slot_value(oa, tbl, idx) = value;
+	memcpy(oa_slot_key(oa, tbl, idx), key, key_sz);
+	tbl->count++;
+}
+
+static void
+oa_tbl_erase(oa_tbl_t *tbl, size_t idx)
+{
+	ASSERT(OA_IS_FULL(tbl->ctrl[idx]));
+	ASSERT(tbl->count != 0);
+	/*
+	 * We must leave a tombstone, as other keys' probe sequences may
+	 * have passed through this slot. Tombstones are cleaned up the
+	 * next time the table is rehashed.
+	 */
+	oa_set_ctrl(tbl, idx, OA_DELETED);
+	tbl->count--;
+}
+
+/*
+ * Moves up to `nslots' slots from the old table into the current one.
+ * Releases the old table once it has been fully drained.
+ */
+static void
+oa_migrate(htbl_t *htbl, size_t nslots)
+{
+	htbl_oa_t *oa = htbl->oa;
+	oa_tbl_t *old = &oa->old;
+
+	if (old->cap == 0)
+		return;
+	if (nslots > old->cap - oa->mig_pos)
+		nslots = old->cap - oa->mig_pos;
+	for (size_t end = oa->mig_pos + nslots; oa->mig_pos < end;
+	    oa->mig_pos++) {
+		size_t idx = oa->mig_pos;
+		const uint8_t *key;
+
+		if (!OA_IS_FULL(old->ctrl[idx]))
+			continue;
+		key = oa_slot_key(oa, old, idx);
+		oa_tbl_insert(oa, &oa->cur, key, htbl->key_sz,
+		    H(htbl, key), *oa_slot_value(oa, old, idx));
+		/*
+		 * Don't disturb the probe sequences of keys which are
+		 * still waiting to be migrated.
+		 */
+		oa_tbl_erase(old, idx);
+	}
+	if (oa->mig_pos == old->cap) {
+		ASSERT0(old->count);
+		oa_tbl_free(old);
+		oa->mig_pos = 0;
+	}
+}
+
+/*
+ * Called when the current table has run out of growth room. Turns the
+ * current table into the old one and starts migrating into a new table.
+ * If most of the used-up room is tombstones, the new table is the same
+ * size, which simply cleans them out.
+ */
+static void
+oa_grow(htbl_t *htbl)
+{
+	htbl_oa_t *oa = htbl->oa;
+	size_t cap = oa->cur.cap;
+
+	ASSERT_MSG(__atomic_load_n(&oa->walkers, __ATOMIC_RELAXED) == 0,
+	    "Attempted to grow an open-addressing hash table %p from "
+	    "within htbl_foreach(). Adding new keys while walking the "
+	    "table is not supported.", htbl);
+	/* Any in-flight migration must finish before we start another */
+	oa_migrate(htbl, SIZE_MAX);
+	ASSERT0(oa->old.cap);
+	if (oa->cur.count >= cap / 2)
+		cap *= 2;
+	oa->old = oa->cur;
+	oa_tbl_alloc(oa, &oa->cur, cap);
+	oa->mig_pos = 0;
+}
+
+static void
+oa_create(htbl_t *htbl, size_t tbl_sz)
+{
+	htbl_oa_t *oa = safe_calloc(1, sizeof (*oa));
+
+	/* keep the value pointers in each slot naturally aligned */
+	oa->slot_sz = (sizeof (void *) + htbl->key_sz + sizeof (void *) - 1) &
+	    ~(sizeof (void *) - 1);
+	htbl->oa = oa;
+	htbl->tbl_sz = MAX(P2ROUNDUP(tbl_sz), OA_GROUP_WIDTH);
+	oa_tbl_alloc(oa, &oa->cur, htbl->tbl_sz);
+}
+
+static void
+oa_destroy(htbl_t *htbl)
+{
+	htbl_oa_t *oa = htbl->oa;
+
+	ASSERT0(__atomic_load_n(&oa->walkers, __ATOMIC_RELAXED));
+	oa_tbl_free(&oa->cur);
+	if (oa->old.cap != 0)
+		oa_tbl_free(&oa->old);
+	free(oa);
+	htbl->oa = NULL;
+}
+
+static void
+oa_tbl_empty(const htbl_oa_t *oa, oa_tbl_t *tbl,
+    void (*func)(void *, void *), void *userinfo)
+{
+	for (size_t i = 0; i < tbl->cap && tbl->count != 0; i++) {
+		if (!OA_IS_FULL(tbl->ctrl[i]))
+			continue;
+		if (func != NULL)
+			func(*oa_slot_value(oa, tbl, i), userinfo);
+		tbl->count--;
+	}
+	memset(tbl->ctrl, OA_EMPTY, tbl->cap + OA_GROUP_WIDTH);
+	tbl->growth_left = tbl->cap - tbl->cap / 8;
+}
+
+static void
+oa_empty(htbl_t *htbl, void (*func)(void *, void *), void *userinfo)
+{
+	htbl_oa_t *oa = htbl->oa;
+
+	ASSERT0(__atomic_load_n(&oa->walkers, __ATOMIC_RELAXED));
+	oa_tbl_empty(oa, &oa->cur, func, userinfo);
+	if (oa->old.cap != 0) {
+		oa_tbl_empty(oa, &oa->old, func, userinfo);
+		oa_tbl_free(&oa->old);
+		oa->mig_pos = 0;
+	}
+}
+
+static void **
+oa_lookup(const htbl_t *htbl, const void *key, uint64_t h)
+{
+	const htbl_oa_t *oa = htbl->oa;
+	size_t idx = oa_tbl_find(oa, &oa->cur, key, htbl->key_sz, h);
+
+	if (idx != SIZE_MAX)
+		return (oa_slot_value(oa, &oa->cur, idx));
+	if (oa->old.cap != 0) {
+		idx = oa_tbl_find(oa, &oa->old, key, htbl->key_sz, h);
+		if (idx != SIZE_MAX)
+			return (oa_slot_value(oa, &oa->old, idx));
+	}
+	return (NULL);
+}
+
+static void
+oa_set(htbl_t *htbl, const void *key, void *value)
+{
+	htbl_oa_t *oa = htbl->oa;
+	uint64_t h = H(htbl, key);
+	void **slot_value;
+
+	if (__atomic_load_n(&oa->walkers, __ATOMIC_RELAXED) == 0)
+		oa_migrate(htbl, OA_MIGRATE_STEP);
+	slot_value = oa_lookup(htbl, key, h);
+	if (slot_value != NULL) {
+		*slot_value = value;
+		return;
+	}
+	if (oa->cur.growth_left == 0) {
+		size_t idx = oa_tbl_find_free(&oa->cur, h);
+		if (oa->cur.ctrl[idx] == OA_EMPTY)
+			oa_grow(htbl);
+	}
+	oa_tbl_insert(oa, &oa->cur, key, htbl->key_sz, h, value);
+	htbl->num_values++;
+}
+
+static bool
+oa_remove(htbl_t *htbl, const void *key)
+{
+	htbl_oa_t *oa = htbl->oa;
+	uint64_t h = H(htbl, key);
+	size_t idx;
+
+	/*
+	 * Migration moves entries around, which would confuse an
+	 * in-progress walk, so hold off until it's done.
+	 */
+	if (__atomic_load_n(&oa->walkers, __ATOMIC_RELAXED) == 0)
+		oa_migrate(htbl, OA_MIGRATE_STEP);
+	idx = oa_tbl_find(oa, &oa->cur, key, htbl->key_sz, h);
+	if (idx != SIZE_MAX) {
+		oa_tbl_erase(&oa->cur, idx);
+	} else if (oa->old.cap != 0 && (idx = oa_tbl_find(oa, &oa->old,
+	    key, htbl->key_sz, h)) != SIZE_MAX) {
+		oa_tbl_erase(&oa->old, idx);
+	} else {
+		return (false);
+	}
+	ASSERT(htbl->num_values != 0);
+	htbl->num_values--;
+	return (true);
+}
+
+static void
+oa_tbl_foreach(const htbl_oa_t *oa, const oa_tbl_t *tbl,
+    void (*func)(const void *, void *, void *), void *userinfo)
+{
+	for (size_t i = 0; i < tbl->cap; i++) {
+		if (OA_IS_FULL(tbl->ctrl[i])) {
+			func(oa_slot_key(oa, tbl, i),
+			    *oa_slot_value(oa, tbl, i), userinfo);
+		}
+	}
+}
+
+static void
+oa_foreach(const htbl_t *htbl, void (*func)(const void *, void *, void *),
+    void *userinfo)
+{
+	htbl_oa_t *oa = htbl->oa;
+
+	__atomic_add_fetch(&oa->walkers, 1, __ATOMIC_RELAXED);
+	oa_tbl_foreach(oa, &oa->cur, func, userinfo);
+	if (oa->old.cap != 0)
+		oa_tbl_foreach(oa, &oa->old, func, userinfo);
+	__atomic_sub_fetch(&oa->walkers, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Concurrent backend (HTBL_LAYOUT_CONCURRENT).
+ *
+ * This is a chained hash table whose chains are only ever modified using
+ * single atomic pointer stores, so readers can walk them without taking
+ * any locks. Writers serialize on `lock'. An item which has been unlinked
+ * from its chain may still be in the process of being examined by a
+ * reader, so instead of freeing it immediately, it is placed on the
+ * `retired' list. Once enough items have been retired, the writer waits
+ * for a grace period to elapse and then frees them.
+ *
+ * Grace periods are tracked using a two-phase epoch counter. Every reader
+ * increments a reader count for the current epoch parity before touching
+ * the table and decrements it when done. To end a grace period, the
+ * writer flips the epoch parity and waits until the reader counts of the
+ * old parity have drained to zero. Any reader which could still see an
+ * item retired before the flip must have registered under the old parity.
+ * The reader counts are split into cache line-sized shards, selected by
+ * a per-thread index, so that readers on different CPUs don't fight over
+ * a single cache line.
+ *
+ * Growing the table can't relink existing items, as readers might be
+ * walking their chains. Instead, all items are copied into a new bucket
+ * array, which is then atomically published, and the old items and the
+ * old bucket array are retired.
+ */
+#define	CONC_SHARDS		32
+#define	CONC_RETIRE_BATCH	64
+/* grow the bucket array once the average chain length exceeds this */
+#define	CONC_MAX_LOAD		2
+
+typedef struct conc_item_s {
+	struct conc_item_s	*next;		/* atomic */
+	struct conc_item_s	*retire_next;
+	void			*value;		/* atomic */
+	uint8_t			key[1];	/* variable length, see key_sz */
+} conc_item_t;
+
+typedef struct {
+	size_t		tbl_sz;
+	conc_item_t	*buckets[1];	/* atomic, variable length */
+} conc_bkts_t;
+
+typedef struct {
+	unsigned long	readers[2];	/* atomic, indexed by epoch parity */
+	uint8_t		pad[64 - 2 * sizeof (unsigned long)];
+} conc_shard_t;
+
+struct htbl_conc_s {
+	conc_shard_t	shards[CONC_SHARDS];
+	mutex_t		lock;
+	conc_bkts_t	*bkts;		/* atomic */
+	unsigned	epoch;		/* atomic */
+	conc_item_t	*retired;
+	size_t		n_retired;
+	bool		walking;	/* atomic */
+	thread_id_t	walker;
+};
+
+static THREAD_LOCAL unsigned conc_shard_id = UINT_MAX;
+static unsigned conc_shard_next = 0;
+
+static inline unsigned
+conc_my_shard(void)
+{
+	if (COND_UNLIKELY(conc_shard_id == UINT_MAX)) {
+		conc_shard_id = __atomic_fetch_add(&conc_shard_next, 1,
+		    __ATOMIC_RELAXED) % CONC_SHARDS;
+	}
+	return (conc_shard_id);
+}
+
+static inline unsigned
+conc_read_enter(htbl_conc_t *conc, unsigned shard)
+{
+	unsigned long *readers = conc->shards[shard].readers;
+
+	for (;;) {
+		unsigned e = __atomic_load_n(&conc->epoch,
+		    __ATOMIC_SEQ_CST) & 1;
+
+		__atomic_fetch_add(&readers[e], 1, __ATOMIC_SEQ_CST);
+		/*
+		 * If the epoch flipped before our increment became
+		 * visible, the writer might not have seen us, so retry
+		 * under the new parity.
+		 */
+		if ((__atomic_load_n(&conc->epoch, __ATOMIC_SEQ_CST) & 1) == e)
+			return (e);
+		__atomic_fetch_sub(&readers[e], 1, __ATOMIC_RELEASE);
+	}
+}
+
+static inline void
+conc_read_exit(htbl_conc_t *conc, unsigned shard, unsigned e)
+{
+	__atomic_fetch_sub(&conc->shards[shard].readers[e], 1,
+	    __ATOMIC_RELEASE);
+}
+
+/*
+ * Waits until all readers which might have seen the table state prior
+ * to this call have finished.
+ */
+static void
+conc_synchronize(htbl_conc_t *conc)
+{
+	unsigned old = __atomic_fetch_add(&conc->epoch, 1,
+	    __ATOMIC_SEQ_CST) & 1;
+
+	for (unsigned i = 0; i < CONC_SHARDS; i++) {
+		const unsigned long *readers = &conc->shards[i].readers[old];
+
+		for (unsigned spins = 0; __atomic_load_n(readers,
+		    __ATOMIC_SEQ_CST) != 0; spins++) {
+			if (spins >= 1000)
+				usleep(10);
+		}
+	}
+}
+
+static void
+conc_reclaim(htbl_conc_t *conc)
+{
+	if (conc->retired == NULL)
+		return;
+	conc_synchronize(conc);
+	for (conc_item_t *item = conc->retired, *next; item != NULL;
+	    item = next) {
+		next = item->retire_next;
+		free(item);
+	}
+	conc->retired = NULL;
+	conc->n_retired = 0;
+}
+
+static void
+conc_retire(htbl_conc_t *conc, conc_item_t *item)
+{
+	item->retire_next = conc->retired;
+	conc->retired = item;
+	conc->n_retired++;
+	/* retired items the walker may be sitting on must stay around */
+	if (conc->n_retired >= CONC_RETIRE_BATCH && !conc->walking)
+		conc_reclaim(conc);
+}
+
+static conc_bkts_t *
+conc_bkts_alloc(size_t tbl_sz)
+{
+	conc_bkts_t *bkts = safe_calloc(1, sizeof (*bkts) +
+	    (tbl_sz - 1) * sizeof (*bkts->buckets));
+	bkts->tbl_sz = tbl_sz;
+	return (bkts);
+}
+
+static conc_item_t *
+conc_item_alloc(const htbl_t *htbl, const void *key, void *value)
+{
+	conc_item_t *item = safe_calloc(1, sizeof (*item) + htbl->key_sz - 1);
+	memcpy(item->key, key, htbl->key_sz);
+	item->value = value;
+	return (item);
+}
+
+/*
+ * Lets htbl_set() & htbl_remove() be called from within an htbl_foreach()
+ * callback, in which case the walking thread already holds the lock.
+ */
+static bool
+conc_write_enter(htbl_conc_t *conc)
+{
+	if (__atomic_load_n(&conc->walking, __ATOMIC_ACQUIRE) &&
+	    thread_equal(conc->walker, curthread_id)) {
+		return (false);
+	}
+	mutex_enter(&conc->lock);
+	return (true);
+}
+
+static void
+conc_write_exit(htbl_conc_t *conc, bool locked)
+{
+	if (locked)
+		mutex_exit(&conc->lock);
+}
+
+static void
+conc_create(htbl_t *htbl, size_t tbl_sz)
+{
+	htbl_conc_t *conc = safe_calloc(1, sizeof (*conc));
+
+	ASSERT_MSG(!htbl->multi_value, "Concurrent hash table %p cannot "
+	    "be created as multi-value", htbl);
+	mutex_init(&conc->lock);
+	htbl->tbl_sz = P2ROUNDUP(tbl_sz);
+	conc->bkts = conc_bkts_alloc(htbl->tbl_sz);
+	htbl->conc = conc;
+}
+
+static void
+conc_destroy(htbl_t *htbl)
+{
+	htbl_conc_t *conc = htbl->conc;
+
+	ASSERT(!conc->walking);
+	for (size_t i = 0; i < conc->bkts->tbl_sz; i++)
+		ASSERT3P(conc->bkts->buckets[i], ==, NULL);
+	/* No readers may exist anymore, so no need for a grace period */
+	for (conc_item_t *item = conc->retired, *next; item != NULL;
+	    item = next) {
+		next = item->retire_next;
+		free(item);
+	}
+	free(conc->bkts);
+	mutex_destroy(&conc->lock);
+	free(conc);
+	htbl->conc = NULL;
+}
+
+/*
+ * Copies all items into a new bucket array of size `tbl_sz', publishes it
+ * and retires the old items. Must be called with the lock held.
+ */
+static void
+conc_resize(htbl_t *htbl, size_t tbl_sz)
+{
+	htbl_conc_t *conc = htbl->conc;
+	conc_bkts_t *old = conc->bkts;
+	conc_bkts_t *bkts = conc_bkts_alloc(tbl_sz);
+
+	for (size_t i = 0; i < old->tbl_sz; i++) {
+		for (conc_item_t *item = old->buckets[i]; item != NULL;
+		    item = item->next) {
+			conc_item_t *copy = conc_item_alloc(htbl, item->key,
+			    item->value);
+			conc_item_t **head =
+			    &bkts->buckets[H(htbl, item->key) & (tbl_sz - 1)];
+			copy->next = *head;
+			*head = copy;
+		}
+	}
+	__atomic_store_n(&conc->bkts, bkts, __ATOMIC_RELEASE);
+	htbl->tbl_sz = tbl_sz;
+
+	for (size_t i = 0; i < old->tbl_sz; i++) {
+		for (conc_item_t *item = old->buckets[i]; item != NULL;
+		    item = item->next) {
+			item->retire_next = conc->retired;
+			conc->retired = item;
+		}
+	}
+	/* wait out readers of the old array before freeing it */
+	conc_reclaim(conc);
+	free(old);
+}
+
 static void
-htbl_create_impl(htbl_t *htbl, size_t tbl_sz, size_t key_sz, bool multi_value)
+conc_set(htbl_t *htbl, const void *key, void *value)
+{
+	htbl_conc_t *conc = htbl->conc;
+	bool locked = conc_write_enter(conc);
+	conc_bkts_t *bkts = conc->bkts;
+	conc_item_t **head = &bkts->buckets[H(htbl, key) &
+	    (bkts->tbl_sz - 1)];
+	conc_item_t *item;
+
+	for (item = *head; item != NULL; item = item->next) {
+		if (memcmp(item->key, key, htbl->key_sz) == 0) {
+			__atomic_store_n(&item->value, value,
+			    __ATOMIC_RELEASE);
+			conc_write_exit(conc, locked);
+			return;
+		}
+	}
+	item = conc_item_alloc(htbl, key, value);
+	item->next = *head;
+	/* publishes the fully initialized item to readers */
+	__atomic_store_n(head, item, __ATOMIC_RELEASE);
+	__atomic_store_n(&htbl->num_values, htbl->num_values + 1,
+	    __ATOMIC_RELAXED);
+	/*
+	 * Resizing replaces every item, which would pull the rug out from
+	 * under a walker. We'll catch up on the next insert after the walk.
+	 */
+	if (htbl->num_values > bkts->tbl_sz * CONC_MAX_LOAD && !conc->walking)
+		conc_resize(htbl, bkts->tbl_sz * 2);
+	conc_write_exit(conc, locked);
+}
+
+static bool
+conc_remove(htbl_t *htbl, const void *key)
+{
+	htbl_conc_t *conc = htbl->conc;
+	bool locked = conc_write_enter(conc);
+	conc_bkts_t *bkts = conc->bkts;
+	conc_item_t **pprev = &bkts->buckets[H(htbl, key) &
+	    (bkts->tbl_sz - 1)];
+
+	for (conc_item_t *item = *pprev; item != NULL;
+	    pprev = &item->next, item = item->next) {
+		if (memcmp(item->key, key, htbl->key_sz) == 0) {
+			/*
+			 * The item's own `next' pointer stays intact, so
+			 * readers currently on it can continue their walk.
+			 */
+			__atomic_store_n(pprev, item->next, __ATOMIC_RELEASE);
+			ASSERT(htbl->num_values != 0);
+			__atomic_store_n(&htbl->num_values,
+			    htbl->num_values - 1, __ATOMIC_RELAXED);
+			conc_retire(conc, item);
+			conc_write_exit(conc, locked);
+			return (true);
+		}
+	}
+	conc_write_exit(conc, locked);
+	return (false);
+}
+
+static void *
+conc_lookup(const htbl_t *htbl, const void *key)
+{
+	htbl_conc_t *conc = htbl->conc;
+	uint64_t h = H(htbl, key);
+	unsigned shard = conc_my_shard();
+	unsigned e = conc_read_enter(conc, shard);
+	const conc_bkts_t *bkts = __atomic_load_n(&conc->bkts,
+	    __ATOMIC_ACQUIRE);
+	void *value = NULL;
+
+	for (conc_item_t *item = __atomic_load_n(&bkts->buckets[h &
+	    (bkts->tbl_sz - 1)], __ATOMIC_ACQUIRE); item != NULL;
+	    item = __atomic_load_n(&item->next, __ATOMIC_ACQUIRE)) {
+		if (memcmp(item->key, key, htbl->key_sz) == 0) {
+			value = __atomic_load_n(&item->value,
+			    __ATOMIC_ACQUIRE);
+			break;
+		}
+	}
+	conc_read_exit(conc, shard, e);
+
+	return (value);
+}
+
+static void
+conc_empty(htbl_t *htbl, void (*func)(void *, void *), void *userinfo)
+{
+	htbl_conc_t *conc = htbl->conc;
+	conc_bkts_t *bkts;
+
+	mutex_enter(&conc->lock);
+	ASSERT(!conc->walking);
+	bkts = conc->bkts;
+	for (size_t i = 0; i < bkts->tbl_sz; i++) {
+		conc_item_t *item = bkts->buckets[i];
+
+		__atomic_store_n(&bkts->buckets[i], NULL, __ATOMIC_RELEASE);
+		for (; item != NULL; item = item->next) {
+			if (func != NULL)
+				func(item->value, userinfo);
+			item->retire_next = conc->retired;
+			conc->retired = item;
+		}
+	}
+	__atomic_store_n(&htbl->num_values, 0, __ATOMIC_RELAXED);
+	conc_reclaim(conc);
+	mutex_exit(&conc->lock);
+}
+
+static void
+conc_foreach(const htbl_t *htbl, void (*func)(const void *, void *, void *),
+    void *userinfo)
+{
+	htbl_conc_t *conc = htbl->conc;
+	const conc_bkts_t *bkts;
+
+	mutex_enter(&conc->lock);
+	conc->walker = curthread_id;
+	__atomic_store_n(&conc->walking, true, __ATOMIC_RELEASE);
+	bkts = conc->bkts;
+	for (size_t i = 0; i < bkts->tbl_sz; i++) {
+		for (conc_item_t *item = bkts->buckets[i], *next = NULL;
+		    item != NULL; item = next) {
+			/* the callback might remove the current item */
+			next = item->next;
+			func(item->key, item->value, userinfo);
+		}
+	}
+	__atomic_store_n(&conc->walking, false, __ATOMIC_RELEASE);
+	if (conc->n_retired >= CONC_RETIRE_BATCH)
+		conc_reclaim(conc);
+	mutex_exit(&conc->lock);
+}
+
+static void
+htbl_create_impl(htbl_t *htbl, size_t tbl_sz, size_t key_sz, bool multi_value,
+    const htbl_opts_t *opts)
 {
 	ASSERT(htbl != NULL);
 	ASSERT(key_sz != 0);
@@ -90,6 +1070,25 @@ htbl_create_impl(htbl_t *htbl, size_t tbl_sz, size_t key_sz, bool multi_value)
 	ASSERT(tbl_sz <= ((size_t)1 << ((sizeof(size_t) * 8) - 1)));
 
 	memset(htbl, 0, sizeof (*htbl));
+	htbl->key_sz = key_sz;
+	htbl->multi_value = multi_value;
+	if (opts != NULL) {
+		ASSERT3U(opts->hash, <=, HTBL_HASH_CUSTOM);
+		ASSERT(opts->hash != HTBL_HASH_CUSTOM ||
+		    opts->hash_func != NULL);
+		htbl->hash = opts->hash;
+		htbl->hash_func = opts->hash_func;
+		htbl->hash_userinfo = opts->hash_userinfo;
+	}
+	if (opts != NULL && opts->layout == HTBL_LAYOUT_OPEN_ADDR &&
+	    !multi_value) {
+		oa_create(htbl, tbl_sz);
+		return;
+	}
+	if (opts != NULL && opts->layout == HTBL_LAYOUT_CONCURRENT) {
+		conc_create(htbl, tbl_sz);
+		return;
+	}
 	/* round table size up to nearest multiple of 2 */
 	htbl->tbl_sz = P2ROUNDUP(tbl_sz);
 	htbl->buckets = safe_malloc(sizeof (*htbl->buckets) * htbl->tbl_sz);
@@ -98,8 +1097,6 @@ htbl_create_impl(htbl_t *htbl, size_t tbl_sz, size_t key_sz, bool multi_value)
 		list_create(&htbl->buckets[i], sizeof (htbl_bucket_item_t),
 		    offsetof(htbl_bucket_item_t, bucket_node));
 	}
-	htbl->key_sz = key_sz;
-	htbl->multi_value = multi_value;
 }
 
 /**
@@ -127,14 +1124,38 @@ void
 htbl_create(htbl_t REQ_PTR(htbl), size_t tbl_sz, size_t key_sz,
     bool_t multi_value)
 {
-	htbl_create_impl(htbl, tbl_sz, key_sz, multi_value);
+	htbl_create_impl(htbl, tbl_sz, key_sz, multi_value, NULL);
 }
 
 void
 htbl2_create(htbl2_t REQ_PTR(htbl), size_t tbl_sz, size_t key_sz,
     size_t value_sz, bool multi_value)
 {
-	htbl_create_impl(&htbl->h, tbl_sz, key_sz, multi_value);
+	htbl_create_impl(&htbl->h, tbl_sz, key_sz, multi_value, NULL);
+	htbl->value_sz = value_sz;
+}
+
+/**
+ * Same as htbl_create(), but allows selecting additional hash table
+ * options, such as the storage layout and hash function.
+ * @param opts Optional set of extended options. Passing NULL here
+ *	is equivalent to calling htbl_create().
+ * @see htbl_opts_t
+ * @see htbl_layout_t
+ * @see htbl_hash_t
+ */
+void
+htbl_create_opts(htbl_t REQ_PTR(htbl), size_t tbl_sz, size_t key_sz,
+    bool_t multi_value, const htbl_opts_t *opts)
+{
+	htbl_create_impl(htbl, tbl_sz, key_sz, multi_value, opts);
+}
+
+void
+htbl2_create_opts(htbl2_t REQ_PTR(htbl), size_t tbl_sz, size_t key_sz,
+    size_t value_sz, bool multi_value, const htbl_opts_t *opts)
+{
+	htbl_create_impl(&htbl->h, tbl_sz, key_sz, multi_value, opts);
 	htbl->value_sz = value_sz;
 }
 
@@ -155,6 +1176,14 @@ htbl_destroy(htbl_t REQ_PTR(htbl))
 {
 	ASSERT(htbl != NULL);
 	ASSERT(htbl->num_values == 0);
+	if (htbl->oa != NULL) {
+		oa_destroy(htbl);
+		return;
+	}
+	if (htbl->conc != NULL) {
+		conc_destroy(htbl);
+		return;
+	}
 	ASSERT(htbl->buckets != NULL);
 	for (size_t i = 0; i < htbl->tbl_sz; i++)
 		list_destroy(&htbl->buckets[i]);
@@ -205,6 +1234,15 @@ htbl_empty(htbl_t REQ_PTR(htbl), void (*func)(void *value, void *userinfo),
 {
 	if (htbl->num_values == 0)
 		return;
+	if (htbl->oa != NULL) {
+		oa_empty(htbl, func, userinfo);
+		htbl->num_values = 0;
+		return;
+	}
+	if (htbl->conc != NULL) {
+		conc_empty(htbl, func, userinfo);
+		return;
+	}
 	for (size_t i = 0; i < htbl->tbl_sz; i++) {
 		for (htbl_bucket_item_t *item = list_head(&htbl->buckets[i]);
 		    item; item = list_head(&htbl->buckets[i])) {
@@ -234,6 +1272,8 @@ size_t
 htbl_count(const htbl_t *htbl)
 {
 	ASSERT(htbl != NULL);
+	if (htbl->conc != NULL)
+		return (__atomic_load_n(&htbl->num_values, __ATOMIC_RELAXED));
 	return (htbl->num_values);
 }
 
@@ -241,7 +1281,7 @@ size_t
 htbl2_count(const htbl2_t *htbl)
 {
 	ASSERT(htbl != NULL);
-	return (htbl->h.num_values);
+	return (htbl_count(&htbl->h));
 }
 
 static void
@@ -260,13 +1300,21 @@ htbl_set_impl(htbl_t REQ_PTR(htbl), const void *key, void *value,
     size_t value_sz)
 {
 	ASSERT(key != NULL);
+	ASSERT(value != NULL);
 
-	list_t *bucket = &htbl->buckets[H(key, htbl->key_sz) &
+	if (htbl->oa != NULL) {
+		oa_set(htbl, key, value);
+		return;
+	}
+	if (htbl->conc != NULL) {
+		conc_set(htbl, key, value);
+		return;
+	}
+
+	list_t *bucket = &htbl->buckets[H(htbl, key) &
 	    (htbl->tbl_sz - 1)];
 	htbl_bucket_item_t *item;
 
-	ASSERT(key != NULL);
-	ASSERT(value != NULL);
 	for (item = list_head(bucket); item; item = list_next(bucket, item)) {
 		if (memcmp(item->key, key, htbl->key_sz) == 0) {
 			if (htbl->multi_value)
@@ -343,7 +1391,18 @@ htbl_remove(htbl_t REQ_PTR(htbl), const void *key, bool_t nil_ok)
 	ASSERT(htbl != NULL);
 	ASSERT(key != NULL);
 
-	list_t *bucket = &htbl->buckets[H(key, htbl->key_sz) &
+	if (htbl->oa != NULL) {
+		if (!oa_remove(htbl, key))
+			ASSERT(nil_ok);
+		return;
+	}
+	if (htbl->conc != NULL) {
+		if (!conc_remove(htbl, key))
+			ASSERT(nil_ok);
+		return;
+	}
+
+	list_t *bucket = &htbl->buckets[H(htbl, key) &
 	    (htbl->tbl_sz - 1)];
 	htbl_bucket_item_t *item;
 
@@ -416,7 +1475,7 @@ htbl_remove_multi(htbl_t REQ_PTR(htbl), const void *key,
 	free(list_item);
 	if (list_count(&item->multi) == 0) {
 		list_t *bucket =
-		    &htbl->buckets[H(key, htbl->key_sz) & (htbl->tbl_sz - 1)];
+		    &htbl->buckets[H(htbl, key) & (htbl->tbl_sz - 1)];
 		list_remove(bucket, item);
 		list_destroy(&item->multi);
 		free(item);
@@ -437,7 +1496,7 @@ htbl_lookup_common(const htbl_t *htbl, const void *key)
 	ASSERT(htbl != NULL);
 	ASSERT(key != NULL);
 
-	list_t *bucket = &htbl->buckets[H(key, htbl->key_sz) &
+	list_t *bucket = &htbl->buckets[H(htbl, key) &
 	    (htbl->tbl_sz - 1)];
 	htbl_bucket_item_t *item;
 
@@ -463,6 +1522,12 @@ htbl_lookup(const htbl_t REQ_PTR(htbl), const void *key)
 {
 	htbl_bucket_item_t *item;
 	ASSERT(!htbl->multi_value);
+	if (htbl->oa != NULL) {
+		void **value = oa_lookup(htbl, key, H(htbl, key));
+		return (value != NULL ? *value : NULL);
+	}
+	if (htbl->conc != NULL)
+		return (conc_lookup(htbl, key));
 	item = htbl_lookup_common(htbl, key);
 	return (item != NULL ? item->value : NULL);
 }
@@ -523,6 +1588,14 @@ htbl_foreach(const htbl_t *htbl,
 {
 	ASSERT(htbl != NULL);
 	ASSERT(func != NULL);
+	if (htbl->oa != NULL) {
+		oa_foreach(htbl, func, userinfo);
+		return;
+	}
+	if (htbl->conc != NULL) {
+		conc_foreach(htbl, func, userinfo);
+		return;
+	}
 	for (size_t i = 0; i < htbl->tbl_sz; i++) {
 		list_t *bucket = &htbl->buckets[i];
 		for (const htbl_bucket_item_t *item = list_head(bucket),
@@ -606,6 +1679,53 @@ htbl_dump(const htbl_t *htbl, bool_t printable_keys)
 
 	append_format(&result, &result_sz, "(%lu){\n",
 	    (long unsigned)htbl->num_values);
+	if (htbl->oa != NULL) {
+		const htbl_oa_t *oa = htbl->oa;
+		const oa_tbl_t *tbls[2] = { &oa->cur, &oa->old };
+
+		for (int t = 0; t < 2; t++) {
+			for (size_t i = 0; i < tbls[t]->cap; i++) {
+				if (!OA_IS_FULL(tbls[t]->ctrl[i]))
+					continue;
+				if (printable_keys) {
+					append_format(&result, &result_sz,
+					    "  [%lu] = (%s)\n", (long unsigned)i,
+					    oa_slot_key(oa, tbls[t], i));
+				} else {
+					append_format(&result, &result_sz,
+					    "  [%lu] = (#BIN)\n",
+					    (long unsigned)i);
+				}
+			}
+		}
+		append_format(&result, &result_sz, "}");
+		return (result);
+	}
+	if (htbl->conc != NULL) {
+		htbl_conc_t *conc = htbl->conc;
+
+		mutex_enter(&conc->lock);
+		for (size_t i = 0; i < conc->bkts->tbl_sz; i++) {
+			append_format(&result, &result_sz, "  [%lu] =",
+			    (long unsigned)i);
+			if (conc->bkts->buckets[i] == NULL)
+				append_format(&result, &result_sz, " <empty>");
+			for (const conc_item_t *item = conc->bkts->buckets[i];
+			    item != NULL; item = item->next) {
+				if (printable_keys) {
+					append_format(&result, &result_sz,
+					    " (%s) ", item->key);
+				} else {
+					append_format(&result, &result_sz,
+					    " (#BIN)");
+				}
+			}
+			append_format(&result, &result_sz, "\n");
+		}
+		mutex_exit(&conc->lock);
+		append_format(&result, &result_sz, "}");
+		return (result);
+	}
 	for (size_t i = 0; i < htbl->tbl_sz; i++) {
 		list_t *bucket = &htbl->buckets[i];
 		append_format(&result, &result_sz, "  [%lu] =",
@@ -0,0 +1,271 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license in the file COPYING
+ * or http://www.opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file COPYING.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+
+#include <stddef.h>
+
+#include "acfutils/assert.h"
+#include "acfutils/lru.h"
+
+/*
+ * Pinned objects are taken off the `lru' list altogether, so lru_trim()
+ * only ever has to look at the list's tail and never skips over objects
+ * which it isn't allowed to evict.
+ */
+
+static inline lru_node_t *
+obj2node(const lru_t *lru, const void *obj)
+{
+	ASSERT(obj != NULL);
+	return ((lru_node_t *)((uintptr_t)obj + lru->offset));
+}
+
+/**
+ * Initializes a cache.
+ *
+ * @param size Size of the cached objects, as returned by `sizeof()'.
+ * @param offset Offset of the lru_node_t in the cached objects, as
+ *	returned by `offsetof()'.
+ * @param budget Number of bytes which lru_trim() shrinks the cache to.
+ * @param evict_cb Callback used to release evicted objects.
+ * @param userinfo Passed as the second argument to `evict_cb'.
+ */
+void
+lru_create(lru_t *lru, size_t size, size_t offset, uint64_t budget,
+    lru_evict_cb_t evict_cb, void *userinfo)
+{
+	ASSERT(lru != NULL);
+	ASSERT3U(offset + sizeof (lru_node_t), <=, size);
+	ASSERT(evict_cb != NULL);
+
+	list_create(&lru->lru, size, offset + offsetof(lru_node_t, node));
+	lru->offset = offset;
+	lru->count = 0;
+	lru->size = 0;
+	lru->budget = budget;
+	lru->evict_cb = evict_cb;
+	lru->userinfo = userinfo;
+}
+
+/**
+ * Deinitializes a cache. The cache must be empty (see lru_purge()).
+ */
+void
+lru_destroy(lru_t *lru)
+{
+	ASSERT(lru != NULL);
+	ASSERT0(lru->count);
+	ASSERT0(lru->size);
+	list_destroy(&lru->lru);
+}
+
+/**
+ * Inserts an object as the most recently used one. If the object is
+ * already in the cache, this only updates its size and marks it as most
+ * recently used. The cache isn't trimmed, so the total size may exceed
+ * the budget until the next call to lru_trim().
+ */
+void
+lru_insert(lru_t *lru, void *obj, uint64_t size)
+{
+	lru_node_t *node = obj2node(lru, obj);
+
+	if (node->cached) {
+		ASSERT3U(lru->size, >=, node->size);
+		lru->size -= node->size;
+		if (node->pins == 0)
+			list_remove(&lru->lru, obj);
+	} else {
+		node->cached = B_TRUE;
+		node->pins = 0;
+		lru->count++;
+	}
+	node->size = size;
+	lru->size += size;
+	if (node->pins == 0)
+		list_insert_head(&lru->lru, obj);
+}
+
+/**
+ * Removes an object from the cache without calling the eviction
+ * callback. The object must be in the cache and must not be pinned.
+ */
+void
+lru_remove(lru_t *lru, void *obj)
+{
+	lru_node_t *node = obj2node(lru, obj);
+
+	ASSERT(node->cached);
+	ASSERT0(node->pins);
+	ASSERT3U(lru->size, >=, node->size);
+	ASSERT(lru->count != 0);
+
+	list_remove(&lru->lru, obj);
+	lru->size -= node->size;
+	lru->count--;
+	node->size = 0;
+	node->cached = B_FALSE;
+}
+
+/**
+ * @return True if `obj' is in the cache, pinned or not.
+ */
+bool_t
+lru_contains(const lru_t *lru, const void *obj)
+{
+	return (obj2node(lru, obj)->cached);
+}
+
+/**
+ * Marks an object in the cache as the most recently used one. Pinned
+ * objects become the most recently used ones when they're unpinned, so
+ * touching them does nothing.
+ */
+void
+lru_touch(lru_t *lru, void *obj)
+{
+	lru_node_t *node = obj2node(lru, obj);
+
+	ASSERT(node->cached);
+	if (node->pins == 0) {
+		list_remove(&lru->lru, obj);
+		list_insert_head(&lru->lru, obj);
+	}
+}
+
+/**
+ * Protects an object in the cache from eviction until a matching call
+ * to lru_unpin(). Pins nest.
+ */
+void
+lru_pin(lru_t *lru, void *obj)
+{
+	lru_node_t *node = obj2node(lru, obj);
+
+	ASSERT(node->cached);
+	if (node->pins == 0)
+		list_remove(&lru->lru, obj);
+	node->pins++;
+	ASSERT(node->pins != 0);
+}
+
+/**
+ * Drops a pin placed by lru_pin(). Once the last pin is dropped, the
+ * object becomes the most recently used one. This doesn't trim the
+ * cache, even if the object no longer fits within the budget.
+ */
+void
+lru_unpin(lru_t *lru, void *obj)
+{
+	lru_node_t *node = obj2node(lru, obj);
+
+	ASSERT(node->cached);
+	ASSERT(node->pins != 0);
+	node->pins--;
+	if (node->pins == 0)
+		list_insert_head(&lru->lru, obj);
+}
+
+/**
+ * Changes the cache's budget. Like lru_insert(), this doesn't trim the
+ * cache by itself.
+ */
+void
+lru_set_budget(lru_t *lru, uint64_t budget)
+{
+	ASSERT(lru != NULL);
+	lru->budget = budget;
+}
+
+uint64_t
+lru_get_budget(const lru_t *lru)
+{
+	ASSERT(lru != NULL);
+	return (lru->budget);
+}
+
+/**
+ * @return The total size of all objects in the cache, including pinned
+ *	ones. This is kept up to date incrementally, so it's O(1).
+ */
+uint64_t
+lru_size(const lru_t *lru)
+{
+	ASSERT(lru != NULL);
+	return (lru->size);
+}
+
+/**
+ * @return The number of objects in the cache, including pinned ones.
+ */
+size_t
+lru_count(const lru_t *lru)
+{
+	ASSERT(lru != NULL);
+	return (lru->count);
+}
+
+static void
+evict(lru_t *lru, void *obj)
+{
+	lru_remove(lru, obj);
+	lru->evict_cb(obj, lru->userinfo);
+}
+
+/**
+ * Evicts the least recently used unpinned objects until the total size
+ * of the cache is within its budget, or only pinned objects remain.
+ *
+ * @return The number of objects evicted.
+ */
+size_t
+lru_trim(lru_t *lru)
+{
+	size_t n = 0;
+
+	ASSERT(lru != NULL);
+	while (lru->size > lru->budget) {
+		void *obj = list_tail(&lru->lru);
+
+		if (obj == NULL)
+			break;
+		evict(lru, obj);
+		n++;
+	}
+
+	return (n);
+}
+
+/**
+ * Evicts all unpinned objects from the cache, regardless of its budget.
+ */
+void
+lru_purge(lru_t *lru)
+{
+	void *obj;
+
+	ASSERT(lru != NULL);
+	while ((obj = list_tail(&lru->lru)) != NULL)
+		evict(lru, obj);
+}
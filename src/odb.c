@@ -17,6 +17,7 @@
  */
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
@@ -25,10 +26,13 @@
 #include "acfutils/assert.h"
 #include "acfutils/avl.h"
 #include "acfutils/compress.h"
+#include "acfutils/helpers.h"
 #include "acfutils/list.h"
+#include "acfutils/math.h"
 #include "acfutils/odb.h"
 #include "acfutils/perf.h"
 #include "acfutils/safe_alloc.h"
+#include "acfutils/taskq.h"
 #include "acfutils/thread.h"
 #include "acfutils/time.h"
 
@@ -44,10 +48,10 @@
 
 #define	FAA_DOF_URL	"https://aeronav.faa.gov/Obst_Data/DAILY_DOF_CSV.ZIP"
 
-enum {
+typedef enum {
 	ODB_REGION_US,		/* USA */
 	NUM_ODB_REGIONS
-};
+} odb_region_t;
 
 typedef struct {
 	odb_t		*odb;
@@ -62,15 +66,72 @@ typedef struct {
 	float		agl;
 	obst_light_t	light;
 	unsigned	quant;
-
-	list_node_t	node;
 } obst_t;
 
+/*
+ * Binary obstacle tiles. Next to each text tile in the cache, we also keep
+ * a binary copy of it (with a ".bin" suffix), which is simply mapped into
+ * memory on load, instead of re-parsing the text. As in the airport
+ * database, the text tiles remain the authoritative copy and a missing or
+ * invalid binary tile is regenerated from the text tile.
+ *
+ * The file consists of a header, a grid index and an array of fixed-size
+ * obstacle records. The records are sorted along a Hilbert curve through
+ * the tile (with positions quantized to a 65536 x 65536 grid), so nearby
+ * obstacles are stored close together. The Hilbert curve visits each
+ * aligned square of the grid in one go, so all records within one cell of
+ * a coarser ODB_BIN_GRID x ODB_BIN_GRID grid (roughly 3.5 km in latitude)
+ * form a contiguous run. The grid index holds the start of each cell's run
+ * in Hilbert order (plus one final entry holding the number of records),
+ * so spatial queries only need to look at the cells they overlap.
+ */
+#define	ODB_BIN_MAGIC		0x4342444fu	/* "ODBC" in little endian */
+#define	ODB_BIN_VERSION		1
+#define	ODB_BIN_SUFFIX		".bin"
+#define	ODB_BIN_GRID_ORDER	5
+#define	ODB_BIN_GRID		(1 << ODB_BIN_GRID_ORDER)
+#define	ODB_BIN_CELLS		(ODB_BIN_GRID * ODB_BIN_GRID)
+#define	ODB_BIN_POS_ORDER	16	/* 65536 x 65536 position grid */
+#define	ODB_BIN_POS_SCALE	1e7	/* lat & lon are in 1e-7 degrees */
+
+typedef struct {
+	uint32_t	magic;		/* ODB_BIN_MAGIC */
+	uint32_t	version;	/* ODB_BIN_VERSION */
+	int32_t		lat;
+	int32_t		lon;
+	uint32_t	n_obst;
+	uint32_t	grid;		/* ODB_BIN_GRID */
+} odb_bin_hdr_t;
+
+typedef struct {
+	int32_t		lat;		/* 1e-7 degrees */
+	int32_t		lon;		/* 1e-7 degrees */
+	int16_t		amsl;		/* feet */
+	uint16_t	agl;		/* feet */
+	uint16_t	quant;
+	uint8_t		type;		/* obst_type_t */
+	uint8_t		light;		/* obst_light_t */
+} odb_bin_obst_t;
+
+CTASSERT(sizeof (odb_bin_hdr_t) == 24);
+CTASSERT(sizeof (odb_bin_obst_t) == 16);
+CTASSERT((sizeof (odb_bin_hdr_t) + (ODB_BIN_CELLS + 1) * sizeof (uint32_t)) %
+    4 == 0);
+
 typedef struct {
 	odb_t		*odb;
 	int		lat, lon;
 	time_t		access_t;
-	list_t		obst;
+	/* obstacles of a tile under construction in a refresh */
+	obst_t		*obst;
+	size_t		n_obst;
+	size_t		cap_obst;
+	/* obstacles of a loaded tile, mapped from the binary tile */
+	uint8_t		*bin;
+	size_t		bin_sz;		/* non-zero if mapped */
+	const uint32_t	*cells;
+	const odb_bin_obst_t *bin_obst;
+	unsigned	n_bin_obst;
 	avl_node_t	node;
 } odb_tile_t;
 
@@ -78,9 +139,11 @@ struct odb_s {
 	char 		*cache_dir;
 	char		*cainfo;
 	unsigned	unload_delay;
+	unsigned	refresh_threads;
 
 	mutex_t		tiles_lock;
 	avl_tree_t	tiles;
+	avl_tree_t	new_tiles;	/* tiles being built by a refresh */
 
 	mutex_t		refresh_lock;
 	thread_t	refresh_thr;
@@ -92,11 +155,8 @@ struct odb_s {
 	char		*proxy;
 };
 
-static void add_obst_to_odb(obst_type_t type, geo_pos3_t pos, float agl,
-    obst_light_t light, unsigned quant, void *userinfo);
-static odb_tile_t *load_tile(odb_t *odb, int lat, int lon,
-    bool_t load_from_db);
-static void odb_flush_tiles(odb_t *odb);
+static odb_tile_t *load_tile(odb_t *odb, int lat, int lon);
+static void odb_flush_tiles(odb_t *odb, avl_tree_t *tiles);
 
 static int
 tile_compar(const void *a, const void *b)
@@ -217,86 +277,116 @@ light2dof(obst_light_t light)
 	}
 }
 
+#define	DOF_MIN_FIELDS	19
+
+/*
+ * Parses a single line of a DOF file, modifying the line in place.
+ * @return B_TRUE if the line holds a valid obstacle, which is then
+ *	filled into `obst'.
+ */
+static bool_t
+dof_parse_line(char *line, obst_t *obst)
+{
+	char *comps[DOF_MIN_FIELDS];
+	unsigned n_comps = 1;
+	float amsl;
+
+	ASSERT(line != NULL);
+	ASSERT(obst != NULL);
+
+	strip_space(line);
+	/* split in place, so we don't allocate anything for every line */
+	comps[0] = line;
+	for (char *p = strchr(line, ','); p != NULL; p = strchr(&p[1], ',')) {
+		*p = '\0';
+		if (n_comps < DOF_MIN_FIELDS)
+			comps[n_comps] = &p[1];
+		n_comps++;
+	}
+	if (n_comps < DOF_MIN_FIELDS || strcmp(comps[0], "OAS") == 0)
+		return (B_FALSE);
+
+	obst->quant = atoi(comps[10]);
+	obst->agl = FEET2MET(atof(comps[11]));
+	amsl = FEET2MET(atof(comps[12]));
+	obst->type = dof2type(comps[9]);
+	obst->light = dof2light(comps[13]);
+	obst->pos.lat = atof(comps[5]);
+	obst->pos.lon = atof(comps[6]);
+	obst->pos.elev = amsl - obst->agl;
+
+	return (is_valid_lat(obst->pos.lat) && is_valid_lon(obst->pos.lon) &&
+	    obst->agl >= 0 && is_valid_alt_m(obst->agl) &&
+	    is_valid_alt_m(amsl) && obst->quant != 0);
+}
+
+/*
+ * Reads a DOF file from a decompression stream line by line, so that the
+ * (very large) decompressed file never needs to be held in memory.
+ */
 static bool_t
-odb_proc_us_dof_impl(const char *buf, size_t len, add_obst_cb_t cb,
+odb_proc_us_dof_impl(decompress_stream_t *st, add_obst_cb_t cb,
     void *userinfo)
 {
-	ASSERT(buf != NULL);
+	char *line = NULL;
+	size_t linecap = 0;
+
+	ASSERT(st != NULL);
 	ASSERT(cb != NULL);
 
-	for (const char *line_start = buf, *line_end = buf;
-	    line_start < buf + len; line_start = line_end + 1) {
-		char **comps;
-		size_t n_comps;
-		obst_type_t type;
-		obst_light_t light;
-		geo_pos3_t pos;
-		float agl, amsl;
-		unsigned quant;
-		char line[256];
-
-		line_end = strchr(line_start, '\n');
-		if (line_end == NULL)
-			line_end = buf + len;
-		lacf_strlcpy(line, line_start, MIN((int)sizeof (line),
-		    (line_end - line_start) + 1));
-
-		strip_space(line);
-
-		comps = strsplit(line, ",", B_FALSE, &n_comps);
-
-		if (n_comps < 19 || strcmp(comps[0], "OAS") == 0)
-			goto next;
-
-		quant = atoi(comps[10]);
-		agl = FEET2MET(atof(comps[11]));
-		amsl = FEET2MET(atof(comps[12]));
-		type = dof2type(comps[9]);
-		light = dof2light(comps[13]);
-		pos.lat = atof(comps[5]);
-		pos.lon = atof(comps[6]);
-		pos.elev = amsl - agl;
-
-		if (!is_valid_lat(pos.lat) || !is_valid_lon(pos.lon) ||
-		    agl < 0 || !is_valid_alt_m(agl) || !is_valid_alt_m(amsl) ||
-		    quant == 0)
-			goto next;
-
-		cb(type, pos, agl, light, quant, userinfo);
-next:
-		free_strlist(comps, n_comps);
+	while (decompress_stream_getline(st, &line, &linecap) >= 0) {
+		obst_t obst;
+
+		if (dof_parse_line(line, &obst)) {
+			cb(obst.type, obst.pos, obst.agl, obst.light,
+			    obst.quant, userinfo);
+		}
 	}
+	free(line);
 
-	return (B_TRUE);
+	return (!decompress_stream_error(st));
 }
 
 static bool_t
 odb_proc_us_dof(const char *path, add_obst_cb_t cb, void *userinfo)
 {
-	char *str;
+	decompress_stream_t *st;
 	bool_t res;
 
 	ASSERT(path != NULL);
-	str = file2str(path, NULL);
-
-	if (str == NULL)
+	st = decompress_stream_open(path, DECOMPRESS_FMT_NONE);
+	if (st == NULL)
 		return (B_FALSE);
-	res = odb_proc_us_dof_impl(str, strlen(str), cb, userinfo);
-	LACF_DESTROY(str);
+	res = odb_proc_us_dof_impl(st, cb, userinfo);
+	decompress_stream_close(st);
 
 	return (res);
 }
 
 static void
-free_tile(odb_tile_t *tile)
+tile_add_obst(odb_tile_t *tile, const obst_t *obst)
 {
-	obst_t *obst;
+	ASSERT(tile != NULL);
+	ASSERT(obst != NULL);
 
+	if (tile->n_obst == tile->cap_obst) {
+		tile->cap_obst = MAX(tile->cap_obst * 2, 64);
+		tile->obst = safe_realloc(tile->obst,
+		    tile->cap_obst * sizeof (*tile->obst));
+	}
+	tile->obst[tile->n_obst++] = *obst;
+}
+
+static void
+free_tile(odb_tile_t *tile)
+{
 	ASSERT(tile != NULL);
 
-	while ((obst = list_remove_head(&tile->obst)) != NULL)
-		free(obst);
-	list_destroy(&tile->obst);
+	free(tile->obst);
+	if (tile->bin_sz != 0)
+		file_unmap(tile->bin, tile->bin_sz);
+	else
+		free(tile->bin);
 	memset(tile, 0, sizeof (*tile));
 	free(tile);
 }
@@ -317,6 +407,8 @@ odb_init(const char *xpdir, const char *cainfo)
 	mutex_init(&odb->tiles_lock);
 	avl_create(&odb->tiles, tile_compar, sizeof (odb_tile_t),
 	    offsetof(odb_tile_t, node));
+	avl_create(&odb->new_tiles, tile_compar, sizeof (odb_tile_t),
+	    offsetof(odb_tile_t, node));
 
 	mutex_init(&odb->refresh_lock);
 
@@ -338,10 +430,12 @@ odb_fini(odb_t *odb)
 	mutex_destroy(&odb->refresh_lock);
 
 	mutex_enter(&odb->tiles_lock);
-	odb_flush_tiles(odb);
+	odb_flush_tiles(odb, &odb->tiles);
+	odb_flush_tiles(odb, &odb->new_tiles);
 	mutex_exit(&odb->tiles_lock);
 
 	avl_destroy(&odb->tiles);
+	avl_destroy(&odb->new_tiles);
 	mutex_destroy(&odb->tiles_lock);
 
 	free(odb->proxy);
@@ -360,6 +454,24 @@ odb_set_unload_delay(odb_t *odb, unsigned seconds)
 	odb->unload_delay = seconds;
 }
 
+/**
+ * Sets the number of threads used to parse the obstacle data and write
+ * out the database tiles in a refresh. The tiles written don't depend
+ * on this setting, since their obstacles are sorted before they're
+ * written out. The default for a newly created odb is 0, which means
+ * one thread per CPU.
+ *
+ * @param odb The database for which to set the thread count.
+ * @param n The number of threads to use, 0 to use one per CPU, or 1
+ *	to do everything on the refresh thread only.
+ */
+void
+odb_set_refresh_threads(odb_t *odb, unsigned n)
+{
+	ASSERT(odb != NULL);
+	odb->refresh_threads = n;
+}
+
 time_t
 odb_get_cc_refresh_date_impl(odb_t* odb, const char *cc)
 {
@@ -423,6 +535,235 @@ dl_write(char *ptr, size_t size, size_t nmemb, void *userdata)
 	return (bytes);
 }
 
+/*
+ * Computes the distance of (x, y) along a Hilbert curve through a grid of
+ * 2^order x 2^order points. The index of a point on a coarser curve is the
+ * top bits of its index on a finer one, i.e.:
+ *	hilbert_idx(k, x >> (n - k), y >> (n - k)) ==
+ *	    hilbert_idx(n, x, y) >> (2 * (n - k))
+ */
+static uint32_t
+hilbert_idx(unsigned order, uint32_t x, uint32_t y)
+{
+	uint32_t d = 0;
+
+	ASSERT3U(order, >, 0);
+	ASSERT3U(order, <=, 16);
+
+	for (uint32_t s = 1u << (order - 1); s > 0; s >>= 1) {
+		uint32_t rx = ((x & s) != 0);
+		uint32_t ry = ((y & s) != 0);
+
+		d += s * s * ((3 * rx) ^ ry);
+		/* rotate the quadrant, so the sub-curve is oriented right */
+		if (ry == 0) {
+			uint32_t tmp;
+
+			if (rx == 1) {
+				x = s - 1 - (x & (s - 1));
+				y = s - 1 - (y & (s - 1));
+			}
+			tmp = x;
+			x = y;
+			y = tmp;
+		}
+	}
+	return (d);
+}
+
+/*
+ * Returns the position of a coordinate along one axis of the position
+ * grid of a tile which starts at `origin' degrees.
+ */
+static inline uint32_t
+bin_grid_pos(int32_t coord, int origin)
+{
+	int64_t x = ((int64_t)coord - (int64_t)origin * ODB_BIN_POS_SCALE) *
+	    (1 << ODB_BIN_POS_ORDER) / (int64_t)ODB_BIN_POS_SCALE;
+
+	if (x < 0)
+		return (0);
+	return (MIN(x, (1 << ODB_BIN_POS_ORDER) - 1));
+}
+
+typedef struct {
+	uint32_t	key;
+	odb_bin_obst_t	obst;
+} bin_sort_t;
+
+static int
+bin_sort_compar(const void *a, const void *b)
+{
+	const bin_sort_t *sa = a, *sb = b;
+
+	if (sa->key < sb->key)
+		return (-1);
+	if (sa->key > sb->key)
+		return (1);
+	/*
+	 * Obstacles in the same spot are ordered by the rest of the
+	 * record, so the output doesn't depend on the input order.
+	 * odb_bin_obst_t has no padding, so records which compare equal
+	 * are indistinguishable.
+	 */
+	return (memcmp(&sa->obst, &sb->obst, sizeof (sa->obst)));
+}
+
+/*
+ * Builds a binary tile from the obstacles in `obst'.
+ */
+static uint8_t *
+bin_tile_build(int lat, int lon, const obst_t *obst, size_t n, size_t *sz_p)
+{
+	size_t sz = sizeof (odb_bin_hdr_t) +
+	    (ODB_BIN_CELLS + 1) * sizeof (uint32_t) +
+	    n * sizeof (odb_bin_obst_t);
+	bin_sort_t *sort = safe_calloc(MAX(n, 1), sizeof (*sort));
+	uint8_t *buf = safe_calloc(1, sz);
+	odb_bin_hdr_t *hdr = (odb_bin_hdr_t *)buf;
+	uint32_t *cells = (uint32_t *)&buf[sizeof (*hdr)];
+	odb_bin_obst_t *recs = (odb_bin_obst_t *)&cells[ODB_BIN_CELLS + 1];
+
+	ASSERT(obst != NULL || n == 0);
+	ASSERT(sz_p != NULL);
+	VERIFY3U(n, <=, UINT32_MAX);
+
+	for (size_t i = 0; i < n; i++) {
+		const obst_t *o = &obst[i];
+		odb_bin_obst_t *rec = &sort[i].obst;
+
+		rec->lat = round(o->pos.lat * ODB_BIN_POS_SCALE);
+		rec->lon = round(o->pos.lon * ODB_BIN_POS_SCALE);
+		rec->amsl = clampi(round(MET2FEET(o->pos.elev + o->agl)),
+		    INT16_MIN, INT16_MAX);
+		rec->agl = clampi(round(MET2FEET(o->agl)), 0, UINT16_MAX);
+		rec->quant = MIN(o->quant, UINT16_MAX);
+		rec->type = o->type;
+		rec->light = o->light;
+		sort[i].key = hilbert_idx(ODB_BIN_POS_ORDER,
+		    bin_grid_pos(rec->lon, lon), bin_grid_pos(rec->lat, lat));
+	}
+	qsort(sort, n, sizeof (*sort), bin_sort_compar);
+
+	hdr->magic = ODB_BIN_MAGIC;
+	hdr->version = ODB_BIN_VERSION;
+	hdr->lat = lat;
+	hdr->lon = lon;
+	hdr->n_obst = n;
+	hdr->grid = ODB_BIN_GRID;
+	/* count the obstacles per cell, then turn that into start indices */
+	for (size_t i = 0; i < n; i++) {
+		recs[i] = sort[i].obst;
+		cells[(sort[i].key >> (2 * (ODB_BIN_POS_ORDER -
+		    ODB_BIN_GRID_ORDER))) + 1]++;
+	}
+	for (size_t i = 0; i < ODB_BIN_CELLS; i++)
+		cells[i + 1] += cells[i];
+	ASSERT3U(cells[ODB_BIN_CELLS], ==, n);
+	free(sort);
+
+	*sz_p = sz;
+	return (buf);
+}
+
+static bool_t
+bin_tile_validate(const uint8_t *buf, size_t sz, int lat, int lon)
+{
+	const odb_bin_hdr_t *hdr = (const odb_bin_hdr_t *)buf;
+	const uint32_t *cells = (const uint32_t *)&buf[sizeof (*hdr)];
+	const size_t idx_sz = (ODB_BIN_CELLS + 1) * sizeof (uint32_t);
+
+	if (sz < sizeof (*hdr) + idx_sz || hdr->magic != ODB_BIN_MAGIC ||
+	    hdr->version != ODB_BIN_VERSION || hdr->lat != lat ||
+	    hdr->lon != lon || hdr->grid != ODB_BIN_GRID ||
+	    (sz - sizeof (*hdr) - idx_sz) / sizeof (odb_bin_obst_t) !=
+	    hdr->n_obst ||
+	    (sz - sizeof (*hdr) - idx_sz) % sizeof (odb_bin_obst_t) != 0)
+		return (B_FALSE);
+	if (cells[0] != 0 || cells[ODB_BIN_CELLS] != hdr->n_obst)
+		return (B_FALSE);
+	for (unsigned i = 0; i < ODB_BIN_CELLS; i++) {
+		if (cells[i] > cells[i + 1])
+			return (B_FALSE);
+	}
+	return (B_TRUE);
+}
+
+/*
+ * Points a tile at its binary data. From here on, free_tile() takes care
+ * of releasing `buf'.
+ */
+static void
+bin_tile_attach(odb_tile_t *tile, uint8_t *buf, size_t sz, bool_t mapped)
+{
+	const odb_bin_hdr_t *hdr = (const odb_bin_hdr_t *)buf;
+
+	ASSERT(tile != NULL);
+	ASSERT(tile->bin == NULL);
+	ASSERT(buf != NULL);
+
+	tile->bin = buf;
+	tile->bin_sz = (mapped ? sz : 0);
+	tile->cells = (const uint32_t *)&buf[sizeof (*hdr)];
+	tile->bin_obst = (const odb_bin_obst_t *)
+	    &tile->cells[ODB_BIN_CELLS + 1];
+	tile->n_bin_obst = hdr->n_obst;
+}
+
+static bool_t
+bin_tile_write(const char *path, const uint8_t *buf, size_t sz)
+{
+	char *bin_path = sprintf_alloc("%s" ODB_BIN_SUFFIX, path);
+	FILE *fp = fopen(bin_path, "wb");
+	bool_t res;
+
+	if (fp == NULL) {
+		logMsg("Error writing obstacle database tile %s: %s",
+		    bin_path, strerror(errno));
+		free(bin_path);
+		return (B_FALSE);
+	}
+	res = (fwrite(buf, 1, sz, fp) == sz);
+	res &= (fclose(fp) == 0);
+	if (!res) {
+		logMsg("Error writing obstacle database tile %s: %s",
+		    bin_path, strerror(errno));
+		remove_file(bin_path, B_FALSE);
+	}
+	free(bin_path);
+
+	return (res);
+}
+
+/*
+ * A total order on obstacles. The order in which a refresh adds
+ * obstacles to a tile depends on how the DOF got split up between the
+ * parser threads, so tiles are sorted before being written out.
+ */
+static int
+obst_compar(const void *a, const void *b)
+{
+	const obst_t *oa = a, *ob = b;
+
+#define	CMP_FIELD(field) \
+	do { \
+		if (oa->field < ob->field) \
+			return (-1); \
+		if (oa->field > ob->field) \
+			return (1); \
+	} while (0)
+	CMP_FIELD(pos.lat);
+	CMP_FIELD(pos.lon);
+	CMP_FIELD(pos.elev);
+	CMP_FIELD(agl);
+	CMP_FIELD(type);
+	CMP_FIELD(light);
+	CMP_FIELD(quant);
+#undef	CMP_FIELD
+
+	return (0);
+}
+
 static bool_t
 write_tile(odb_t *odb, odb_tile_t *tile, const char *cc)
 {
@@ -430,6 +771,8 @@ write_tile(odb_t *odb, odb_tile_t *tile, const char *cc)
 	char *path, *dirpath, *p;
 	FILE *fp = NULL;
 	bool_t res = B_FALSE;
+	uint8_t *bin;
+	size_t bin_sz;
 
 	ASSERT(odb != NULL);
 	ASSERT(tile != NULL);
@@ -447,22 +790,29 @@ write_tile(odb_t *odb, odb_tile_t *tile, const char *cc)
 
 	if (!create_directory_recursive(dirpath))
 		goto errout;
+	qsort(tile->obst, tile->n_obst, sizeof (*tile->obst), obst_compar);
 	fp = fopen(path, "wb");
 	if (fp == NULL) {
 		logMsg("Error writing obstacle database tile %s: %s",
 		    path, strerror (errno));
 		goto errout;
 	}
-	for (obst_t *obst = list_head(&tile->obst); obst != NULL;
-	    obst = list_next(&tile->obst, obst)) {
+	for (size_t i = 0; i < tile->n_obst; i++) {
+		const obst_t *obst = &tile->obst[i];
+
 		fprintf(fp, ",,US,,,%f,%f,,,%s,%d,%.0f,%.0f,%c,1A,,,,\n",
 		    obst->pos.lat, obst->pos.lon, type2dof(obst->type),
 		    obst->quant, MET2FEET(obst->agl),
 		    MET2FEET(obst->pos.elev + obst->agl),
 		    light2dof(obst->light));
 	}
+	fclose(fp);
+	fp = NULL;
 
-	res = B_TRUE;
+	bin = bin_tile_build(tile->lat, tile->lon, tile->obst, tile->n_obst,
+	    &bin_sz);
+	res = bin_tile_write(path, bin, bin_sz);
+	free(bin);
 errout:
 	if (fp != NULL)
 		fclose(fp);
@@ -472,30 +822,76 @@ errout:
 	return (res);
 }
 
+static unsigned
+odb_refresh_threads(const odb_t *odb)
+{
+	ASSERT(odb != NULL);
+	return (odb->refresh_threads != 0 ? odb->refresh_threads :
+	    lacf_num_cpus());
+}
+
+typedef struct {
+	odb_t		*odb;
+	const char	*cc;
+	odb_tile_t	**tiles;
+	bool_t		failed;
+} write_tiles_t;
+
 static void
+write_tiles_range(void *userinfo, size_t begin, size_t end)
+{
+	write_tiles_t *wt = userinfo;
+
+	for (size_t i = begin; i < end; i++) {
+		if (!write_tile(wt->odb, wt->tiles[i], wt->cc))
+			__atomic_store_n(&wt->failed, B_TRUE, __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * Writes out all tiles built by a refresh. The tiles are independent
+ * files, so they are written in parallel.
+ */
+static bool_t
 odb_write_tiles(odb_t *odb, const char *cc)
 {
+	write_tiles_t wt = { .odb = odb, .cc = cc };
+	size_t n = avl_numnodes(&odb->new_tiles), i = 0;
+	unsigned n_threads = odb_refresh_threads(odb);
+	taskq_t *tq = NULL;
+
 	ASSERT(odb != NULL);
 	ASSERT_MUTEX_HELD(&odb->tiles_lock);
 	ASSERT(cc != NULL);
 
-	for (odb_tile_t *tile = avl_first(&odb->tiles); tile != NULL;
-	    tile = AVL_NEXT(&odb->tiles, tile)) {
-		if (!write_tile(odb, tile, cc))
-			break;
+	wt.tiles = safe_calloc(MAX(n, 1), sizeof (*wt.tiles));
+	for (odb_tile_t *tile = avl_first(&odb->new_tiles); tile != NULL;
+	    tile = AVL_NEXT(&odb->new_tiles, tile))
+		wt.tiles[i++] = tile;
+	/* The calling thread participates, so n - 1 workers suffice. */
+	if (n_threads > 1) {
+		tq = taskq_alloc2(0, MIN(n_threads - 1, TASKQ_WS_MAX_THREADS),
+		    0, NULL, NULL, NULL, NULL, NULL, TASKQ_FLAG_WORK_STEALING);
 	}
+	lacf_parallel_for(tq, 0, n, 1, write_tiles_range, &wt);
+	if (tq != NULL)
+		taskq_free(tq);
+	free(wt.tiles);
+
+	return (!wt.failed);
 }
 
 static void
-odb_flush_tiles(odb_t *odb)
+odb_flush_tiles(odb_t *odb, avl_tree_t *tiles)
 {
 	void *cookie = NULL;
 	odb_tile_t *tile;
 
 	ASSERT(odb != NULL);
 	ASSERT_MUTEX_HELD(&odb->tiles_lock);
+	ASSERT(tiles != NULL);
 
-	while ((tile = avl_destroy_nodes(&odb->tiles, &cookie)) != NULL)
+	while ((tile = avl_destroy_nodes(tiles, &cookie)) != NULL)
 		free_tile(tile);
 }
 
@@ -523,11 +919,303 @@ errout:
 	LACF_DESTROY(path);
 }
 
+/*
+ * DOF ingestion. The thread reading the DOF (which decompresses it on
+ * the fly) cuts it into chunks of whole lines and queues those up for a
+ * number of parser tasks. Each parser sorts the obstacles it parses into
+ * a private set of tiles, so the parsers don't contend for anything but
+ * the chunk queue. The queue is bounded, so the decompressed file never
+ * needs to be held in memory in full. Once the whole file has been read,
+ * the parsers' tiles are merged into odb->new_tiles.
+ */
+#define	DOF_CHUNK_SZ		(1 << 20)	/* bytes */
+#define	DOF_CHUNKS_PER_PARSER	2		/* max queued chunks */
+
+typedef struct {
+	char		*buf;
+	size_t		len;
+	list_node_t	node;
+} dof_chunk_t;
+
+typedef struct dof_ingest_s dof_ingest_t;
+
+typedef struct {
+	dof_ingest_t	*ing;
+	avl_tree_t	tiles;
+	odb_tile_t	*last;	/* DOFs are sorted, so usually a match */
+} dof_parser_t;
+
+struct dof_ingest_s {
+	bool_t		threaded;
+	mutex_t		lock;
+	condvar_t	cv;
+	list_t		chunks;
+	unsigned	max_chunks;
+	bool_t		eof;
+	unsigned	n_parsers;
+	dof_parser_t	*parsers;
+};
+
+static void
+dof_parse_chunk(dof_parser_t *parser, dof_chunk_t *chunk)
+{
+	char *line = chunk->buf, *end = &chunk->buf[chunk->len];
+
+	while (line < end) {
+		char *nl = memchr(line, '\n', end - line);
+		obst_t obst;
+
+		if (nl == NULL)
+			nl = end;
+		/* chunk buffers have room for this past the end */
+		*nl = '\0';
+		if (dof_parse_line(line, &obst)) {
+			int lat = floor(obst.pos.lat);
+			int lon = floor(obst.pos.lon);
+			odb_tile_t *tile = parser->last;
+
+			if (tile == NULL || tile->lat != lat ||
+			    tile->lon != lon) {
+				odb_tile_t srch = { .lat = lat, .lon = lon };
+				avl_index_t where;
+
+				tile = avl_find(&parser->tiles, &srch, &where);
+				if (tile == NULL) {
+					tile = safe_calloc(1, sizeof (*tile));
+					tile->lat = lat;
+					tile->lon = lon;
+					avl_insert(&parser->tiles, tile, where);
+				}
+				parser->last = tile;
+			}
+			tile_add_obst(tile, &obst);
+		}
+		line = &nl[1];
+	}
+	free(chunk->buf);
+	free(chunk);
+}
+
+static void
+dof_parser_run(void *arg)
+{
+	dof_parser_t *parser = arg;
+	dof_ingest_t *ing = parser->ing;
+
+	mutex_enter(&ing->lock);
+	for (;;) {
+		dof_chunk_t *chunk;
+
+		while (list_head(&ing->chunks) == NULL && !ing->eof)
+			cv_wait(&ing->cv, &ing->lock);
+		chunk = list_remove_head(&ing->chunks);
+		if (chunk == NULL)
+			break;
+		/* the reader might be waiting for room in the queue */
+		cv_broadcast(&ing->cv);
+		mutex_exit(&ing->lock);
+		dof_parse_chunk(parser, chunk);
+		mutex_enter(&ing->lock);
+	}
+	mutex_exit(&ing->lock);
+}
+
+static void
+dof_queue_chunk(dof_ingest_t *ing, dof_chunk_t *chunk)
+{
+	if (!ing->threaded) {
+		dof_parse_chunk(&ing->parsers[0], chunk);
+		return;
+	}
+	mutex_enter(&ing->lock);
+	while (list_count(&ing->chunks) >= ing->max_chunks)
+		cv_wait(&ing->cv, &ing->lock);
+	list_insert_tail(&ing->chunks, chunk);
+	cv_broadcast(&ing->cv);
+	mutex_exit(&ing->lock);
+}
+
+/*
+ * Moves the tiles built by a parser into odb->new_tiles, or frees them
+ * if `keep' is false.
+ */
+static void
+dof_merge_tiles(odb_t *odb, dof_parser_t *parser, bool_t keep)
+{
+	odb_tile_t *tile;
+
+	ASSERT_MUTEX_HELD(&odb->tiles_lock);
+
+	while ((tile = avl_first(&parser->tiles)) != NULL) {
+		odb_tile_t *dst;
+		avl_index_t where;
+
+		avl_remove(&parser->tiles, tile);
+		if (!keep) {
+			free_tile(tile);
+			continue;
+		}
+		dst = avl_find(&odb->new_tiles, tile, &where);
+		if (dst == NULL) {
+			tile->odb = odb;
+			avl_insert(&odb->new_tiles, tile, where);
+			continue;
+		}
+		for (size_t i = 0; i < tile->n_obst; i++)
+			tile_add_obst(dst, &tile->obst[i]);
+		free_tile(tile);
+	}
+	avl_destroy(&parser->tiles);
+}
+
+/*
+ * Reads a DOF file from `st' and sorts its obstacles into odb->new_tiles.
+ * If `run' is provided, reading is aborted as soon as it becomes false.
+ * @return B_TRUE if the whole file was read successfully.
+ */
+static bool_t
+dof_ingest(odb_t *odb, decompress_stream_t *st, const bool_t *run)
+{
+	dof_ingest_t ing = { .threaded = B_FALSE };
+	unsigned n_threads = odb_refresh_threads(odb);
+	taskq_t *tq = NULL;
+	taskq_group_t *grp = NULL;
+	char *carry = safe_malloc(DOF_CHUNK_SZ);
+	size_t carry_len = 0;
+	bool_t ok = B_TRUE;
+
+	ASSERT(odb != NULL);
+	ASSERT(st != NULL);
+
+	mutex_init(&ing.lock);
+	cv_init(&ing.cv);
+	list_create(&ing.chunks, sizeof (dof_chunk_t),
+	    offsetof(dof_chunk_t, node));
+	/* the reading thread does the decompression, the rest parse */
+	ing.n_parsers = clampi(n_threads - 1, 1, TASKQ_WS_MAX_THREADS);
+	ing.max_chunks = DOF_CHUNKS_PER_PARSER * ing.n_parsers;
+	ing.parsers = safe_calloc(ing.n_parsers, sizeof (*ing.parsers));
+	for (unsigned i = 0; i < ing.n_parsers; i++) {
+		ing.parsers[i].ing = &ing;
+		avl_create(&ing.parsers[i].tiles, tile_compar,
+		    sizeof (odb_tile_t), offsetof(odb_tile_t, node));
+	}
+	if (n_threads > 1) {
+		ing.threaded = B_TRUE;
+		tq = taskq_alloc2(0, ing.n_parsers, 0, NULL, NULL, NULL, NULL,
+		    NULL, 0);
+		grp = taskq_group_alloc(tq);
+		for (unsigned i = 0; i < ing.n_parsers; i++) {
+			taskq_group_submit(grp, dof_parser_run,
+			    &ing.parsers[i]);
+		}
+	}
+
+	for (;;) {
+		dof_chunk_t *chunk;
+		ssize_t n;
+		size_t len;
+
+		if (run != NULL && !*run) {
+			ok = B_FALSE;
+			break;
+		}
+		chunk = safe_calloc(1, sizeof (*chunk));
+		/* +1 for the NUL terminator dof_parse_chunk() appends */
+		chunk->buf = safe_malloc(DOF_CHUNK_SZ + 1);
+		memcpy(chunk->buf, carry, carry_len);
+		n = decompress_stream_read(st, &chunk->buf[carry_len],
+		    DOF_CHUNK_SZ - carry_len);
+		if (n <= 0) {
+			/* hand over any unterminated last line */
+			chunk->len = carry_len;
+			if (n < 0 || carry_len == 0) {
+				free(chunk->buf);
+				free(chunk);
+			} else {
+				dof_queue_chunk(&ing, chunk);
+			}
+			ok = (n == 0);
+			break;
+		}
+		/* hand over whole lines only, the rest goes into the next */
+		len = carry_len + n;
+		for (chunk->len = len; chunk->len > 0 &&
+		    chunk->buf[chunk->len - 1] != '\n'; chunk->len--)
+			;
+		if (chunk->len == 0 && len == DOF_CHUNK_SZ) {
+			/* not a DOF if a line doesn't fit into a chunk */
+			chunk->len = len;
+		}
+		carry_len = len - chunk->len;
+		memcpy(carry, &chunk->buf[chunk->len], carry_len);
+		if (chunk->len != 0) {
+			dof_queue_chunk(&ing, chunk);
+		} else {
+			free(chunk->buf);
+			free(chunk);
+		}
+	}
+
+	mutex_enter(&ing.lock);
+	ing.eof = B_TRUE;
+	cv_broadcast(&ing.cv);
+	mutex_exit(&ing.lock);
+	if (grp != NULL) {
+		taskq_group_free(grp);
+		taskq_free(tq);
+	}
+	ASSERT0(list_count(&ing.chunks));
+
+	mutex_enter(&odb->tiles_lock);
+	for (unsigned i = 0; i < ing.n_parsers; i++)
+		dof_merge_tiles(odb, &ing.parsers[i], ok);
+	mutex_exit(&odb->tiles_lock);
+
+	free(ing.parsers);
+	list_destroy(&ing.chunks);
+	cv_destroy(&ing.cv);
+	mutex_destroy(&ing.lock);
+	free(carry);
+
+	return (ok);
+}
+
+/*
+ * Replaces the on-disk tiles of `cc' with the tiles built by a refresh.
+ */
+static void
+odb_install_new_tiles(odb_t *odb, const char *cc, odb_region_t region)
+{
+	char *subpath = mkpathname(odb->cache_dir, cc, NULL);
+
+	ASSERT(odb != NULL);
+
+	mutex_enter(&odb->tiles_lock);
+
+	/* unmap the old binary tiles before we delete them */
+	odb_flush_tiles(odb, &odb->tiles);
+	if (file_exists(subpath, NULL))
+		remove_directory(subpath);
+	create_directory_recursive(odb->cache_dir);
+	if (!odb_write_tiles(odb, cc)) {
+		logMsg("Error updating obstacle database: failed to write "
+		    "some tiles of region \"%s\"", cc);
+	}
+	odb_flush_tiles(odb, &odb->new_tiles);
+	write_odb_refresh_date(odb, cc);
+
+	lacf_free(subpath);
+	odb->refresh_times[region] = time(NULL);
+
+	mutex_exit(&odb->tiles_lock);
+}
+
 static void
 odb_refresh_us_decompress(odb_t *odb, dl_info_t *dl_info)
 {
-	size_t len;
-	void *buf;
+	decompress_stream_t *st;
+	bool_t ok = B_FALSE;
 
 	ASSERT(odb != NULL);
 	ASSERT(dl_info != NULL);
@@ -537,35 +1225,27 @@ odb_refresh_us_decompress(odb_t *odb, dl_info_t *dl_info)
 		    "server didn't send any data", FAA_DOF_URL);
 		return;
 	}
-	buf = decompress_zip(dl_info->buf, dl_info->bufsz, &len);
-	if (buf != NULL) {
-		char *subpath = mkpathname(odb->cache_dir, "US", NULL);
+	st = decompress_stream_open_mem(dl_info->buf, dl_info->bufsz,
+	    DECOMPRESS_FMT_ZIP);
+	if (st != NULL) {
 		/*
-		 * The downloaded DOF is HUUUGE, so DON'T lock here.
-		 * add_obst_to_odb will lock the database when it's
-		 * ready to add a single obstacle instead.
+		 * The downloaded DOF is HUUUGE, so it's decompressed on the
+		 * fly and DON'T lock here. dof_ingest only locks the
+		 * database to merge in its results at the end.
 		 */
-		odb_proc_us_dof_impl(buf, len, add_obst_to_odb, odb);
-
-		mutex_enter(&odb->tiles_lock);
-
-		if (file_exists(subpath, NULL))
-			remove_directory(subpath);
-		create_directory_recursive(odb->cache_dir);
-		odb_write_tiles(odb, "US");
-		odb_flush_tiles(odb);
-		write_odb_refresh_date(odb, "US");
-
-		lacf_free(subpath);
-		odb->refresh_times[ODB_REGION_US] = time(NULL);
-
-		mutex_exit(&odb->tiles_lock);
-	} else {
+		ok = dof_ingest(odb, st, &odb->refresh_run);
+		decompress_stream_close(st);
+	}
+	if (ok) {
+		odb_install_new_tiles(odb, "US", ODB_REGION_US);
+	} else if (odb->refresh_run) {
+		/* dof_ingest has already dropped what it got until then */
 		logMsg("Error updating obstacle database from %s: "
 		    "failed to decompress downloaded ZIP file", FAA_DOF_URL);
+		mutex_enter(&odb->tiles_lock);
 		odb->refresh_times[ODB_REGION_US] = -1u;
+		mutex_exit(&odb->tiles_lock);
 	}
-	free(buf);
 }
 
 static void
@@ -661,55 +1341,104 @@ odb_refresh_cc(odb_t *odb, const char *cc)
 	return (B_TRUE);
 }
 
-static void
-add_tile_obst(obst_type_t type, geo_pos3_t pos, float agl,
-    obst_light_t light, unsigned quant, void *userinfo)
+/**
+ * Same as odb_refresh_cc(), but instead of downloading the obstacle data
+ * of the region, reads it from a local file, and does so synchronously.
+ * For "US", this is the FAA Digital Obstacle File in CSV format, either
+ * as is, or in the ZIP archive in which it is published.
+ *
+ * @return B_TRUE if the database was refreshed, B_FALSE if the region
+ *	isn't supported, the file couldn't be read, or a refresh is already
+ *	in progress.
+ */
+bool_t
+odb_refresh_cc_from_file(odb_t *odb, const char *cc, const char *path)
 {
-	odb_tile_t *tile;
-	obst_t *obst = safe_calloc(1, sizeof (*obst));
+	decompress_stream_t *st;
+	bool_t ok;
 
-	ASSERT(userinfo != NULL);
-	tile = userinfo;
-	ASSERT(tile->odb != NULL);
-	ASSERT_MUTEX_HELD(&tile->odb->tiles_lock);
+	ASSERT(odb != NULL);
+	ASSERT(cc != NULL);
+	ASSERT(path != NULL);
 
-	obst->type = type;
-	obst->pos = pos;
-	obst->agl = agl;
-	obst->light = light;
-	obst->quant = quant;
+	if (strcmp(cc, "US") != 0)
+		return (B_FALSE);
+	/* Holding refresh_lock keeps odb_refresh_cc from starting a refresh */
+	mutex_enter(&odb->refresh_lock);
+	if (odb->refresh_run) {
+		mutex_exit(&odb->refresh_lock);
+		return (B_FALSE);
+	}
+	st = decompress_stream_open(path, DECOMPRESS_FMT_AUTO);
+	if (st == NULL) {
+		logMsg("Error updating obstacle database from %s: can't open "
+		    "file", path);
+		mutex_exit(&odb->refresh_lock);
+		return (B_FALSE);
+	}
+	ok = dof_ingest(odb, st, NULL);
+	decompress_stream_close(st);
+	if (ok) {
+		odb_install_new_tiles(odb, cc, ODB_REGION_US);
+	} else {
+		logMsg("Error updating obstacle database from %s: error "
+		    "reading file", path);
+	}
+	mutex_exit(&odb->refresh_lock);
 
-	list_insert_tail(&tile->obst, obst);
+	return (ok);
 }
 
 static void
-add_obst_to_odb(obst_type_t type, geo_pos3_t pos, float agl,
+add_tile_obst(obst_type_t type, geo_pos3_t pos, float agl,
     obst_light_t light, unsigned quant, void *userinfo)
 {
-	odb_t *odb;
 	odb_tile_t *tile;
 
 	ASSERT(userinfo != NULL);
-	odb = userinfo;
+	tile = userinfo;
 
-	mutex_enter(&odb->tiles_lock);
-	tile = load_tile(odb, floor(pos.lat), floor(pos.lon), B_FALSE);
-	add_tile_obst(type, pos, agl, light, quant, tile);
-	mutex_exit(&odb->tiles_lock);
+	tile_add_obst(tile, &(obst_t){ .type = type, .pos = pos, .agl = agl,
+	    .light = light, .quant = quant });
 }
 
 static void
 odb_populate_tile_us(odb_t *odb, odb_tile_t *tile)
 {
 	char tilepath[32];
-	char *path;
+	char *path, *bin_path;
+	uint8_t *buf;
+	size_t sz;
 
 	ASSERT(odb != NULL);
 	ASSERT(tile != NULL);
 
 	latlon2path(tile->lat, tile->lon, tilepath);
 	path = mkpathname(odb->cache_dir, "US", tilepath, NULL);
+	bin_path = sprintf_alloc("%s" ODB_BIN_SUFFIX, path);
+
+	buf = file2mmap(bin_path, &sz);
+	if (buf != NULL) {
+		if (bin_tile_validate(buf, sz, tile->lat, tile->lon)) {
+			bin_tile_attach(tile, buf, sz, B_TRUE);
+			goto out;
+		}
+		logMsg("%s: invalid binary obstacle tile, regenerating it "
+		    "from text tile", bin_path);
+		file_unmap(buf, sz);
+	}
+	/* A tile without a text tile simply has no obstacles */
+	if (!file_exists(path, NULL))
+		goto out;
 	odb_proc_us_dof(path, add_tile_obst, tile);
+	buf = bin_tile_build(tile->lat, tile->lon, tile->obst, tile->n_obst,
+	    &sz);
+	LACF_DESTROY(tile->obst);
+	tile->n_obst = tile->cap_obst = 0;
+	bin_tile_write(path, buf, sz);
+	bin_tile_attach(tile, buf, sz, B_FALSE);
+out:
+	free(bin_path);
 	lacf_free(path);
 }
 
@@ -722,7 +1451,7 @@ odb_populate_tile(odb_t *odb, odb_tile_t *tile)
 }
 
 static odb_tile_t *
-load_tile(odb_t *odb, int lat, int lon, bool_t load_from_db)
+load_tile(odb_t *odb, int lat, int lon)
 {
 	odb_tile_t *tile;
 	odb_tile_t srch = { .lat = lat, .lon = lon };
@@ -737,19 +1466,24 @@ load_tile(odb_t *odb, int lat, int lon, bool_t load_from_db)
 		tile->odb = odb;
 		tile->lat = lat;
 		tile->lon = lon;
-		list_create(&tile->obst, sizeof (obst_t),
-		    offsetof(obst_t, node));
-
-		if (load_from_db)
-			odb_populate_tile(odb, tile);
+		odb_populate_tile(odb, tile);
 		avl_insert(&odb->tiles, tile, where);
 	}
-	if (load_from_db)
-		tile->access_t = time(NULL);
+	tile->access_t = time(NULL);
 
 	return (tile);
 }
 
+static inline void
+report_obst(const odb_bin_obst_t *obst, add_obst_cb_t cb, void *userinfo)
+{
+	float agl = FEET2MET(obst->agl);
+	geo_pos3_t pos = GEO_POS3(obst->lat / ODB_BIN_POS_SCALE,
+	    obst->lon / ODB_BIN_POS_SCALE, FEET2MET(obst->amsl) - agl);
+
+	cb(obst->type, pos, agl, obst->light, obst->quant, userinfo);
+}
+
 bool_t
 odb_get_obstacles(odb_t *odb, int lat, int lon, add_obst_cb_t cb,
     void *userinfo)
@@ -761,18 +1495,214 @@ odb_get_obstacles(odb_t *odb, int lat, int lon, add_obst_cb_t cb,
 
 	mutex_enter(&odb->tiles_lock);
 
-	tile = load_tile(odb, lat, lon, B_TRUE);
-	for (obst_t *obst = list_head(&tile->obst); obst != NULL;
-	    obst = list_next(&tile->obst, obst)) {
-		cb(obst->type, obst->pos, obst->agl, obst->light, obst->quant,
-		    userinfo);
-	}
+	tile = load_tile(odb, lat, lon);
+	for (unsigned i = 0; i < tile->n_bin_obst; i++)
+		report_obst(&tile->bin_obst[i], cb, userinfo);
 
 	mutex_exit(&odb->tiles_lock);
 
 	return (B_TRUE);
 }
 
+/*
+ * A spatial query. Candidate obstacles are picked from the grid cells
+ * overlapping a lat/lon bounding box and then tested precisely in a local
+ * flat-earth frame around `origin', with x pointing east and y north, in
+ * meters. Over the distances involved in obstacle awareness (a few dozen
+ * km at most), the error of that is negligible.
+ */
+typedef struct {
+	double		lat_min, lat_max;
+	double		lon_min, lon_max;	/* can extend past +-180 */
+	geo_pos2_t	origin;
+	double		cos_lat;
+	bool_t		corridor;
+	vect2_t		end;	/* corridor end point in the local frame */
+	double		dist_sq;	/* radius or half-width, squared */
+} odb_query_t;
+
+static inline double
+norm_lon_diff(double dlon)
+{
+	if (dlon > 180)
+		return (dlon - 360);
+	if (dlon < -180)
+		return (dlon + 360);
+	return (dlon);
+}
+
+static inline vect2_t
+query_proj(const odb_query_t *q, double lat, double lon)
+{
+	return (VECT2(DEG2RAD(norm_lon_diff(lon - q->origin.lon)) *
+	    q->cos_lat * EARTH_MSL, DEG2RAD(lat - q->origin.lat) * EARTH_MSL));
+}
+
+static inline bool_t
+query_match(const odb_query_t *q, vect2_t v)
+{
+	if (q->corridor) {
+		double len_sq = q->end.x * q->end.x + q->end.y * q->end.y;
+		double t = (len_sq > 0 ? clamp((v.x * q->end.x +
+		    v.y * q->end.y) / len_sq, 0, 1) : 0);
+
+		v.x -= t * q->end.x;
+		v.y -= t * q->end.y;
+	}
+	return (v.x * v.x + v.y * v.y <= q->dist_sq);
+}
+
+/*
+ * Sets up the bounding box of a query around the segment from `a' to `b'
+ * (a single point for a radius query), extended by `dist' meters.
+ */
+static void
+query_init(odb_query_t *q, geo_pos2_t a, geo_pos2_t b, double dist)
+{
+	double dlat = RAD2DEG(dist / EARTH_MSL) + 1e-6;
+	double lon_b = a.lon + norm_lon_diff(b.lon - a.lon);
+	double max_lat;
+
+	q->lat_min = MIN(a.lat, b.lat) - dlat;
+	q->lat_max = MAX(a.lat, b.lat) + dlat;
+	max_lat = MAX(fabs(q->lat_min), fabs(q->lat_max));
+	if (max_lat < 89.9) {
+		double dlon = dlat / cos(DEG2RAD(max_lat));
+
+		q->lon_min = MIN(a.lon, lon_b) - dlon;
+		q->lon_max = MAX(a.lon, lon_b) + dlon;
+	}
+	if (max_lat >= 89.9 || q->lon_max - q->lon_min >= 360) {
+		q->lon_min = -180;
+		q->lon_max = 180;
+	}
+	q->origin = a;
+	q->cos_lat = cos(DEG2RAD((a.lat + b.lat) / 2));
+	q->dist_sq = POW2(dist);
+}
+
+static size_t
+query_tile(const odb_query_t *q, const odb_tile_t *tile, int lon_unwrapped,
+    add_obst_cb_t cb, void *userinfo)
+{
+	int x0, x1, y0, y1;
+	size_t n = 0;
+
+	if (tile->n_bin_obst == 0)
+		return (0);
+	x0 = clampi(floor((q->lon_min - lon_unwrapped) * ODB_BIN_GRID), 0,
+	    ODB_BIN_GRID - 1);
+	x1 = clampi(floor((q->lon_max - lon_unwrapped) * ODB_BIN_GRID), 0,
+	    ODB_BIN_GRID - 1);
+	y0 = clampi(floor((q->lat_min - tile->lat) * ODB_BIN_GRID), 0,
+	    ODB_BIN_GRID - 1);
+	y1 = clampi(floor((q->lat_max - tile->lat) * ODB_BIN_GRID), 0,
+	    ODB_BIN_GRID - 1);
+
+	for (int y = y0; y <= y1; y++) {
+		for (int x = x0; x <= x1; x++) {
+			uint32_t cell = hilbert_idx(ODB_BIN_GRID_ORDER, x, y);
+
+			for (uint32_t i = tile->cells[cell];
+			    i < tile->cells[cell + 1]; i++) {
+				const odb_bin_obst_t *obst =
+				    &tile->bin_obst[i];
+
+				if (!query_match(q, query_proj(q,
+				    obst->lat / ODB_BIN_POS_SCALE,
+				    obst->lon / ODB_BIN_POS_SCALE)))
+					continue;
+				report_obst(obst, cb, userinfo);
+				n++;
+			}
+		}
+	}
+	return (n);
+}
+
+static size_t
+query_run(odb_t *odb, const odb_query_t *q, add_obst_cb_t cb,
+    void *userinfo)
+{
+	int lat_min = MAX(floor(q->lat_min), -90);
+	int lat_max = MIN(floor(q->lat_max), 89);
+	int lon_min = floor(q->lon_min);
+	int lon_max = MIN(floor(q->lon_max), lon_min + 359);
+	size_t n = 0;
+
+	mutex_enter(&odb->tiles_lock);
+	for (int lat = lat_min; lat <= lat_max; lat++) {
+		for (int lon = lon_min; lon <= lon_max; lon++) {
+			/* normalize the tile longitude to -180..179 */
+			int tile_lon = ((lon + 180) % 360 + 360) % 360 - 180;
+
+			n += query_tile(q, load_tile(odb, lat, tile_lon), lon,
+			    cb, userinfo);
+		}
+	}
+	mutex_exit(&odb->tiles_lock);
+
+	return (n);
+}
+
+/**
+ * Reports all obstacles within a radius of a point. Unlike with
+ * odb_get_obstacles(), only the parts of the tiles near the point are
+ * looked at, so this is cheap enough to call several times per second.
+ * The callback is invoked with the database locked, so it must not call
+ * back into the database.
+ * @param odb The obstacle database.
+ * @param center The center point of the query.
+ * @param radius Radius around `center' in meters.
+ * @param cb Callback invoked for each obstacle found.
+ * @param userinfo Optional argument for `cb'.
+ * @return The number of obstacles reported.
+ */
+size_t
+odb_get_obstacles_radius(odb_t *odb, geo_pos2_t center, double radius,
+    add_obst_cb_t cb, void *userinfo)
+{
+	odb_query_t q = { .corridor = B_FALSE };
+
+	ASSERT(odb != NULL);
+	ASSERT(is_valid_lat(center.lat));
+	ASSERT(is_valid_lon(center.lon));
+	ASSERT3F(radius, >=, 0);
+	ASSERT(cb != NULL);
+
+	query_init(&q, center, center, radius);
+	return (query_run(odb, &q, cb, userinfo));
+}
+
+/**
+ * Reports all obstacles within a corridor, such as along a planned or
+ * projected flight path. The corridor consists of all points within
+ * `half_width' of the great circle segment from `start' to `end' (which
+ * is approximated by a straight line in a local flat-earth frame, so
+ * the segment shouldn't be longer than a few dozen km). See
+ * odb_get_obstacles_radius() for the rest.
+ * @param half_width Distance from the center line in meters.
+ * @return The number of obstacles reported.
+ */
+size_t
+odb_get_obstacles_corridor(odb_t *odb, geo_pos2_t start, geo_pos2_t end,
+    double half_width, add_obst_cb_t cb, void *userinfo)
+{
+	odb_query_t q = { .corridor = B_TRUE };
+
+	ASSERT(odb != NULL);
+	ASSERT(is_valid_lat(start.lat));
+	ASSERT(is_valid_lon(start.lon));
+	ASSERT(is_valid_lat(end.lat));
+	ASSERT(is_valid_lon(end.lon));
+	ASSERT3F(half_width, >=, 0);
+	ASSERT(cb != NULL);
+
+	query_init(&q, start, end, half_width);
+	q.end = query_proj(&q, end.lat, end.lon);
+	return (query_run(odb, &q, cb, userinfo));
+}
+
 void
 odb_set_proxy(odb_t *odb, const char *proxy)
 {
@@ -28,20 +28,89 @@
 #include "acfutils/assert.h"
 #include "acfutils/list.h"
 #include "acfutils/safe_alloc.h"
+#include "acfutils/sysmacros.h"
 #include "acfutils/taskq.h"
 #include "acfutils/thread.h"
 #include "acfutils/time.h"
+#include "acfutils/tls.h"
 
-typedef struct {
+/*
+ * Maximum number of recycled task nodes we keep around per free list.
+ * Anything above this is returned to the heap.
+ */
+#define	TASKQ_MAX_FREE_NODES	1024
+#define	NO_DEADLINE		UINT64_MAX
+
+typedef enum {
+	TASK_QUEUED,
+	TASK_RUNNING,
+	TASK_DONE,
+	TASK_CANCELLED
+} task_state_t;
+
+typedef struct taskq_queue_s taskq_queue_t;
+
+/*
+ * Internal function tasks, used to implement task groups and
+ * lacf_parallel_for on top of any taskq, regardless of its proc_func.
+ * If the task is discarded rather than run, `discard' is set.
+ */
+typedef void (*task_func_t)(void *arg, bool discard);
+
+/*
+ * Task nodes double as the handles returned from taskq_submit2. A node
+ * holds one reference for being queued/running and one for each
+ * outstanding handle. It's recycled once the last reference is dropped.
+ */
+struct taskq_task_s {
 	void		*task;
+	task_func_t	func;		/* NULL for regular tasks */
+	uint64_t	deadline;	/* NO_DEADLINE if none was given */
+	taskq_queue_t	*q;		/* WS queue we're on, NULL if shared */
+	taskq_prio_t	prio;
+	unsigned	state;		/* atomic, task_state_t */
+	unsigned	refcnt;		/* atomic */
 	list_node_t	node;
-} taskq_task_t;
+};
+typedef struct taskq_task_s taskq_task_t;
+
+/* Common parameters of all the tasks in a single submission */
+typedef struct {
+	taskq_prio_t	prio;
+	uint64_t	deadline;
+	task_func_t	func;
+	taskq_task_t	**handle;	/* single task submissions only */
+} submit_args_t;
+
+/*
+ * Tasks of a single priority class. Tasks with a deadline are kept sorted
+ * by it and always run before tasks without a deadline.
+ */
+typedef struct {
+	list_t		dated;
+	list_t		undated;
+} task_list_t;
+
+/*
+ * In work-stealing mode, each worker thread owns one of these. The owner
+ * pushes & pops tasks at the tail (LIFO, which keeps recently produced
+ * data in cache), while other workers steal from the head (FIFO).
+ */
+struct taskq_queue_s {
+	mutex_t		lock;
+	task_list_t	tasks[TASKQ_NUM_PRIOS];
+	list_t		free;		/* recycled taskq_task_t nodes */
+	unsigned	n_tasks;	/* atomic, for lock-free peeking */
+	bool		owned;		/* protected by taskq_t.lock */
+};
 
 typedef struct {
 	taskq_t		*tq;
 	thread_t	thr;
 	void		*thr_info;
 	list_node_t	node;
+	taskq_queue_t	*q;		/* work-stealing mode only */
+	uint64_t	rand_state;	/* victim selection for stealing */
 } taskq_thr_t;
 
 struct taskq_s {
@@ -51,6 +120,7 @@ struct taskq_s {
 	taskq_proc_task_t	proc_func;
 	taskq_discard_task_t	discard_func;
 	void			*userinfo;
+	bool			ws;
 
 	mutex_t			lock;
 	/* protected by lock */
@@ -59,11 +129,183 @@ struct taskq_s {
 	uint64_t		thr_stop_delay_us;
 	condvar_t		cv;
 	bool			shutdown;
-	list_t			tasks;
+	task_list_t		tasks[TASKQ_NUM_PRIOS];
+	list_t			free_tasks;
 	list_t			threads;
 	unsigned		num_thr_ready;
+	/* threads blocked in taskq_wait wait on this */
+	condvar_t		done_cv;
+	unsigned		n_waiters;	/* atomic */
+
+	/*
+	 * Work-stealing mode state. The counters are atomic, so that
+	 * submitting a task only needs to take the global lock when a
+	 * worker needs to be woken up or spawned.
+	 */
+	taskq_queue_t		queues[TASKQ_WS_MAX_THREADS];
+	unsigned		n_queues;	/* atomic, high water mark */
+	unsigned		submit_rr;	/* atomic */
+	unsigned		n_pending;	/* atomic, queued tasks */
+	unsigned		n_sleeping;	/* atomic */
+	unsigned		n_threads;	/* atomic */
 };
 
+/* The worker thread we're running on, if any */
+static THREAD_LOCAL taskq_thr_t *taskq_curthr = NULL;
+
+static void taskq_worker(void *info);
+static void taskq_worker_ws(void *info);
+
+static void
+task_lists_create(task_list_t lists[TASKQ_NUM_PRIOS])
+{
+	for (int i = 0; i < TASKQ_NUM_PRIOS; i++) {
+		list_create(&lists[i].dated, sizeof (taskq_task_t),
+		    offsetof(taskq_task_t, node));
+		list_create(&lists[i].undated, sizeof (taskq_task_t),
+		    offsetof(taskq_task_t, node));
+	}
+}
+
+static void
+task_lists_insert(task_list_t lists[TASKQ_NUM_PRIOS], taskq_task_t *t)
+{
+	task_list_t *l = &lists[t->prio];
+
+	if (t->deadline == NO_DEADLINE) {
+		list_insert_tail(&l->undated, t);
+	} else {
+		taskq_task_t *prev;
+		/*
+		 * Deadlines are mostly submitted in increasing order, so
+		 * search for the insertion point from the tail.
+		 */
+		for (prev = list_tail(&l->dated); prev != NULL &&
+		    prev->deadline > t->deadline;
+		    prev = list_prev(&l->dated, prev))
+			;
+		list_insert_after(&l->dated, prev, t);
+	}
+}
+
+static void
+task_lists_remove(task_list_t lists[TASKQ_NUM_PRIOS], taskq_task_t *t)
+{
+	task_list_t *l = &lists[t->prio];
+	list_remove(t->deadline == NO_DEADLINE ? &l->undated : &l->dated, t);
+}
+
+/*
+ * Removes the most urgent task: highest priority class first, earliest
+ * deadline first within a class. Undated tasks are taken from the tail
+ * if `lifo' is set, otherwise from the head.
+ */
+static taskq_task_t *
+task_lists_pop(task_list_t lists[TASKQ_NUM_PRIOS], bool lifo)
+{
+	for (int i = 0; i < TASKQ_NUM_PRIOS; i++) {
+		task_list_t *l = &lists[i];
+		taskq_task_t *t;
+
+		if ((t = list_remove_head(&l->dated)) != NULL)
+			return (t);
+		t = (lifo ? list_remove_tail(&l->undated) :
+		    list_remove_head(&l->undated));
+		if (t != NULL)
+			return (t);
+	}
+	return (NULL);
+}
+
+static taskq_task_t *
+task_node_get(list_t *free_list, void *task, const submit_args_t *args)
+{
+	taskq_task_t *t = list_remove_head(free_list);
+
+	if (t == NULL)
+		t = safe_malloc(sizeof (*t));
+	t->task = task;
+	t->func = args->func;
+	t->deadline = args->deadline;
+	t->q = NULL;
+	t->prio = args->prio;
+	t->state = TASK_QUEUED;
+	t->refcnt = 1;
+	if (args->handle != NULL) {
+		t->refcnt++;
+		*args->handle = t;
+	}
+
+	return (t);
+}
+
+static void
+task_node_put(list_t *free_list, taskq_task_t *t)
+{
+	if (list_count(free_list) < TASKQ_MAX_FREE_NODES)
+		list_insert_head(free_list, t);
+	else
+		free(t);
+}
+
+static bool
+task_node_rele(taskq_task_t *t)
+{
+	return (__atomic_sub_fetch(&t->refcnt, 1, __ATOMIC_ACQ_REL) == 0);
+}
+
+static void
+task_node_list_destroy(list_t *free_list)
+{
+	taskq_task_t *t;
+
+	while ((t = list_remove_head(free_list)) != NULL)
+		free(t);
+	list_destroy(free_list);
+}
+
+/*
+ * Marks a task as finished (processed or cancelled) and wakes up anybody
+ * blocked on it in taskq_wait. `locked' indicates whether the caller
+ * already holds tq->lock.
+ */
+static void
+task_set_finished(taskq_t *tq, taskq_task_t *t, task_state_t state,
+    bool locked)
+{
+	ASSERT(state == TASK_DONE || state == TASK_CANCELLED);
+	/*
+	 * Pairs with the waiter incrementing n_waiters before re-checking
+	 * the task state, so either we see the waiter, or it sees us.
+	 */
+	__atomic_store_n(&t->state, state, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&tq->n_waiters, __ATOMIC_SEQ_CST) != 0) {
+		if (!locked)
+			mutex_enter(&tq->lock);
+		cv_broadcast(&tq->done_cv);
+		if (!locked)
+			mutex_exit(&tq->lock);
+	}
+}
+
+static void
+task_run(taskq_t *tq, taskq_thr_t *thr, taskq_task_t *task)
+{
+	if (task->func != NULL)
+		task->func(task->task, false);
+	else
+		tq->proc_func(tq->userinfo, thr->thr_info, task->task);
+}
+
+static void
+task_discard(taskq_t *tq, taskq_task_t *task)
+{
+	if (task->func != NULL)
+		task->func(task->task, true);
+	else
+		tq->discard_func(tq->userinfo, task->task);
+}
+
 static bool
 task_wait_for_work(taskq_t *tq)
 {
@@ -77,6 +319,73 @@ task_wait_for_work(taskq_t *tq)
 		return (true);
 	}
 }
+/*
+ * Must be called with tq->lock held. Spawns a new worker thread.
+ */
+static void
+spawn_worker(taskq_t *tq)
+{
+	taskq_thr_t *thr = safe_calloc(1, sizeof (*thr));
+
+	thr->tq = tq;
+	if (tq->ws) {
+		unsigned i;
+		/* Claim the lowest unowned queue */
+		for (i = 0; i < TASKQ_WS_MAX_THREADS; i++) {
+			if (!tq->queues[i].owned)
+				break;
+		}
+		VERIFY3U(i, <, TASKQ_WS_MAX_THREADS);
+		thr->q = &tq->queues[i];
+		thr->q->owned = true;
+		if (i >= tq->n_queues)
+			__atomic_store_n(&tq->n_queues, i + 1, __ATOMIC_RELEASE);
+		thr->rand_state = (((uintptr_t)thr) ^ microclock()) | 1;
+		__atomic_add_fetch(&tq->n_threads, 1, __ATOMIC_SEQ_CST);
+	}
+	list_insert_tail(&tq->threads, thr);
+	VERIFY(thread_create(&thr->thr, tq->ws ? taskq_worker_ws :
+	    taskq_worker, thr));
+}
+
+/*
+ * Must be called with tq->lock held, which will be dropped. Removes the
+ * calling worker thread from the taskq and frees it.
+ */
+static void
+worker_exit(taskq_thr_t *thr)
+{
+	taskq_t *tq = thr->tq;
+	/*
+	 * Cannot relinquish the lock here until we are completely removed
+	 * from the tq->threads list, otherwise taskq_submit might thing we
+	 * were just busy and we might still process work. But we are
+	 * definitely on our way out.
+	 */
+	if (tq->fini_func != NULL)
+		tq->fini_func(tq->userinfo, thr->thr_info);
+
+	ASSERT(list_link_active(&thr->node));
+	list_remove(&tq->threads, thr);
+	if (thr->q != NULL) {
+		/*
+		 * Any tasks left in our queue will be picked up by the
+		 * remaining workers via stealing.
+		 */
+		thr->q->owned = false;
+	}
+	if (list_count(&tq->threads) == 0)
+		cv_broadcast(&tq->cv);
+	/*
+	 * Mustn't touch `tq' after this, as on a taskq_free, it can become
+	 * freed after releasing this lock
+	 */
+	mutex_exit(&tq->lock);
+
+	taskq_curthr = NULL;
+	memset(thr, 0, sizeof (*thr));
+	free(thr);
+}
 
 static void
 taskq_worker(void *info)
@@ -88,8 +397,8 @@ taskq_worker(void *info)
 	thr = info;
 	ASSERT(thr->tq != NULL);
 	tq = thr->tq;
-	ASSERT(tq->proc_func != NULL);
 
+	taskq_curthr = thr;
 	if (tq->init_func != NULL)
 		thr->thr_info = tq->init_func(tq->userinfo);
 
@@ -101,7 +410,7 @@ taskq_worker(void *info)
 		/* Too many threads spawned? Stop. */
 		if (list_count(&tq->threads) > tq->num_threads_max)
 			break;
-		task = list_remove_head(&tq->tasks);
+		task = task_lists_pop(tq->tasks, false);
 		if (task == NULL) {
 			/* No work to be done */
 			if (task_wait_for_work(tq) ||
@@ -111,39 +420,229 @@ taskq_worker(void *info)
 				break;
 			}
 		}
+		__atomic_store_n(&task->state, TASK_RUNNING,
+		    __ATOMIC_RELEASE);
 		tq->num_thr_ready--;
 		mutex_exit(&tq->lock);
 
 		/* Process the task */
-		tq->proc_func(tq->userinfo, thr->thr_info, task->task);
-		free(task);
+		task_run(tq, thr, task);
 
 		mutex_enter(&tq->lock);
+		task_set_finished(tq, task, TASK_DONE, true);
+		if (task_node_rele(task))
+			task_node_put(&tq->free_tasks, task);
 		tq->num_thr_ready++;
 	}
 	ASSERT(tq->num_thr_ready != 0);
 	tq->num_thr_ready--;
-	/*
-	 * Cannot relinquish the lock here until we are completely removed
-	 * from the tq->threads list, otherwise taskq_submit might thing we
-	 * were just busy and we might still process work. But we are
-	 * definitely on our way out.
-	 */
-	if (tq->fini_func != NULL)
-		tq->fini_func(tq->userinfo, thr->thr_info);
 
-	ASSERT(list_link_active(&thr->node));
-	list_remove(&tq->threads, thr);
-	if (list_count(&tq->threads) == 0)
-		cv_broadcast(&tq->cv);
-	/*
-	 * Mustn't touch `tq' after this, as on a taskq_free, it can become
-	 * freed after releasing this lock
-	 */
+	worker_exit(thr);
+}
+
+/*
+ * Pushes a batch of tasks onto the tail of a work-stealing queue.
+ */
+static void
+ws_queue_push(taskq_t *tq, taskq_queue_t *q, void **tasks, size_t n,
+    const submit_args_t *args)
+{
+	mutex_enter(&q->lock);
+	for (size_t i = 0; i < n; i++) {
+		taskq_task_t *t = task_node_get(&q->free, tasks[i], args);
+		t->q = q;
+		task_lists_insert(q->tasks, t);
+	}
+	__atomic_add_fetch(&q->n_tasks, n, __ATOMIC_RELAXED);
+	mutex_exit(&q->lock);
+	/* Must be visible before the submitter checks for sleepers */
+	__atomic_add_fetch(&tq->n_pending, n, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Takes the most urgent task off a work-stealing queue. Undated tasks
+ * are taken from the tail if we're the queue's owner, or the head if
+ * we're stealing. As an optimization, the
+ * node of the previously executed task is recycled in the same critical
+ * section.
+ */
+static taskq_task_t *
+ws_queue_pop(taskq_t *tq, taskq_queue_t *q, bool steal,
+    taskq_task_t *recycle)
+{
+	taskq_task_t *t;
+
+	if (__atomic_load_n(&q->n_tasks, __ATOMIC_RELAXED) == 0 &&
+	    recycle == NULL) {
+		return (NULL);
+	}
+	mutex_enter(&q->lock);
+	if (recycle != NULL)
+		task_node_put(&q->free, recycle);
+	t = task_lists_pop(q->tasks, !steal);
+	if (t != NULL) {
+		__atomic_store_n(&t->state, TASK_RUNNING, __ATOMIC_RELEASE);
+		__atomic_sub_fetch(&q->n_tasks, 1, __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&tq->n_pending, 1, __ATOMIC_SEQ_CST);
+	}
+	mutex_exit(&q->lock);
+
+	return (t);
+}
+
+static taskq_task_t *
+ws_steal(taskq_t *tq, taskq_thr_t *thr)
+{
+	unsigned n_queues;
+	unsigned start;
+
+	if (__atomic_load_n(&tq->n_pending, __ATOMIC_SEQ_CST) == 0)
+		return (NULL);
+	n_queues = __atomic_load_n(&tq->n_queues, __ATOMIC_ACQUIRE);
+	/* xorshift64 - we just need to spread the thieves out */
+	thr->rand_state ^= thr->rand_state << 13;
+	thr->rand_state ^= thr->rand_state >> 7;
+	thr->rand_state ^= thr->rand_state << 17;
+	start = thr->rand_state % n_queues;
+	for (unsigned i = 0; i < n_queues; i++) {
+		taskq_queue_t *q = &tq->queues[(start + i) % n_queues];
+		taskq_task_t *t;
+
+		if (q == thr->q)
+			continue;
+		t = ws_queue_pop(tq, q, true, NULL);
+		if (t != NULL)
+			return (t);
+	}
+	return (NULL);
+}
+
+/*
+ * Wakes up sleeping workers, or spawns new ones if none are sleeping,
+ * to handle `n' newly submitted tasks. In the common case of all workers
+ * already being busy, this doesn't touch the global lock.
+ */
+static void
+ws_kick_workers(taskq_t *tq, size_t n)
+{
+	unsigned n_sleeping;
+
+	if (__atomic_load_n(&tq->n_sleeping, __ATOMIC_SEQ_CST) == 0 &&
+	    __atomic_load_n(&tq->n_threads, __ATOMIC_SEQ_CST) >=
+	    tq->num_threads_max) {
+		return;
+	}
+	mutex_enter(&tq->lock);
+	n_sleeping = tq->n_sleeping;
+	if (n <= n_sleeping) {
+		for (size_t i = 0; i < n; i++)
+			cv_signal(&tq->cv);
+	} else {
+		if (n_sleeping != 0)
+			cv_broadcast(&tq->cv);
+		for (size_t i = n_sleeping; i < n && !tq->shutdown &&
+		    tq->n_threads < tq->num_threads_max; i++) {
+			spawn_worker(tq);
+		}
+	}
 	mutex_exit(&tq->lock);
+}
 
-	memset(thr, 0, sizeof (*thr));
-	free(thr);
+/*
+ * Must be called with tq->lock held. Attempts to remove the calling
+ * worker from the active thread count. If work showed up concurrently
+ * (which the submitter might have missed, seeing us as still running),
+ * the removal is undone and we return false.
+ */
+static bool
+ws_try_exit(taskq_t *tq)
+{
+	__atomic_sub_fetch(&tq->n_threads, 1, __ATOMIC_SEQ_CST);
+	if (!tq->shutdown &&
+	    __atomic_load_n(&tq->n_pending, __ATOMIC_SEQ_CST) != 0) {
+		__atomic_add_fetch(&tq->n_threads, 1, __ATOMIC_SEQ_CST);
+		return (false);
+	}
+	return (true);
+}
+
+static void
+taskq_worker_ws(void *info)
+{
+	taskq_thr_t *thr;
+	taskq_t *tq;
+	taskq_task_t *recycle = NULL;
+	bool exited = false;
+
+	ASSERT(info != NULL);
+	thr = info;
+	ASSERT(thr->tq != NULL);
+	tq = thr->tq;
+	ASSERT(thr->q != NULL);
+
+	taskq_curthr = thr;
+	if (tq->init_func != NULL)
+		thr->thr_info = tq->init_func(tq->userinfo);
+
+	for (;;) {
+		taskq_task_t *task;
+		bool woken;
+
+		if (__atomic_load_n(&tq->shutdown, __ATOMIC_RELAXED)) {
+			mutex_enter(&tq->lock);
+			break;
+		}
+		task = ws_queue_pop(tq, thr->q, false, recycle);
+		recycle = NULL;
+		if (task == NULL)
+			task = ws_steal(tq, thr);
+		if (task != NULL) {
+			task_run(tq, thr, task);
+			task_set_finished(tq, task, TASK_DONE, false);
+			if (task_node_rele(task))
+				recycle = task;
+			continue;
+		}
+		/* No work to be done */
+		mutex_enter(&tq->lock);
+		if (tq->shutdown)
+			break;
+		/* Too many threads spawned? Stop. */
+		if (tq->n_threads > tq->num_threads_max) {
+			if (ws_try_exit(tq)) {
+				exited = true;
+				break;
+			}
+			mutex_exit(&tq->lock);
+			continue;
+		}
+		/*
+		 * Announce we're going to sleep and then recheck for work.
+		 * This pairs with ws_queue_push & ws_kick_workers, so that
+		 * either we see the new task, or the submitter sees us.
+		 */
+		__atomic_add_fetch(&tq->n_sleeping, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&tq->n_pending, __ATOMIC_SEQ_CST) != 0) {
+			__atomic_sub_fetch(&tq->n_sleeping, 1,
+			    __ATOMIC_SEQ_CST);
+			mutex_exit(&tq->lock);
+			continue;
+		}
+		woken = task_wait_for_work(tq);
+		__atomic_sub_fetch(&tq->n_sleeping, 1, __ATOMIC_SEQ_CST);
+		if (!woken && tq->n_threads > tq->num_threads_min &&
+		    ws_try_exit(tq)) {
+			exited = true;
+			break;
+		}
+		mutex_exit(&tq->lock);
+	}
+	/* On shutdown, we haven't been taken out of the thread count yet */
+	if (!exited)
+		__atomic_sub_fetch(&tq->n_threads, 1, __ATOMIC_SEQ_CST);
+	free(recycle);
+
+	worker_exit(thr);
 }
 
 taskq_t *
@@ -151,21 +650,55 @@ taskq_alloc(unsigned num_threads_min, unsigned num_threads_max,
     uint64_t thr_stop_delay_us, taskq_init_thr_t init_func,
     taskq_fini_thr_t fini_func, taskq_proc_task_t proc_func,
     taskq_discard_task_t discard_func, void *userinfo)
+{
+	return (taskq_alloc2(num_threads_min, num_threads_max,
+	    thr_stop_delay_us, init_func, fini_func, proc_func, discard_func,
+	    userinfo, 0));
+}
+
+taskq_t *
+taskq_alloc2(unsigned num_threads_min, unsigned num_threads_max,
+    uint64_t thr_stop_delay_us, taskq_init_thr_t init_func,
+    taskq_fini_thr_t fini_func, taskq_proc_task_t proc_func,
+    taskq_discard_task_t discard_func, void *userinfo, unsigned flags)
 {
 	taskq_t *tq = safe_calloc(1, sizeof (*tq));
 
 	ASSERT3U(num_threads_min, <=, num_threads_max);
 	ASSERT(num_threads_max != 0);
-	ASSERT(proc_func != NULL);
-	ASSERT(discard_func != NULL);
+	/*
+	 * A taskq without proc & discard callbacks can only be used with
+	 * task groups and lacf_parallel_for.
+	 */
+	ASSERT((proc_func == NULL) == (discard_func == NULL));
 
 	mutex_init(&tq->lock);
 	cv_init(&tq->cv);
-	list_create(&tq->tasks, sizeof (taskq_task_t),
+	cv_init(&tq->done_cv);
+	task_lists_create(tq->tasks);
+	list_create(&tq->free_tasks, sizeof (taskq_task_t),
 	    offsetof(taskq_task_t, node));
 	list_create(&tq->threads, sizeof (taskq_thr_t),
 	    offsetof(taskq_thr_t, node));
 
+	tq->ws = !!(flags & TASKQ_FLAG_WORK_STEALING);
+	if (tq->ws) {
+		num_threads_max = MIN(num_threads_max, TASKQ_WS_MAX_THREADS);
+		num_threads_min = MIN(num_threads_min, num_threads_max);
+		for (unsigned i = 0; i < TASKQ_WS_MAX_THREADS; i++) {
+			taskq_queue_t *q = &tq->queues[i];
+
+			mutex_init(&q->lock);
+			task_lists_create(q->tasks);
+			list_create(&q->free, sizeof (taskq_task_t),
+			    offsetof(taskq_task_t, node));
+		}
+		/*
+		 * Queue 0 always exists, so there's somewhere to put tasks
+		 * before the first worker has started up.
+		 */
+		tq->n_queues = 1;
+	}
 	tq->num_threads_min = num_threads_min;
 	tq->num_threads_max = num_threads_max;
 	tq->thr_stop_delay_us = thr_stop_delay_us;
@@ -178,18 +711,37 @@ taskq_alloc(unsigned num_threads_min, unsigned num_threads_max,
 	return (tq);
 }
 
-void
-taskq_free(taskq_t *tq)
+/*
+ * Discards all tasks in the list. Nodes which still have a handle
+ * pointing to them are left for taskq_handle_release to free.
+ */
+static void
+discard_task_lists(taskq_t *tq, task_list_t lists[TASKQ_NUM_PRIOS])
 {
 	taskq_task_t *task;
 
+	while ((task = task_lists_pop(lists, false)) != NULL) {
+		task_discard(tq, task);
+		__atomic_store_n(&task->state, TASK_CANCELLED,
+		    __ATOMIC_RELEASE);
+		if (task_node_rele(task))
+			free(task);
+	}
+	for (int i = 0; i < TASKQ_NUM_PRIOS; i++) {
+		list_destroy(&lists[i].dated);
+		list_destroy(&lists[i].undated);
+	}
+}
+
+void
+taskq_free(taskq_t *tq)
+{
 	ASSERT(tq != NULL);
-	ASSERT(tq->discard_func != NULL);
 	/*
 	 * Notify all parked workers to stop.
 	 */
 	mutex_enter(&tq->lock);
-	tq->shutdown = true;
+	__atomic_store_n(&tq->shutdown, true, __ATOMIC_RELAXED);
 	/* The worker threads will empty out the `tq->threads' list */
 	while (list_count(&tq->threads) != 0) {
 		cv_broadcast(&tq->cv);
@@ -198,46 +750,260 @@ taskq_free(taskq_t *tq)
 	mutex_exit(&tq->lock);
 	ASSERT0(list_count(&tq->threads));
 	list_destroy(&tq->threads);
+	ASSERT0(tq->n_waiters);
 	/*
 	 * Discard incomplete work.
 	 */
-	while ((task = list_remove_head(&tq->tasks)) != NULL) {
-		tq->discard_func(tq->userinfo, task->task);
-		free(task);
+	discard_task_lists(tq, tq->tasks);
+	task_node_list_destroy(&tq->free_tasks);
+	if (tq->ws) {
+		for (unsigned i = 0; i < TASKQ_WS_MAX_THREADS; i++) {
+			taskq_queue_t *q = &tq->queues[i];
+
+			ASSERT(!q->owned);
+			discard_task_lists(tq, q->tasks);
+			task_node_list_destroy(&q->free);
+			mutex_destroy(&q->lock);
+		}
 	}
-	list_destroy(&tq->tasks);
 	/*
 	 * Destroy threading primitives.
 	 */
+	cv_destroy(&tq->done_cv);
 	cv_destroy(&tq->cv);
 	mutex_destroy(&tq->lock);
 
 	free(tq);
 }
 
+static void
+ws_submit(taskq_t *tq, void **tasks, size_t n, const submit_args_t *args)
+{
+	taskq_thr_t *thr = taskq_curthr;
+
+	if (thr != NULL && thr->tq == tq) {
+		/*
+		 * Submitted from one of our own workers. Keep the work local,
+		 * idle workers will steal it if we can't keep up.
+		 */
+		ws_queue_push(tq, thr->q, tasks, n, args);
+	} else {
+		/*
+		 * External submitter, spread the batch over the active
+		 * queues, so thieves don't all converge on a single queue.
+		 */
+		unsigned n_queues = __atomic_load_n(&tq->n_queues,
+		    __ATOMIC_ACQUIRE);
+		size_t n_chunks = MIN(n, n_queues);
+		size_t chunk = (n + n_chunks - 1) / n_chunks;
+
+		for (size_t off = 0; off < n; off += chunk) {
+			unsigned qi = __atomic_fetch_add(&tq->submit_rr, 1,
+			    __ATOMIC_RELAXED) % n_queues;
+			ws_queue_push(tq, &tq->queues[qi], &tasks[off],
+			    MIN(chunk, n - off), args);
+		}
+	}
+	ws_kick_workers(tq, n);
+}
+
+static void
+submit_impl(taskq_t *tq, void **tasks, size_t n, const submit_args_t *args)
+{
+	ASSERT(tq != NULL);
+	ASSERT(tasks != NULL || n == 0);
+	ASSERT3S(args->prio, >=, 0);
+	ASSERT3S(args->prio, <, TASKQ_NUM_PRIOS);
+	ASSERT(args->handle == NULL || n == 1);
+	ASSERT(args->func != NULL || tq->proc_func != NULL);
+
+	if (n == 0)
+		return;
+	if (tq->ws) {
+		ws_submit(tq, tasks, n, args);
+		return;
+	}
+	mutex_enter(&tq->lock);
+	for (size_t i = 0; i < n; i++) {
+		taskq_task_t *t = task_node_get(&tq->free_tasks, tasks[i],
+		    args);
+		task_lists_insert(tq->tasks, t);
+	}
+	for (size_t i = 0; i < n; i++) {
+		if (i < tq->num_thr_ready) {
+			/* Only wake up a single worker per task */
+			cv_signal(&tq->cv);
+		} else if (list_count(&tq->threads) < tq->num_threads_max) {
+			/*
+			 * No worker ready and we can still add more,
+			 * spawn a new one.
+			 */
+			spawn_worker(tq);
+		} else {
+			break;
+		}
+	}
+	mutex_exit(&tq->lock);
+}
+
 void
 taskq_submit(taskq_t *tq, void *task)
 {
-	taskq_task_t *t = safe_calloc(1, sizeof (*t));
+	const submit_args_t args = {
+	    .prio = TASKQ_PRIO_NORMAL, .deadline = NO_DEADLINE
+	};
+	submit_impl(tq, &task, 1, &args);
+}
+
+/**
+ * Submits an array of tasks to a taskq in one go. This is equivalent to
+ * calling taskq_submit() on each element of `tasks', but only takes the
+ * taskq's locks once per batch, rather than once per task.
+ */
+void
+taskq_submit_batch(taskq_t *tq, void **tasks, size_t n)
+{
+	const submit_args_t args = {
+	    .prio = TASKQ_PRIO_NORMAL, .deadline = NO_DEADLINE
+	};
+	submit_impl(tq, tasks, n, &args);
+}
+
+/**
+ * Submits a task with an explicit priority class and optional deadline.
+ * Higher priority classes are always started first. Within a class,
+ * tasks with a deadline are started in earliest-deadline-first order,
+ * ahead of any tasks without a deadline.
+ *
+ * In work-stealing mode, this ordering is only best-effort, since it is
+ * only kept within each worker's queue: a worker picks the most urgent
+ * task from its own queue before attempting to steal from others.
+ *
+ * @param prio The priority class of the task.
+ * @param deadline_us Absolute deadline in microclock() time, or 0 if
+ *	the task has no deadline.
+ * @return A handle to the task, which can be passed to taskq_cancel()
+ *	and taskq_wait(). The handle must be released using
+ *	taskq_handle_release() once no longer needed.
+ */
+taskq_handle_t *
+taskq_submit2(taskq_t *tq, void *task, taskq_prio_t prio,
+    uint64_t deadline_us)
+{
+	taskq_task_t *handle = NULL;
+	const submit_args_t args = {
+	    .prio = prio,
+	    .deadline = (deadline_us != 0 ? deadline_us : NO_DEADLINE),
+	    .handle = &handle
+	};
+
+	submit_impl(tq, &task, 1, &args);
+	ASSERT(handle != NULL);
+
+	return (handle);
+}
+
+/**
+ * Attempts to withdraw a task submitted using taskq_submit2(). If the
+ * task hasn't been started yet, it's removed from the queue and passed
+ * to the taskq's discard callback (from the calling thread).
+ *
+ * @return True if the task was cancelled, false if it has already
+ *	started running, completed or had been cancelled before.
+ */
+bool
+taskq_cancel(taskq_t *tq, taskq_handle_t *handle)
+{
+	taskq_task_t *t = handle;
+	mutex_t *lock;
+	bool cancelled = false;
 
 	ASSERT(tq != NULL);
-	t->task = task;
+	ASSERT(t != NULL);
+	/* A queued task's queue never changes, so this is safe to read */
+	lock = (t->q != NULL ? &t->q->lock : &tq->lock);
 
-	mutex_enter(&tq->lock);
-	list_insert_tail(&tq->tasks, t);
-	if (tq->num_thr_ready != 0) {
-		/* Only wake up a single worker */
-		cv_signal(&tq->cv);
-	} else if (list_count(&tq->threads) < tq->num_threads_max) {
-		/* No worker ready and we can still add more, spawn a new one */
-		taskq_thr_t *thr = safe_calloc(1, sizeof (*thr));
-		thr->tq = tq;
-		list_insert_tail(&tq->threads, thr);
-		VERIFY(thread_create(&thr->thr, taskq_worker, thr));
+	mutex_enter(lock);
+	if (__atomic_load_n(&t->state, __ATOMIC_ACQUIRE) == TASK_QUEUED) {
+		if (t->q != NULL) {
+			task_lists_remove(t->q->tasks, t);
+			__atomic_sub_fetch(&t->q->n_tasks, 1,
+			    __ATOMIC_RELAXED);
+			__atomic_sub_fetch(&tq->n_pending, 1,
+			    __ATOMIC_SEQ_CST);
+		} else {
+			task_lists_remove(tq->tasks, t);
+		}
+		__atomic_store_n(&t->state, TASK_RUNNING, __ATOMIC_RELEASE);
+		cancelled = true;
+	}
+	mutex_exit(lock);
+
+	if (cancelled) {
+		task_discard(tq, t);
+		task_set_finished(tq, t, TASK_CANCELLED, false);
+		/* The caller's handle still holds a reference */
+		VERIFY(!task_node_rele(t));
 	}
+
+	return (cancelled);
+}
+
+/**
+ * Blocks until a task submitted using taskq_submit2() has either been
+ * processed, or has been cancelled.
+ *
+ * Beware of calling this from within the taskq's own worker threads: if
+ * all workers end up waiting on tasks which are still queued, the taskq
+ * deadlocks.
+ */
+void
+taskq_wait(taskq_t *tq, taskq_handle_t *handle)
+{
+	ASSERT(tq != NULL);
+	ASSERT(handle != NULL);
+
+	if (taskq_is_done(handle))
+		return;
+	mutex_enter(&tq->lock);
+	__atomic_add_fetch(&tq->n_waiters, 1, __ATOMIC_SEQ_CST);
+	while (!taskq_is_done(handle))
+		cv_wait(&tq->done_cv, &tq->lock);
+	__atomic_sub_fetch(&tq->n_waiters, 1, __ATOMIC_SEQ_CST);
 	mutex_exit(&tq->lock);
 }
 
+/**
+ * @return True if the task has either finished processing, or has been
+ *	cancelled. Doesn't block.
+ */
+bool
+taskq_is_done(const taskq_handle_t *handle)
+{
+	unsigned state;
+
+	ASSERT(handle != NULL);
+	state = __atomic_load_n(&handle->state, __ATOMIC_SEQ_CST);
+
+	return (state == TASK_DONE || state == TASK_CANCELLED);
+}
+
+/**
+ * Releases a task handle returned from taskq_submit2(). This doesn't
+ * affect the task itself. The handle must not be used after this.
+ */
+void
+taskq_handle_release(taskq_handle_t *handle)
+{
+	ASSERT(handle != NULL);
+	/*
+	 * If the task is still queued or running, the taskq will free the
+	 * node once done with it.
+	 */
+	if (task_node_rele(handle))
+		free(handle);
+}
+
 bool
 taskq_wants_shutdown(taskq_t *tq)
 {
@@ -274,6 +1040,8 @@ void
 taskq_set_num_threads_max(taskq_t *tq, unsigned num_threads_max)
 {
 	ASSERT(tq != NULL);
+	if (tq->ws)
+		num_threads_max = MIN(num_threads_max, TASKQ_WS_MAX_THREADS);
 	if (tq->num_threads_max != num_threads_max) {
 		mutex_enter(&tq->lock);
 		tq->num_threads_max = num_threads_max;
@@ -307,3 +1075,298 @@ taskq_get_thr_stop_delay(const taskq_t *tq)
 	ASSERT(tq != NULL);
 	return (tq->thr_stop_delay_us);
 }
+
+static void
+submit_funcs(taskq_t *tq, task_func_t func, void **args, size_t n)
+{
+	const submit_args_t sa = {
+	    .prio = TASKQ_PRIO_NORMAL, .deadline = NO_DEADLINE, .func = func
+	};
+	submit_impl(tq, args, n, &sa);
+}
+
+typedef struct {
+	taskq_group_func_t	func;
+	void			*arg;
+	list_node_t		node;
+} group_item_t;
+
+/*
+ * Items submitted to a group are kept in the group itself. For each item,
+ * a "ticket" task is submitted to the taskq, which runs whichever item is
+ * next in line. The joining thread runs items directly off the group's
+ * list, so any tickets which arrive after it has emptied the list just
+ * drop their reference to the group.
+ */
+struct taskq_group_s {
+	taskq_t		*tq;
+	mutex_t		lock;
+	condvar_t	cv;
+	list_t		items;		/* not yet started */
+	unsigned	n_running;	/* protected by lock */
+	unsigned	refcnt;		/* atomic, owner + queued tickets */
+};
+
+static void
+group_rele(taskq_group_t *grp)
+{
+	if (__atomic_sub_fetch(&grp->refcnt, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	ASSERT0(list_count(&grp->items));
+	list_destroy(&grp->items);
+	cv_destroy(&grp->cv);
+	mutex_destroy(&grp->lock);
+	free(grp);
+}
+
+static bool
+group_run_one(taskq_group_t *grp)
+{
+	group_item_t *item;
+
+	mutex_enter(&grp->lock);
+	item = list_remove_head(&grp->items);
+	if (item == NULL) {
+		mutex_exit(&grp->lock);
+		return (false);
+	}
+	grp->n_running++;
+	mutex_exit(&grp->lock);
+
+	item->func(item->arg);
+	free(item);
+
+	mutex_enter(&grp->lock);
+	ASSERT(grp->n_running != 0);
+	grp->n_running--;
+	if (grp->n_running == 0 && list_count(&grp->items) == 0)
+		cv_broadcast(&grp->cv);
+	mutex_exit(&grp->lock);
+
+	return (true);
+}
+
+static void
+group_ticket(void *arg, bool discard)
+{
+	taskq_group_t *grp = arg;
+
+	if (!discard)
+		group_run_one(grp);
+	group_rele(grp);
+}
+
+/**
+ * Creates a task group. A task group lets you submit a set of functions
+ * to run on a taskq and then wait for all of them to complete using
+ * taskq_group_join(). Groups can be used with any taskq, regardless of
+ * its processing callback. The group must be freed using
+ * taskq_group_free().
+ */
+taskq_group_t *
+taskq_group_alloc(taskq_t *tq)
+{
+	taskq_group_t *grp = safe_calloc(1, sizeof (*grp));
+
+	ASSERT(tq != NULL);
+	grp->tq = tq;
+	mutex_init(&grp->lock);
+	cv_init(&grp->cv);
+	list_create(&grp->items, sizeof (group_item_t),
+	    offsetof(group_item_t, node));
+	grp->refcnt = 1;
+
+	return (grp);
+}
+
+/**
+ * Joins the group and frees it.
+ */
+void
+taskq_group_free(taskq_group_t *grp)
+{
+	ASSERT(grp != NULL);
+	taskq_group_join(grp);
+	group_rele(grp);
+}
+
+/**
+ * Submits `func' to be called with `arg' on the group's taskq. It is
+ * safe to submit further work to a group from within a function that is
+ * running as part of the same group.
+ */
+void
+taskq_group_submit(taskq_group_t *grp, taskq_group_func_t func, void *arg)
+{
+	group_item_t *item = safe_malloc(sizeof (*item));
+	void *ticket = grp;
+
+	ASSERT(grp != NULL);
+	ASSERT(func != NULL);
+	item->func = func;
+	item->arg = arg;
+
+	__atomic_add_fetch(&grp->refcnt, 1, __ATOMIC_RELAXED);
+	mutex_enter(&grp->lock);
+	list_insert_tail(&grp->items, item);
+	/* A joiner might be waiting for a running item to finish */
+	cv_broadcast(&grp->cv);
+	mutex_exit(&grp->lock);
+
+	submit_funcs(grp->tq, group_ticket, &ticket, 1);
+}
+
+/**
+ * Waits for all functions submitted to the group to complete. Rather
+ * than just blocking, the calling thread runs any functions which haven't
+ * been picked up by the taskq's workers yet, so it's safe to join a group
+ * from within one of the taskq's own worker threads. After this returns,
+ * the group can be reused.
+ */
+void
+taskq_group_join(taskq_group_t *grp)
+{
+	ASSERT(grp != NULL);
+
+	for (;;) {
+		while (group_run_one(grp))
+			;
+		mutex_enter(&grp->lock);
+		if (list_count(&grp->items) == 0) {
+			if (grp->n_running == 0) {
+				mutex_exit(&grp->lock);
+				break;
+			}
+			cv_wait(&grp->cv, &grp->lock);
+		}
+		mutex_exit(&grp->lock);
+	}
+}
+
+/*
+ * Maximum number of helper tasks a single lacf_parallel_for submits.
+ */
+#define	PARALLEL_FOR_MAX_HELPERS	64
+
+typedef struct {
+	lacf_parallel_for_func_t	fn;
+	void				*userinfo;
+	size_t				begin;
+	size_t				end;
+	size_t				grain;
+	size_t				n_chunks;
+	size_t				next_chunk;	/* atomic */
+	size_t				chunks_done;	/* atomic */
+	unsigned			refcnt;		/* atomic */
+	mutex_t				lock;
+	condvar_t			cv;
+} parallel_for_t;
+
+static void
+parallel_for_rele(parallel_for_t *pf)
+{
+	if (__atomic_sub_fetch(&pf->refcnt, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	cv_destroy(&pf->cv);
+	mutex_destroy(&pf->lock);
+	free(pf);
+}
+
+/*
+ * Grabs chunks off the range until there are none left.
+ */
+static void
+parallel_for_run(parallel_for_t *pf)
+{
+	for (;;) {
+		size_t chunk = __atomic_fetch_add(&pf->next_chunk, 1,
+		    __ATOMIC_RELAXED);
+		size_t begin, end;
+
+		if (chunk >= pf->n_chunks)
+			break;
+		begin = pf->begin + chunk * pf->grain;
+		end = MIN(begin + pf->grain, pf->end);
+		pf->fn(pf->userinfo, begin, end);
+		if (__atomic_add_fetch(&pf->chunks_done, 1,
+		    __ATOMIC_ACQ_REL) == pf->n_chunks) {
+			mutex_enter(&pf->lock);
+			cv_broadcast(&pf->cv);
+			mutex_exit(&pf->lock);
+		}
+	}
+}
+
+static void
+parallel_for_helper(void *arg, bool discard)
+{
+	parallel_for_t *pf = arg;
+
+	if (!discard)
+		parallel_for_run(pf);
+	parallel_for_rele(pf);
+}
+
+/**
+ * Calls `fn' over the range [begin, end), split up into chunks of `grain'
+ * elements, in parallel on the worker threads of `tq'. The calling thread
+ * participates in processing the chunks and returns once all of them have
+ * been processed. As such, this is safe to call from within the taskq's
+ * own worker threads (including from nested parallel loops).
+ *
+ * @param tq The taskq to run on. If NULL, the loop is run serially on
+ *	the calling thread.
+ * @param grain Number of elements passed to each invocation of `fn'. If
+ *	0, a grain size is picked to give each worker a few chunks.
+ * @param fn Callback invoked with a sub-range [begin, end) to process.
+ */
+void
+lacf_parallel_for(taskq_t *tq, size_t begin, size_t end, size_t grain,
+    lacf_parallel_for_func_t fn, void *userinfo)
+{
+	parallel_for_t *pf;
+	size_t n_chunks, n_helpers;
+	void *helpers[PARALLEL_FOR_MAX_HELPERS];
+
+	ASSERT(fn != NULL);
+	ASSERT3U(begin, <=, end);
+
+	if (begin == end)
+		return;
+	if (grain == 0) {
+		unsigned n_thr = (tq != NULL ? tq->num_threads_max : 1);
+		grain = MAX((end - begin) / (4 * (n_thr + 1)), 1);
+	}
+	n_chunks = (end - begin + grain - 1) / grain;
+	n_helpers = (tq != NULL ? MIN(MIN(n_chunks - 1, tq->num_threads_max),
+	    PARALLEL_FOR_MAX_HELPERS) : 0);
+	if (n_helpers == 0) {
+		for (size_t b = begin; b < end; b += MIN(grain, end - b))
+			fn(userinfo, b, b + MIN(grain, end - b));
+		return;
+	}
+
+	pf = safe_calloc(1, sizeof (*pf));
+	pf->fn = fn;
+	pf->userinfo = userinfo;
+	pf->begin = begin;
+	pf->end = end;
+	pf->grain = grain;
+	pf->n_chunks = n_chunks;
+	pf->refcnt = n_helpers + 1;
+	mutex_init(&pf->lock);
+	cv_init(&pf->cv);
+	for (size_t i = 0; i < n_helpers; i++)
+		helpers[i] = pf;
+	submit_funcs(tq, parallel_for_helper, helpers, n_helpers);
+
+	parallel_for_run(pf);
+	/* Wait for chunks still being processed by the helpers */
+	mutex_enter(&pf->lock);
+	while (__atomic_load_n(&pf->chunks_done, __ATOMIC_ACQUIRE) <
+	    pf->n_chunks) {
+		cv_wait(&pf->cv, &pf->lock);
+	}
+	mutex_exit(&pf->lock);
+	parallel_for_rele(pf);
+}
@@ -0,0 +1,979 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+
+/*
+ * Times the airport database cache rebuild with 1 to N threads and checks
+ * that every multi-threaded rebuild produces a cache which is byte-for-byte
+ * identical to the single-threaded one. It then times loading all airports
+ * from the text and from the binary cache, along with the memory they
+ * take up and the time to unload them again, and checks that both load the
+ * same data. It also measures the memory taken up by just the tiles, with
+ * none of their airports loaded. Finally, it compares nearest airport
+ * queries through the airport index's spatial index against the tile scan
+ * done by adb_find_nearest_airports, and against a brute-force search of
+ * the index. It also flies a simulated route with synchronous and
+ * asynchronous tile loading side by side, comparing the time spent per
+ * frame and the airports found. If no X-Plane directory is given on the
+ * command line, a synthetic one is generated in /tmp, with a few custom
+ * scenery packs overriding airports in the global apt.dat. On the
+ * synthetic directory, it then also modifies some of the scenery and
+ * checks that incrementally updating an existing cache produces the same
+ * cache as a full rebuild.
+ *
+ * Usage: adbbench [-t max_threads] [xpdir]
+ */
+
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef	__GLIBC__
+#include <malloc.h>
+#endif
+
+#include <acfutils/airportdb.h>
+#include <acfutils/assert.h>
+#include <acfutils/helpers.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/thread.h>
+#include <acfutils/time.h>
+
+enum { SYNTH_AIRPORTS = 40000, SYNTH_PACKS = 3 };
+enum { NEAREST_QUERIES = 5000, NEAREST_REPEAT = 10, NEAREST_K = 8 };
+enum { FLIGHT_FRAMES = 4000, FLIGHT_STEP = 1000 /* meters */ };
+/* small enough for the flight to go over it, so tiles get evicted */
+enum { TILE_MEM_BUDGET = 256 << 10 };
+
+static void
+log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+static void
+gen_airport(FILE *fp, unsigned i, unsigned variant)
+{
+	double lat = (rand() % 16000) / 100.0 - 80;
+	double lon = (rand() % 35000) / 100.0 - 175;
+
+	fprintf(fp, "1 %d 0 0 X%05u %s Airport %u\n", rand() % 5000, i,
+	    (i % 5 == 0 ? "Z\xc3\xbcrich" : "Some"), variant);
+	for (int r = 0, n = 1 + rand() % 4; r < n; r++) {
+		fprintf(fp, "100 45.00 %d 0 0.25 1 2 1 "
+		    "%02d %.8f %.8f %d.00 0.00 3 0 0 1 "
+		    "%02d %.8f %.8f 0.00 0.00 3 0 0 1\n", 1 + rand() % 3,
+		    r * 4 + 1, lat + r * 0.001, lon, rand() % 300, r * 4 + 19,
+		    lat + r * 0.001 + 0.02, lon + 0.01);
+	}
+	fprintf(fp, "1051 %d TWR\n1050 %d ATIS\n", 118000 + rand() % 10000,
+	    121000 + rand() % 10000);
+	for (int g = 0, n = rand() % 4; g < n; g++) {
+		fprintf(fp, "1300 %.8f %.8f %.2f gate jets Gate %c%d\n",
+		    lat + 0.0001 * g, lon, (rand() % 3600) / 10.0,
+		    'A' + variant, g);
+	}
+	if (variant == 0 || rand() % 2 == 0) {
+		fprintf(fp, "1302 city Town %u\n1302 country Nowhere\n"
+		    "1302 iata_code %c%c%c\n1302 transition_alt %d\n", variant,
+		    'A' + rand() % 26, 'A' + rand() % 26, 'A' + rand() % 26,
+		    1000 * (3 + rand() % 15));
+	}
+	fprintf(fp, "1302 region_code R%u\n\n", variant);
+}
+
+static void
+gen_apt_dat(const char *xpdir, const char *pack, unsigned variant,
+    unsigned step)
+{
+	char *dirname, *fname;
+	FILE *fp;
+
+	if (pack != NULL) {
+		dirname = mkpathname(xpdir, "Custom Scenery", pack,
+		    "Earth nav data", NULL);
+	} else {
+		dirname = mkpathname(xpdir, "Global Scenery",
+		    "Global Airports", "Earth nav data", NULL);
+	}
+	VERIFY(create_directory_recursive(dirname));
+	fname = mkpathname(dirname, "apt.dat", NULL);
+	fp = fopen(fname, "w");
+	VERIFY(fp != NULL);
+	fprintf(fp, "I\n1100 Generated\n\n");
+	for (unsigned i = variant; i < SYNTH_AIRPORTS; i += step)
+		gen_airport(fp, i, variant);
+	fprintf(fp, "99\n");
+	fclose(fp);
+	free(fname);
+	free(dirname);
+}
+
+static char *
+gen_xpdir(void)
+{
+	char *xpdir = safe_strdup("/tmp/adbbench-XXXXXX");
+	char *path;
+	FILE *fp;
+
+	VERIFY(mkdtemp(xpdir) != NULL);
+	srand(1);
+	path = mkpathname(xpdir, "Custom Scenery", NULL);
+	VERIFY(create_directory_recursive(path));
+	free(path);
+	path = mkpathname(xpdir, "Custom Scenery", "scenery_packs.ini", NULL);
+	fp = fopen(path, "w");
+	VERIFY(fp != NULL);
+	fprintf(fp, "I\n1000 Version\nSCENERY\n\n");
+	for (unsigned i = 1; i <= SYNTH_PACKS; i++) {
+		char pack[16];
+
+		snprintf(pack, sizeof (pack), "Pack%u", i);
+		fprintf(fp, "SCENERY_PACK Custom Scenery/%s/\n", pack);
+		gen_apt_dat(xpdir, pack, i, 7 * i);
+	}
+	fclose(fp);
+	free(path);
+	gen_apt_dat(xpdir, NULL, 0, 1);
+	path = mkpathname(xpdir, "Resources", "default data", "CIFP", NULL);
+	VERIFY(create_directory_recursive(path));
+	free(path);
+
+	return (xpdir);
+}
+
+static double
+rebuild(const char *xpdir, const char *cachedir, unsigned n_threads)
+{
+	airportdb_t db = { .inited = B_FALSE };
+	uint64_t start;
+
+	airportdb_create(&db, xpdir, cachedir);
+	db.ifr_only = B_FALSE;
+	adb_set_rebuild_threads(&db, n_threads);
+	start = nanoclock();
+	VERIFY(adb_recreate_cache(&db, 0));
+	start = nanoclock() - start;
+	airportdb_destroy(&db);
+
+	return (NSEC2SEC((double)start));
+}
+
+typedef struct {
+	char		**idents;
+	size_t		n_idents;
+} idents_t;
+
+static void
+add_ident(const arpt_index_t *idx, void *userinfo)
+{
+	idents_t *ids = userinfo;
+	ids->idents[ids->n_idents++] = safe_strdup(idx->ident);
+}
+
+static airportdb_t *
+open_cache(const char *xpdir, const char *cachedir, bool_t binary)
+{
+	airportdb_t *db = safe_calloc(1, sizeof (*db));
+
+	airportdb_create(db, xpdir, cachedir);
+	db->ifr_only = B_FALSE;
+	db->binary_cache = binary;
+	VERIFY(adb_recreate_cache(db, 0));
+
+	return (db);
+}
+
+static double
+load_all(airportdb_t *db, const idents_t *ids)
+{
+	uint64_t start = nanoclock();
+
+	for (size_t i = 0; i < ids->n_idents; i++)
+		VERIFY(adb_airport_lookup_by_ident(db, ids->idents[i]) != NULL);
+
+	return (NSEC2SEC((double)(nanoclock() - start)));
+}
+
+static double
+unload_all(airportdb_t *db)
+{
+	uint64_t start = nanoclock();
+
+	adb_unload_distant_airport_tiles(db, NULL_GEO_POS2);
+
+	return (NSEC2SEC((double)(nanoclock() - start)));
+}
+
+/*
+ * Resident set size of the process in bytes, or 0 if it can't be read.
+ * Free heap memory is handed back to the OS first. Otherwise, whichever
+ * load is measured first quietly reuses memory freed by the benchmarks
+ * before it and comes out looking smaller.
+ */
+static size_t
+rss_bytes(void)
+{
+	FILE *fp;
+	unsigned long size, resident;
+
+#ifdef	__GLIBC__
+	malloc_trim(0);
+#endif
+	fp = fopen("/proc/self/statm", "r");
+	if (fp == NULL)
+		return (0);
+	if (fscanf(fp, "%lu %lu", &size, &resident) != 2)
+		resident = 0;
+	fclose(fp);
+
+	return (resident * sysconf(_SC_PAGESIZE));
+}
+
+/*
+ * Bytes of heap memory allocated, or 0 if we can't tell. Unlike the RSS,
+ * this also counts allocated pages which haven't been touched yet.
+ */
+static size_t
+heap_bytes(void)
+{
+#ifdef	__GLIBC__
+	struct mallinfo2 mi = mallinfo2();
+
+	return (mi.uordblks + mi.hblkhd);
+#else
+	return (0);
+#endif
+}
+
+#define	CHECK_FIELD(a, b, field) \
+	VERIFY0(memcmp(&(a)->field, &(b)->field, sizeof ((a)->field)))
+#define	CHECK_STR(a, b, field) \
+	do { \
+		VERIFY(((a)->field == NULL) == ((b)->field == NULL)); \
+		if ((a)->field != NULL) \
+			VERIFY0(strcmp((a)->field, (b)->field)); \
+	} while (0)
+
+static void
+compare_airports(const airport_t *a, const airport_t *b)
+{
+	const runway_t *ra, *rb;
+	const freq_info_t *fa, *fb;
+	const ramp_start_t *sa, *sb;
+
+	CHECK_FIELD(a, b, ident);
+	CHECK_FIELD(a, b, icao);
+	CHECK_FIELD(a, b, iata);
+	CHECK_FIELD(a, b, cc);
+	CHECK_FIELD(a, b, cc3);
+	CHECK_FIELD(a, b, name);
+	CHECK_STR(a, b, name_orig);
+	CHECK_STR(a, b, country);
+	CHECK_STR(a, b, city);
+	CHECK_FIELD(a, b, refpt);
+	CHECK_FIELD(a, b, refpt_m);
+	CHECK_FIELD(a, b, TA);
+	CHECK_FIELD(a, b, TL);
+	CHECK_FIELD(a, b, TA_m);
+	CHECK_FIELD(a, b, TL_m);
+	CHECK_FIELD(a, b, in_navdb);
+	CHECK_FIELD(a, b, have_iaps);
+	CHECK_FIELD(a, b, ecef);
+
+	VERIFY3U(avl_numnodes(&a->rwys), ==, avl_numnodes(&b->rwys));
+	for (ra = avl_first(&a->rwys), rb = avl_first(&b->rwys); ra != NULL;
+	    ra = AVL_NEXT(&a->rwys, ra), rb = AVL_NEXT(&b->rwys, rb)) {
+		CHECK_FIELD(ra, rb, width);
+		CHECK_FIELD(ra, rb, joint_id);
+		CHECK_FIELD(ra, rb, rev_joint_id);
+		CHECK_FIELD(ra, rb, surf);
+		CHECK_FIELD(ra, rb, length);
+		for (int i = 0; i < 2; i++) {
+			CHECK_FIELD(ra, rb, ends[i].id);
+			CHECK_FIELD(ra, rb, ends[i].thr);
+			CHECK_FIELD(ra, rb, ends[i].thr_m);
+			CHECK_FIELD(ra, rb, ends[i].displ);
+			CHECK_FIELD(ra, rb, ends[i].blast);
+			CHECK_FIELD(ra, rb, ends[i].gpa);
+			CHECK_FIELD(ra, rb, ends[i].tch);
+			CHECK_FIELD(ra, rb, ends[i].tch_m);
+			CHECK_FIELD(ra, rb, ends[i].thr_v);
+			CHECK_FIELD(ra, rb, ends[i].dthr_v);
+			CHECK_FIELD(ra, rb, ends[i].hdg);
+			CHECK_FIELD(ra, rb, ends[i].land_len);
+		}
+	}
+	VERIFY3U(list_count(&a->freqs), ==, list_count(&b->freqs));
+	for (fa = list_head(&a->freqs), fb = list_head(&b->freqs); fa != NULL;
+	    fa = list_next(&a->freqs, fa), fb = list_next(&b->freqs, fb)) {
+		CHECK_FIELD(fa, fb, type);
+		CHECK_FIELD(fa, fb, freq);
+		CHECK_FIELD(fa, fb, name);
+	}
+	VERIFY3U(avl_numnodes(&a->ramp_starts), ==,
+	    avl_numnodes(&b->ramp_starts));
+	for (sa = avl_first(&a->ramp_starts), sb = avl_first(&b->ramp_starts);
+	    sa != NULL; sa = AVL_NEXT(&a->ramp_starts, sa),
+	    sb = AVL_NEXT(&b->ramp_starts, sb)) {
+		CHECK_FIELD(sa, sb, name);
+		CHECK_FIELD(sa, sb, pos);
+		CHECK_FIELD(sa, sb, hdgt);
+		CHECK_FIELD(sa, sb, type);
+	}
+}
+
+/*
+ * Loads every airport from both the text and the binary cache and checks
+ * that they come out identical.
+ */
+static void
+bench_load(const char *xpdir, const char *cachedir)
+{
+	airportdb_t *db_text = open_cache(xpdir, cachedir, B_FALSE);
+	airportdb_t *db_bin = open_cache(xpdir, cachedir, B_TRUE);
+	idents_t ids = { .n_idents = 0 };
+	double t_text, t_bin;
+	size_t rss_start, rss_text, rss_bin;
+	size_t heap_start, heap_text, heap_bin;
+
+	ids.idents = safe_calloc(adb_airport_index_walk(db_text, NULL, NULL),
+	    sizeof (*ids.idents));
+	adb_airport_index_walk(db_text, add_ident, &ids);
+
+	rss_start = rss_bytes();
+	heap_start = heap_bytes();
+	t_text = load_all(db_text, &ids);
+	rss_text = rss_bytes();
+	heap_text = heap_bytes();
+	t_bin = load_all(db_bin, &ids);
+	rss_bin = rss_bytes();
+	heap_bin = heap_bytes();
+	printf("loading %u airports: text %.3f s, binary %.3f s (%.2fx)\n",
+	    (unsigned)ids.n_idents, t_text, t_bin, t_text / t_bin);
+	printf("resident memory growth: text %.1f MB, binary %.1f MB\n",
+	    (rss_text - MIN(rss_text, rss_start)) / 1e6,
+	    (rss_bin - MIN(rss_bin, rss_text)) / 1e6);
+	if (heap_start != 0) {
+		printf("heap growth: text %.1f MB, binary %.1f MB\n",
+		    (heap_text - MIN(heap_text, heap_start)) / 1e6,
+		    (heap_bin - MIN(heap_bin, heap_text)) / 1e6);
+	}
+	for (size_t i = 0; i < ids.n_idents; i++) {
+		compare_airports(
+		    adb_airport_lookup_by_ident(db_text, ids.idents[i]),
+		    adb_airport_lookup_by_ident(db_bin, ids.idents[i]));
+	}
+	t_text = unload_all(db_text);
+	t_bin = unload_all(db_bin);
+	printf("unloading: text %.3f s, binary %.3f s\n", t_text, t_bin);
+
+	free_strlist(ids.idents, ids.n_idents);
+	airportdb_destroy(db_text);
+	airportdb_destroy(db_bin);
+	free(db_text);
+	free(db_bin);
+}
+
+typedef struct {
+	geo_pos2_t	*pos;
+	size_t		n_pos;
+} positions_t;
+
+static void
+add_pos(const arpt_index_t *idx, void *userinfo)
+{
+	positions_t *pos = userinfo;
+	pos->pos[pos->n_pos++] = GEO_POS2(idx->pos.lat, idx->pos.lon);
+}
+
+static size_t
+load_tiles(airportdb_t *db, const positions_t *pos)
+{
+	size_t heap_start = heap_bytes(), heap_end;
+
+	for (size_t i = 0; i < pos->n_pos; i++)
+		adb_load_nearest_airport_tiles(db, pos->pos[i]);
+	heap_end = heap_bytes();
+
+	return (heap_end - MIN(heap_end, heap_start));
+}
+
+/*
+ * Measures the heap taken up by loading every tile, without loading the
+ * airports in them (i.e. without runway geometry). This is the usual case
+ * for most of the airports in the tiles around the aircraft.
+ */
+static void
+bench_tiles_mem(const char *xpdir, const char *cachedir)
+{
+	airportdb_t *db_text = open_cache(xpdir, cachedir, B_FALSE);
+	airportdb_t *db_bin = open_cache(xpdir, cachedir, B_TRUE);
+	positions_t pos = { .n_pos = 0 };
+	size_t heap_text, heap_bin;
+
+	pos.pos = safe_calloc(adb_airport_index_walk(db_text, NULL, NULL),
+	    sizeof (*pos.pos));
+	adb_airport_index_walk(db_text, add_pos, &pos);
+	heap_text = load_tiles(db_text, &pos);
+	heap_bin = load_tiles(db_bin, &pos);
+	if (heap_bytes() != 0) {
+		printf("heap growth, tiles only: text %.1f MB, "
+		    "binary %.1f MB\n", heap_text / 1e6, heap_bin / 1e6);
+	}
+
+	free(pos.pos);
+	airportdb_destroy(db_text);
+	airportdb_destroy(db_bin);
+	free(db_text);
+	free(db_bin);
+}
+
+typedef struct {
+	const arpt_index_t	**idx;
+	size_t			n_idx;
+} found_t;
+
+static void
+add_found(const arpt_index_t *idx, void *userinfo)
+{
+	found_t *found = userinfo;
+	found->idx[found->n_idx++] = idx;
+}
+
+static double
+index_dist(const arpt_index_t *idx, geo_pos2_t pos)
+{
+	vect3_t a = geo2ecef_mtr(GEO_POS3(pos.lat, pos.lon, 0), &wgs84);
+	vect3_t b = geo2ecef_ft(GEO_POS3(idx->pos.lat, idx->pos.lon,
+	    idx->pos.elev), &wgs84);
+
+	return (vect3_abs(vect3_sub(a, b)));
+}
+
+/*
+ * Checks that the radius query returns the same airports as the tile scan
+ * in adb_find_nearest_airports. The index stores positions in single
+ * precision, so airports right at the edge of the search radius may
+ * legitimately end up on either side of it.
+ */
+static void
+check_radius(airportdb_t *db, geo_pos2_t pos, list_t *l, const found_t *found,
+    double radius)
+{
+	for (const airport_t *arpt = list_head(l); arpt != NULL;
+	    arpt = list_next(l, arpt)) {
+		size_t i;
+
+		for (i = 0; i < found->n_idx; i++) {
+			if (strcmp(found->idx[i]->ident, arpt->ident) == 0)
+				break;
+		}
+		if (i == found->n_idx) {
+			const arpt_index_t *idx = NULL;
+
+			for (const arpt_index_t *x = avl_first(&db->arpt_index);
+			    x != NULL && idx == NULL;
+			    x = AVL_NEXT(&db->arpt_index, x)) {
+				if (strcmp(x->ident, arpt->ident) == 0)
+					idx = x;
+			}
+			VERIFY(idx != NULL);
+			VERIFY3F(fabs(index_dist(idx, pos) - radius), <, 1);
+		}
+	}
+	VERIFY3S(labs((long)found->n_idx - (long)list_count(l)), <=, 1);
+}
+
+/*
+ * Checks a k-nearest query against a brute-force search of the index.
+ */
+static void
+check_nearest(airportdb_t *db, geo_pos2_t pos, const arpt_index_t **res,
+    const double *dists, size_t n_res)
+{
+	double ref[NEAREST_K];
+	size_t n_ref = 0;
+
+	for (const arpt_index_t *idx = avl_first(&db->arpt_index);
+	    idx != NULL; idx = AVL_NEXT(&db->arpt_index, idx)) {
+		double d = index_dist(idx, pos);
+		size_t i;
+
+		if (n_ref == NEAREST_K && d >= ref[n_ref - 1])
+			continue;
+		if (n_ref < NEAREST_K)
+			n_ref++;
+		for (i = n_ref - 1; i > 0 && ref[i - 1] > d; i--)
+			ref[i] = ref[i - 1];
+		ref[i] = d;
+	}
+	VERIFY3U(n_res, ==, n_ref);
+	for (size_t i = 0; i < n_res; i++) {
+		VERIFY3F(fabs(dists[i] - ref[i]), <, 1e-3);
+		VERIFY3F(fabs(index_dist(res[i], pos) - dists[i]), <, 1e-3);
+	}
+}
+
+/*
+ * Times nearest airport searches around positions close to random airports,
+ * using the tile scan in adb_find_nearest_airports (with the tiles already
+ * loaded), and the radius and k-nearest queries on the airport index. Each
+ * search is repeated a few times at every position, the way an EGPWS or
+ * a nearest airport page would poll it.
+ */
+static void
+bench_nearest(const char *xpdir, const char *cachedir)
+{
+	airportdb_t *db = open_cache(xpdir, cachedir, B_TRUE);
+	size_t n_arpts = adb_airport_index_walk(db, NULL, NULL);
+	const arpt_index_t *res[NEAREST_K];
+	double dists[NEAREST_K];
+	found_t found = { .n_idx = 0 };
+	idents_t ids = { .n_idents = 0 };
+	double radius = db->load_limit;
+	uint64_t t_scan = 0, t_radius = 0, t_nearest = 0, n_found = 0;
+	double n_queries = NEAREST_QUERIES * NEAREST_REPEAT;
+
+	found.idx = safe_calloc(n_arpts, sizeof (*found.idx));
+	ids.idents = safe_calloc(n_arpts, sizeof (*ids.idents));
+	adb_airport_index_walk(db, add_ident, &ids);
+	srand(2);
+	for (unsigned q = 0; q < NEAREST_QUERIES; q++) {
+		const airport_t *arpt = adb_airport_lookup_by_ident(db,
+		    ids.idents[rand() % n_arpts]);
+		geo_pos2_t pos;
+		list_t *l;
+		uint64_t start;
+		size_t n_res;
+
+		VERIFY(arpt != NULL);
+		pos = GEO_POS2(arpt->refpt.lat + (rand() % 200 - 100) / 2000.0,
+		    arpt->refpt.lon + (rand() % 200 - 100) / 2000.0);
+		load_nearest_airport_tiles(db, pos);
+		/* the first scan loads the airports, only time the second */
+		adb_free_nearest_airport_list(adb_find_nearest_airports(db,
+		    pos));
+
+		start = nanoclock();
+		for (int i = 0; i < NEAREST_REPEAT; i++) {
+			adb_free_nearest_airport_list(
+			    adb_find_nearest_airports(db, pos));
+		}
+		t_scan += nanoclock() - start;
+
+		start = nanoclock();
+		for (int i = 0; i < NEAREST_REPEAT; i++) {
+			found.n_idx = 0;
+			adb_airport_index_radius(db, pos, radius, add_found,
+			    &found);
+		}
+		t_radius += nanoclock() - start;
+		l = adb_find_nearest_airports(db, pos);
+		check_radius(db, pos, l, &found, radius);
+		n_found += found.n_idx;
+		adb_free_nearest_airport_list(l);
+
+		start = nanoclock();
+		for (int i = 0; i < NEAREST_REPEAT; i++) {
+			n_res = adb_airport_index_nearest(db, pos, INFINITY,
+			    res, dists, NEAREST_K);
+		}
+		t_nearest += nanoclock() - start;
+		if (q % 10 == 0)
+			check_nearest(db, pos, res, dists, n_res);
+
+		adb_unload_distant_airport_tiles(db, pos);
+	}
+	printf("nearest airports (%u positions, %.2f found on average):\n"
+	    "  tile scan %.2f us, index radius %.2f us, "
+	    "index %u-nearest %.2f us\n", NEAREST_QUERIES,
+	    (double)n_found / NEAREST_QUERIES, t_scan / 1000.0 / n_queries,
+	    t_radius / 1000.0 / n_queries, NEAREST_K,
+	    t_nearest / 1000.0 / n_queries);
+
+	free_strlist(ids.idents, ids.n_idents);
+	free(found.idx);
+	airportdb_destroy(db);
+	free(db);
+}
+
+static bool_t
+same_airports(list_t *l1, list_t *l2)
+{
+	if (list_count(l1) != list_count(l2))
+		return (B_FALSE);
+	for (const airport_t *a1 = list_head(l1); a1 != NULL;
+	    a1 = list_next(l1, a1)) {
+		const airport_t *a2;
+
+		for (a2 = list_head(l2); a2 != NULL; a2 = list_next(l2, a2)) {
+			if (strcmp(a1->ident, a2->ident) == 0)
+				break;
+		}
+		if (a2 == NULL)
+			return (B_FALSE);
+	}
+	return (B_TRUE);
+}
+
+/*
+ * CPU time consumed by the calling thread. Unlike wall clock time, this
+ * doesn't include the time we spend preempted by the background loader
+ * on machines with few cores.
+ */
+static uint64_t
+thread_cpu_ns(void)
+{
+	struct timespec ts;
+
+	VERIFY0(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts));
+	return (ts.tv_sec * 1000000000ull + ts.tv_nsec);
+}
+
+/*
+ * Flies a great circle route, calling the tile loading and nearest airport
+ * search every frame, the way a flight loop would. Synchronous loading
+ * does its file I/O on the "flight loop", asynchronous loading shouldn't.
+ * Whenever the asynchronous database reports no pending tiles, it must
+ * find the same airports as the synchronous one.
+ */
+static void
+bench_async(const char *xpdir, const char *cachedir)
+{
+	airportdb_t *db_sync = open_cache(xpdir, cachedir, B_TRUE);
+	airportdb_t *db_async = open_cache(xpdir, cachedir, B_TRUE);
+	geo_pos2_t pos = GEO_POS2(30.2, -120.3);
+	const double trk = 60;
+	uint64_t max_sync = 0, max_async = 0, tot_sync = 0, tot_async = 0;
+	unsigned n_compared = 0;
+
+	adb_set_async_load(db_async, B_TRUE);
+	adb_set_tile_mem_budget(db_async, TILE_MEM_BUDGET);
+	for (unsigned f = 0; f < FLIGHT_FRAMES; f++) {
+		uint64_t start, t;
+		list_t *l_sync, *l_async;
+		unsigned n_pending;
+
+		start = thread_cpu_ns();
+		adb_load_nearest_airport_tiles(db_sync, pos);
+		l_sync = adb_find_nearest_airports(db_sync, pos);
+		adb_unload_distant_airport_tiles(db_sync, pos);
+		t = thread_cpu_ns() - start;
+		max_sync = MAX(max_sync, t);
+		tot_sync += t;
+
+		start = thread_cpu_ns();
+		adb_load_nearest_airport_tiles2(db_async, pos, trk,
+		    20 * FLIGHT_STEP);
+		l_async = adb_find_nearest_airports2(db_async, pos, &n_pending);
+		adb_unload_distant_airport_tiles(db_async, pos);
+		t = thread_cpu_ns() - start;
+		max_async = MAX(max_async, t);
+		tot_async += t;
+
+		if (n_pending == 0) {
+			VERIFY(same_airports(l_sync, l_async));
+			n_compared++;
+		}
+		adb_free_nearest_airport_list(l_sync);
+		adb_free_nearest_airport_list(l_async);
+		pos = geo_displace(&wgs84, pos, trk, FLIGHT_STEP);
+		/* give the loader some time, as if rendering a frame */
+		usleep(500);
+	}
+	/* wait for the loader to catch up and compare the final position */
+	while (adb_pending_airport_tiles(db_async, NULL, 0) != 0)
+		usleep(1000);
+	{
+		list_t *l_sync = adb_find_nearest_airports(db_sync, pos);
+		unsigned n_pending;
+		list_t *l_async = adb_find_nearest_airports2(db_async, pos,
+		    &n_pending);
+
+		VERIFY0(n_pending);
+		VERIFY(same_airports(l_sync, l_async));
+		adb_free_nearest_airport_list(l_sync);
+		adb_free_nearest_airport_list(l_async);
+	}
+	printf("flight of %u frames (%u compared), CPU time per frame:\n"
+	    "  sync load %.1f us avg, %.1f us max; "
+	    "async load %.1f us avg, %.1f us max\n",
+	    FLIGHT_FRAMES, n_compared, tot_sync / 1000.0 / FLIGHT_FRAMES,
+	    max_sync / 1000.0, tot_async / 1000.0 / FLIGHT_FRAMES,
+	    max_async / 1000.0);
+	printf("tiles resident at the end: sync %u, async with %u kB "
+	    "budget %u\n", (unsigned)avl_numnodes(&db_sync->geo_table),
+	    TILE_MEM_BUDGET >> 10,
+	    (unsigned)avl_numnodes(&db_async->geo_table));
+
+	airportdb_destroy(db_sync);
+	airportdb_destroy(db_async);
+	free(db_sync);
+	free(db_async);
+}
+
+/*
+ * Recursively compares two directory trees, returning the number of files
+ * compared. Any difference is fatal.
+ */
+static unsigned
+compare_dirs(const char *dir1, const char *dir2)
+{
+	DIR *dp = opendir(dir1);
+	struct dirent *de;
+	unsigned n = 0;
+
+	VERIFY(dp != NULL);
+	while ((de = readdir(dp)) != NULL) {
+		char *p1, *p2;
+		bool_t isdir;
+
+		if (strcmp(de->d_name, ".") == 0 ||
+		    strcmp(de->d_name, "..") == 0)
+			continue;
+		p1 = mkpathname(dir1, de->d_name, NULL);
+		p2 = mkpathname(dir2, de->d_name, NULL);
+		VERIFY(file_exists(p1, &isdir));
+		if (isdir) {
+			n += compare_dirs(p1, p2);
+		} else {
+			long l1, l2;
+			char *b1 = file2str_name(&l1, p1);
+			char *b2 = file2str_name(&l2, p2);
+
+			if (b2 == NULL || l1 != l2 || memcmp(b1, b2, l1) != 0) {
+				fprintf(stderr, "%s and %s differ\n", p1, p2);
+				exit(1);
+			}
+			free(b1);
+			free(b2);
+			n++;
+		}
+		free(p1);
+		free(p2);
+	}
+	closedir(dp);
+
+	return (n);
+}
+
+static char *
+pack_apt_dat_path(const char *xpdir, const char *pack)
+{
+	return (mkpathname(xpdir, "Custom Scenery", pack, "Earth nav data",
+	    "apt.dat", NULL));
+}
+
+/*
+ * Returns the contents of a synthetic apt.dat, without the final "99" line.
+ */
+static char *
+read_apt_dat_body(const char *fname, long *len)
+{
+	char *buf = file2str_name(len, fname);
+	char *end;
+
+	VERIFY(buf != NULL);
+	end = strstr(buf, "\n99\n");
+	VERIFY(end != NULL);
+	end[1] = '\0';
+	*len = end + 1 - buf;
+
+	return (buf);
+}
+
+/*
+ * In Pack1, drops the first airport (uncovering the global one), changes
+ * the elevation of the second and adds a new one. Pack2 gets a copy of an
+ * airport from Pack1, so that Pack1's version wins. Finally, a CIFP file
+ * is added for one of the global airports.
+ */
+static void
+modify_xpdir(const char *xpdir)
+{
+	char *fname = pack_apt_dat_path(xpdir, "Pack1");
+	char *buf, *first, *second, *third;
+	long len;
+	FILE *fp;
+
+	buf = read_apt_dat_body(fname, &len);
+	first = strstr(buf, "\n1 ") + 1;
+	second = strstr(first, "\n1 ") + 1;
+	third = strstr(second, "\n1 ") + 1;
+	fp = fopen(fname, "w");
+	VERIFY(fp != NULL);
+	fwrite(buf, 1, first - buf, fp);
+	fprintf(fp, "1 1234");
+	second = strchr(second + 2, ' ');
+	fwrite(second, 1, third - second, fp);
+	fwrite(third, 1, strlen(third), fp);
+	gen_airport(fp, SYNTH_AIRPORTS + 1, 1);
+	fprintf(fp, "99\n");
+	fclose(fp);
+	free(buf);
+	free(fname);
+
+	fname = pack_apt_dat_path(xpdir, "Pack2");
+	buf = read_apt_dat_body(fname, &len);
+	fp = fopen(fname, "w");
+	VERIFY(fp != NULL);
+	fwrite(buf, 1, len, fp);
+	gen_airport(fp, 8, 2);
+	fprintf(fp, "99\n");
+	fclose(fp);
+	free(buf);
+	free(fname);
+
+	fname = mkpathname(xpdir, "Resources", "default data", "CIFP",
+	    "X00010.dat", NULL);
+	fp = fopen(fname, "w");
+	VERIFY(fp != NULL);
+	fprintf(fp, "RWY:RW01,,,1234,,,,45;\n");
+	fclose(fp);
+	free(fname);
+}
+
+/*
+ * Swaps the priority of Pack1 and Pack2, which changes which one provides
+ * the airport they have in common.
+ */
+static void
+swap_packs(const char *xpdir)
+{
+	char *fname = mkpathname(xpdir, "Custom Scenery", "scenery_packs.ini",
+	    NULL);
+	long len;
+	char *buf = file2str_name(&len, fname);
+	char *p1 = strstr(buf, "Pack1/"), *p2 = strstr(buf, "Pack2/");
+	FILE *fp;
+
+	VERIFY(p1 != NULL && p2 != NULL);
+	p1[4] = '2';
+	p2[4] = '1';
+	fp = fopen(fname, "w");
+	VERIFY(fp != NULL);
+	fwrite(buf, 1, len, fp);
+	fclose(fp);
+	free(buf);
+	free(fname);
+}
+
+/*
+ * Brings the cache in `cachedir' up to date incrementally and compares the
+ * result to a full rebuild in an empty cache directory.
+ */
+static void
+check_incremental(const char *xpdir, const char *cachedir, const char *what,
+    unsigned n_threads)
+{
+	char *full_cachedir = sprintf_alloc("%s.full", xpdir);
+	double t_full, t_inc;
+	unsigned n_files;
+
+	t_full = rebuild(xpdir, full_cachedir, n_threads);
+	t_inc = rebuild(xpdir, cachedir, n_threads);
+	n_files = compare_dirs(full_cachedir, cachedir);
+	VERIFY3U(compare_dirs(cachedir, full_cachedir), ==, n_files);
+	printf("%-18s %10.3f %12.3f  (%u files identical)\n", what, t_full,
+	    t_inc, n_files);
+	VERIFY(remove_directory(full_cachedir));
+	free(full_cachedir);
+}
+
+static void
+bench_incremental(const char *xpdir, unsigned n_threads)
+{
+	char *cachedir = sprintf_alloc("%s.cache_inc", xpdir);
+
+	(void) rebuild(xpdir, cachedir, n_threads);
+	printf("\n%-18s %10s %12s\n", "change", "full (s)",
+	    "incremental (s)");
+	check_incremental(xpdir, cachedir, "none", n_threads);
+	modify_xpdir(xpdir);
+	check_incremental(xpdir, cachedir, "airports & CIFP", n_threads);
+	swap_packs(xpdir);
+	check_incremental(xpdir, cachedir, "scenery order", n_threads);
+	VERIFY(remove_directory(cachedir));
+	free(cachedir);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned max_threads = lacf_num_cpus();
+	int opt;
+	char *xpdir, *ref_cachedir;
+	bool_t synth = B_FALSE;
+	double t1;
+	unsigned n_files;
+
+	log_init(log_func, "adbbench");
+	while ((opt = getopt(argc, argv, "t:")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-t max_threads] [xpdir]\n",
+			    argv[0]);
+			return (1);
+		}
+	}
+	max_threads = MAX(max_threads, 2);
+	if (optind < argc) {
+		xpdir = safe_strdup(argv[optind]);
+	} else {
+		xpdir = gen_xpdir();
+		synth = B_TRUE;
+	}
+	ref_cachedir = sprintf_alloc("%s.cache1", xpdir);
+
+	t1 = rebuild(xpdir, ref_cachedir, 1);
+	printf("%7s  %10s %7s\n", "threads", "time (s)", "speedup");
+	printf("%7u  %10.3f %6.2fx\n", 1, t1, 1.0);
+	for (unsigned n = 2; n <= max_threads; n *= 2) {
+		char *cachedir = sprintf_alloc("%s.cache%u", xpdir, n);
+		double t = rebuild(xpdir, cachedir, n);
+
+		n_files = compare_dirs(ref_cachedir, cachedir);
+		printf("%7u  %10.3f %6.2fx  (%u files identical)\n", n, t,
+		    t1 / t, n_files);
+		VERIFY(remove_directory(cachedir));
+		free(cachedir);
+	}
+	bench_load(xpdir, ref_cachedir);
+	bench_tiles_mem(xpdir, ref_cachedir);
+	bench_nearest(xpdir, ref_cachedir);
+	bench_async(xpdir, ref_cachedir);
+	if (synth)
+		bench_incremental(xpdir, max_threads);
+
+	VERIFY(remove_directory(ref_cachedir));
+	free(ref_cachedir);
+	if (synth)
+		VERIFY(remove_directory(xpdir));
+	free(xpdir);
+	log_fini();
+
+	return (0);
+}
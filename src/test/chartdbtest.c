@@ -0,0 +1,307 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+/*
+ * Hammers the chart loader with requests for changing charts, zooms and
+ * day/night modes, interleaved with chartdb_purge(), so that queued load
+ * jobs get cancelled and the caches get purged while other jobs are in
+ * the middle of a stage. Then loads every chart once more and checks the
+ * resulting surfaces. Build with DEBUG to get the lock and pin
+ * assertions in chartdb.c checked along the way.
+ *
+ * Runs offline against the "aeronav.faa.gov" provider: the chart index
+ * and the charts are placed into the disk cache beforehand and all
+ * downloads go to a dead proxy, so the provider falls back to the cached
+ * copies. The charts are PNG files. Pass a PDF file with -f, along with
+ * the pdftoppm and pdfinfo paths, to also run PDF charts through the
+ * PDF stage and the PNG cache.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cairo.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/chartdb.h>
+#include <acfutils/crc64.h>
+#include <acfutils/helpers.h>
+#include <acfutils/log.h>
+#include <acfutils/png.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/time.h>
+
+#define	PROV_NAME	"aeronav.faa.gov"
+#define	AIRAC		2601
+#define	ICAO		"KTST"
+#define	DEAD_PROXY	"http://127.0.0.1:9"
+/* How long to wait for the final load of each chart */
+#define	LOAD_TIMEOUT	SEC2USEC(30)
+
+enum { N_PNG_CHARTS = 8, N_PDF_CHARTS = 4, N_OPS = 20000 };
+
+static const double zooms[] = { 0.5, 1.0, 1.5, 2.0 };
+
+static void
+log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+static int
+chart_width(int i)
+{
+	return (200 + 37 * i);
+}
+
+static int
+chart_height(int i)
+{
+	return (300 + 23 * i);
+}
+
+/* Opaque, so cairo's premultiplied pixels come out unchanged */
+static uint32_t
+chart_pixel(int i)
+{
+	return (0xff000000u | ((uint32_t)(i * 16) << 16) | 0x8040u);
+}
+
+static void
+write_png_chart(const char *dir, int i)
+{
+	int w = chart_width(i), h = chart_height(i);
+	uint8_t *data = safe_malloc(w * h * 4);
+	uint32_t px = chart_pixel(i);
+	char name[32];
+	char *path;
+
+	for (int j = 0; j < w * h; j++) {
+		data[j * 4] = (px >> 16) & 0xff;
+		data[j * 4 + 1] = (px >> 8) & 0xff;
+		data[j * 4 + 2] = px & 0xff;
+		data[j * 4 + 3] = 0xff;
+	}
+	snprintf(name, sizeof (name), "TST%d.PNG", i);
+	path = mkpathname(dir, name, NULL);
+	VERIFY(png_write_to_file_rgba(path, w, h, data));
+	free(path);
+	free(data);
+}
+
+static void
+write_pdf_chart(const char *dir, int i, const void *pdf, size_t pdf_len)
+{
+	char name[32];
+	char *path;
+	FILE *fp;
+
+	snprintf(name, sizeof (name), "TST%d.PDF", i);
+	path = mkpathname(dir, name, NULL);
+	fp = fopen(path, "wb");
+	VERIFY(fp != NULL);
+	VERIFY3U(fwrite(pdf, 1, pdf_len, fp), ==, pdf_len);
+	fclose(fp);
+	free(path);
+}
+
+static void
+write_index(const char *dir, int n_pdf)
+{
+	char *path = mkpathname(dir, "d-TPP_Metafile.xml", NULL);
+	FILE *fp = fopen(path, "w");
+
+	VERIFY(fp != NULL);
+	fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	    "<digital_tpp cycle=\"%d\">\n"
+	    "<state_code ID=\"XX\">\n"
+	    "<city_name ID=\"TEST CITY\">\n"
+	    "<airport_name ID=\"TEST FIELD\" icao_ident=\"" ICAO "\" "
+	    "apt_ident=\"TST\">\n", AIRAC);
+	for (int i = 0; i < N_PNG_CHARTS + n_pdf; i++) {
+		fprintf(fp, "<record><chart_code>APD</chart_code>"
+		    "<chart_name>CHART %d</chart_name>"
+		    "<pdf_name>TST%d.%s</pdf_name></record>\n", i, i,
+		    i < N_PNG_CHARTS ? "PNG" : "PDF");
+	}
+	fprintf(fp, "</airport_name>\n</city_name>\n</state_code>\n"
+	    "</digital_tpp>\n");
+	fclose(fp);
+	free(path);
+}
+
+static void
+check_surface(cairo_surface_t *surf, int i, bool_t night)
+{
+	const uint32_t *data;
+
+	VERIFY3U(cairo_surface_status(surf), ==, CAIRO_STATUS_SUCCESS);
+	VERIFY(cairo_image_surface_get_format(surf) == CAIRO_FORMAT_ARGB32 ||
+	    cairo_image_surface_get_format(surf) == CAIRO_FORMAT_RGB24);
+	if (i >= N_PNG_CHARTS) {
+		VERIFY3S(cairo_image_surface_get_width(surf), >, 0);
+		VERIFY3S(cairo_image_surface_get_height(surf), >, 0);
+		return;
+	}
+	VERIFY3S(cairo_image_surface_get_width(surf), ==, chart_width(i));
+	VERIFY3S(cairo_image_surface_get_height(surf), ==, chart_height(i));
+	cairo_surface_flush(surf);
+	data = (const uint32_t *)cairo_image_surface_get_data(surf);
+	/* night mode inverts the colors, but not the alpha */
+	VERIFY3U(data[0] & 0xffffffu, ==, (night ?
+	    ~chart_pixel(i) : chart_pixel(i)) & 0xffffffu);
+}
+
+static void
+hammer(chartdb_t *cdb, int n_charts)
+{
+	for (int op = 0; op < N_OPS; op++) {
+		int i = crc64_rand() % n_charts;
+		char name[32];
+		cairo_surface_t *surf;
+		bool_t night = crc64_rand() % 2;
+
+		snprintf(name, sizeof (name), "CHART %d", i);
+		VERIFY(chartdb_get_chart_surface(cdb, ICAO, name, 0,
+		    zooms[crc64_rand() % ARRAY_NUM_ELEM(zooms)], night,
+		    &surf, NULL));
+		if (surf != NULL) {
+			VERIFY3U(cairo_surface_status(surf), ==,
+			    CAIRO_STATUS_SUCCESS);
+			cairo_surface_destroy(surf);
+		}
+		switch (crc64_rand() % 16) {
+		case 0:
+			chartdb_purge(cdb);
+			break;
+		case 1:
+			/* shrink the caches so that loads evict each other */
+			chartdb_set_load_limit(cdb, (crc64_rand() % 4) << 20);
+			break;
+		case 2:
+		case 3:
+			usleep(crc64_rand() % 2000);
+			break;
+		}
+	}
+}
+
+static void
+load_all(chartdb_t *cdb, int n_charts)
+{
+	for (int i = 0; i < n_charts; i++) {
+		uint64_t start = microclock();
+		bool_t night = (i % 2 == 1);
+		cairo_surface_t *surf;
+		char name[32];
+
+		snprintf(name, sizeof (name), "CHART %d", i);
+		for (;;) {
+			VERIFY(chartdb_get_chart_surface(cdb, ICAO, name, 0,
+			    1.0, night, &surf, NULL));
+			if (surf != NULL)
+				break;
+			VERIFY_MSG(microclock() - start < LOAD_TIMEOUT,
+			    "timed out loading %s", name);
+			usleep(1000);
+		}
+		check_surface(surf, i, night);
+		cairo_surface_destroy(surf);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	char cache[] = "/tmp/chartdbtest-XXXXXX";
+	const char *pdftoppm = NULL, *pdfinfo = NULL, *pdf_file = NULL;
+	void *pdf = NULL;
+	size_t pdf_len = 0;
+	int n_pdf = 0, opt;
+	char airac_nr[8];
+	char *dir;
+	chartdb_t *cdb;
+	uint64_t start;
+
+	log_init(log_func, "chartdbtest");
+	crc64_init();
+	crc64_srand(1);
+	while ((opt = getopt(argc, argv, "p:i:f:")) != -1) {
+		switch (opt) {
+		case 'p':
+			pdftoppm = optarg;
+			break;
+		case 'i':
+			pdfinfo = optarg;
+			break;
+		case 'f':
+			pdf_file = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-p <pdftoppm> "
+			    "-i <pdfinfo> -f <chart.pdf>]\n", argv[0]);
+			return (1);
+		}
+	}
+	if (pdf_file != NULL) {
+		VERIFY_MSG(pdftoppm != NULL && pdfinfo != NULL,
+		    "%s", "-f also needs -p and -i");
+		pdf = file2buf(pdf_file, &pdf_len);
+		VERIFY_MSG(pdf != NULL, "can't read %s", pdf_file);
+		n_pdf = N_PDF_CHARTS;
+	}
+
+	VERIFY(mkdtemp(cache) != NULL);
+	snprintf(airac_nr, sizeof (airac_nr), "%d", AIRAC);
+	dir = mkpathname(cache, PROV_NAME, airac_nr, NULL);
+	VERIFY(create_directory_recursive(dir));
+	write_index(dir, n_pdf);
+	for (int i = 0; i < N_PNG_CHARTS; i++)
+		write_png_chart(dir, i);
+	for (int i = N_PNG_CHARTS; i < N_PNG_CHARTS + n_pdf; i++)
+		write_pdf_chart(dir, i, pdf, pdf_len);
+	free(pdf);
+
+	/* chart_prov_faa.c falls back to the cached copies */
+	setenv("http_proxy", DEAD_PROXY, 1);
+	setenv("https_proxy", DEAD_PROXY, 1);
+	cdb = chartdb_init(cache, pdftoppm, pdfinfo, AIRAC, PROV_NAME, NULL);
+	VERIFY(cdb != NULL);
+	chartdb_set_proxy(cdb, DEAD_PROXY);
+	chartdb_set_loader_threads(cdb, 2);
+	start = microclock();
+	while (!chartdb_is_ready(cdb)) {
+		VERIFY_MSG(microclock() - start < LOAD_TIMEOUT, "%s",
+		    "timed out loading the chart index");
+		usleep(1000);
+	}
+
+	hammer(cdb, N_PNG_CHARTS + n_pdf);
+	printf("hammer: OK\n");
+	chartdb_purge(cdb);
+	chartdb_set_load_limit(cdb, 64 << 20);
+	load_all(cdb, N_PNG_CHARTS + n_pdf);
+	printf("load: OK\n");
+
+	chartdb_fini(cdb);
+	VERIFY(remove_directory(cache));
+	free(dir);
+
+	return (0);
+}
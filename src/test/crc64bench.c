@@ -0,0 +1,126 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+
+/*
+ * Verifies that crc64_append() and crc64_combine() produce the same
+ * results as a plain byte-at-a-time reference CRC64 across a range of
+ * buffer sizes and alignments, then measures crc64() throughput.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/crc64.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/time.h>
+
+#define	CRC64_POLY	0xC96C5795D7870F42ULL
+
+enum { BUF_SZ = 64 << 20 };
+
+static uint64_t ref_table[256];
+
+static void
+log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+static uint64_t
+ref_crc64(const uint8_t *buf, size_t sz)
+{
+	uint64_t crc = (uint64_t)-1;
+	for (size_t i = 0; i < sz; i++)
+		crc = (crc >> 8) ^ ref_table[(crc ^ buf[i]) & 0xFF];
+	return (crc);
+}
+
+static void
+verify(const uint8_t *buf)
+{
+	for (size_t sz = 0; sz < 2048; sz += (sz < 300 ? 1 : 37)) {
+		for (size_t off = 0; off < 16; off++) {
+			uint64_t ref = ref_crc64(buf + off, sz);
+			size_t split = sz / 3;
+
+			VERIFY3U(crc64(buf + off, sz), ==, ref);
+			VERIFY3U(crc64_append(crc64(buf + off, split),
+			    buf + off + split, sz - split), ==, ref);
+			VERIFY3U(crc64_combine(crc64(buf + off, split),
+			    crc64(buf + off + split, sz - split),
+			    sz - split), ==, ref);
+		}
+	}
+	/* one large buffer, combined from unevenly sized chunks */
+	{
+		uint64_t ref = ref_crc64(buf, BUF_SZ);
+		uint64_t crc = crc64(buf, 0);
+		size_t off = 0;
+
+		VERIFY3U(crc64(buf, BUF_SZ), ==, ref);
+		for (size_t chunk = 4093; off < BUF_SZ; chunk *= 3) {
+			size_t len = MIN(chunk, BUF_SZ - off);
+			crc = crc64_combine(crc, crc64(buf + off, len), len);
+			off += len;
+		}
+		VERIFY3U(crc, ==, ref);
+	}
+}
+
+int
+main(void)
+{
+	uint8_t *buf = safe_malloc(BUF_SZ + 16);
+	uint64_t start, end, crc;
+
+	log_init(log_func, "crc64bench");
+	crc64_init();
+
+	for (int i = 0; i < 256; i++) {
+		uint64_t c = i;
+		for (int j = 0; j < 8; j++)
+			c = (c >> 1) ^ (-(c & 1) & CRC64_POLY);
+		ref_table[i] = c;
+	}
+	crc64_srand(1);
+	for (size_t i = 0; i < BUF_SZ + 16; i += sizeof (uint64_t)) {
+		uint64_t r = crc64_rand();
+		memcpy(&buf[i], &r, sizeof (r));
+	}
+	verify(buf);
+	printf("Verification passed\n");
+
+	start = nanoclock();
+	crc = ref_crc64(buf, BUF_SZ);
+	end = nanoclock();
+	printf("byte-at-a-time:  %8.1f MB/s\n",
+	    (BUF_SZ / 1048576.0) / NSEC2SEC((double)(end - start)));
+
+	start = nanoclock();
+	VERIFY3U(crc64(buf, BUF_SZ), ==, crc);
+	end = nanoclock();
+	printf("crc64():         %8.1f MB/s\n",
+	    (BUF_SZ / 1048576.0) / NSEC2SEC((double)(end - start)));
+
+	free(buf);
+	log_fini();
+
+	return (0);
+}
@@ -29,10 +29,15 @@
 #include <unistd.h>
 
 #include <acfutils/assert.h>
+#include <acfutils/crc64.h>
 #include <acfutils/dsf.h>
+#include <acfutils/helpers.h>
 #include <acfutils/math.h>
 #include <acfutils/log.h>
 #include <acfutils/png.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/taskq.h>
+#include <acfutils/time.h>
 
 static dsf_cmd_cb_t cmd_cbs[NUM_DSF_CMDS];
 
@@ -204,6 +209,475 @@ water_mask(dsf_t *dsf)
 	free(buf);
 }
 
+/*
+ * Checks that the POOL and PO32 atoms in `dsf' hold exactly the same
+ * values as those in `ref', which must have been parsed without
+ * DSF_PARSE_INTERLEAVE.
+ */
+static bool_t
+pools_equal(const dsf_t *ref, const dsf_t *dsf, bool_t interleaved)
+{
+	static const uint32_t pool_ids[] = { DSF_ATOM_POOL, DSF_ATOM_PO32 };
+	const dsf_atom_t *ref_geod = dsf_lookup(ref, DSF_ATOM_GEOD, 0, 0);
+	const dsf_atom_t *geod = dsf_lookup(dsf, DSF_ATOM_GEOD, 0, 0);
+
+	if (ref_geod == NULL || geod == NULL)
+		return (ref_geod == geod);
+
+	for (int i = 0; i < 2; i++) {
+		const dsf_atom_t *a = dsf_iter(ref_geod, pool_ids[i], NULL);
+		const dsf_atom_t *b = dsf_iter(geod, pool_ids[i], NULL);
+		size_t datalen = (pool_ids[i] == DSF_ATOM_POOL ? 2 : 4);
+
+		for (; a != NULL && b != NULL;
+		    a = dsf_iter(ref_geod, pool_ids[i], a),
+		    b = dsf_iter(geod, pool_ids[i], b)) {
+			const dsf_planar_atom_t *pa = &a->planar_atom;
+			const dsf_planar_atom_t *pb = &b->planar_atom;
+
+			if (pa->data_count != pb->data_count ||
+			    pa->plane_count != pb->plane_count)
+				return (B_FALSE);
+			if (pa->data_count == 0)
+				continue;
+			for (unsigned p = 0; p < pa->plane_count; p++) {
+				const uint8_t *plane = pa->data[p];
+
+				if (!interleaved) {
+					if (memcmp(plane, pb->data[p],
+					    pa->data_count * datalen) != 0)
+						return (B_FALSE);
+					continue;
+				}
+				for (size_t k = 0; k < pa->data_count; k++) {
+					const uint8_t *pt = pb->interleaved;
+					size_t idx = k * pa->plane_count + p;
+
+					if (memcmp(&plane[k * datalen],
+					    &pt[idx * datalen], datalen) != 0)
+						return (B_FALSE);
+				}
+			}
+		}
+		if (a != NULL || b != NULL)
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * What a caller wanting point-major pools has to do without
+ * DSF_PARSE_INTERLEAVE: copy every pool out of its per-plane arrays.
+ */
+static void
+transpose_pools(const dsf_t *dsf)
+{
+	static const uint32_t pool_ids[] = { DSF_ATOM_POOL, DSF_ATOM_PO32 };
+	const dsf_atom_t *geod = dsf_lookup(dsf, DSF_ATOM_GEOD, 0, 0);
+
+	if (geod == NULL)
+		return;
+	for (int i = 0; i < 2; i++) {
+		size_t datalen = (pool_ids[i] == DSF_ATOM_POOL ? 2 : 4);
+
+		for (const dsf_atom_t *a = dsf_iter(geod, pool_ids[i], NULL);
+		    a != NULL; a = dsf_iter(geod, pool_ids[i], a)) {
+			const dsf_planar_atom_t *pa = &a->planar_atom;
+			uint8_t *pts;
+
+			if (pa->data_count == 0)
+				continue;
+			pts = safe_malloc(pa->data_count * pa->plane_count *
+			    datalen);
+			for (size_t k = 0; k < pa->data_count; k++) {
+				for (unsigned p = 0; p < pa->plane_count; p++) {
+					const uint8_t *plane = pa->data[p];
+					memcpy(&pts[(k * pa->plane_count + p) *
+					    datalen], &plane[k * datalen],
+					    datalen);
+				}
+			}
+			free(pts);
+		}
+	}
+}
+
+/*
+ * Re-parses the DSF `iters' times with each combination of scalar or
+ * SIMD decoders and per-plane or interleaved output, checking that all
+ * of them decode exactly the same pools as `ref' (which was parsed with
+ * the scalar decoders). Then compares how long it takes to get at the
+ * first POOL atom when opening `filename' normally and lazily.
+ */
+static void
+time_decode(const dsf_t *ref, const char *filename, int iters)
+{
+	static const struct {
+		const char	*name;
+		unsigned	flags;
+		bool_t		transpose;
+	} modes[] = {
+	    { "scalar", DSF_PARSE_SCALAR, B_FALSE },
+	    { "simd", 0, B_FALSE },
+	    { "simd + transpose", 0, B_TRUE },
+	    { "scalar interleaved", DSF_PARSE_SCALAR | DSF_PARSE_INTERLEAVE,
+	    B_FALSE },
+	    { "simd interleaved", DSF_PARSE_INTERLEAVE, B_FALSE }
+	};
+	double t_base = 0;
+
+	printf("%-20s %10s %9s\n", "decoder", "ms/parse", "speedup");
+	for (size_t m = 0; m < ARRAY_NUM_ELEM(modes); m++) {
+		uint64_t total = 0;
+		double t;
+
+		for (int i = 0; i < iters; i++) {
+			char reason[DSF_REASON_SZ];
+			uint8_t *buf = safe_malloc(ref->size);
+			uint64_t start;
+			dsf_t *dsf;
+
+			/* dsf_parse2 takes ownership of the buffer */
+			memcpy(buf, ref->data, ref->size);
+			start = nanoclock();
+			dsf = dsf_parse2(buf, ref->size, modes[m].flags,
+			    reason);
+			if (dsf == NULL) {
+				fprintf(stderr, "Error parsing DSF: %s\n",
+				    reason);
+				exit(EXIT_FAILURE);
+			}
+			if (modes[m].transpose)
+				transpose_pools(dsf);
+			total += nanoclock() - start;
+			if (i == 0 && !pools_equal(ref, dsf,
+			    (modes[m].flags & DSF_PARSE_INTERLEAVE) != 0)) {
+				fprintf(stderr, "%s decoder output differs "
+				    "from the scalar decoder\n", modes[m].name);
+				exit(EXIT_FAILURE);
+			}
+			dsf_fini(dsf);
+		}
+		t = NSEC2SEC((double)total) * 1000 / iters;
+		if (m == 0)
+			t_base = t;
+		printf("%-20s %10.3f %8.2fx\n", modes[m].name, t, t_base / t);
+	}
+
+	printf("\n%-20s %10s %9s\n", "open to first POOL", "ms", "speedup");
+	for (int lazy = 0; lazy < 2; lazy++) {
+		uint64_t total = 0;
+		double t;
+
+		for (int i = 0; i < iters; i++) {
+			uint64_t start = nanoclock();
+			dsf_t *dsf = dsf_init2(filename,
+			    lazy ? DSF_PARSE_LAZY : 0);
+
+			if (dsf == NULL)
+				exit(EXIT_FAILURE);
+			(void) dsf_lookup(dsf, DSF_ATOM_GEOD, 0,
+			    DSF_ATOM_POOL, 0, 0);
+			total += nanoclock() - start;
+			if (i == 0 && !pools_equal(ref, dsf, B_FALSE)) {
+				fprintf(stderr, "lazily parsed DSF differs "
+				    "from the reference\n");
+				exit(EXIT_FAILURE);
+			}
+			dsf_fini(dsf);
+		}
+		t = NSEC2SEC((double)total) * 1000 / iters;
+		if (!lazy)
+			t_base = t;
+		printf("%-20s %10.3f %8.2fx\n", lazy ? "lazy" : "full", t,
+		    t_base / t);
+	}
+}
+
+/*
+ * Running CRC64 over the callbacks made while parsing all or part of the
+ * CMDS atom, so that the serial and parallel parsers can be compared.
+ */
+typedef struct {
+	uint64_t	crc;
+	uint64_t	len;
+	uint64_t	n_cmds;
+} cmd_digest_t;
+
+static void
+digest_cb(dsf_cmd_t cmd, const void *arg, const dsf_cmd_parser_t *parser)
+{
+	cmd_digest_t *dg = parser->userinfo;
+	uint64_t rec[8] = {
+	    cmd, parser->cmd_file_off, parser->junct_off, parser->defn_idx,
+	    parser->road_subt, (uintptr_t)parser->pool,
+	    (uintptr_t)parser->scal, 0
+	};
+
+	switch (cmd) {
+	case DSF_OBJ:
+	case DSF_TERR_PATCH_FLAGS:
+		rec[7] = (uintptr_t)arg;
+		break;
+	case DSF_OBJ_RNG:
+	case DSF_NET_CHAIN_RNG:
+	case DSF_PATCH_TRIA_RNG:
+	case DSF_PATCH_TRIA_STRIP_RNG:
+	case DSF_PATCH_TRIA_FAN_RNG:
+		rec[7] = crc64(arg, sizeof (dsf_idx_rng_arg_t));
+		break;
+	case DSF_NET_CHAIN:
+	case DSF_NET_CHAIN32:
+	case DSF_PATCH_TRIA:
+	case DSF_PATCH_TRIA_STRIP:
+	case DSF_PATCH_TRIA_FAN: {
+		const dsf_indices_arg_t *a = arg;
+		rec[7] = crc64(a->indices, a->num_coords *
+		    sizeof (*a->indices)) ^ a->num_coords;
+		break;
+	}
+	case DSF_PATCH_TRIA_XPOOL:
+	case DSF_PATCH_TRIA_STRIP_XPOOL:
+	case DSF_PATCH_TRIA_FAN_XPOOL: {
+		const dsf_indices_xpool_arg_t *a = arg;
+		crc64_state_init(&rec[7]);
+		for (int i = 0; i < a->num_coords; i++) {
+			uint64_t idx[3] = {
+			    (uintptr_t)a->indices[i].pool,
+			    (uintptr_t)a->indices[i].scal, a->indices[i].idx
+			};
+			rec[7] = crc64_append(rec[7], idx, sizeof (idx));
+		}
+		break;
+	}
+	case DSF_POLY:
+	case DSF_NEST_POLY:
+	case DSF_NEST_POLY_RNG: {
+		const dsf_poly_arg_t *a = arg;
+		rec[7] = crc64(a->indices, a->num_coords *
+		    sizeof (*a->indices)) ^ ((uint64_t)a->param << 32) ^
+		    a->num_coords;
+		break;
+	}
+	case DSF_POLY_RNG:
+		rec[7] = crc64(arg, sizeof (dsf_poly_rng_arg_t));
+		break;
+	case DSF_TERR_PATCH_FLAGS_N_LOD: {
+		const dsf_flags_n_lod_arg_t *a = arg;
+		float lod[2] = { a->near_lod, a->far_lod };
+		rec[7] = crc64(lod, sizeof (lod)) ^ a->flags;
+		break;
+	}
+	case DSF_COMMENT8:
+	case DSF_COMMENT16:
+	case DSF_COMMENT32: {
+		const dsf_comment_arg_t *a = arg;
+		rec[7] = crc64(a->data, a->len);
+		break;
+	}
+	default:
+		break;
+	}
+	dg->crc = crc64_append(dg->crc, rec, sizeof (rec));
+	dg->len += sizeof (rec);
+	dg->n_cmds++;
+}
+
+static taskq_t *
+alloc_tq(unsigned n_threads)
+{
+	/* The calling thread participates, so n - 1 workers suffice. */
+	return (taskq_alloc2(0, MAX(n_threads, 2) - 1, 0, NULL, NULL, NULL,
+	    NULL, NULL, TASKQ_FLAG_WORK_STEALING));
+}
+
+/*
+ * Compares decoding the pools serially and in parallel on 1 to
+ * `max_threads' threads, then does the same for parsing the command
+ * stream, checking that all of them produce exactly the same results.
+ */
+static void
+time_parallel(const dsf_t *ref, int iters, unsigned max_threads)
+{
+	dsf_cmd_cb_t cbs[NUM_DSF_CMDS];
+	cmd_digest_t ref_dg = { .n_cmds = 0 };
+	char reason[DSF_REASON_SZ];
+	double t_base = 0;
+
+	printf("\n%-20s %10s %10s %9s\n", "pool decode threads", "planar ms",
+	    "interl ms", "speedup");
+	for (unsigned n = 0; n <= max_threads; n = MAX(n * 2, 1)) {
+		taskq_t *tq = (n != 0 ? alloc_tq(n) : NULL);
+		double t[2];
+
+		for (int il = 0; il < 2; il++) {
+			unsigned flags = (il ? DSF_PARSE_INTERLEAVE : 0);
+			uint64_t total = 0;
+
+			for (int i = 0; i < iters; i++) {
+				uint8_t *buf = safe_malloc(ref->size);
+				uint64_t start;
+				dsf_t *dsf;
+
+				memcpy(buf, ref->data, ref->size);
+				start = nanoclock();
+				dsf = dsf_parse3(buf, ref->size, flags, tq,
+				    reason);
+				total += nanoclock() - start;
+				if (dsf == NULL) {
+					fprintf(stderr, "Error parsing DSF: "
+					    "%s\n", reason);
+					exit(EXIT_FAILURE);
+				}
+				if (i == 0 && !pools_equal(ref, dsf, il)) {
+					fprintf(stderr, "parallel decoding "
+					    "differs from the reference\n");
+					exit(EXIT_FAILURE);
+				}
+				dsf_fini(dsf);
+			}
+			t[il] = NSEC2SEC((double)total) * 1000 / iters;
+		}
+		if (n == 0)
+			t_base = t[0];
+		if (n == 0)
+			printf("%-20s", "serial");
+		else
+			printf("%-20u", n);
+		printf(" %10.3f %10.3f %8.2fx\n", t[0], t[1], t_base / t[0]);
+		if (tq != NULL)
+			taskq_free(tq);
+	}
+
+	if (dsf_lookup(ref, DSF_ATOM_CMDS, 0, 0) == NULL)
+		return;
+	for (int i = 0; i < NUM_DSF_CMDS; i++)
+		cbs[i] = digest_cb;
+	crc64_state_init(&ref_dg.crc);
+	if (!dsf_parse_cmds(ref, cbs, &ref_dg, reason)) {
+		fprintf(stderr, "Error parsing DSF commands: %s\n", reason);
+		return;
+	}
+	printf("\n%-20s %10s %10s %9s\n", "CMDS parse threads", "ms",
+	    "segments", "speedup");
+	for (unsigned n = 0; n <= max_threads; n = MAX(n * 2, 1)) {
+		taskq_t *tq = (n != 0 ? alloc_tq(n) : NULL);
+		size_t n_segs = 1;
+		uint64_t total = 0;
+		double t;
+
+		for (int i = 0; i < iters; i++) {
+			uint64_t start = nanoclock();
+			cmd_digest_t dg;
+
+			crc64_state_init(&dg.crc);
+			dg.len = dg.n_cmds = 0;
+			if (n == 0) {
+				VERIFY(dsf_parse_cmds(ref, cbs, &dg, reason));
+			} else {
+				dsf_cmd_segs_t *segs = dsf_split_cmds(ref,
+				    4 * n, reason);
+				cmd_digest_t *seg_dg;
+				void **ui;
+
+				VERIFY(segs != NULL);
+				n_segs = dsf_cmd_segs_num(segs);
+				seg_dg = safe_calloc(n_segs, sizeof (*seg_dg));
+				ui = safe_calloc(n_segs, sizeof (*ui));
+				for (size_t j = 0; j < n_segs; j++) {
+					crc64_state_init(&seg_dg[j].crc);
+					ui[j] = &seg_dg[j];
+				}
+				VERIFY(dsf_parse_cmds_parallel(segs, tq, cbs,
+				    ui, reason));
+				/* reassemble the segments in order */
+				for (size_t j = 0; j < n_segs; j++) {
+					dg.crc = (j == 0 ? seg_dg[j].crc :
+					    crc64_combine(dg.crc,
+					    seg_dg[j].crc, seg_dg[j].len));
+					dg.len += seg_dg[j].len;
+					dg.n_cmds += seg_dg[j].n_cmds;
+				}
+				free(seg_dg);
+				free(ui);
+				dsf_cmd_segs_free(segs);
+			}
+			total += nanoclock() - start;
+			if (dg.crc != ref_dg.crc ||
+			    dg.n_cmds != ref_dg.n_cmds) {
+				fprintf(stderr, "parallel command parsing "
+				    "differs from the serial parser\n");
+				exit(EXIT_FAILURE);
+			}
+		}
+		t = NSEC2SEC((double)total) * 1000 / iters;
+		if (n == 0) {
+			t_base = t;
+			printf("%-20s", "serial");
+		} else {
+			printf("%-20u", n);
+		}
+		printf(" %10.3f %10u %8.2fx\n", t, (unsigned)n_segs,
+		    t_base / t);
+		if (tq != NULL)
+			taskq_free(tq);
+	}
+}
+
+/*
+ * Compares opening the DSF without the DSF cache against opening it
+ * through a cold cache (which misses and writes the entry out) and a
+ * warm one (which serves it from the entry written by the cold open).
+ * The cache is kept in a scratch subdirectory of `cachedir', which is
+ * removed afterwards.
+ */
+static void
+time_cache(const dsf_t *ref, const char *filename, const char *cachedir,
+    int iters)
+{
+	static const char *names[] = { "uncached", "cold", "warm" };
+	char *dir = mkpathname(cachedir, "dsfdump-timing", NULL);
+	double t_base = 0;
+
+	printf("\n%-20s %10s %9s\n", "DSF cache", "ms/open", "speedup");
+	for (int m = 0; m < 3; m++) {
+		uint64_t total = 0;
+		double t;
+
+		for (int i = 0; i < iters; i++) {
+			uint64_t start;
+			dsf_t *dsf;
+
+			if (m == 1 && file_exists(dir, NULL))
+				(void) remove_directory(dir);
+			if (m != 0 && !dsf_cache_init(dir, 0)) {
+				fprintf(stderr, "Can't create DSF cache "
+				    "directory %s\n", dir);
+				exit(EXIT_FAILURE);
+			}
+			start = nanoclock();
+			dsf = dsf_init(filename);
+			total += nanoclock() - start;
+			if (dsf == NULL)
+				exit(EXIT_FAILURE);
+			if (!pools_equal(ref, dsf, B_FALSE)) {
+				fprintf(stderr, "%s DSF cache open differs "
+				    "from the reference\n", names[m]);
+				exit(EXIT_FAILURE);
+			}
+			dsf_fini(dsf);
+			dsf_cache_fini();
+		}
+		t = NSEC2SEC((double)total) * 1000 / iters;
+		if (m == 0)
+			t_base = t;
+		printf("%-20s %10.3f %8.2fx\n", names[m], t, t_base / t);
+	}
+	(void) remove_directory(dir);
+	free(dir);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -215,14 +689,19 @@ main(int argc, char *argv[])
 	bool_t dump_cmds = B_FALSE;
 	bool_t do_dump_dem = B_FALSE;
 	bool_t do_water_mask = B_FALSE;
+	int time_iters = 0;
+	unsigned max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned flags = 0;
+	const char *cachedir = NULL;
 
 	memset(cmd_cbs, 0, sizeof (cmd_cbs));
 	for (int i = 0; i < NUM_DSF_CMDS; i++)
 		cmd_cbs[i] = cmd_cb;
 
 	log_init(logfunc, "dsfdump");
+	crc64_init();
 
-	while ((opt = getopt(argc, argv, "hqcdw")) != -1) {
+	while ((opt = getopt(argc, argv, "hqcdwlt:j:C:")) != -1) {
 		switch (opt) {
 		case 'q':
 			quiet = B_TRUE;
@@ -234,13 +713,28 @@ main(int argc, char *argv[])
 			do_dump_dem = B_TRUE;
 			break;
 		case 'h':
-			printf("Usage: %s [-q] <dsf-file>\n", argv[0]);
+			printf("Usage: %s [-ql] [-t <iters>] [-j <threads>] "
+			    "[-C <cachedir>] <dsf-file>\n", argv[0]);
 			exit(EXIT_SUCCESS);
 		case 'w':
 			do_water_mask = B_TRUE;
 			break;
+		case 'l':
+			flags |= DSF_PARSE_LAZY;
+			break;
+		case 't':
+			time_iters = MAX(atoi(optarg), 1);
+			break;
+		case 'j':
+			max_threads = MAX(atoi(optarg), 1);
+			break;
+		case 'C':
+			cachedir = optarg;
+			break;
 		default:
-			fprintf(stderr, "Usage: %s [-q] <dsf-file>\n", argv[0]);
+			fprintf(stderr, "Usage: %s [-ql] [-t <iters>] "
+			    "[-j <threads>] [-C <cachedir>] <dsf-file>\n",
+			    argv[0]);
 			exit(EXIT_FAILURE);
 		}
 	}
@@ -251,7 +745,18 @@ main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	dsf = dsf_init(argv[optind]);
+	if (cachedir != NULL && time_iters == 0 &&
+	    !dsf_cache_init(cachedir, 0)) {
+		fprintf(stderr, "Can't create DSF cache directory %s\n",
+		    cachedir);
+		exit(EXIT_FAILURE);
+	}
+	/*
+	 * In timing mode, the initial parse with the scalar decoders serves
+	 * as the reference the other decoders are checked against.
+	 */
+	dsf = dsf_init2(argv[optind], time_iters != 0 ? DSF_PARSE_SCALAR :
+	    flags);
 	if (dsf == NULL)
 		return (1);
 
@@ -278,8 +783,15 @@ main(int argc, char *argv[])
 	}
 	if (do_water_mask)
 		water_mask(dsf);
+	if (time_iters != 0) {
+		time_decode(dsf, argv[optind], time_iters);
+		time_parallel(dsf, time_iters, max_threads);
+		if (cachedir != NULL)
+			time_cache(dsf, argv[optind], cachedir, time_iters);
+	}
 
 	dsf_fini(dsf);
+	dsf_cache_fini();
 
 	return (0);
 }
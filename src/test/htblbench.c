@@ -0,0 +1,179 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+
+/*
+ * Compares the throughput of the built-in hash functions on the key sizes
+ * used by the airport database, as well as the lookup throughput of the
+ * chained and open-addressing hash table layouts. Table keys are 8 bytes
+ * wide, the same as the ICAO identifiers used by the airport database.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <acfutils/airportdb.h>
+#include <acfutils/assert.h>
+#include <acfutils/crc64.h>
+#include <acfutils/htbl.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/time.h>
+
+enum { KEY_SZ = 8, NUM_LOOKUPS = 4000000, NUM_HASHES = 20000000 };
+
+static void
+log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+static void
+make_key(uint8_t key[KEY_SZ], uint64_t i)
+{
+	/* Scramble the index so keys aren't inserted in hash order */
+	i *= 0x9e3779b97f4a7c15ull;
+	memcpy(key, &i, KEY_SZ);
+}
+
+static double
+bench_hash(htbl_hash_t hash, size_t key_sz)
+{
+	uint8_t keys[64][16];
+	uint64_t start, end, acc = 0;
+
+	ASSERT3U(key_sz, <=, sizeof (*keys));
+	for (unsigned i = 0; i < ARRAY_NUM_ELEM(keys); i++) {
+		for (unsigned j = 0; j < sizeof (*keys); j++)
+			keys[i][j] = 'A' + (i * 7 + j * 13) % 26;
+	}
+	start = nanoclock();
+	for (unsigned i = 0; i < NUM_HASHES; i++) {
+		const uint8_t *key = keys[i % ARRAY_NUM_ELEM(keys)];
+		if (hash == HTBL_HASH_FAST)
+			acc += htbl_hash_fast(key, key_sz);
+		else
+			acc += crc64(key, key_sz);
+	}
+	end = nanoclock();
+	/* keep the compiler from discarding the loop */
+	if (acc == 0)
+		printf(" ");
+
+	return (NUM_HASHES / NSEC2SEC((double)(end - start)));
+}
+
+static double
+bench_layout(htbl_layout_t layout, htbl_hash_t hash, unsigned n_entries)
+{
+	htbl_t htbl;
+	htbl_opts_t opts = { .layout = layout, .hash = hash };
+	uint8_t *keys = safe_malloc((size_t)n_entries * KEY_SZ);
+	uint64_t start, end;
+	uintptr_t sum = 0, expected = 0;
+
+	/*
+	 * Size the chained table the way its users typically do. The
+	 * open-addressing table starts small and grows as needed.
+	 */
+	htbl_create_opts(&htbl, layout == HTBL_LAYOUT_CHAINED ?
+	    n_entries : 16, KEY_SZ, B_FALSE, &opts);
+	for (unsigned i = 0; i < n_entries; i++) {
+		make_key(&keys[i * KEY_SZ], i);
+		htbl_set(&htbl, &keys[i * KEY_SZ], (void *)(uintptr_t)(i + 1));
+	}
+	VERIFY3U(htbl_count(&htbl), ==, n_entries);
+
+	start = nanoclock();
+	for (unsigned i = 0; i < NUM_LOOKUPS; i++) {
+		/* every 4th lookup is a miss */
+		unsigned idx = (i * 7919u) % n_entries;
+		uint8_t miss_key[KEY_SZ];
+
+		if (i % 4 == 3) {
+			make_key(miss_key, (uint64_t)n_entries + i);
+			VERIFY3P(htbl_lookup(&htbl, miss_key), ==, NULL);
+		} else {
+			sum += (uintptr_t)htbl_lookup(&htbl,
+			    &keys[idx * KEY_SZ]);
+			expected += idx + 1;
+		}
+	}
+	end = nanoclock();
+	VERIFY3U(sum, ==, expected);
+
+	for (unsigned i = 0; i < n_entries; i += 2)
+		htbl_remove(&htbl, &keys[i * KEY_SZ], B_FALSE);
+	VERIFY3U(htbl_count(&htbl), ==, n_entries / 2);
+	for (unsigned i = 0; i < n_entries; i++) {
+		void *value = htbl_lookup(&htbl, &keys[i * KEY_SZ]);
+		if (i % 2 == 0)
+			VERIFY3P(value, ==, NULL);
+		else
+			VERIFY3P(value, ==, (void *)(uintptr_t)(i + 1));
+	}
+	htbl_empty(&htbl, NULL, NULL);
+	htbl_destroy(&htbl);
+	free(keys);
+
+	return (NUM_LOOKUPS / NSEC2SEC((double)(end - start)));
+}
+
+int
+main(void)
+{
+	static const unsigned sizes[] = { 10000, 100000, 1000000 };
+	static const struct {
+		const char	*name;
+		size_t		key_sz;
+	} keys[] = {
+	    { "IATA", AIRPORTDB_IATA_LEN },
+	    { "ICAO/ident", AIRPORTDB_ICAO_LEN },
+	    { "16-byte", 16 },
+	    { "12-byte", 12 }
+	};
+
+	log_init(log_func, "htblbench");
+	crc64_init();
+
+	printf("%-12s %6s  %16s  %16s  %7s\n", "key", "size",
+	    "crc64 (hash/s)", "fast (hash/s)", "speedup");
+	for (unsigned i = 0; i < ARRAY_NUM_ELEM(keys); i++) {
+		double crc = bench_hash(HTBL_HASH_CRC64, keys[i].key_sz);
+		double fast = bench_hash(HTBL_HASH_FAST, keys[i].key_sz);
+
+		printf("%-12s %6u  %16.0f  %16.0f  %6.2fx\n", keys[i].name,
+		    (unsigned)keys[i].key_sz, crc, fast, fast / crc);
+	}
+	printf("\n%10s  %16s  %16s  %16s\n", "entries", "chained (op/s)",
+	    "open addr (op/s)", "oa+fast (op/s)");
+	for (unsigned i = 0; i < ARRAY_NUM_ELEM(sizes); i++) {
+		double chained = bench_layout(HTBL_LAYOUT_CHAINED,
+		    HTBL_HASH_CRC64, sizes[i]);
+		double oa = bench_layout(HTBL_LAYOUT_OPEN_ADDR,
+		    HTBL_HASH_CRC64, sizes[i]);
+		double oa_fast = bench_layout(HTBL_LAYOUT_OPEN_ADDR,
+		    HTBL_HASH_FAST, sizes[i]);
+
+		printf("%10u  %16.0f  %16.0f  %16.0f\n", sizes[i], chained,
+		    oa, oa_fast);
+	}
+
+	log_fini();
+
+	return (0);
+}
@@ -0,0 +1,242 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+/*
+ * Runs random operations against an lru_t and a naive model of it,
+ * checking that both evict the same objects in the same order and agree
+ * on the total size. Then times inserting into a full cache at several
+ * cache sizes, where an O(1) trim should show a flat cost per insert.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/crc64.h>
+#include <acfutils/helpers.h>
+#include <acfutils/log.h>
+#include <acfutils/lru.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/time.h>
+
+enum { N_OBJS = 64, N_OPS = 1000000 };
+
+typedef struct {
+	unsigned	id;
+	/* model state */
+	bool_t		cached;
+	uint64_t	size;
+	unsigned	pins;
+	uint64_t	stamp;
+	lru_node_t	lru_node;
+} obj_t;
+
+static obj_t	objs[N_OBJS];
+static uint64_t	now;
+static int	last_evicted = -1;
+static unsigned	n_evicted;
+
+static void
+log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+static void
+evict_cb(void *obj, void *userinfo)
+{
+	obj_t *o = obj;
+
+	UNUSED(userinfo);
+	last_evicted = o->id;
+	n_evicted++;
+}
+
+/* The unpinned, cached object with the oldest stamp, or NULL. */
+static obj_t *
+model_victim(void)
+{
+	obj_t *victim = NULL;
+
+	for (int i = 0; i < N_OBJS; i++) {
+		obj_t *o = &objs[i];
+
+		if (o->cached && o->pins == 0 &&
+		    (victim == NULL || o->stamp < victim->stamp))
+			victim = o;
+	}
+	return (victim);
+}
+
+static uint64_t
+model_size(void)
+{
+	uint64_t size = 0;
+
+	for (int i = 0; i < N_OBJS; i++) {
+		if (objs[i].cached)
+			size += objs[i].size;
+	}
+	return (size);
+}
+
+static void
+model_trim(lru_t *lru, uint64_t budget)
+{
+	obj_t *victim;
+
+	while (model_size() > budget && (victim = model_victim()) != NULL) {
+		unsigned n = n_evicted;
+
+		/* evict one at a time by lowering the budget step by step */
+		lru_set_budget(lru, model_size() - 1);
+		VERIFY3U(lru_trim(lru), ==, 1);
+		VERIFY3U(n_evicted, ==, n + 1);
+		VERIFY3S(last_evicted, ==, victim->id);
+		victim->cached = B_FALSE;
+		victim->pins = 0;
+	}
+	lru_set_budget(lru, budget);
+	VERIFY0(lru_trim(lru));
+}
+
+static void
+check_model(void)
+{
+	lru_t lru;
+	uint64_t budget = 0;
+	size_t n;
+
+	lru_create(&lru, sizeof (obj_t), offsetof(obj_t, lru_node), 0,
+	    evict_cb, NULL);
+	for (int i = 0; i < N_OBJS; i++)
+		objs[i].id = i;
+	for (int op = 0; op < N_OPS; op++) {
+		obj_t *o = &objs[crc64_rand() % N_OBJS];
+
+		now++;
+		switch (crc64_rand() % 8) {
+		case 0:
+		case 1:
+			o->size = 1 + crc64_rand() % 1000;
+			o->stamp = now;
+			if (!o->cached)
+				o->pins = 0;
+			o->cached = B_TRUE;
+			lru_insert(&lru, o, o->size);
+			break;
+		case 2:
+			if (o->cached && o->pins == 0) {
+				lru_remove(&lru, o);
+				o->cached = B_FALSE;
+			}
+			break;
+		case 3:
+			if (o->cached) {
+				lru_touch(&lru, o);
+				o->stamp = now;
+			}
+			break;
+		case 4:
+			if (o->cached && o->pins < 3) {
+				lru_pin(&lru, o);
+				o->pins++;
+			}
+			break;
+		case 5:
+			if (o->cached && o->pins != 0) {
+				lru_unpin(&lru, o);
+				if (--o->pins == 0)
+					o->stamp = now;
+			}
+			break;
+		case 6:
+			budget = crc64_rand() % (N_OBJS * 600);
+			model_trim(&lru, budget);
+			break;
+		case 7:
+			VERIFY3U(lru_contains(&lru, o), ==, o->cached);
+			break;
+		}
+		VERIFY3U(lru_size(&lru), ==, model_size());
+	}
+	for (int i = 0; i < N_OBJS; i++) {
+		while (objs[i].cached && objs[i].pins != 0) {
+			lru_unpin(&lru, &objs[i]);
+			objs[i].pins--;
+		}
+	}
+	n = lru_count(&lru);
+	n_evicted = 0;
+	lru_purge(&lru);
+	VERIFY3U(n_evicted, ==, n);
+	VERIFY0(lru_count(&lru));
+	VERIFY0(lru_size(&lru));
+	lru_destroy(&lru);
+}
+
+static void
+null_evict_cb(void *obj, void *userinfo)
+{
+	UNUSED(obj);
+	UNUSED(userinfo);
+}
+
+static void
+bench(void)
+{
+	enum { OBJ_SZ = 1 << 20, N_INSERTS = 1000000 };
+
+	printf("\n%-24s %12s\n", "cached objects", "ns/insert");
+	for (size_t n = 100; n <= 1000000; n *= 100) {
+		obj_t *bobjs = safe_calloc(2 * n, sizeof (*bobjs));
+		lru_t lru;
+		uint64_t start;
+		char name[32];
+
+		lru_create(&lru, sizeof (obj_t), offsetof(obj_t, lru_node),
+		    n * OBJ_SZ, null_evict_cb, NULL);
+		start = nanoclock();
+		for (size_t i = 0; i < N_INSERTS; i++) {
+			obj_t *o = &bobjs[i % (2 * n)];
+
+			lru_insert(&lru, o, OBJ_SZ);
+			lru_trim(&lru);
+		}
+		snprintf(name, sizeof (name), "%d", (int)n);
+		printf("%-24s %12.1f\n", name,
+		    (double)(nanoclock() - start) / N_INSERTS);
+		VERIFY3U(lru_count(&lru), ==, n);
+		lru_purge(&lru);
+		lru_destroy(&lru);
+		free(bobjs);
+	}
+}
+
+int
+main(void)
+{
+	log_init(log_func, "lrubench");
+	crc64_init();
+	crc64_srand(1);
+
+	check_model();
+	printf("model: OK\n");
+	bench();
+
+	return (0);
+}
@@ -0,0 +1,479 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+/*
+ * Refreshes an obstacle database from a random FAA Digital Obstacle File
+ * (as CSV and ZIP, with 1 and 3 threads) and checks that both refreshes
+ * write identical tiles, that the tiles, and the binary tiles generated
+ * from them, return the same obstacles, and that radius and corridor
+ * queries return exactly the obstacles a brute force search finds (give
+ * or take a sliver at the edge of the query area).
+ * Then compares the cost of refreshes, tile loads and queries.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/crc64.h>
+#include <acfutils/geom.h>
+#include <acfutils/helpers.h>
+#include <acfutils/log.h>
+#include <acfutils/math.h>
+#include <acfutils/odb.h>
+#include <acfutils/perf.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/thread.h>
+#include <acfutils/time.h>
+#include <zip/zip.h>
+
+#define	XPDIR		"odbbench.tmp"
+#define	DOF_PATH	XPDIR "/DOF.CSV"
+#define	DOF_ZIP_PATH	XPDIR "/DOF.ZIP"
+#define	OBST_PER_TILE	20000
+#define	NM		1852.0
+
+typedef struct {
+	geo_pos3_t	pos;
+	float		agl;
+	obst_type_t	type;
+	obst_light_t	light;
+	unsigned	quant;
+	bool_t		seen;
+} test_obst_t;
+
+/* the last two tiles are on either side of the antimeridian */
+static const int tiles[][2] = {
+    { 40, -75 }, { 40, -74 }, { 41, -75 }, { 41, -74 },
+    { 51, 179 }, { 51, -180 }
+};
+#define	N_TILES	ARRAY_NUM_ELEM(tiles)
+#define	N_OBST	(N_TILES * OBST_PER_TILE)
+
+static test_obst_t *obst;
+
+static void
+log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+static double
+rand_unit(void)
+{
+	return ((crc64_rand() % 1000000000) / 1e9);
+}
+
+static int
+obst_compar(const void *a, const void *b)
+{
+	const test_obst_t *oa = a, *ob = b;
+
+	if (oa->pos.lat < ob->pos.lat)
+		return (-1);
+	if (oa->pos.lat > ob->pos.lat)
+		return (1);
+	return (0);
+}
+
+/*
+ * Writes the obstacles in the format of the FAA Digital Obstacle File, as
+ * a CSV file and as a ZIP archive of it.
+ */
+static void
+write_dof(void)
+{
+	static const char *types[] = { "BLDG", "TOWER", "STACK", "POLE" };
+	static const char lights[] = { 'R', 'D', 'N', 'W' };
+	FILE *fp;
+	struct zip_t *zip;
+	void *buf;
+	size_t len;
+
+	VERIFY(create_directory_recursive(XPDIR));
+	fp = fopen(DOF_PATH, "wb");
+	VERIFY(fp != NULL);
+	fprintf(fp, "OAS,VERIFIED STATUS,COUNTRY,STATE,CITY,LATDEC,LONDEC,"
+	    "DMSLAT,DMSLON,TYPE,QUANTITY,AGL,AMSL,LIGHTING,ACCURACY,MARKING,"
+	    "FAA STUDY,ACTION,JDATE\r\n");
+	obst = safe_calloc(N_OBST, sizeof (*obst));
+	for (size_t t = 0; t < N_TILES; t++) {
+		int lat = tiles[t][0], lon = tiles[t][1];
+
+		for (int i = 0; i < OBST_PER_TILE; i++) {
+			test_obst_t *o = &obst[t * OBST_PER_TILE + i];
+			int type = crc64_rand() % ARRAY_NUM_ELEM(types);
+			int light = crc64_rand() % ARRAY_NUM_ELEM(lights);
+			int agl = 10 + crc64_rand() % 2000;
+			int amsl = agl + crc64_rand() % 5000;
+
+			/* some obstacles are clustered, like in a city */
+			if (i % 2 == 0) {
+				o->pos.lat = lat + rand_unit() * 0.999999;
+				o->pos.lon = lon + rand_unit() * 0.999999;
+			} else {
+				o->pos.lat = lat + 0.5 + rand_unit() * 0.05;
+				o->pos.lon = lon + 0.5 + rand_unit() * 0.05;
+			}
+			o->quant = 1 + crc64_rand() % 3;
+			o->agl = FEET2MET(agl);
+			o->pos.elev = FEET2MET(amsl) - o->agl;
+			fprintf(fp, "01-000001,O,US,NY,CITY,%f,%f,40 00 00.00N,"
+			    "074 00 00.00W,%s,%d,%d,%d,%c,1A,N,,A,2023001\r\n",
+			    o->pos.lat, o->pos.lon, types[type], o->quant,
+			    agl, amsl, lights[light]);
+			/* round the same way the text file does */
+			o->pos.lat = round(o->pos.lat * 1e6) / 1e6;
+			o->pos.lon = round(o->pos.lon * 1e6) / 1e6;
+		}
+	}
+	fclose(fp);
+	qsort(obst, N_OBST, sizeof (*obst), obst_compar);
+
+	buf = file2buf(DOF_PATH, &len);
+	VERIFY(buf != NULL);
+	zip = zip_open(DOF_ZIP_PATH, ZIP_DEFAULT_COMPRESSION_LEVEL, 'w');
+	VERIFY(zip != NULL);
+	VERIFY0(zip_entry_open(zip, "DOF.CSV"));
+	VERIFY0(zip_entry_write(zip, buf, len));
+	VERIFY0(zip_entry_close(zip));
+	zip_close(zip);
+	free(buf);
+}
+
+static char *
+tile_path(size_t t, const char *suffix)
+{
+	return (sprintf_alloc(XPDIR "/Output/caches/obstacle.db/"
+	    "US/%+03d%+04d/%+03d%+04d%s",
+	    (int)floor(tiles[t][0] / 10.0) * 10,
+	    (int)floor(tiles[t][1] / 10.0) * 10,
+	    tiles[t][0], tiles[t][1], suffix));
+}
+
+static void
+remove_bin_tiles(void)
+{
+	for (size_t t = 0; t < N_TILES; t++) {
+		char *path = tile_path(t, ".bin");
+
+		VERIFY(remove_file(path, B_FALSE));
+		free(path);
+	}
+}
+
+/* CRCs of the text and binary tiles, to compare refreshes */
+static void
+tile_crcs(uint64_t crcs[N_TILES][2])
+{
+	for (size_t t = 0; t < N_TILES; t++) {
+		for (int bin = 0; bin < 2; bin++) {
+			char *path = tile_path(t, bin ? ".bin" : "");
+			size_t len;
+			void *buf = file2buf(path, &len);
+
+			VERIFY_MSG(buf != NULL, "can't read %s", path);
+			crcs[t][bin] = crc64(buf, len);
+			free(buf);
+			free(path);
+		}
+	}
+}
+
+/* `obst' is sorted by latitude, so binary search for the first match */
+static test_obst_t *
+find_obst(geo_pos3_t pos, float agl)
+{
+	size_t lo = 0, hi = N_OBST;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (obst[mid].pos.lat < pos.lat - 1e-6)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (size_t i = lo; i < N_OBST && obst[i].pos.lat <= pos.lat + 1e-6;
+	    i++) {
+		if (fabs(obst[i].pos.lat - pos.lat) < 1e-6 &&
+		    fabs(obst[i].pos.lon - pos.lon) < 1e-6 &&
+		    fabs(obst[i].agl - agl) < 0.01 &&
+		    fabs(obst[i].pos.elev - pos.elev) < 0.01)
+			return (&obst[i]);
+	}
+	return (NULL);
+}
+
+static void
+count_cb(obst_type_t type, geo_pos3_t pos, float agl, obst_light_t light,
+    unsigned quant, void *userinfo)
+{
+	UNUSED(type);
+	UNUSED(pos);
+	UNUSED(agl);
+	UNUSED(light);
+	UNUSED(quant);
+	(*(size_t *)userinfo)++;
+}
+
+static void
+check_tile_cb(obst_type_t type, geo_pos3_t pos, float agl,
+    obst_light_t light, unsigned quant, void *userinfo)
+{
+	test_obst_t *o = find_obst(pos, agl);
+
+	UNUSED(type);
+	UNUSED(light);
+	VERIFY_MSG(o != NULL, "unknown obstacle at %f x %f", pos.lat,
+	    pos.lon);
+	VERIFY3U(o->quant, ==, quant);
+	(*(size_t *)userinfo)++;
+}
+
+static void
+check_tiles(odb_t *odb)
+{
+	for (size_t t = 0; t < N_TILES; t++) {
+		size_t n = 0;
+
+		VERIFY(odb_get_obstacles(odb, tiles[t][0], tiles[t][1],
+		    check_tile_cb, &n));
+		VERIFY3U(n, ==, OBST_PER_TILE);
+	}
+}
+
+/* Distance from `p' to the segment `a'-`b', in meters, the slow way */
+static double
+seg_dist(geo_pos2_t a, geo_pos2_t b, geo_pos2_t p)
+{
+	double cos_lat = cos(DEG2RAD((a.lat + b.lat) / 2));
+	double bx = DEG2RAD(normalize_hdg(b.lon - a.lon + 180) - 180) *
+	    cos_lat, by = DEG2RAD(b.lat - a.lat);
+	double px = DEG2RAD(normalize_hdg(p.lon - a.lon + 180) - 180) *
+	    cos_lat, py = DEG2RAD(p.lat - a.lat);
+	double t = 0;
+
+	if (bx != 0 || by != 0)
+		t = clamp((px * bx + py * by) / (bx * bx + by * by), 0, 1);
+	return (sqrt(POW2(px - t * bx) + POW2(py - t * by)) * EARTH_MSL);
+}
+
+static void
+mark_cb(obst_type_t type, geo_pos3_t pos, float agl, obst_light_t light,
+    unsigned quant, void *userinfo)
+{
+	test_obst_t *o = find_obst(pos, agl);
+
+	UNUSED(type);
+	UNUSED(light);
+	UNUSED(quant);
+	UNUSED(userinfo);
+	VERIFY(o != NULL);
+	VERIFY(!o->seen);
+	o->seen = B_TRUE;
+}
+
+static void
+check_query(odb_t *odb, geo_pos2_t a, geo_pos2_t b, double dist)
+{
+	size_t n, n_in = 0;
+	bool_t radius = (a.lat == b.lat && a.lon == b.lon);
+
+	for (size_t i = 0; i < N_OBST; i++)
+		obst[i].seen = B_FALSE;
+	if (radius)
+		n = odb_get_obstacles_radius(odb, a, dist, mark_cb, NULL);
+	else
+		n = odb_get_obstacles_corridor(odb, a, b, dist, mark_cb, NULL);
+	for (size_t i = 0; i < N_OBST; i++) {
+		double d = seg_dist(a, b, GEO3_TO_GEO2(obst[i].pos));
+
+		if (d < dist * 0.999)
+			VERIFY_MSG(obst[i].seen, "missed obstacle %d", (int)i);
+		else if (d > dist * 1.001)
+			VERIFY_MSG(!obst[i].seen, "bogus obstacle %d", (int)i);
+		n_in += obst[i].seen;
+	}
+	VERIFY3U(n, ==, n_in);
+}
+
+static geo_pos2_t
+rand_pos(void)
+{
+	size_t t = crc64_rand() % N_TILES;
+
+	return (GEO_POS2(tiles[t][0] + rand_unit(),
+	    tiles[t][1] + rand_unit()));
+}
+
+static void
+check_queries(odb_t *odb)
+{
+	for (int i = 0; i < 100; i++) {
+		geo_pos2_t a = rand_pos();
+		geo_pos2_t b = GEO_POS2(a.lat + (rand_unit() - 0.5) * 0.4,
+		    a.lon + (rand_unit() - 0.5) * 0.4);
+		double dist = (0.5 + rand_unit() * 10) * NM;
+
+		b.lon = normalize_hdg(b.lon + 180) - 180;
+		check_query(odb, a, a, dist);
+		check_query(odb, a, b, dist / 4);
+	}
+	/* straddling the antimeridian */
+	check_query(odb, GEO_POS2(51.5, 179.99), GEO_POS2(51.5, 179.99),
+	    20 * NM);
+	check_query(odb, GEO_POS2(51.4, 179.9), GEO_POS2(51.6, -179.9),
+	    2 * NM);
+}
+
+static double
+usec_since(uint64_t start)
+{
+	return ((nanoclock() - start) / 1000.0);
+}
+
+/*
+ * Times refreshing the database from a DOF file with 1 thread and with
+ * one thread per CPU.
+ */
+static void
+bench_refresh(const char *path)
+{
+	unsigned n_cpus = lacf_num_cpus();
+
+	for (unsigned n_threads = 1;; n_threads = n_cpus) {
+		odb_t *odb = odb_init(XPDIR, NULL);
+		uint64_t start = nanoclock();
+		char name[64];
+
+		odb_set_refresh_threads(odb, n_threads);
+		VERIFY_MSG(odb_refresh_cc_from_file(odb, "US", path),
+		    "%s: refresh failed", path);
+		snprintf(name, sizeof (name), "refresh, %u thread%s",
+		    n_threads, n_threads == 1 ? "" : "s");
+		printf("%-36s %12.0f\n", name, usec_since(start));
+		odb_fini(odb);
+		if (n_threads == n_cpus)
+			break;
+	}
+}
+
+static void
+bench(const char *dof_path)
+{
+	enum { N_QUERIES = 10000 };
+	odb_t *odb;
+	uint64_t start;
+	size_t n = 0;
+
+	printf("\n%-36s %12s\n", "", "usec");
+	/* the binary tiles exist by now, so remove them to time the text */
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass == 0)
+			remove_bin_tiles();
+		odb = odb_init(XPDIR, NULL);
+		start = nanoclock();
+		for (size_t t = 0; t < 4; t++) {
+			VERIFY(odb_get_obstacles(odb, tiles[t][0], tiles[t][1],
+			    count_cb, &n));
+		}
+		printf("%-36s %12.0f\n", pass == 0 ? "load 4 tiles, text" :
+		    "load 4 tiles, binary", usec_since(start) / 4);
+		odb_fini(odb);
+	}
+
+	odb = odb_init(XPDIR, NULL);
+	start = nanoclock();
+	for (int i = 0; i < N_QUERIES / 100; i++) {
+		VERIFY(odb_get_obstacles(odb, 40, -75, count_cb, &n));
+		VERIFY(odb_get_obstacles(odb, 40, -74, count_cb, &n));
+	}
+	printf("%-36s %12.2f\n", "2 whole tiles (5 NM at a corner)",
+	    usec_since(start) / (N_QUERIES / 100));
+	start = nanoclock();
+	for (int i = 0; i < N_QUERIES; i++) {
+		odb_get_obstacles_radius(odb, GEO_POS2(40.5, -74 +
+		    (i % 100) * 1e-4), 5 * NM, count_cb, &n);
+	}
+	printf("%-36s %12.2f\n", "radius 5 NM", usec_since(start) / N_QUERIES);
+	start = nanoclock();
+	for (int i = 0; i < N_QUERIES; i++) {
+		odb_get_obstacles_corridor(odb, GEO_POS2(40.2, -74.2),
+		    GEO_POS2(40.4, -74.1 + (i % 100) * 1e-4), 1 * NM,
+		    count_cb, &n);
+	}
+	printf("%-36s %12.2f\n", "corridor 13 NM x 2 NM",
+	    usec_since(start) / N_QUERIES);
+	odb_fini(odb);
+
+	bench_refresh(dof_path);
+}
+
+/*
+ * Usage: odbbench [DOF]
+ * With a (zipped or unzipped) FAA DOF file, only times refreshing the
+ * database from it.
+ */
+int
+main(int argc, char *argv[])
+{
+	odb_t *odb;
+	uint64_t crcs[2][N_TILES][2];
+
+	log_init(log_func, "odbbench");
+	crc64_init();
+	crc64_srand(1);
+
+	if (file_exists(XPDIR, NULL))
+		remove_directory(XPDIR);
+	if (argc > 1) {
+		bench_refresh(argv[1]);
+		remove_directory(XPDIR);
+		return (0);
+	}
+	write_dof();
+
+	/* 1 thread from the CSV file, then 3 threads from the ZIP file */
+	for (int pass = 0; pass < 2; pass++) {
+		odb = odb_init(XPDIR, NULL);
+		odb_set_refresh_threads(odb, pass == 0 ? 1 : 3);
+		VERIFY(odb_refresh_cc_from_file(odb, "US",
+		    pass == 0 ? DOF_PATH : DOF_ZIP_PATH));
+		check_tiles(odb);
+		check_queries(odb);
+		odb_fini(odb);
+		tile_crcs(crcs[pass]);
+	}
+	/* the thread count mustn't change what's written */
+	VERIFY0(memcmp(crcs[0], crcs[1], sizeof (crcs[0])));
+	printf("refresh, tiles & queries: OK\n");
+	/* binary tiles get regenerated from the text tiles */
+	remove_bin_tiles();
+	odb = odb_init(XPDIR, NULL);
+	check_tiles(odb);
+	odb_fini(odb);
+	printf("binary tile regeneration: OK\n");
+
+	bench(DOF_ZIP_PATH);
+
+	remove_directory(XPDIR);
+	free(obst);
+
+	return (0);
+}
@@ -0,0 +1,337 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+
+/*
+ * Measures how lacf_parallel_for and taskq groups scale from 1 to N
+ * threads, on a synthetic compute-bound loop and on tokenizing the
+ * airport records of an apt.dat file and measuring their runways. The
+ * tokenizer is a stand-in for the apt.dat workload, not airportdb's own
+ * parser (adbbench measures how adb_recreate_cache scales). If no
+ * apt.dat is given on the command line, a synthetic one is generated in
+ * memory. The 1 thread row runs everything serially on the calling
+ * thread and is the baseline for the speedups.
+ *
+ * Usage: parforbench [-t max_threads] [apt.dat]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/geom.h>
+#include <acfutils/helpers.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/taskq.h>
+#include <acfutils/time.h>
+
+enum { SYNTH_ELEMS = 2000000, SYNTH_AIRPORTS = 40000, MAX_RWY_COMPS = 32 };
+
+typedef struct {
+	char		**recs;		/* start of each airport record */
+	size_t		*rec_lens;
+	size_t		n_recs;
+	unsigned	*n_rwys;	/* output, per record */
+	double		*rwy_len;	/* output, per record */
+} apt_dat_t;
+
+static void
+log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+static void
+dummy_proc(void *userinfo, void *thr_info, void *task)
+{
+	UNUSED(userinfo);
+	UNUSED(thr_info);
+	UNUSED(task);
+	VERIFY_FAIL();
+}
+
+static void
+dummy_discard(void *userinfo, void *task)
+{
+	UNUSED(userinfo);
+	UNUSED(task);
+}
+
+static void
+synth_func(void *userinfo, size_t begin, size_t end)
+{
+	double *out = userinfo;
+
+	for (size_t i = begin; i < end; i++) {
+		double x = i;
+		for (int j = 0; j < 16; j++)
+			x = sqrt(x + j) * 1.0001;
+		out[i] = x;
+	}
+}
+
+static char *
+gen_apt_dat(size_t *len_p)
+{
+	char *buf = NULL;
+	size_t cap = 0;
+
+	srand(1);
+	append_format(&buf, &cap, "I\n1100 Generated\n\n");
+	for (unsigned i = 0; i < SYNTH_AIRPORTS; i++) {
+		double lat = (rand() % 16000) / 100.0 - 80;
+		double lon = (rand() % 36000) / 100.0 - 180;
+
+		append_format(&buf, &cap, "1 %d 0 0 X%05u Airport %u\n",
+		    rand() % 5000, i, i);
+		for (int r = 0, n = 1 + rand() % 4; r < n; r++) {
+			append_format(&buf, &cap, "100 45.00 1 0 0.25 1 2 1 "
+			    "%02d %.8f %.8f 0.00 0.00 3 0 0 1 "
+			    "%02d %.8f %.8f 0.00 0.00 3 0 0 1\n", r * 4 + 1,
+			    lat + r * 0.001, lon, r * 4 + 19,
+			    lat + r * 0.001 + 0.02, lon + 0.01);
+		}
+		append_format(&buf, &cap, "1302 city Nowhere\n"
+		    "1302 country Nowhere\n\n");
+	}
+	append_format(&buf, &cap, "99\n");
+	*len_p = strlen(buf);
+
+	return (buf);
+}
+
+static void
+split_apt_dat(char *buf, apt_dat_t *apt)
+{
+	size_t cap = 0;
+
+	for (char *p = buf; p != NULL && *p != 0;) {
+		char *eol = strchr(p, '\n');
+
+		if (strncmp(p, "1 ", 2) == 0) {
+			if (apt->n_recs == cap) {
+				cap = MAX(cap * 2, 1024);
+				apt->recs = safe_realloc(apt->recs,
+				    cap * sizeof (*apt->recs));
+				apt->rec_lens = safe_realloc(apt->rec_lens,
+				    cap * sizeof (*apt->rec_lens));
+			}
+			if (apt->n_recs != 0) {
+				apt->rec_lens[apt->n_recs - 1] =
+				    p - apt->recs[apt->n_recs - 1];
+			}
+			apt->recs[apt->n_recs++] = p;
+		}
+		p = (eol != NULL ? eol + 1 : NULL);
+	}
+	if (apt->n_recs != 0) {
+		apt->rec_lens[apt->n_recs - 1] =
+		    strlen(apt->recs[apt->n_recs - 1]);
+	}
+	apt->n_rwys = safe_calloc(apt->n_recs, sizeof (*apt->n_rwys));
+	apt->rwy_len = safe_calloc(apt->n_recs, sizeof (*apt->rwy_len));
+}
+
+/*
+ * Tokenizes every line of each airport record and computes the length of
+ * each land runway from its threshold coordinates.
+ */
+static void
+parse_apt_func(void *userinfo, size_t begin, size_t end)
+{
+	apt_dat_t *apt = userinfo;
+
+	for (size_t i = begin; i < end; i++) {
+		char *rec = safe_malloc(apt->rec_lens[i] + 1);
+		char *line, *saveptr = NULL;
+
+		memcpy(rec, apt->recs[i], apt->rec_lens[i]);
+		rec[apt->rec_lens[i]] = 0;
+		apt->n_rwys[i] = 0;
+		apt->rwy_len[i] = 0;
+		for (line = strtok_r(rec, "\n", &saveptr); line != NULL;
+		    line = strtok_r(NULL, "\n", &saveptr)) {
+			char *comps[MAX_RWY_COMPS];
+			ssize_t n_comps;
+
+			strip_space(line);
+			n_comps = explode_line(line, ' ', comps, MAX_RWY_COMPS);
+			if (n_comps >= 20 && strcmp(comps[0], "100") == 0) {
+				geo_pos2_t p1 = GEO_POS2(atof(comps[9]),
+				    atof(comps[10]));
+				geo_pos2_t p2 = GEO_POS2(atof(comps[18]),
+				    atof(comps[19]));
+
+				apt->n_rwys[i]++;
+				apt->rwy_len[i] += gc_distance(p1, p2);
+			}
+		}
+		free(rec);
+	}
+}
+
+typedef struct {
+	apt_dat_t	*apt;
+	size_t		begin;
+	size_t		end;
+} grp_arg_t;
+
+static void
+grp_func(void *arg)
+{
+	grp_arg_t *ga = arg;
+	parse_apt_func(ga->apt, ga->begin, ga->end);
+}
+
+/* With a NULL `tq', runs the group's functions serially. */
+static double
+bench_group(taskq_t *tq, apt_dat_t *apt)
+{
+	enum { GRP_CHUNK = 256 };
+	size_t n_args = (apt->n_recs + GRP_CHUNK - 1) / GRP_CHUNK;
+	grp_arg_t *args = safe_calloc(n_args, sizeof (*args));
+	taskq_group_t *grp = (tq != NULL ? taskq_group_alloc(tq) : NULL);
+	uint64_t start = nanoclock();
+
+	for (size_t i = 0; i < n_args; i++) {
+		args[i].apt = apt;
+		args[i].begin = i * GRP_CHUNK;
+		args[i].end = MIN((i + 1) * GRP_CHUNK, apt->n_recs);
+		if (grp != NULL)
+			taskq_group_submit(grp, grp_func, &args[i]);
+		else
+			grp_func(&args[i]);
+	}
+	if (grp != NULL)
+		taskq_group_join(grp);
+	start = nanoclock() - start;
+	if (grp != NULL)
+		taskq_group_free(grp);
+	free(args);
+
+	return (NSEC2SEC((double)start));
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+	char *buf;
+	size_t len;
+	apt_dat_t apt = { .n_recs = 0 };
+	double *out, *ref, t_synth1 = 0, t_apt1 = 0;
+	unsigned *ref_rwys;
+
+	log_init(log_func, "parforbench");
+	while ((opt = getopt(argc, argv, "t:")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-t max_threads] "
+			    "[apt.dat]\n", argv[0]);
+			return (1);
+		}
+	}
+	max_threads = MAX(max_threads, 1);
+	if (optind < argc) {
+		long l;
+		buf = file2str_name(&l, argv[optind]);
+		if (buf == NULL) {
+			fprintf(stderr, "Can't read %s\n", argv[optind]);
+			return (1);
+		}
+		len = l;
+	} else {
+		buf = gen_apt_dat(&len);
+	}
+	split_apt_dat(buf, &apt);
+	printf("apt.dat: %.1f MB, %u airports\n", len / 1e6,
+	    (unsigned)apt.n_recs);
+
+	/* Serial reference results */
+	ref = safe_calloc(SYNTH_ELEMS, sizeof (*ref));
+	out = safe_calloc(SYNTH_ELEMS, sizeof (*out));
+	synth_func(ref, 0, SYNTH_ELEMS);
+	parse_apt_func(&apt, 0, apt.n_recs);
+	ref_rwys = safe_calloc(apt.n_recs, sizeof (*ref_rwys));
+	memcpy(ref_rwys, apt.n_rwys, apt.n_recs * sizeof (*ref_rwys));
+
+	printf("%7s  %10s %7s  %11s %7s  %10s\n", "threads", "synth (s)",
+	    "speedup", "tokenize(s)", "speedup", "group (s)");
+	for (unsigned n = 1; n <= max_threads; n *= 2) {
+		/*
+		 * The calling thread also participates, so we only need
+		 * n - 1 workers to keep n cores busy. With a single
+		 * thread, there are no workers and everything runs
+		 * serially.
+		 */
+		taskq_t *tq = NULL;
+		uint64_t start;
+		double t_synth, t_apt, t_grp;
+
+		if (n > 1) {
+			tq = taskq_alloc2(0, n - 1, 0, NULL, NULL, dummy_proc,
+			    dummy_discard, NULL, TASKQ_FLAG_WORK_STEALING);
+		}
+
+		start = nanoclock();
+		lacf_parallel_for(tq, 0, SYNTH_ELEMS, 0, synth_func, out);
+		t_synth = NSEC2SEC((double)(nanoclock() - start));
+		VERIFY0(memcmp(out, ref, SYNTH_ELEMS * sizeof (*out)));
+
+		memset(apt.n_rwys, 0, apt.n_recs * sizeof (*apt.n_rwys));
+		start = nanoclock();
+		lacf_parallel_for(tq, 0, apt.n_recs, 64, parse_apt_func,
+		    &apt);
+		t_apt = NSEC2SEC((double)(nanoclock() - start));
+		VERIFY0(memcmp(apt.n_rwys, ref_rwys,
+		    apt.n_recs * sizeof (*ref_rwys)));
+
+		memset(apt.n_rwys, 0, apt.n_recs * sizeof (*apt.n_rwys));
+		t_grp = bench_group(tq, &apt);
+		VERIFY0(memcmp(apt.n_rwys, ref_rwys,
+		    apt.n_recs * sizeof (*ref_rwys)));
+
+		if (n == 1) {
+			t_synth1 = t_synth;
+			t_apt1 = t_apt;
+		}
+		printf("%7u  %10.3f %6.2fx  %11.3f %6.2fx  %10.3f\n", n,
+		    t_synth, t_synth1 / t_synth, t_apt, t_apt1 / t_apt, t_grp);
+		if (tq != NULL)
+			taskq_free(tq);
+	}
+
+	free(ref);
+	free(out);
+	free(ref_rwys);
+	free(apt.recs);
+	free(apt.rec_lens);
+	free(apt.n_rwys);
+	free(apt.rwy_len);
+	free(buf);
+	log_fini();
+
+	return (0);
+}
@@ -16,14 +16,37 @@
  * Copyright 2023 Saso Kiselkov. All rights reserved.
  */
 
+/*
+ * Without arguments, stress-tests rwmutex_t for correctness. When run
+ * with `-b', benchmarks hash table lookups under contention instead:
+ * NUM_WORKERS - 1 reader threads perform lookups, while one writer
+ * thread keeps adding and removing entries. The table is protected by
+ * a mutex_t, an rwmutex_t, or not locked at all, using the
+ * HTBL_LAYOUT_CONCURRENT layout.
+ */
+
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #include <acfutils/assert.h>
+#include <acfutils/htbl.h>
 #include <acfutils/log.h>
 #include <acfutils/thread.h>
 
-enum { NUM_WORKERS = 8 };
+enum {
+	NUM_WORKERS = 8,
+	BENCH_KEYS = 65536,		/* stable keys, always present */
+	BENCH_CHURN_KEYS = 1024,	/* keys added & removed by writer */
+	BENCH_DURATION = 2000000	/* microseconds per configuration */
+};
+
+typedef enum {
+	BENCH_MUTEX,
+	BENCH_RWMUTEX,
+	BENCH_CONCURRENT
+} bench_mode_t;
 
 static bool shutdown = false;
 static rwmutex_t mutex;
@@ -55,11 +78,161 @@ worker_func(void *arg)
 	}
 }
 
+static bench_mode_t bench_mode;
+static htbl_t bench_htbl;
+static mutex_t bench_mtx;
+static atomic64_t bench_writes = 0;
+
+static void
+bench_read_enter(void)
+{
+	if (bench_mode == BENCH_MUTEX)
+		mutex_enter(&bench_mtx);
+	else if (bench_mode == BENCH_RWMUTEX)
+		rwmutex_enter(&mutex, false);
+}
+
+static void
+bench_read_exit(void)
+{
+	if (bench_mode == BENCH_MUTEX)
+		mutex_exit(&bench_mtx);
+	else if (bench_mode == BENCH_RWMUTEX)
+		rwmutex_exit(&mutex);
+}
+
+static void
+bench_write_enter(void)
+{
+	if (bench_mode == BENCH_MUTEX)
+		mutex_enter(&bench_mtx);
+	else if (bench_mode == BENCH_RWMUTEX)
+		rwmutex_enter(&mutex, true);
+}
+
+static void
+bench_reader(void *arg)
+{
+	unsigned thread_nr = (uintptr_t)arg;
+	uint64_t key = thread_nr * 7919;
+
+	while (!shutdown) {
+		void *value;
+
+		key = (key + 40503) % (BENCH_KEYS + BENCH_CHURN_KEYS);
+		bench_read_enter();
+		value = htbl_lookup(&bench_htbl, &key);
+		bench_read_exit();
+		/* churn keys may or may not be present */
+		VERIFY(value == (void *)(uintptr_t)(key + 1) ||
+		    (value == NULL && key >= BENCH_KEYS));
+		atomic_inc_64(&lock_ops[thread_nr]);
+	}
+}
+
+static void
+bench_writer(void *arg)
+{
+	LACF_UNUSED(arg);
+
+	for (uint64_t i = 0; !shutdown; i++) {
+		uint64_t key = BENCH_KEYS + (i % BENCH_CHURN_KEYS);
+
+		bench_write_enter();
+		if ((i / BENCH_CHURN_KEYS) % 2 == 0)
+			htbl_set(&bench_htbl, &key, (void *)(uintptr_t)(key + 1));
+		else
+			htbl_remove(&bench_htbl, &key, B_FALSE);
+		/* read & write exit are the same */
+		bench_read_exit();
+		atomic_inc_64(&bench_writes);
+		/* writes are rare compared to lookups */
+		usleep(50);
+	}
+}
+
+static void
+bench_run(bench_mode_t mode, const char *name)
+{
+	htbl_opts_t opts = {
+	    .layout = (mode == BENCH_CONCURRENT ? HTBL_LAYOUT_CONCURRENT :
+	    HTBL_LAYOUT_CHAINED),
+	    .hash = HTBL_HASH_FAST
+	};
+	long long reads = 0;
+
+	bench_mode = mode;
+	shutdown = false;
+	bench_writes = 0;
+	for (int i = 0; i < NUM_WORKERS; i++)
+		lock_ops[i] = 0;
+
+	htbl_create_opts(&bench_htbl, BENCH_KEYS, sizeof (uint64_t), B_FALSE,
+	    &opts);
+	for (uint64_t key = 0; key < BENCH_KEYS; key++)
+		htbl_set(&bench_htbl, &key, (void *)(uintptr_t)(key + 1));
+
+	VERIFY(thread_create(&threads[0], bench_writer, NULL));
+	for (int i = 1; i < NUM_WORKERS; i++) {
+		VERIFY(thread_create(&threads[i], bench_reader,
+		    (void *)(uintptr_t)i));
+	}
+	usleep(BENCH_DURATION);
+	shutdown = true;
+	for (int i = 0; i < NUM_WORKERS; i++)
+		thread_join(&threads[i]);
+
+	for (int i = 1; i < NUM_WORKERS; i++)
+		reads += lock_ops[i];
+	printf("%-12s %14.0f lookups/s  %8.0f writes/s\n", name,
+	    reads / USEC2SEC((double)BENCH_DURATION),
+	    bench_writes / USEC2SEC((double)BENCH_DURATION));
+
+	htbl_empty(&bench_htbl, NULL, NULL);
+	htbl_destroy(&bench_htbl);
+}
+
+static void
+bench_htbl_contention(void)
+{
+	mutex_init(&bench_mtx);
+	printf("%d readers, 1 writer, %d keys\n", NUM_WORKERS - 1,
+	    BENCH_KEYS);
+	bench_run(BENCH_MUTEX, "mutex_t");
+	bench_run(BENCH_RWMUTEX, "rwmutex_t");
+	bench_run(BENCH_CONCURRENT, "concurrent");
+	mutex_destroy(&bench_mtx);
+}
+
 int
-main(void)
+main(int argc, char **argv)
 {
+	int opt;
+	bool bench = false;
+
 	log_init(log_func, "rwmutex");
 
+	while ((opt = getopt(argc, argv, "hb")) != -1) {
+		switch (opt) {
+		case 'b':
+			bench = true;
+			break;
+		case 'h':
+			printf("Usage: %s [-b]\n", argv[0]);
+			exit(EXIT_SUCCESS);
+		default:
+			fprintf(stderr, "Usage: %s [-b]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (bench) {
+		rwmutex_init(&mutex);
+		bench_htbl_contention();
+		rwmutex_destroy(&mutex);
+		log_fini();
+		return (0);
+	}
+
 	rwmutex_init(&mutex);
 	for (int i = 0; i < NUM_WORKERS; i++) {
 		watchdog[i] = microclock();
@@ -0,0 +1,584 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+
+/*
+ * Benchmarks the runway geometry of the airport database on a synthetic
+ * tile densely packed with airports, each with several sets of close
+ * parallel runways. It checks that the runway bounding boxes built by the
+ * database match the ones built runway by runway with scalar geom.c calls
+ * (the way the database used to build them), and times that per-runway
+ * construction against loading the whole tile from the text and binary
+ * caches. It then checks that adb_airport_rwys_at finds the same runways
+ * as point_in_poly on every runway's bounding boxes, and times the two on
+ * random positions around the airports.
+ *
+ * Usage: rwybench
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <acfutils/airportdb.h>
+#include <acfutils/assert.h>
+#include <acfutils/geom.h>
+#include <acfutils/helpers.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/time.h>
+
+enum { DENSE_AIRPORTS = 400, DENSE_HDGS = 4, DENSE_PARALLELS = 3 };
+enum { LOAD_REPEAT = 10, PROX_QUERIES = 200000 };
+
+#define	TILE_LAT		47
+#define	TILE_LON		8
+#define	MAX_BBOX_ERR		1e-6	/* meters */
+
+/* Same as in airportdb.c */
+#define	RWY_PROXIMITY_LAT_FRACT		3
+#define	RWY_PROXIMITY_LON_DISPL		609.57
+#define	RWY_APCH_PROXIMITY_LAT_ANGLE	3.3
+#define	RWY_APCH_PROXIMITY_LON_DISPL	5500
+#define	RWY_APCH_PROXIMITY_LAT_DISPL	(RWY_APCH_PROXIMITY_LON_DISPL * \
+	__builtin_tan(DEG2RAD(RWY_APCH_PROXIMITY_LAT_ANGLE)))
+
+/* Runway geometry built the per-runway way */
+typedef struct {
+	vect2_t		thr_v[2];
+	vect2_t		dthr_v[2];
+	double		land_len[2];
+	double		length;
+	vect2_t		bboxes[ADB_RWY_AREA_APCH][5];
+	vect2_t		apch_bbox[2][7];
+} ref_rwy_t;
+
+typedef struct {
+	airport_t	**arpts;
+	size_t		n_arpts;
+} arpts_t;
+
+typedef struct {
+	const arpt_index_t	**idx;
+	size_t			n_idx;
+} index_t;
+
+static void
+log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+static geo_pos2_t
+displace(geo_pos2_t pos, double x, double y)
+{
+	return (GEO_POS2(pos.lat + y / 111320.0, pos.lon + x /
+	    (111320.0 * cos(DEG2RAD(pos.lat)))));
+}
+
+static void
+gen_airport(FILE *fp, unsigned i)
+{
+	geo_pos2_t ctr = GEO_POS2(TILE_LAT + 0.05 + (rand() % 9000) / 1e4,
+	    TILE_LON + 0.05 + (rand() % 9000) / 1e4);
+	static const char *sfx[2][DENSE_PARALLELS] = {
+		{ "L", "C", "R" }, { "R", "C", "L" }
+	};
+
+	fprintf(fp, "1 %d 0 0 D%04u Dense Airport %u\n", rand() % 2000, i, i);
+	for (unsigned h = 0; h < DENSE_HDGS; h++) {
+		unsigned num = 1 + 4 * h + rand() % 4;
+		double hdg = DEG2RAD(num * 10);
+		double len = 2000 + rand() % 1500;
+		double spacing = 100 + rand() % 800;
+
+		for (unsigned p = 0; p < DENSE_PARALLELS; p++) {
+			double lat_off = (p - 1.0) * spacing;
+			double x = cos(hdg) * lat_off, y = -sin(hdg) * lat_off;
+			geo_pos2_t t1 = displace(ctr, x - sin(hdg) * len / 2,
+			    y - cos(hdg) * len / 2);
+			geo_pos2_t t2 = displace(ctr, x + sin(hdg) * len / 2,
+			    y + cos(hdg) * len / 2);
+
+			fprintf(fp, "100 %d.00 1 0 0.25 1 2 1 "
+			    "%02u%s %.8f %.8f %d.00 %d.00 3 0 0 1 "
+			    "%02u%s %.8f %.8f %d.00 %d.00 3 0 0 1\n",
+			    30 + rand() % 30, num, sfx[0][p], t1.lat, t1.lon,
+			    rand() % 3 == 0 ? rand() % 400 : 0, rand() % 100,
+			    num + 18, sfx[1][p], t2.lat, t2.lon,
+			    rand() % 3 == 0 ? rand() % 400 : 0, rand() % 100);
+		}
+	}
+	fprintf(fp, "1302 city Town\n1302 country Nowhere\n\n");
+}
+
+static char *
+gen_xpdir(void)
+{
+	char *xpdir = safe_strdup("/tmp/rwybench-XXXXXX");
+	char *path;
+	FILE *fp;
+
+	VERIFY(mkdtemp(xpdir) != NULL);
+	srand(1);
+	path = mkpathname(xpdir, "Custom Scenery", NULL);
+	VERIFY(create_directory_recursive(path));
+	free(path);
+	path = mkpathname(xpdir, "Custom Scenery", "scenery_packs.ini", NULL);
+	fp = fopen(path, "w");
+	VERIFY(fp != NULL);
+	fprintf(fp, "I\n1000 Version\nSCENERY\n\n");
+	fclose(fp);
+	free(path);
+	path = mkpathname(xpdir, "Global Scenery", "Global Airports",
+	    "Earth nav data", NULL);
+	VERIFY(create_directory_recursive(path));
+	free(path);
+	path = mkpathname(xpdir, "Global Scenery", "Global Airports",
+	    "Earth nav data", "apt.dat", NULL);
+	fp = fopen(path, "w");
+	VERIFY(fp != NULL);
+	fprintf(fp, "I\n1100 Generated\n\n");
+	for (unsigned i = 0; i < DENSE_AIRPORTS; i++)
+		gen_airport(fp, i);
+	fprintf(fp, "99\n");
+	fclose(fp);
+	free(path);
+	path = mkpathname(xpdir, "Resources", "default data", "CIFP", NULL);
+	VERIFY(create_directory_recursive(path));
+	free(path);
+
+	return (xpdir);
+}
+
+static airportdb_t *
+open_cache(const char *xpdir, const char *cachedir, bool_t binary)
+{
+	airportdb_t *db = safe_calloc(1, sizeof (*db));
+
+	airportdb_create(db, xpdir, cachedir);
+	db->ifr_only = B_FALSE;
+	db->binary_cache = binary;
+	VERIFY(adb_recreate_cache(db, 0));
+
+	return (db);
+}
+
+static void
+add_idx(const arpt_index_t *idx, void *userinfo)
+{
+	index_t *index = userinfo;
+	index->idx[index->n_idx++] = idx;
+}
+
+/*
+ * Looks up all airports of the tile, which loads the tile and builds the
+ * runway geometry of all of its airports.
+ */
+static double
+load_tile(airportdb_t *db, arpts_t *a)
+{
+	index_t index = { .n_idx = 0 };
+	uint64_t start;
+
+	index.idx = safe_calloc(adb_airport_index_walk(db, NULL, NULL),
+	    sizeof (*index.idx));
+	adb_airport_index_walk(db, add_idx, &index);
+	a->arpts = safe_calloc(index.n_idx, sizeof (*a->arpts));
+	a->n_arpts = 0;
+
+	start = nanoclock();
+	for (size_t i = 0; i < index.n_idx; i++) {
+		airport_t *arpt = adb_airport_lookup_by_ident(db,
+		    index.idx[i]->ident);
+
+		VERIFY(arpt != NULL);
+		VERIFY(arpt->load_complete);
+		a->arpts[a->n_arpts++] = arpt;
+	}
+	start = nanoclock() - start;
+	free(index.idx);
+
+	return (NSEC2SEC((double)start));
+}
+
+static double
+bench_load_tile(airportdb_t *db, arpts_t *a)
+{
+	double t = 0;
+
+	for (int i = 0; i < LOAD_REPEAT; i++) {
+		adb_unload_distant_airport_tiles(db, NULL_GEO_POS2);
+		free(a->arpts);
+		t += load_tile(db, a);
+	}
+	return (t / LOAD_REPEAT);
+}
+
+static void
+ref_rect_bbox(vect2_t thresh_v, vect2_t dir_v, double width, double len,
+    double long_displ, vect2_t *bbox)
+{
+	vect2_t len_displ_v;
+
+	bbox[0] = vect2_add(thresh_v, vect2_set_abs(vect2_norm(dir_v, B_TRUE),
+	    width / 2));
+	bbox[0] = vect2_add(bbox[0], vect2_set_abs(vect2_neg(dir_v),
+	    long_displ));
+	bbox[3] = vect2_add(thresh_v, vect2_set_abs(vect2_norm(dir_v, B_FALSE),
+	    width / 2));
+	bbox[3] = vect2_add(bbox[3], vect2_set_abs(vect2_neg(dir_v),
+	    long_displ));
+	len_displ_v = vect2_set_abs(dir_v, len + long_displ);
+	bbox[1] = vect2_add(bbox[0], len_displ_v);
+	bbox[2] = vect2_add(bbox[3], len_displ_v);
+	bbox[4] = NULL_VECT2;
+}
+
+static void
+ref_apch_bbox(const runway_t *rwy, const ref_rwy_t *ref, int end_i,
+    vect2_t *bbox)
+{
+	const runway_end_t *end = &rwy->ends[end_i];
+	const fpp_t *fpp = &rwy->arpt->fpp;
+	double limit_left = 1000000, limit_right = 1000000;
+	vect2_t x, a, b, b1, c, c1, d, thr_v, dir_v;
+	size_t n_pts = 0;
+
+	for (int i = 0; i < 7; i++)
+		bbox[i] = NULL_VECT2;
+	thr_v = ref->thr_v[end_i];
+	dir_v = vect2_sub(ref->thr_v[!end_i], thr_v);
+	x = vect2_add(thr_v, vect2_set_abs(vect2_neg(dir_v),
+	    RWY_APCH_PROXIMITY_LON_DISPL));
+	a = vect2_add(x, vect2_set_abs(vect2_norm(dir_v, B_TRUE),
+	    rwy->width / 2 + RWY_APCH_PROXIMITY_LAT_DISPL));
+	b = vect2_add(thr_v, vect2_set_abs(vect2_norm(dir_v, B_TRUE),
+	    rwy->width / 2));
+	c = vect2_add(thr_v, vect2_set_abs(vect2_norm(dir_v, B_FALSE),
+	    rwy->width / 2));
+	d = vect2_add(x, vect2_set_abs(vect2_norm(dir_v, B_FALSE),
+	    rwy->width / 2 + RWY_APCH_PROXIMITY_LAT_DISPL));
+	b1 = NULL_VECT2;
+	c1 = NULL_VECT2;
+
+	if (strlen(end->id) >= 3) {
+		int my_num_id = atoi(end->id);
+
+		for (const runway_t *orwy = avl_first(&rwy->arpt->rwys);
+		    orwy != NULL; orwy = AVL_NEXT(&rwy->arpt->rwys, orwy)) {
+			const runway_end_t *orwy_end;
+			vect2_t othr_v, v;
+			double a, dist;
+
+			if (orwy == rwy)
+				continue;
+			if (atoi(orwy->ends[0].id) == my_num_id)
+				orwy_end = &orwy->ends[0];
+			else if (atoi(orwy->ends[1].id) == my_num_id)
+				orwy_end = &orwy->ends[1];
+			else
+				continue;
+			othr_v = geo2fpp(GEO3_TO_GEO2(orwy_end->thr), fpp);
+			v = vect2_sub(othr_v, thr_v);
+			a = rel_hdg(dir2hdg(dir_v), dir2hdg(v));
+			dist = fabs(sin(DEG2RAD(a)) * vect2_abs(v));
+			if (a < 0)
+				limit_left = MIN(dist / 2, limit_left);
+			else
+				limit_right = MIN(dist / 2, limit_right);
+		}
+	}
+	if (limit_left < RWY_APCH_PROXIMITY_LAT_DISPL) {
+		c1 = vect2vect_isect(vect2_sub(d, c), c, vect2_neg(dir_v),
+		    vect2_add(thr_v, vect2_set_abs(vect2_norm(dir_v, B_FALSE),
+		    limit_left)), B_FALSE);
+		d = vect2_add(x, vect2_set_abs(vect2_norm(dir_v, B_FALSE),
+		    limit_left));
+	}
+	if (limit_right < RWY_APCH_PROXIMITY_LAT_DISPL) {
+		b1 = vect2vect_isect(vect2_sub(b, a), a, vect2_neg(dir_v),
+		    vect2_add(thr_v, vect2_set_abs(vect2_norm(dir_v, B_TRUE),
+		    limit_right)), B_FALSE);
+		a = vect2_add(x, vect2_set_abs(vect2_norm(dir_v, B_TRUE),
+		    limit_right));
+	}
+	bbox[n_pts++] = a;
+	if (!IS_NULL_VECT(b1))
+		bbox[n_pts++] = b1;
+	bbox[n_pts++] = b;
+	bbox[n_pts++] = c;
+	if (!IS_NULL_VECT(c1))
+		bbox[n_pts++] = c1;
+	bbox[n_pts++] = d;
+}
+
+/*
+ * Builds the geometry of one runway with scalar geom.c calls, projecting
+ * the thresholds through the airport's fpp.
+ */
+static void
+ref_load_rwy(const runway_t *rwy, ref_rwy_t *ref)
+{
+	const fpp_t *fpp = &rwy->arpt->fpp;
+	vect2_t dt1v = geo2fpp(GEO3_TO_GEO2(rwy->ends[0].thr), fpp);
+	vect2_t dt2v = geo2fpp(GEO3_TO_GEO2(rwy->ends[1].thr), fpp);
+	double displ1 = rwy->ends[0].displ, displ2 = rwy->ends[1].displ;
+	double blast1 = rwy->ends[0].blast, blast2 = rwy->ends[1].blast;
+	vect2_t dir_v = vect2_sub(dt2v, dt1v);
+	double dlen = vect2_abs(dir_v);
+	vect2_t t1v = vect2_add(dt1v, vect2_set_abs(dir_v, displ1));
+	vect2_t t2v = vect2_add(dt2v, vect2_set_abs(vect2_neg(dir_v), displ2));
+	double len = vect2_abs(vect2_sub(t2v, t1v));
+	double bonus1 = MAX(displ1, RWY_PROXIMITY_LON_DISPL - displ1);
+	double bonus2 = MAX(displ2, RWY_PROXIMITY_LON_DISPL - displ2);
+
+	ref->thr_v[0] = t1v;
+	ref->thr_v[1] = t2v;
+	ref->dthr_v[0] = dt1v;
+	ref->dthr_v[1] = dt2v;
+	ref->land_len[0] = vect2_abs(vect2_sub(dt2v, t1v));
+	ref->land_len[1] = vect2_abs(vect2_sub(dt1v, t2v));
+	ref->length = len;
+	ref_rect_bbox(t1v, dir_v, rwy->width, len, 0,
+	    ref->bboxes[ADB_RWY_AREA_RWY]);
+	ref_rect_bbox(dt1v, dir_v, rwy->width, dlen, 0,
+	    ref->bboxes[ADB_RWY_AREA_TORA]);
+	ref_rect_bbox(dt1v, dir_v, rwy->width, dlen + blast2, blast1,
+	    ref->bboxes[ADB_RWY_AREA_ASDA]);
+	ref_rect_bbox(t1v, dir_v, RWY_PROXIMITY_LAT_FRACT * rwy->width,
+	    len + bonus2, bonus1, ref->bboxes[ADB_RWY_AREA_PROX]);
+	ref_apch_bbox(rwy, ref, 0, ref->apch_bbox[0]);
+	ref_apch_bbox(rwy, ref, 1, ref->apch_bbox[1]);
+}
+
+static size_t
+count_rwys(const arpts_t *a)
+{
+	size_t n = 0;
+
+	for (size_t i = 0; i < a->n_arpts; i++)
+		n += avl_numnodes(&a->arpts[i]->rwys);
+	return (n);
+}
+
+static double
+bench_ref_load(const arpts_t *a, ref_rwy_t *refs)
+{
+	uint64_t start = nanoclock();
+
+	for (int r = 0; r < LOAD_REPEAT; r++) {
+		ref_rwy_t *ref = refs;
+
+		for (size_t i = 0; i < a->n_arpts; i++) {
+			const airport_t *arpt = a->arpts[i];
+
+			for (const runway_t *rwy = avl_first(&arpt->rwys);
+			    rwy != NULL; rwy = AVL_NEXT(&arpt->rwys, rwy))
+				ref_load_rwy(rwy, ref++);
+		}
+	}
+	return (NSEC2SEC((double)(nanoclock() - start)) / LOAD_REPEAT);
+}
+
+static void
+check_close(vect2_t a, vect2_t b)
+{
+	VERIFY3U(IS_NULL_VECT(a), ==, IS_NULL_VECT(b));
+	if (!IS_NULL_VECT(a))
+		VERIFY3F(vect2_dist(a, b), <, MAX_BBOX_ERR);
+}
+
+static void
+check_geometry(const arpts_t *a, const ref_rwy_t *refs)
+{
+	const ref_rwy_t *ref = refs;
+
+	for (size_t i = 0; i < a->n_arpts; i++) {
+		const airport_t *arpt = a->arpts[i];
+
+		for (const runway_t *rwy = avl_first(&arpt->rwys); rwy != NULL;
+		    rwy = AVL_NEXT(&arpt->rwys, rwy), ref++) {
+			const vect2_t *bboxes[ADB_RWY_AREA_APCH] = {
+				rwy->rwy_bbox, rwy->tora_bbox,
+				rwy->asda_bbox, rwy->prox_bbox
+			};
+
+			VERIFY3F(fabs(rwy->length - ref->length), <,
+			    MAX_BBOX_ERR);
+			for (int e = 0; e < 2; e++) {
+				const runway_end_t *re = &rwy->ends[e];
+
+				VERIFY0(memcmp(&re->dthr_v, &ref->dthr_v[e],
+				    sizeof (re->dthr_v)));
+				check_close(re->thr_v, ref->thr_v[e]);
+				VERIFY3F(fabs(re->land_len -
+				    ref->land_len[e]), <, MAX_BBOX_ERR);
+				for (int j = 0; j < 7; j++) {
+					check_close(re->apch_bbox[j],
+					    ref->apch_bbox[e][j]);
+				}
+			}
+			for (int area = 0; area < ADB_RWY_AREA_APCH; area++) {
+				for (int j = 0; j < 5; j++) {
+					check_close(bboxes[area][j],
+					    ref->bboxes[area][j]);
+				}
+			}
+		}
+	}
+}
+
+typedef struct {
+	airport_t	*arpt;
+	vect2_t		pos_v;
+} query_t;
+
+/*
+ * Tests a position against the bounding boxes of all runways of an
+ * airport one by one and returns the number of hits, which are stored
+ * in `rwys' and `ends' the same way adb_airport_rwys_at does.
+ */
+static size_t
+poly_rwys_at(airport_t *arpt, vect2_t pos_v, adb_rwy_area_t area,
+    runway_t **rwys, unsigned *ends)
+{
+	size_t n = 0;
+
+	for (runway_t *rwy = avl_first(&arpt->rwys); rwy != NULL;
+	    rwy = AVL_NEXT(&arpt->rwys, rwy)) {
+		const vect2_t *bboxes[ADB_RWY_AREA_APCH] = {
+			rwy->rwy_bbox, rwy->tora_bbox, rwy->asda_bbox,
+			rwy->prox_bbox
+		};
+
+		if (area != ADB_RWY_AREA_APCH) {
+			if (point_in_poly(pos_v, bboxes[area])) {
+				rwys[n] = rwy;
+				ends[n++] = 0;
+			}
+			continue;
+		}
+		for (unsigned e = 0; e < 2; e++) {
+			if (point_in_poly(pos_v, rwy->ends[e].apch_bbox)) {
+				rwys[n] = rwy;
+				ends[n++] = e;
+			}
+		}
+	}
+	return (n);
+}
+
+static void
+bench_prox(const arpts_t *a)
+{
+	enum { MAX_HITS = 2 * DENSE_HDGS * DENSE_PARALLELS };
+	static const char *area_names[ADB_NUM_RWY_AREAS] = {
+		"rwy", "tora", "asda", "prox", "apch"
+	};
+	query_t *q = safe_calloc(PROX_QUERIES, sizeof (*q));
+
+	for (size_t i = 0; i < PROX_QUERIES; i++) {
+		q[i].arpt = a->arpts[rand() % a->n_arpts];
+		q[i].pos_v = VECT2((rand() % 16000) - 8000.0,
+		    (rand() % 16000) - 8000.0);
+	}
+	printf("%5s  %8s  %12s  %12s  %7s\n", "area", "hits", "per-rwy (s)",
+	    "batch (s)", "speedup");
+	for (int area = 0; area < ADB_NUM_RWY_AREAS; area++) {
+		runway_t *rwys1[MAX_HITS], *rwys2[MAX_HITS];
+		unsigned ends1[MAX_HITS], ends2[MAX_HITS];
+		size_t hits = 0;
+		uint64_t start;
+		double t_poly, t_batch;
+
+		for (size_t i = 0; i < PROX_QUERIES; i++) {
+			size_t n1 = poly_rwys_at(q[i].arpt, q[i].pos_v, area,
+			    rwys1, ends1);
+			size_t n2 = adb_airport_rwys_at(q[i].arpt, q[i].pos_v,
+			    area, rwys2, ends2, MAX_HITS);
+
+			VERIFY3U(n1, ==, n2);
+			VERIFY0(memcmp(rwys1, rwys2, n1 * sizeof (*rwys1)));
+			VERIFY0(memcmp(ends1, ends2, n1 * sizeof (*ends1)));
+			hits += n1;
+		}
+		start = nanoclock();
+		for (size_t i = 0; i < PROX_QUERIES; i++) {
+			(void) poly_rwys_at(q[i].arpt, q[i].pos_v, area,
+			    rwys1, ends1);
+		}
+		t_poly = NSEC2SEC((double)(nanoclock() - start));
+		start = nanoclock();
+		for (size_t i = 0; i < PROX_QUERIES; i++) {
+			(void) adb_airport_rwys_at(q[i].arpt, q[i].pos_v,
+			    area, rwys2, ends2, MAX_HITS);
+		}
+		t_batch = NSEC2SEC((double)(nanoclock() - start));
+		printf("%5s  %8u  %12.3f  %12.3f  %6.2fx\n", area_names[area],
+		    (unsigned)hits, t_poly, t_batch, t_poly / t_batch);
+	}
+	free(q);
+}
+
+int
+main(void)
+{
+	char *xpdir, *cachedir;
+	airportdb_t *db_text, *db_bin;
+	arpts_t a_text = { .n_arpts = 0 }, a_bin = { .n_arpts = 0 };
+	ref_rwy_t *refs;
+	size_t n_rwys;
+	double t_text, t_bin, t_ref;
+
+	log_init(log_func, "rwybench");
+	xpdir = gen_xpdir();
+	cachedir = sprintf_alloc("%s.cache", xpdir);
+	db_text = open_cache(xpdir, cachedir, B_FALSE);
+	db_bin = open_cache(xpdir, cachedir, B_TRUE);
+
+	t_text = bench_load_tile(db_text, &a_text);
+	t_bin = bench_load_tile(db_bin, &a_bin);
+	n_rwys = count_rwys(&a_bin);
+	refs = safe_calloc(n_rwys, sizeof (*refs));
+	t_ref = bench_ref_load(&a_bin, refs);
+	check_geometry(&a_bin, refs);
+	check_geometry(&a_text, refs);
+
+	printf("dense tile: %u airports, %u runways\n",
+	    (unsigned)a_bin.n_arpts, (unsigned)n_rwys);
+	printf("per-runway geometry alone:     %8.2f ms\n", t_ref * 1000);
+	printf("text tile load incl. geometry: %8.2f ms\n", t_text * 1000);
+	printf("bin tile load incl. geometry:  %8.2f ms\n", t_bin * 1000);
+	bench_prox(&a_bin);
+
+	free(refs);
+	free(a_text.arpts);
+	free(a_bin.arpts);
+	airportdb_destroy(db_text);
+	airportdb_destroy(db_bin);
+	free(db_text);
+	free(db_bin);
+	VERIFY(remove_directory(cachedir));
+	VERIFY(remove_directory(xpdir));
+	free(cachedir);
+	free(xpdir);
+	log_fini();
+
+	return (0);
+}
@@ -0,0 +1,468 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+/*
+ * Checks that the decompress_stream_*() functions produce exactly the
+ * same output as the whole-buffer decompressors for zlib, gzip and zip
+ * data, in pull and push style, with all sorts of read and push sizes,
+ * and that they detect corrupt and truncated input. Then compares their
+ * throughput. Any 7-zip archives (or other compressed files) given on
+ * the command line are checked against decompress_7z() the same way.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/compress.h>
+#include <acfutils/conf.h>
+#include <acfutils/crc64.h>
+#include <acfutils/helpers.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/time.h>
+#include <zip/zip.h>
+
+enum { DATA_SZ = 32 << 20 };
+
+static const char *gz_path = "streambench.gz";
+static const char *zip_path = "streambench.zip";
+
+static void
+log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+/*
+ * Generates compressible conf-file-like text with a mix of line
+ * terminators.
+ */
+static char *
+gen_data(size_t *len_p)
+{
+	char *buf = safe_malloc(DATA_SZ + 128);
+	size_t len = 0;
+
+	for (unsigned i = 0; len < DATA_SZ; i++) {
+		len += sprintf(&buf[len], "key%u = value %llx%s", i,
+		    (unsigned long long)(crc64_rand() % 100000),
+		    i % 7 == 0 ? "\r\n" : "\n");
+	}
+	*len_p = len;
+	return (buf);
+}
+
+/* Reads a pull stream to its end, `chunk' bytes at a time */
+static uint8_t *
+read_all(decompress_stream_t *st, size_t chunk, size_t *len_p)
+{
+	size_t len = 0, cap = chunk;
+	uint8_t *buf = safe_malloc(cap);
+
+	for (;;) {
+		ssize_t n;
+
+		if (cap - len < chunk) {
+			cap = MAX(cap * 2, len + chunk);
+			buf = safe_realloc(buf, cap);
+		}
+		n = decompress_stream_read(st, &buf[len], chunk);
+		if (n < 0) {
+			free(buf);
+			return (NULL);
+		}
+		len += n;
+		if ((size_t)n < chunk)
+			break;
+	}
+	VERIFY0(decompress_stream_read(st, buf, chunk));
+	*len_p = len;
+	return (buf);
+}
+
+static void
+check_pull(decompress_stream_t *st, const void *ref, size_t ref_len,
+    size_t chunk, const char *what)
+{
+	size_t len;
+	uint8_t *buf;
+
+	VERIFY_MSG(st != NULL, "%s: can't open stream", what);
+	buf = read_all(st, chunk, &len);
+	VERIFY_MSG(buf != NULL, "%s: read error (chunk %d)", what, (int)chunk);
+	VERIFY_MSG(len == ref_len && memcmp(buf, ref, len) == 0,
+	    "%s: output differs (chunk %d)", what, (int)chunk);
+	free(buf);
+	decompress_stream_close(st);
+}
+
+/* Splits `ref' into lines the way decompress_stream_getline() should */
+static void
+check_getline(decompress_stream_t *st, const char *ref, size_t ref_len)
+{
+	char *line = NULL;
+	size_t cap = 0, off = 0;
+	ssize_t n;
+
+	VERIFY(st != NULL);
+	while ((n = decompress_stream_getline(st, &line, &cap)) >= 0) {
+		const char *nl = memchr(&ref[off], '\n', ref_len - off);
+		size_t ref_n = (nl != NULL ? (size_t)(nl - &ref[off]) :
+		    ref_len - off);
+
+		if (ref_n != 0 && ref[off + ref_n - 1] == '\r')
+			ref_n--;
+		VERIFY3U(n, ==, ref_n);
+		VERIFY0(memcmp(line, &ref[off], n));
+		off += (nl != NULL ? (size_t)(nl - &ref[off]) + 1 : ref_n);
+	}
+	VERIFY3U(off, ==, ref_len);
+	VERIFY(!decompress_stream_error(st));
+	free(line);
+	decompress_stream_close(st);
+}
+
+typedef struct {
+	const uint8_t	*ref;
+	size_t		ref_len;
+	size_t		off;
+	bool_t		ok;
+} push_check_t;
+
+static bool_t
+push_cb(const void *buf, size_t len, void *userinfo)
+{
+	push_check_t *pc = userinfo;
+
+	VERIFY3U(len, <=, 65536);
+	if (pc->off + len > pc->ref_len ||
+	    memcmp(buf, &pc->ref[pc->off], len) != 0) {
+		pc->ok = B_FALSE;
+		return (B_FALSE);
+	}
+	pc->off += len;
+	return (B_TRUE);
+}
+
+/*
+ * Pushes `in' into a push stream in randomly sized pieces.
+ * @return B_TRUE if the stream decompressed it to exactly `ref'.
+ */
+static bool_t
+push_all(decompress_fmt_t fmt, const uint8_t *in, size_t in_len,
+    const void *ref, size_t ref_len, size_t max_push)
+{
+	push_check_t pc = { .ref = ref, .ref_len = ref_len, .ok = B_TRUE };
+	decompress_stream_t *st = decompress_stream_push_init(fmt, push_cb,
+	    &pc);
+	bool_t ok = B_TRUE;
+
+	for (size_t off = 0; off < in_len && ok;) {
+		/* MIN() evaluates its arguments twice */
+		size_t n = 1 + crc64_rand() % max_push;
+
+		n = MIN(n, in_len - off);
+
+		ok = decompress_stream_push(st, &in[off], n);
+		off += n;
+	}
+	ok = decompress_stream_push_end(st) && ok;
+	decompress_stream_close(st);
+
+	return (ok && pc.ok && pc.off == ref_len);
+}
+
+static void
+write_gzip(const char *path, const void *buf, size_t len)
+{
+	/* Two gzip members, which must decompress as one */
+	for (int i = 0; i < 2; i++) {
+		gzFile gz = gzopen(path, i == 0 ? "wb" : "ab");
+		size_t half = len / 2;
+
+		VERIFY(gz != NULL);
+		if (i == 0)
+			VERIFY3S(gzwrite(gz, buf, half), ==, (int)half);
+		else
+			VERIFY3S(gzwrite(gz, (const uint8_t *)buf + half,
+			    len - half), ==, (int)(len - half));
+		gzclose(gz);
+	}
+}
+
+static void
+write_zip(const char *path, const void *buf, size_t len)
+{
+	struct zip_t *zip = zip_open(path, ZIP_DEFAULT_COMPRESSION_LEVEL, 'w');
+
+	VERIFY(zip != NULL);
+	VERIFY0(zip_entry_open(zip, "data.txt"));
+	VERIFY0(zip_entry_write(zip, buf, len));
+	VERIFY0(zip_entry_close(zip));
+	zip_close(zip);
+}
+
+static void
+check_corrupt(const uint8_t *in, size_t in_len, decompress_fmt_t fmt,
+    const char *ref, size_t ref_len)
+{
+	uint8_t *bad = safe_malloc(in_len);
+	size_t len;
+
+	/* truncated */
+	for (size_t cut = 0; cut < in_len; cut += MAX(in_len / 7, 1)) {
+		decompress_stream_t *st = decompress_stream_open_mem(in, cut,
+		    fmt);
+		uint8_t *out;
+
+		if (st == NULL)
+			continue;
+		out = read_all(st, 65536, &len);
+		VERIFY_MSG(out == NULL, "truncation at %d not detected",
+		    (int)cut);
+		VERIFY(decompress_stream_error(st));
+		decompress_stream_close(st);
+		if (fmt != DECOMPRESS_FMT_ZIP)
+			VERIFY(!push_all(fmt, in, cut, ref, ref_len, 100000));
+	}
+	/* bit flips in the compressed data */
+	for (int i = 0; i < 20; i++) {
+		size_t off = 32 + crc64_rand() % (in_len / 2);
+		decompress_stream_t *st;
+		uint8_t *out;
+
+		memcpy(bad, in, in_len);
+		bad[off] ^= 1 << (crc64_rand() % 8);
+		st = decompress_stream_open_mem(bad, in_len, fmt);
+		if (st == NULL)
+			continue;
+		out = read_all(st, 65536, &len);
+		VERIFY_MSG(out == NULL || (len == ref_len &&
+		    memcmp(out, ref, len) == 0),
+		    "corruption at %d not detected", (int)off);
+		free(out);
+		decompress_stream_close(st);
+	}
+	free(bad);
+}
+
+static void
+check_conf(void)
+{
+	const char *text = "# comment\nfoo = bar\r\n\tbaz = 1 2 3\nx = y";
+	const char *path = "streambench.conf.gz";
+	const char *s;
+	conf_t *conf;
+	int errline;
+
+	write_gzip(path, text, strlen(text));
+	conf = conf_read_file(path, &errline);
+	VERIFY(conf != NULL);
+	VERIFY(conf_get_str(conf, "foo", &s) && strcmp(s, "bar") == 0);
+	VERIFY(conf_get_str(conf, "baz", &s) && strcmp(s, "1 2 3") == 0);
+	VERIFY(conf_get_str(conf, "x", &s) && strcmp(s, "y") == 0);
+	conf_free(conf);
+	remove_file(path, B_FALSE);
+}
+
+static double
+mbps(size_t len, uint64_t start)
+{
+	return ((len / 1048576.0) / NSEC2SEC((double)(nanoclock() - start)));
+}
+
+static void
+bench(const char *ref, size_t ref_len, const void *zbuf, size_t zlen)
+{
+	uint64_t start;
+	size_t len;
+	uint8_t *out;
+	decompress_stream_t *st;
+	push_check_t pc = {
+	    .ref = (const uint8_t *)ref, .ref_len = ref_len, .ok = B_TRUE
+	};
+
+	printf("\n%-28s %10s %14s\n", "32 MB of text", "MB/s",
+	    "peak buffers");
+	start = nanoclock();
+	out = zlib_decompress((void *)zbuf, zlen, &len);
+	printf("%-28s %10.1f %11.1f MB\n", "zlib_decompress", mbps(len, start),
+	    (zlen + len) / 1048576.0);
+	free(out);
+
+	start = nanoclock();
+	st = decompress_stream_open(gz_path, DECOMPRESS_FMT_AUTO);
+	out = safe_malloc(65536);
+	while (decompress_stream_read(st, out, 65536) == 65536)
+		;
+	printf("%-28s %10.1f %11.1f MB\n", "stream read, gzip file",
+	    mbps(ref_len, start), (65536 * 2) / 1048576.0);
+	decompress_stream_close(st);
+	free(out);
+
+	start = nanoclock();
+	st = decompress_stream_open(zip_path, DECOMPRESS_FMT_AUTO);
+	out = safe_malloc(65536);
+	while (decompress_stream_read(st, out, 65536) == 65536)
+		;
+	printf("%-28s %10.1f %11.1f MB\n", "stream read, zip file",
+	    mbps(ref_len, start), (65536 + 65536 + 32768) / 1048576.0);
+	decompress_stream_close(st);
+	free(out);
+
+	start = nanoclock();
+	st = decompress_stream_push_init(DECOMPRESS_FMT_ZLIB, push_cb, &pc);
+	for (size_t off = 0; off < zlen; off += 16384) {
+		VERIFY(decompress_stream_push(st, (const uint8_t *)zbuf + off,
+		    MIN(16384, zlen - off)));
+	}
+	VERIFY(decompress_stream_push_end(st));
+	decompress_stream_close(st);
+	printf("%-28s %10.1f %11.1f MB\n", "stream push, zlib 16k",
+	    mbps(ref_len, start), 65536 / 1048576.0);
+}
+
+/*
+ * Checks a compressed file (e.g. a 7-zip archive) given on the command
+ * line against the matching whole-buffer decompressor.
+ */
+static void
+check_file(const char *path)
+{
+	decompress_stream_t *st = decompress_stream_open(path,
+	    DECOMPRESS_FMT_AUTO);
+	size_t ref_len;
+	uint8_t *ref;
+	uint64_t start;
+
+	if (st == NULL) {
+		fprintf(stderr, "%s: can't open\n", path);
+		exit(EXIT_FAILURE);
+	}
+	if (decompress_stream_fmt(st) == DECOMPRESS_FMT_7Z) {
+		start = nanoclock();
+		ref = decompress_7z(path, &ref_len);
+		VERIFY(ref != NULL);
+		printf("%-28s %10.1f %11.1f MB\n", "decompress_7z",
+		    mbps(ref_len, start), (2 * ref_len) / 1048576.0);
+	} else {
+		ref = (uint8_t *)file2buf(path, &ref_len);
+	}
+	VERIFY3U(decompress_stream_size(st), ==, ref_len);
+	decompress_stream_close(st);
+
+	for (size_t chunk = 1; chunk <= (1 << 20); chunk *= 64) {
+		if (chunk == 1 && ref_len > (4 << 20))
+			continue;
+		start = nanoclock();
+		check_pull(decompress_stream_open(path, DECOMPRESS_FMT_AUTO),
+		    ref, ref_len, chunk, path);
+		if (chunk == 4096) {
+			printf("%-28s %10.1f\n", "stream read, 4k chunks",
+			    mbps(ref_len, start));
+		}
+	}
+	free(ref);
+	printf("%s: OK\n", path);
+}
+
+int
+main(int argc, char *argv[])
+{
+	size_t len, zlen, gzlen, ziplen;
+	char *data;
+	uint8_t *zbuf, *gzbuf, *zipbuf;
+	static const size_t chunks[] = { 1, 3, 4096, 65535, 65536, 1 << 20 };
+
+	log_init(log_func, "streambench");
+	crc64_init();
+	crc64_srand(1);
+
+	data = gen_data(&len);
+	zbuf = zlib_compress(data, len, &zlen);
+	VERIFY(zbuf != NULL);
+	write_gzip(gz_path, data, len);
+	write_zip(zip_path, data, len);
+	gzbuf = file2buf(gz_path, &gzlen);
+	zipbuf = file2buf(zip_path, &ziplen);
+
+	for (size_t i = 0; i < ARRAY_NUM_ELEM(chunks); i++) {
+		if (chunks[i] < 4096) {
+			/* Tiny reads are slow, use a 1 MB prefix for them */
+			size_t slen;
+			uint8_t *small = zlib_compress(data, 1 << 20, &slen);
+
+			check_pull(decompress_stream_open_mem(small, slen,
+			    DECOMPRESS_FMT_AUTO), data, 1 << 20, chunks[i],
+			    "zlib");
+			free(small);
+			continue;
+		}
+		check_pull(decompress_stream_open_mem(zbuf, zlen,
+		    DECOMPRESS_FMT_AUTO), data, len, chunks[i], "zlib");
+		check_pull(decompress_stream_open(gz_path,
+		    DECOMPRESS_FMT_AUTO), data, len, chunks[i], "gzip");
+		check_pull(decompress_stream_open_mem(gzbuf, gzlen,
+		    DECOMPRESS_FMT_GZIP), data, len, chunks[i], "gzip mem");
+		check_pull(decompress_stream_open(zip_path,
+		    DECOMPRESS_FMT_AUTO), data, len, chunks[i], "zip");
+		check_pull(decompress_stream_open_mem(zipbuf, ziplen,
+		    DECOMPRESS_FMT_ZIP), data, len, chunks[i], "zip mem");
+	}
+	check_getline(decompress_stream_open(gz_path, DECOMPRESS_FMT_AUTO),
+	    data, len);
+	check_getline(decompress_stream_open_mem(zipbuf, ziplen,
+	    DECOMPRESS_FMT_AUTO), data, len);
+	check_getline(decompress_stream_open_mem(data, len,
+	    DECOMPRESS_FMT_AUTO), data, len);
+
+	for (size_t max_push = 1; max_push <= (1 << 20); max_push *= 32) {
+		VERIFY(push_all(DECOMPRESS_FMT_AUTO, zbuf, zlen, data, len,
+		    max_push));
+		VERIFY(push_all(DECOMPRESS_FMT_GZIP, gzbuf, gzlen, data, len,
+		    max_push));
+		VERIFY(push_all(DECOMPRESS_FMT_AUTO, (uint8_t *)data, len,
+		    data, len, max_push));
+		/* Push one byte at a time only for the first few */
+		if (max_push == 1)
+			max_push = 1024;
+	}
+	VERIFY(push_all(DECOMPRESS_FMT_AUTO, (uint8_t *)"ab", 2, "ab", 2, 1));
+
+	check_corrupt(zbuf, zlen, DECOMPRESS_FMT_ZLIB, data, len);
+	check_corrupt(gzbuf, gzlen, DECOMPRESS_FMT_GZIP, data, len);
+	check_corrupt(zipbuf, ziplen, DECOMPRESS_FMT_ZIP, data, len);
+	check_conf();
+	printf("Verification passed\n");
+
+	bench(data, len, zbuf, zlen);
+	for (int i = 1; i < argc; i++)
+		check_file(argv[i]);
+
+	remove_file(gz_path, B_FALSE);
+	remove_file(zip_path, B_FALSE);
+	free(data);
+	free(zbuf);
+	free(gzbuf);
+	free(zipbuf);
+	log_fini();
+
+	return (0);
+}
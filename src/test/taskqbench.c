@@ -0,0 +1,319 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+*/
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+
+/*
+ * Measures the task throughput of the shared-list and work-stealing taskq
+ * modes on large numbers of tiny tasks, and verifies that every task is
+ * either processed or discarded exactly once. Also checks priority and
+ * deadline ordering, cancellation and waiting on task handles.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/taskq.h>
+#include <acfutils/time.h>
+
+enum { NUM_TASKS = 1000000, BATCH_SZ = 256, FANOUT = 64, TASK_WORK = 64 };
+
+typedef struct {
+	taskq_t		*tq;
+	unsigned	processed;	/* atomic */
+	unsigned	discarded;	/* atomic */
+	unsigned	inited;		/* atomic */
+	unsigned	finied;		/* atomic */
+	bool		fanout;
+} bench_t;
+
+static void
+log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+static void *
+init_thr(void *userinfo)
+{
+	bench_t *b = userinfo;
+	__atomic_add_fetch(&b->inited, 1, __ATOMIC_RELAXED);
+	return (b);
+}
+
+static void
+fini_thr(void *userinfo, void *thr_info)
+{
+	bench_t *b = userinfo;
+	VERIFY3P(thr_info, ==, b);
+	__atomic_add_fetch(&b->finied, 1, __ATOMIC_RELAXED);
+}
+
+static void
+proc_task(void *userinfo, void *thr_info, void *task)
+{
+	bench_t *b = userinfo;
+	uintptr_t n = (uintptr_t)task;
+	volatile unsigned x = 0;
+
+	UNUSED(thr_info);
+	/*
+	 * In fan-out mode, odd-numbered tasks spawn FANOUT sub-tasks from
+	 * within the worker, exercising the worker-local queues.
+	 */
+	if (b->fanout && (n & 1) != 0) {
+		void *sub[FANOUT];
+		for (unsigned i = 0; i < FANOUT; i++)
+			sub[i] = (void *)(uintptr_t)(2 * i);
+		taskq_submit_batch(b->tq, sub, FANOUT);
+	}
+	for (unsigned i = 0; i < TASK_WORK; i++)
+		x += i;
+	__atomic_add_fetch(&b->processed, 1, __ATOMIC_RELAXED);
+}
+
+static void
+discard_task(void *userinfo, void *task)
+{
+	bench_t *b = userinfo;
+	UNUSED(task);
+	__atomic_add_fetch(&b->discarded, 1, __ATOMIC_RELAXED);
+}
+
+static void
+wait_processed(bench_t *b, unsigned n)
+{
+	while (__atomic_load_n(&b->processed, __ATOMIC_RELAXED) < n)
+		usleep(100);
+}
+
+static double
+bench(unsigned n_threads, unsigned flags, bool batch, bool fanout)
+{
+	bench_t b = { .fanout = fanout };
+	uint64_t start, end;
+	unsigned n_total = NUM_TASKS;
+
+	b.tq = taskq_alloc2(0, n_threads, 0, init_thr, fini_thr, proc_task,
+	    discard_task, &b, flags);
+	start = nanoclock();
+	if (fanout) {
+		unsigned n_roots = NUM_TASKS / (FANOUT + 1);
+		for (unsigned i = 0; i < n_roots; i++)
+			taskq_submit(b.tq, (void *)(uintptr_t)1);
+		n_total = n_roots * (FANOUT + 1);
+	} else if (batch) {
+		void *tasks[BATCH_SZ];
+		for (unsigned i = 0; i < NUM_TASKS; i += BATCH_SZ) {
+			unsigned n = MIN(BATCH_SZ, NUM_TASKS - i);
+			for (unsigned j = 0; j < n; j++)
+				tasks[j] = (void *)(uintptr_t)(2 * (i + j));
+			taskq_submit_batch(b.tq, tasks, n);
+		}
+	} else {
+		for (unsigned i = 0; i < NUM_TASKS; i++)
+			taskq_submit(b.tq, (void *)(uintptr_t)(2 * i));
+	}
+	wait_processed(&b, n_total);
+	end = nanoclock();
+	taskq_free(b.tq);
+
+	VERIFY3U(b.processed, ==, n_total);
+	VERIFY0(b.discarded);
+	VERIFY3U(b.inited, ==, b.finied);
+
+	return (n_total / NSEC2SEC((double)(end - start)));
+}
+
+/*
+ * Frees a taskq with work still queued and checks that everything that
+ * didn't get to run was handed to the discard callback.
+ */
+static void
+check_discard(unsigned flags)
+{
+	bench_t b = { .fanout = false };
+	void *tasks[BATCH_SZ];
+
+	b.tq = taskq_alloc2(1, 4, 0, init_thr, fini_thr, proc_task,
+	    discard_task, &b, flags);
+	for (unsigned i = 0; i < BATCH_SZ; i++)
+		tasks[i] = NULL;
+	for (unsigned i = 0; i < 100; i++)
+		taskq_submit_batch(b.tq, tasks, BATCH_SZ);
+	taskq_free(b.tq);
+	VERIFY3U(b.processed + b.discarded, ==, 100 * BATCH_SZ);
+	VERIFY3U(b.inited, ==, b.finied);
+}
+
+/*
+ * Checks that idle workers above num_threads_min exit after the stop
+ * delay and get respawned when new work arrives.
+ */
+static void
+check_scaling(unsigned flags)
+{
+	bench_t b = { .fanout = false };
+
+	b.tq = taskq_alloc2(0, 4, 1000, init_thr, fini_thr, proc_task,
+	    discard_task, &b, flags);
+	for (unsigned i = 0; i < 1000; i++)
+		taskq_submit(b.tq, NULL);
+	wait_processed(&b, 1000);
+	while (__atomic_load_n(&b.finied, __ATOMIC_RELAXED) !=
+	    __atomic_load_n(&b.inited, __ATOMIC_RELAXED)) {
+		usleep(1000);
+	}
+	for (unsigned i = 0; i < 1000; i++)
+		taskq_submit(b.tq, NULL);
+	wait_processed(&b, 2000);
+	taskq_free(b.tq);
+	VERIFY0(b.discarded);
+	VERIFY3U(b.inited, ==, b.finied);
+}
+
+typedef struct {
+	bool		gate_running;	/* atomic */
+	bool		gate_open;	/* atomic */
+	unsigned	order[16];
+	unsigned	n_done;		/* atomic */
+	unsigned	n_discarded;
+} order_t;
+
+/*
+ * Task 0 is a gate, which blocks the (single) worker until opened, so
+ * that the following tasks pile up in the queue. All other tasks just
+ * record the order in which they were run.
+ */
+static void
+order_proc(void *userinfo, void *thr_info, void *task)
+{
+	order_t *o = userinfo;
+	unsigned id = (uintptr_t)task;
+
+	UNUSED(thr_info);
+	if (id == 0) {
+		__atomic_store_n(&o->gate_running, true, __ATOMIC_RELEASE);
+		while (!__atomic_load_n(&o->gate_open, __ATOMIC_ACQUIRE))
+			usleep(100);
+		return;
+	}
+	o->order[__atomic_fetch_add(&o->n_done, 1, __ATOMIC_RELAXED)] = id;
+}
+
+static void
+order_discard(void *userinfo, void *task)
+{
+	order_t *o = userinfo;
+	UNUSED(task);
+	o->n_discarded++;
+}
+
+static void
+check_prio_cancel(unsigned flags)
+{
+	/*
+	 * Undated tasks are run FIFO from the shared list, but LIFO by a
+	 * work-stealing queue's owner.
+	 */
+	static const unsigned expected_shared[] = { 5, 6, 4, 2, 7 };
+	static const unsigned expected_ws[] = { 5, 6, 4, 7, 2 };
+	const unsigned *expected = ((flags & TASKQ_FLAG_WORK_STEALING) ?
+	    expected_ws : expected_shared);
+	const unsigned n_expected = ARRAY_NUM_ELEM(expected_shared);
+	order_t o = { .gate_open = false };
+	taskq_t *tq = taskq_alloc2(0, 1, 0, NULL, NULL, order_proc,
+	    order_discard, &o, flags);
+	uint64_t now;
+	taskq_handle_t *gate, *h[8];
+
+	gate = taskq_submit2(tq, (void *)0, TASKQ_PRIO_NORMAL, 0);
+	while (!__atomic_load_n(&o.gate_running, __ATOMIC_ACQUIRE))
+		usleep(100);
+	now = microclock();
+	h[1] = taskq_submit2(tq, (void *)1, TASKQ_PRIO_LOW, 0);
+	h[2] = taskq_submit2(tq, (void *)2, TASKQ_PRIO_NORMAL, 0);
+	h[3] = taskq_submit2(tq, (void *)3, TASKQ_PRIO_HIGH, 0);
+	h[4] = taskq_submit2(tq, (void *)4, TASKQ_PRIO_NORMAL, now + 2000);
+	h[5] = taskq_submit2(tq, (void *)5, TASKQ_PRIO_HIGH, 0);
+	h[6] = taskq_submit2(tq, (void *)6, TASKQ_PRIO_NORMAL, now + 1000);
+	h[7] = taskq_submit2(tq, (void *)7, TASKQ_PRIO_NORMAL, 0);
+	/* withdraw 3 & 1, then try to cancel 3 again */
+	VERIFY(taskq_cancel(tq, h[3]));
+	VERIFY(taskq_cancel(tq, h[1]));
+	VERIFY(!taskq_cancel(tq, h[3]));
+	VERIFY(taskq_is_done(h[3]));
+	VERIFY3U(o.n_discarded, ==, 2);
+	/* dropping a handle early mustn't affect the task */
+	taskq_handle_release(h[7]);
+
+	__atomic_store_n(&o.gate_open, true, __ATOMIC_RELEASE);
+	taskq_wait(tq, gate);
+	taskq_wait(tq, h[2]);
+	while (__atomic_load_n(&o.n_done, __ATOMIC_RELAXED) < n_expected)
+		usleep(100);
+	for (unsigned i = 2; i < 7; i++) {
+		taskq_wait(tq, h[i]);
+		VERIFY(taskq_is_done(h[i]));
+	}
+	VERIFY(!taskq_cancel(tq, h[2]));
+	taskq_free(tq);
+
+	VERIFY3U(o.n_discarded, ==, 2);
+	VERIFY3U(o.n_done, ==, n_expected);
+	for (unsigned i = 0; i < n_expected; i++)
+		VERIFY3U(o.order[i], ==, expected[i]);
+	taskq_handle_release(gate);
+	for (unsigned i = 1; i < 7; i++)
+		taskq_handle_release(h[i]);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned max_threads = (argc > 1 ? atoi(argv[1]) : 8);
+
+	log_init(log_func, "taskqbench");
+
+	check_discard(0);
+	check_discard(TASKQ_FLAG_WORK_STEALING);
+	check_scaling(0);
+	check_scaling(TASKQ_FLAG_WORK_STEALING);
+	check_prio_cancel(0);
+	check_prio_cancel(TASKQ_FLAG_WORK_STEALING);
+
+	printf("%7s  %14s  %14s  %14s  %14s\n", "threads", "shared (t/s)",
+	    "ws (t/s)", "ws batch (t/s)", "ws fanout(t/s)");
+	for (unsigned n = 1; n <= max_threads; n *= 2) {
+		double shared = bench(n, 0, false, false);
+		double ws = bench(n, TASKQ_FLAG_WORK_STEALING, false, false);
+		double ws_batch = bench(n, TASKQ_FLAG_WORK_STEALING, true,
+		    false);
+		double ws_fanout = bench(n, TASKQ_FLAG_WORK_STEALING, false,
+		    true);
+
+		printf("%7u  %14.0f  %14.0f  %14.0f  %14.0f\n", n, shared, ws,
+		    ws_batch, ws_fanout);
+	}
+
+	log_fini();
+
+	return (0);
+}
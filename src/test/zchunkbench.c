@@ -0,0 +1,331 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2026 Saso Kiselkov. All rights reserved.
+ */
+/*
+ * Checks that zlib_compress_chunked() output decompresses correctly with
+ * zlib_decompress(), the decompress_stream_*() functions and zlib's own
+ * gzread(), that stock gzip -t accepts its gzip output, that
+ * zlib_chunked_read() returns the right bytes for random ranges and that
+ * zlib_decompress_chunked() rejects damaged input. Then compares serial
+ * and parallel compression against zlib_compress().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include <acfutils/assert.h>
+#include <acfutils/compress.h>
+#include <acfutils/conf.h>
+#include <acfutils/crc64.h>
+#include <acfutils/helpers.h>
+#include <acfutils/log.h>
+#include <acfutils/safe_alloc.h>
+#include <acfutils/taskq.h>
+#include <acfutils/time.h>
+
+enum { DATA_SZ = 32 << 20 };
+
+static const char *gz_path = "zchunkbench.gz";
+
+static void
+log_func(const char *str)
+{
+	fputs(str, stderr);
+}
+
+/* Generates compressible conf-file-like text */
+static char *
+gen_data(size_t len)
+{
+	char *buf = safe_malloc(len + 64);
+	size_t off = 0;
+
+	for (unsigned i = 0; off < len; i++) {
+		off += sprintf(&buf[off], "key%u = value %llx\n", i,
+		    (unsigned long long)(crc64_rand() % 100000));
+	}
+	return (buf);
+}
+
+/*
+ * Reads a gzip file back with zlib's own gzread() and checks that stock
+ * gzip accepts it without warnings (which would make it exit with 2).
+ */
+static void
+check_gzfile(const char *path, const char *ref, size_t ref_len)
+{
+	uint8_t *out = safe_malloc(ref_len + 1);
+	gzFile gz = gzopen(path, "rb");
+	char *cmd;
+
+	VERIFY(gz != NULL);
+	VERIFY3S(gzread(gz, out, ref_len + 1), ==, (int)ref_len);
+	VERIFY0(memcmp(out, ref, ref_len));
+	gzclose(gz);
+	free(out);
+
+	cmd = sprintf_alloc("gzip -t %s", path);
+	VERIFY_MSG(system(cmd) == 0, "%s failed", cmd);
+	free(cmd);
+}
+
+static void
+check_gzread(const void *zbuf, size_t zlen, const char *ref, size_t ref_len)
+{
+	FILE *fp = fopen(gz_path, "wb");
+
+	VERIFY(fp != NULL);
+	VERIFY3U(fwrite(zbuf, 1, zlen, fp), ==, zlen);
+	fclose(fp);
+	check_gzfile(gz_path, ref, ref_len);
+	remove_file(gz_path, B_FALSE);
+}
+
+static void
+check_stream(const void *zbuf, size_t zlen, const char *ref, size_t ref_len)
+{
+	decompress_stream_t *st = decompress_stream_open_mem(zbuf, zlen,
+	    DECOMPRESS_FMT_AUTO);
+	uint8_t *out = safe_malloc(ref_len + 1);
+	size_t len = 0;
+	ssize_t n;
+
+	VERIFY(st != NULL);
+	while ((n = decompress_stream_read(st, &out[len],
+	    MIN(ref_len + 1 - len, 65536))) > 0)
+		len += n;
+	VERIFY0(n);
+	VERIFY3U(len, ==, ref_len);
+	VERIFY0(memcmp(out, ref, len));
+	decompress_stream_close(st);
+	free(out);
+}
+
+static void
+check_ranges(const void *zbuf, size_t zlen, const char *ref, size_t ref_len)
+{
+	uint8_t *out = safe_malloc(ref_len + 1);
+
+	for (int i = 0; i < 200; i++) {
+		size_t off = crc64_rand() % (ref_len + 1);
+		size_t cap = crc64_rand() % (ref_len / 4 + 2);
+		size_t want = MIN(cap, ref_len - off);
+		ssize_t n = zlib_chunked_read(zbuf, zlen, off, out, cap);
+
+		VERIFY3S(n, ==, (ssize_t)want);
+		VERIFY0(memcmp(out, &ref[off], want));
+	}
+	VERIFY0(zlib_chunked_read(zbuf, zlen, ref_len + 10, out, 1));
+	free(out);
+}
+
+static void
+check_corrupt(const uint8_t *zbuf, size_t zlen)
+{
+	uint8_t *bad = safe_malloc(zlen);
+	size_t len;
+
+	/* truncation loses the index (it's found from the end) */
+	for (size_t cut = 0; cut < zlen; cut += MAX(zlen / 7, 1))
+		VERIFY3S(zlib_chunked_size(zbuf, cut), ==, -1);
+	/* any bit flip either trips a check or is harmless */
+	for (int i = 0; i < 200; i++) {
+		size_t off = crc64_rand() % zlen;
+		size_t ref_len;
+		uint8_t *ref, *out;
+
+		memcpy(bad, zbuf, zlen);
+		bad[off] ^= 1 << (crc64_rand() % 8);
+		out = zlib_decompress_chunked(bad, zlen, NULL, &len);
+		if (out == NULL)
+			continue;
+		ref = zlib_decompress_chunked(zbuf, zlen, NULL, &ref_len);
+		VERIFY_MSG(len == ref_len && memcmp(out, ref, len) == 0,
+		    "corruption at %d not detected", (int)off);
+		free(ref);
+		free(out);
+	}
+	free(bad);
+}
+
+static void
+check_one(const char *ref, size_t ref_len, size_t chunk_sz, bool_t gzip,
+    taskq_t *tq)
+{
+	size_t zlen, len;
+	uint8_t *zbuf = zlib_compress_chunked(ref, ref_len, 6, chunk_sz, gzip,
+	    tq, &zlen);
+	uint8_t *out;
+
+	VERIFY3S(zlib_chunked_size(zbuf, zlen), ==, (ssize_t)ref_len);
+	if (gzip) {
+		check_gzread(zbuf, zlen, ref, ref_len);
+	} else {
+		out = zlib_decompress(zbuf, zlen, &len);
+		VERIFY(out != NULL);
+		VERIFY3U(len, ==, ref_len);
+		VERIFY0(memcmp(out, ref, len));
+		free(out);
+	}
+	check_stream(zbuf, zlen, ref, ref_len);
+	out = zlib_decompress_chunked(zbuf, zlen, tq, &len);
+	VERIFY(out != NULL);
+	VERIFY3U(len, ==, ref_len);
+	VERIFY0(memcmp(out, ref, len));
+	free(out);
+	if (ref_len != 0)
+		check_ranges(zbuf, zlen, ref, ref_len);
+	free(zbuf);
+}
+
+static void
+check_conf(void)
+{
+	const char *path = "zchunkbench.conf.gz";
+	conf_t *conf = conf_create_empty(), *conf2;
+	const char *s;
+	char *text;
+	size_t len;
+	int errline;
+
+	for (int i = 0; i < 10000; i++)
+		conf_set_i_v(conf, "key%d", i, i);
+	conf_set_str(conf, "foo", "bar");
+	VERIFY(conf_write_file2(conf, path, B_TRUE));
+	/* the file holds exactly the text, without a terminating NUL */
+	len = conf_write_buf(conf, NULL, 0);
+	text = safe_malloc(len);
+	conf_write_buf(conf, text, len);
+	check_gzfile(path, text, len - 1);
+	free(text);
+	conf2 = conf_read_file(path, &errline);
+	VERIFY(conf2 != NULL);
+	VERIFY(conf_get_str(conf2, "foo", &s) && strcmp(s, "bar") == 0);
+	for (int i = 0; i < 10000; i++) {
+		int val;
+
+		VERIFY(conf_get_i_v(conf2, "key%d", &val, i));
+		VERIFY3S(val, ==, i);
+	}
+	conf_free(conf2);
+	conf_free(conf);
+	remove_file(path, B_FALSE);
+}
+
+static double
+mbps(size_t len, uint64_t start)
+{
+	return ((len / 1048576.0) / NSEC2SEC((double)(nanoclock() - start)));
+}
+
+static void
+bench(const char *ref, size_t ref_len, taskq_t *tq)
+{
+	uint64_t start;
+	size_t zlen;
+	void *zbuf;
+
+	printf("\n%-32s %10s %10s\n", "32 MB of text, level 6", "MB/s",
+	    "ratio");
+	start = nanoclock();
+	zbuf = zlib_compress((void *)ref, ref_len, &zlen);
+	printf("%-32s %10.1f %10.3f\n", "zlib_compress", mbps(ref_len, start),
+	    (double)zlen / ref_len);
+	free(zbuf);
+
+	for (int par = 0; par < 2; par++) {
+		for (size_t chunk = 256 << 10; chunk <= (4 << 20); chunk *= 4) {
+			char name[64];
+
+			snprintf(name, sizeof (name), "chunked %4d kB, %s",
+			    (int)(chunk >> 10), par ? "taskq" : "serial");
+			start = nanoclock();
+			zbuf = zlib_compress_chunked(ref, ref_len, 6, chunk,
+			    B_FALSE, par ? tq : NULL, &zlen);
+			printf("%-32s %10.1f %10.3f\n", name,
+			    mbps(ref_len, start), (double)zlen / ref_len);
+			free(zbuf);
+		}
+	}
+	zbuf = zlib_compress_chunked(ref, ref_len, 6, 0, B_FALSE, NULL, &zlen);
+	for (int par = 0; par < 2; par++) {
+		size_t len;
+		void *out;
+
+		start = nanoclock();
+		out = zlib_decompress_chunked(zbuf, zlen, par ? tq : NULL,
+		    &len);
+		VERIFY(out != NULL);
+		printf("%-32s %10.1f\n", par ? "decompress_chunked, taskq" :
+		    "decompress_chunked, serial", mbps(ref_len, start));
+		free(out);
+	}
+	free(zbuf);
+}
+
+int
+main(void)
+{
+	static const size_t sizes[] = { 0, 1, 4095, 4096, 4097, 100000 };
+	static const size_t chunks[] = { 1, 7, 4096, 65536 };
+	char *data;
+	taskq_t *tq;
+	size_t zlen;
+	uint8_t *zbuf;
+
+	log_init(log_func, "zchunkbench");
+	crc64_init();
+	crc64_srand(1);
+	/* The calling thread participates, so n - 1 workers suffice. */
+	tq = taskq_alloc2(0, 3, 0, NULL, NULL, NULL, NULL, NULL,
+	    TASKQ_FLAG_WORK_STEALING);
+
+	data = gen_data(DATA_SZ);
+	for (size_t i = 0; i < ARRAY_NUM_ELEM(sizes); i++) {
+		for (size_t j = 0; j < ARRAY_NUM_ELEM(chunks); j++) {
+			if (sizes[i] / chunks[j] > 10000)
+				continue;
+			for (int gzip = 0; gzip < 2; gzip++) {
+				check_one(data, sizes[i], chunks[j], gzip,
+				    NULL);
+				check_one(data, sizes[i], chunks[j], gzip,
+				    tq);
+			}
+		}
+	}
+	check_one(data, DATA_SZ, 0, B_TRUE, tq);
+	printf("round trips: OK\n");
+
+	zbuf = zlib_compress_chunked(data, 300000, 6, 32768, B_TRUE, NULL,
+	    &zlen);
+	check_corrupt(zbuf, zlen);
+	free(zbuf);
+	printf("corruption: OK\n");
+
+	check_conf();
+	printf("conf_write_file2: OK\n");
+
+	bench(data, DATA_SZ, tq);
+
+	taskq_free(tq);
+	free(data);
+
+	return (0);
+}